@@ -0,0 +1,261 @@
+// Seeded synthetic C++ corpus shared by the benchmarks.
+//
+// The same seed and size always produce the same tree, so numbers from different
+// releases are comparable. Files are grouped into modules; each module has a chain of
+// headers where every header includes the previous one, plus a shared base header,
+// so include chains are as deep as a module is long. Sources include their header
+// and define its members.
+
+#![allow(dead_code)]
+
+use chrono::Utc;
+use cpp_index_mcp::lib::cpp_indexer::SymbolExtractor;
+use cpp_index_mcp::lib::storage::models::file_metadata::{ExtractionTier, FileMetadata};
+use cpp_index_mcp::lib::storage::{FileBatch, SymbolRecord, SymbolTable};
+use sha2::{Digest, Sha256};
+use std::fmt::Write as _;
+use std::path::{Path, PathBuf};
+use uuid::Uuid;
+
+/// Corpus sizes benchmarked by default, in files
+pub const DEFAULT_SCALES: [usize; 3] = [1_000, 10_000, 100_000];
+
+/// Seed used by every benchmark unless one measures seed sensitivity
+pub const DEFAULT_SEED: u64 = 0x5eed_c0de;
+
+/// Header/source pairs per module; a module's include chain is this deep
+const FILES_PER_MODULE: usize = 40;
+
+/// Corpus sizes to benchmark: `CPP_INDEX_BENCH_SCALES` as comma-separated file
+/// counts, e.g. `1000,10000` for a quicker run, or `DEFAULT_SCALES`
+pub fn bench_scales() -> Vec<usize> {
+    std::env::var("CPP_INDEX_BENCH_SCALES")
+        .ok()
+        .map(|scales| scales.split(',').filter_map(|scale| scale.trim().parse().ok()).collect::<Vec<usize>>())
+        .filter(|scales| !scales.is_empty())
+        .unwrap_or_else(|| DEFAULT_SCALES.to_vec())
+}
+
+/// SplitMix64; enough for shaping a corpus and stable across platforms
+pub struct Rng(u64);
+
+impl Rng {
+    pub fn new(seed: u64) -> Self {
+        Self(seed)
+    }
+
+    pub fn next_u64(&mut self) -> u64 {
+        self.0 = self.0.wrapping_add(0x9e37_79b9_7f4a_7c15);
+        let mut z = self.0;
+        z = (z ^ (z >> 30)).wrapping_mul(0xbf58_476d_1ce4_e5b9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94d0_49bb_1331_11eb);
+        z ^ (z >> 31)
+    }
+
+    /// Uniform in `low..=high`
+    pub fn range(&mut self, low: usize, high: usize) -> usize {
+        low + (self.next_u64() % (high - low + 1) as u64) as usize
+    }
+
+    pub fn pick<'a>(&mut self, items: &'a [&'a str]) -> &'a str {
+        items[self.range(0, items.len() - 1)]
+    }
+}
+
+pub struct GeneratedFile {
+    /// Path relative to the corpus root
+    pub path: PathBuf,
+    pub content: String,
+}
+
+pub struct Corpus {
+    pub files: Vec<GeneratedFile>,
+}
+
+impl Corpus {
+    /// A corpus of `files` files (half headers, half sources) derived from `seed`
+    pub fn generate(files: usize, seed: u64) -> Self {
+        let mut rng = Rng::new(seed);
+        let mut generated = Vec::with_capacity(files + 1);
+        generated.push(GeneratedFile {
+            path: PathBuf::from("include/core/base.h"),
+            content: base_header(),
+        });
+
+        let pairs = (files / 2).max(1);
+        for pair in 0..pairs {
+            let (module, position) = (pair / FILES_PER_MODULE, pair % FILES_PER_MODULE);
+            let header = header_path(module, position);
+            generated.push(GeneratedFile {
+                content: header_content(&mut rng, module, position),
+                path: header.clone(),
+            });
+            generated.push(GeneratedFile {
+                path: PathBuf::from(format!("src/module_{:04}/unit_{:03}.cpp", module, position)),
+                content: source_content(&mut rng, module, position, &header),
+            });
+        }
+
+        generated.truncate(files.max(2));
+        Self { files: generated }
+    }
+
+    pub fn total_bytes(&self) -> u64 {
+        self.files.iter().map(|file| file.content.len() as u64).sum()
+    }
+
+    /// Writes the corpus under `root`; returns the directory sources include from
+    pub fn write_to(&self, root: &Path) -> std::io::Result<PathBuf> {
+        for file in &self.files {
+            let path = root.join(&file.path);
+            if let Some(parent) = path.parent() {
+                std::fs::create_dir_all(parent)?;
+            }
+            std::fs::write(path, &file.content)?;
+        }
+        Ok(root.join("include"))
+    }
+
+    pub fn sources(&self) -> impl Iterator<Item = &GeneratedFile> {
+        self.files.iter().filter(|file| file.path.extension().map_or(false, |extension| extension == "cpp"))
+    }
+}
+
+/// One batch per corpus file with its tree-sitter symbols, as the fast indexing pass
+/// stores them under `index_id`
+pub fn syntax_batches(corpus: &Corpus, index_id: Uuid) -> Vec<FileBatch> {
+    let mut extractor = SymbolExtractor::new(None).expect("Failed to create extractor");
+
+    corpus
+        .files
+        .iter()
+        .map(|file| {
+            let extraction = extractor.extract_syntax_from_content(&file.path, &file.content).expect("Failed to extract");
+            let hash = format!("{:x}", Sha256::digest(file.content.as_bytes()));
+            let mut metadata = FileMetadata::new(index_id, file.path.to_string_lossy().to_string(), hash, Utc::now(), file.content.len() as u64);
+
+            let mut symbols = SymbolTable::new();
+            for symbol in &extraction.symbols {
+                symbols.push(SymbolRecord::new(
+                    &symbol.name,
+                    symbol.symbol_type,
+                    symbol.start_line.max(1),
+                    symbol.start_column.max(1),
+                    Sha256::digest(symbol.content.as_bytes()).into(),
+                ));
+            }
+            metadata.update_indexing(symbols.len() as u32);
+
+            let mut batch = FileBatch::new(metadata);
+            batch.symbols = symbols;
+            batch.tier = ExtractionTier::Syntax;
+            batch
+        })
+        .collect()
+}
+
+fn header_path(module: usize, position: usize) -> PathBuf {
+    PathBuf::from(format!("include/module_{:04}/unit_{:03}.h", module, position))
+}
+
+fn class_name(module: usize, position: usize) -> String {
+    format!("Unit{}x{}", module, position)
+}
+
+fn base_header() -> String {
+    r#"#pragma once
+#include <cstddef>
+
+namespace core {
+
+template <typename T, std::size_t N>
+class FixedBuffer {
+public:
+    T& operator[](std::size_t index) { return items_[index]; }
+    const T& operator[](std::size_t index) const { return items_[index]; }
+    std::size_t size() const { return N; }
+
+private:
+    T items_[N];
+};
+
+class Base {
+public:
+    virtual ~Base() = default;
+    virtual int id() const = 0;
+
+protected:
+    int generation_ = 0;
+};
+
+}  // namespace core
+"#
+    .to_string()
+}
+
+const TYPES: [&str; 6] = ["int", "long", "double", "float", "unsigned", "bool"];
+const VERBS: [&str; 8] = ["compute", "update", "resolve", "merge", "load", "store", "visit", "scan"];
+
+fn header_content(rng: &mut Rng, module: usize, position: usize) -> String {
+    let name = class_name(module, position);
+    let mut out = String::with_capacity(2048);
+
+    out.push_str("#pragma once\n#include \"core/base.h\"\n");
+    if position > 0 {
+        // Each header includes the previous one, building a chain through the module.
+        let _ = writeln!(out, "#include \"module_{:04}/unit_{:03}.h\"", module, position - 1);
+    }
+    let _ = writeln!(out, "\nnamespace project {{\nnamespace module_{} {{\n", module);
+
+    let _ = writeln!(out, "enum class {}Kind {{", name);
+    for variant in 0..rng.range(2, 6) {
+        let _ = writeln!(out, "    Variant{},", variant);
+    }
+    out.push_str("};\n\n");
+
+    let _ = writeln!(out, "typedef {} {}Value;\n", rng.pick(&TYPES), name);
+
+    let _ = writeln!(out, "template <typename T>\nstruct {}Slot {{\n    T value;\n    bool present = false;\n}};\n", name);
+
+    let base = if position > 0 { class_name(module, position - 1) } else { "core::Base".to_string() };
+    let _ = writeln!(out, "class {} : public {} {{\npublic:", name, base);
+    let _ = writeln!(out, "    {}();\n    ~{}() override;\n    int id() const override;", name, name);
+    for method in 0..rng.range(3, 10) {
+        let _ = writeln!(out, "    {} {}{}({} input);", rng.pick(&TYPES), rng.pick(&VERBS), method, rng.pick(&TYPES));
+    }
+    out.push_str("\nprivate:\n");
+    for field in 0..rng.range(2, 6) {
+        let _ = writeln!(out, "    {} field{}_;", rng.pick(&TYPES), field);
+    }
+    let _ = writeln!(out, "    {}Slot<{}> slot_;\n    core::FixedBuffer<int, {}> buffer_;\n}};\n", name, rng.pick(&TYPES), rng.range(4, 64));
+
+    let _ = writeln!(out, "{}Value make_{}(int seed);\n", name, position);
+    let _ = writeln!(out, "}}  // namespace module_{}\n}}  // namespace project", module);
+    out
+}
+
+fn source_content(rng: &mut Rng, module: usize, position: usize, header: &Path) -> String {
+    let name = class_name(module, position);
+    let include = header.strip_prefix("include").unwrap_or(header).display().to_string();
+    let mut out = String::with_capacity(2048);
+
+    let _ = writeln!(out, "#include \"{}\"\n\nnamespace project {{\nnamespace module_{} {{\n", include, module);
+    let _ = writeln!(out, "{}::{}() {{}}\n\n{}::~{}() {{}}\n", name, name, name, name);
+    let _ = writeln!(out, "int {}::id() const {{\n    return {};\n}}\n", name, module * FILES_PER_MODULE + position);
+
+    let _ = writeln!(out, "{}Value make_{}(int seed) {{", name, position);
+    let _ = writeln!(out, "    {}Value total = 0;", name);
+    let _ = writeln!(out, "    for (int i = 0; i < seed; ++i) {{\n        total += i * {};\n    }}", rng.range(2, 97));
+    out.push_str("    return total;\n}\n\n");
+
+    for helper in 0..rng.range(1, 5) {
+        let _ = writeln!(
+            out,
+            "static {} helper_{}_{}({} a, {} b) {{\n    return a > b ? a : b;\n}}\n",
+            rng.pick(&TYPES), position, helper, rng.pick(&TYPES), rng.pick(&TYPES)
+        );
+    }
+
+    let _ = writeln!(out, "}}  // namespace module_{}\n}}  // namespace project", module);
+    out
+}
@@ -0,0 +1,87 @@
+// Merkle tree cost per corpus size: building it from every file, and the single-file
+// update the watcher pays on each save, which should grow with path depth only.
+
+mod common;
+
+use common::{bench_scales, Corpus, DEFAULT_SEED};
+use cpp_index_mcp::lib::cpp_indexer::{FileNode, FileStat, MerkleTree};
+use criterion::{black_box, criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+use sha2::{Digest, Sha256};
+
+fn file_nodes(corpus: &Corpus) -> Vec<FileNode> {
+    corpus
+        .files
+        .iter()
+        .enumerate()
+        .map(|(i, file)| {
+            let content_hash = format!("{:x}", Sha256::digest(file.content.as_bytes()));
+            FileNode {
+                path: file.path.clone(),
+                metadata_hash: content_hash.clone(),
+                symbols_hash: content_hash.clone(),
+                content_hash,
+                last_modified: i as u64,
+                size: file.content.len() as u64,
+                stat: FileStat { modified_ns: i as u64, size: file.content.len() as u64, inode: i as u64 },
+                dependencies: Vec::new(),
+                dependents: Vec::new(),
+            }
+        })
+        .collect()
+}
+
+fn build_tree(nodes: &[FileNode]) -> MerkleTree {
+    let mut tree = MerkleTree::new();
+    for node in nodes {
+        tree.add_file_node(node.clone()).expect("Failed to add file");
+    }
+    tree
+}
+
+fn merkle_build(c: &mut Criterion) {
+    let mut group = c.benchmark_group("merkle_build");
+    group.sample_size(10);
+
+    for files in bench_scales() {
+        let nodes = file_nodes(&Corpus::generate(files, DEFAULT_SEED));
+        group.throughput(Throughput::Elements(nodes.len() as u64));
+        group.bench_function(format!("{}_files", files), |b| {
+            b.iter(|| black_box(build_tree(&nodes).len()))
+        });
+    }
+
+    group.finish();
+}
+
+fn merkle_update(c: &mut Criterion) {
+    let mut group = c.benchmark_group("merkle_update_single_file");
+
+    for files in bench_scales() {
+        let nodes = file_nodes(&Corpus::generate(files, DEFAULT_SEED));
+        let mut tree = build_tree(&nodes);
+
+        // Alternate between two versions of a file in the middle of the tree.
+        let mut edited = nodes[nodes.len() / 2].clone();
+        let mut version = 0u64;
+        group.bench_function(format!("{}_files", files), |b| {
+            b.iter_batched(
+                || {
+                    version += 1;
+                    edited.content_hash = format!("{:x}", Sha256::digest(version.to_le_bytes()));
+                    edited.last_modified = version;
+                    edited.clone()
+                },
+                |node| {
+                    tree.add_file_node(node).expect("Failed to update file");
+                    black_box(tree.get_root_hash().cloned())
+                },
+                BatchSize::SmallInput,
+            )
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, merkle_build, merkle_update);
+criterion_main!(benches);
@@ -0,0 +1,97 @@
+// Parser throughput over the synthetic corpus: tree-sitter across whole corpora,
+// libclang and the merge step over a fixed sample of sources, since their per-file
+// cost depends on include depth rather than corpus size.
+
+mod common;
+
+use common::{bench_scales, Corpus, DEFAULT_SEED};
+use cpp_index_mcp::lib::cpp_indexer::{ClangParser, ParseResult, SemanticParseResult, SymbolExtractor, TreeSitterParser};
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use std::path::PathBuf;
+
+/// Sources parsed by the libclang and merge benchmarks
+const SAMPLE_SOURCES: usize = 32;
+
+fn tree_sitter_parse_content(c: &mut Criterion) {
+    let mut group = c.benchmark_group("tree_sitter_parse_content");
+    group.sample_size(10);
+
+    for files in bench_scales() {
+        let corpus = Corpus::generate(files, DEFAULT_SEED);
+        let mut parser = TreeSitterParser::new().expect("Failed to create tree-sitter parser");
+
+        group.throughput(Throughput::Bytes(corpus.total_bytes()));
+        group.bench_function(format!("{}_files", files), |b| {
+            b.iter(|| {
+                for file in &corpus.files {
+                    let result = parser.parse_content(&file.content, &file.path).expect("Failed to parse");
+                    black_box(result.symbols.len());
+                }
+            })
+        });
+    }
+
+    group.finish();
+}
+
+fn clang_parse_file(c: &mut Criterion) {
+    let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+    let corpus = Corpus::generate(common::DEFAULT_SCALES[0], DEFAULT_SEED);
+    let include_dir = corpus.write_to(temp_dir.path()).expect("Failed to write corpus");
+    let sources: Vec<PathBuf> = corpus.sources().take(SAMPLE_SOURCES).map(|file| temp_dir.path().join(&file.path)).collect();
+
+    // No unit cache, so every iteration pays for a full parse including headers.
+    let flags = vec!["-std=c++17".to_string(), format!("-I{}", include_dir.display())];
+    let mut parser = ClangParser::new(Some(flags)).expect("Failed to create libclang parser").with_unit_cache_limit(0);
+
+    let mut group = c.benchmark_group("clang_parse_file");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(sources.len() as u64));
+    group.bench_function(format!("{}_sources", sources.len()), |b| {
+        b.iter(|| {
+            for source in &sources {
+                let result = parser.parse_file(source).expect("Failed to parse");
+                black_box(result.symbols.len());
+            }
+        })
+    });
+    group.finish();
+}
+
+fn merge_parser_results(c: &mut Criterion) {
+    let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+    let corpus = Corpus::generate(common::DEFAULT_SCALES[0], DEFAULT_SEED);
+    let include_dir = corpus.write_to(temp_dir.path()).expect("Failed to write corpus");
+
+    let flags = vec!["-std=c++17".to_string(), format!("-I{}", include_dir.display())];
+    let mut tree_sitter = TreeSitterParser::new().expect("Failed to create tree-sitter parser");
+    let mut clang = ClangParser::new(Some(flags.clone())).expect("Failed to create libclang parser").with_unit_cache_limit(0);
+    let extractor = SymbolExtractor::new(Some(flags)).expect("Failed to create extractor");
+
+    // Both parses happen up front; only the merge is measured.
+    let parsed: Vec<(ParseResult, SemanticParseResult)> = corpus
+        .sources()
+        .take(SAMPLE_SOURCES)
+        .map(|file| {
+            let path = temp_dir.path().join(&file.path);
+            let syntax = tree_sitter.parse_content(&file.content, &path).expect("Failed to parse");
+            let semantic = clang.parse_content(&path, &file.content).expect("Failed to parse");
+            (syntax, semantic)
+        })
+        .collect();
+
+    let mut group = c.benchmark_group("merge_parser_results");
+    group.throughput(Throughput::Elements(parsed.len() as u64));
+    group.bench_function(format!("{}_sources", parsed.len()), |b| {
+        b.iter(|| {
+            for (syntax, semantic) in &parsed {
+                let symbols = extractor.merge_parser_results(syntax, semantic).expect("Failed to merge");
+                black_box(symbols.len());
+            }
+        })
+    });
+    group.finish();
+}
+
+criterion_group!(benches, tree_sitter_parse_content, clang_parse_file, merge_parser_results);
+criterion_main!(benches);
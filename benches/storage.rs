@@ -0,0 +1,85 @@
+// Repository throughput: bulk ingest of a whole corpus into a fresh database, and
+// symbol search over an ingested one. Symbols come from the tree-sitter tier so the
+// row counts match what the fast indexing pass stores.
+
+mod common;
+
+use common::{bench_scales, syntax_batches, Corpus, DEFAULT_SEED};
+use cpp_index_mcp::lib::storage::models::code_element::SymbolType;
+use cpp_index_mcp::lib::storage::models::code_index::CodeIndex;
+use cpp_index_mcp::lib::storage::repository::FILES_PER_TRANSACTION;
+use cpp_index_mcp::lib::storage::{DatabaseConfig, DatabaseManager, FileBatch, Repository};
+use criterion::{black_box, criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+
+/// A repository on disk with one empty index, matching how the server stores indices
+fn open_repository(directory: &tempfile::TempDir, index: &CodeIndex) -> Repository {
+    let config = DatabaseConfig::new(directory.path().join("bench.db"));
+    let manager = DatabaseManager::new(config).expect("Failed to open database");
+    let repository = Repository::new(manager.initialize().expect("Failed to open database"));
+    repository.create_code_index(index.clone()).expect("Failed to create index");
+    repository
+}
+
+/// Writes `batches` in the groups the indexer's sink commits together
+fn ingest(repository: &Repository, batches: &[FileBatch]) {
+    for chunk in batches.chunks(FILES_PER_TRANSACTION) {
+        repository.replace_files(chunk).expect("Failed to ingest");
+    }
+}
+
+fn bulk_ingest(c: &mut Criterion) {
+    let mut group = c.benchmark_group("repository_bulk_ingest");
+    group.sample_size(10);
+
+    for files in bench_scales() {
+        let index = CodeIndex::new("bench".to_string(), "/bench".to_string());
+        let batches = syntax_batches(&Corpus::generate(files, DEFAULT_SEED), index.id);
+
+        group.throughput(Throughput::Elements(batches.len() as u64));
+        group.bench_function(format!("{}_files", files), |b| {
+            b.iter_batched(
+                || {
+                    let directory = tempfile::tempdir().expect("Failed to create temp dir");
+                    let repository = open_repository(&directory, &index);
+                    (directory, repository)
+                },
+                |(directory, repository)| {
+                    ingest(&repository, &batches);
+                    (directory, repository)
+                },
+                BatchSize::PerIteration,
+            )
+        });
+    }
+
+    group.finish();
+}
+
+fn search_code_elements(c: &mut Criterion) {
+    let mut group = c.benchmark_group("repository_search_code_elements");
+
+    for files in bench_scales() {
+        let index = CodeIndex::new("bench".to_string(), "/bench".to_string());
+        let directory = tempfile::tempdir().expect("Failed to create temp dir");
+        let repository = open_repository(&directory, &index);
+        ingest(&repository, &syntax_batches(&Corpus::generate(files, DEFAULT_SEED), index.id));
+
+        // An exact class name, a prefix shared by one module, and a substring in every file.
+        let patterns = [("exact", "Unit0x7"), ("prefix", "Unit1x"), ("substring", "make_")];
+        for (label, pattern) in patterns {
+            group.bench_function(format!("{}_files/{}", files, label), |b| {
+                b.iter(|| black_box(repository.search_code_elements(&index.id, pattern, None).expect("Failed to search").len()))
+            });
+        }
+
+        let classes = [SymbolType::Class];
+        group.bench_function(format!("{}_files/prefix_classes_only", files), |b| {
+            b.iter(|| black_box(repository.search_code_elements(&index.id, "Unit1x", Some(&classes)).expect("Failed to search").len()))
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, bulk_ingest, search_code_elements);
+criterion_main!(benches);
@@ -0,0 +1,113 @@
+// End-to-end JSON-RPC round trips through the transport: framing, parsing, dispatch
+// and response writing, over an in-memory pipe instead of STDIO. Tool calls search an
+// index seeded from the benchmark corpus.
+
+mod common;
+
+use common::{syntax_batches, Corpus, DEFAULT_SEED};
+use cpp_index_mcp::lib::mcp_server::{McpServer, ToolHandlers};
+use cpp_index_mcp::lib::storage::models::code_index::CodeIndex;
+use cpp_index_mcp::lib::storage::repository::FILES_PER_TRANSACTION;
+use cpp_index_mcp::lib::storage::{ConnectionPool, DatabaseConfig, DatabaseManager};
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use std::sync::Arc;
+use std::thread;
+use tokio::io::{AsyncBufReadExt, AsyncWriteExt, BufReader, DuplexStream};
+use tokio::runtime::Runtime;
+
+const PIPE_BUFFER: usize = 64 * 1024;
+
+/// Requests in flight at once when measuring pipelined throughput
+const PIPELINE_DEPTH: usize = 64;
+
+/// Files in the index tool calls search
+const INDEX_FILES: usize = 1_000;
+
+/// A database in `directory` holding the index `bench` over a seeded corpus
+fn seeded_database(directory: &tempfile::TempDir) -> ConnectionPool {
+    let manager = DatabaseManager::new(DatabaseConfig::new(directory.path().join("bench.db"))).expect("Failed to open database");
+    let pool = manager.pool().expect("Failed to open pool");
+    let index = CodeIndex::new("bench".to_string(), "/bench".to_string());
+    let repository = pool.write().expect("Failed to get writer");
+    repository.create_code_index(index.clone()).expect("Failed to create index");
+    for chunk in syntax_batches(&Corpus::generate(INDEX_FILES, DEFAULT_SEED), index.id).chunks(FILES_PER_TRANSACTION) {
+        repository.replace_files(chunk).expect("Failed to ingest");
+    }
+    drop(repository);
+    pool
+}
+
+/// A server on its own thread and runtime, driven over a pair of in-memory pipes
+struct ServerHarness {
+    client_input: BufReader<DuplexStream>,
+    client_output: DuplexStream,
+}
+
+impl ServerHarness {
+    fn start(database: Arc<ConnectionPool>) -> Self {
+        let (client_output, server_input) = tokio::io::duplex(PIPE_BUFFER);
+        let (server_output, client_input) = tokio::io::duplex(PIPE_BUFFER);
+
+        thread::spawn(move || {
+            let runtime = Runtime::new().expect("Failed to create server runtime");
+            runtime.block_on(async move {
+                let tool_handlers = ToolHandlers::new().expect("Failed to create tool handlers").with_database(database);
+                let mut server = McpServer::new().expect("Failed to create server").with_tool_handlers(tool_handlers);
+                let _ = server.serve(server_input, server_output).await;
+            });
+        });
+
+        Self { client_input: BufReader::new(client_input), client_output }
+    }
+
+    /// Writes `requests` as one burst and reads back one response line per request
+    async fn round_trip(&mut self, requests: &[u8], responses: usize, line: &mut String) {
+        self.client_output.write_all(requests).await.expect("Failed to write request");
+        for _ in 0..responses {
+            line.clear();
+            self.client_input.read_line(line).await.expect("Failed to read response");
+        }
+    }
+}
+
+fn requests(method_line: impl Fn(usize) -> String, count: usize) -> Vec<u8> {
+    (0..count).map(|id| method_line(id) + "\n").collect::<String>().into_bytes()
+}
+
+fn ping(id: usize) -> String {
+    format!(r#"{{"jsonrpc":"2.0","id":{},"method":"ping"}}"#, id)
+}
+
+/// A symbol search matching one module's classes and their members
+fn tools_call(id: usize) -> String {
+    format!(
+        r#"{{"jsonrpc":"2.0","id":{},"method":"tools/call","params":{{"name":"search_symbols","arguments":{{"index_name":"bench","query":"Unit1x"}}}}}}"#,
+        id
+    )
+}
+
+fn json_rpc_round_trip(c: &mut Criterion) {
+    let runtime = Runtime::new().expect("Failed to create client runtime");
+    let directory = tempfile::tempdir().expect("Failed to create temp dir");
+    let mut harness = ServerHarness::start(Arc::new(seeded_database(&directory)));
+    let mut line = String::new();
+
+    let mut group = c.benchmark_group("json_rpc_round_trip");
+    for (label, request) in [("ping", ping as fn(usize) -> String), ("tools_call", tools_call)] {
+        let single = requests(request, 1);
+        group.throughput(Throughput::Elements(1));
+        group.bench_function(label, |b| {
+            b.iter(|| runtime.block_on(harness.round_trip(&single, 1, &mut line)))
+        });
+
+        let pipelined = requests(request, PIPELINE_DEPTH);
+        group.throughput(Throughput::Elements(PIPELINE_DEPTH as u64));
+        group.bench_function(format!("{}_pipelined_{}", label, PIPELINE_DEPTH), |b| {
+            b.iter(|| runtime.block_on(harness.round_trip(&pipelined, PIPELINE_DEPTH, &mut line)))
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, json_rpc_round_trip);
+criterion_main!(benches);
@@ -1,19 +1,26 @@
 use anyhow::Result;
 use serde::{Deserialize, Serialize};
-use std::path::PathBuf;
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
 
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Config {
     /// Database file path
     pub database_path: PathBuf,
     
+    /// Indices kept in SQLite files of their own instead of `database_path`, by name
+    #[serde(default)]
+    pub index_databases: HashMap<String, PathBuf>,
+    
     /// Log level
     pub log_level: String,
     
     /// Maximum number of concurrent parsing tasks
     pub max_concurrent_tasks: usize,
     
-    /// Memory limit for indexing operations (in MB)
+    /// Budget in MB for the files in flight through an indexing run; an eighth of it
+    /// bounds the per-file cache. This throttles intake but is not a cap on the process:
+    /// the Merkle tree and include graph keep a node per file on top of it.
     pub memory_limit_mb: usize,
     
     /// File extensions to index
@@ -21,12 +28,52 @@ pub struct Config {
     
     /// Directories to ignore during indexing
     pub ignore_patterns: Vec<String>,
+    
+    /// Reuse precompiled headers for shared include prefixes (stored beside the database)
+    #[serde(default)]
+    pub enable_pch_cache: bool,
+    
+    /// Store tree-sitter symbols first so a new index is queryable quickly, then enrich
+    /// them with libclang in the background
+    #[serde(default)]
+    pub enable_deferred_enrichment: bool,
+    
+    /// Answer `search_symbols` from an in-memory name index built at server startup
+    #[serde(default)]
+    pub enable_symbol_index: bool,
+    
+    /// Serve read tools from the index's exported snapshot, when it matches the index
+    #[serde(default)]
+    pub enable_snapshot: bool,
+    
+    /// Take the content hashes of clean tracked files from git's index instead of
+    /// reading and hashing them
+    #[serde(default)]
+    pub enable_git_hashes: bool,
+    
+    /// Maximum number of MCP tool calls and resource reads executing at once; the server
+    /// opens as many read connections to each database
+    #[serde(default = "default_max_in_flight_requests")]
+    pub max_in_flight_requests: usize,
+    
+    /// Number of read-only tool results kept in the result cache (0 = disabled)
+    #[serde(default = "default_result_cache_entries")]
+    pub result_cache_entries: usize,
+}
+
+fn default_max_in_flight_requests() -> usize {
+    crate::lib::mcp_server::dispatch::DEFAULT_MAX_IN_FLIGHT
+}
+
+fn default_result_cache_entries() -> usize {
+    crate::lib::mcp_server::result_cache::DEFAULT_CACHE_ENTRIES
 }
 
 impl Default for Config {
     fn default() -> Self {
         Self {
             database_path: PathBuf::from("./cpp-index.db"),
+            index_databases: HashMap::new(),
             log_level: "info".to_string(),
             max_concurrent_tasks: num_cpus::get(),
             memory_limit_mb: 1024,
@@ -53,11 +100,23 @@ impl Default for Config {
                 "*.dll".to_string(),
                 "*.dylib".to_string(),
             ],
+            enable_pch_cache: false,
+            enable_deferred_enrichment: false,
+            enable_symbol_index: false,
+            enable_snapshot: false,
+            enable_git_hashes: false,
+            max_in_flight_requests: default_max_in_flight_requests(),
+            result_cache_entries: default_result_cache_entries(),
         }
     }
 }
 
 impl Config {
+    /// Database file holding `index_name`; its state files are kept beside it
+    pub fn database_path_for(&self, index_name: &str) -> &Path {
+        self.index_databases.get(index_name).unwrap_or(&self.database_path)
+    }
+    
     /// Load configuration from file or create default
     #[allow(dead_code)]
     pub fn load() -> Result<Self> {
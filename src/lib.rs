@@ -11,6 +11,7 @@ pub mod lib {
     pub mod cpp_indexer;
     pub mod mcp_server;
     pub mod cli_interface;
+    pub mod metrics;
 }
 
 // Re-export main modules for easy access
@@ -1,12 +1,30 @@
-use clang::{Clang, EntityKind, Index};
+use clang::{Clang, EntityKind, Index, TranslationUnit, Unsaved};
 use std::collections::HashMap;
+use crate::lib::cpp_indexer::compilation_database::CompilationDatabase;
+use crate::lib::cpp_indexer::pch_cache::PchCache;
+use crate::lib::storage::models::symbol_relationships::RelationshipType;
+use std::fmt;
 use std::path::{Path, PathBuf};
+use std::sync::{Arc, OnceLock};
+
+/// Process-wide libclang handle; `Clang::new` refuses a second live instance.
+static CLANG: OnceLock<Result<Clang, String>> = OnceLock::new();
+
+/// Returns the shared `Clang` handle so parsers on different workers can each build their own `Index`.
+fn shared_clang() -> Result<&'static Clang, Box<dyn std::error::Error>> {
+    CLANG
+        .get_or_init(Clang::new)
+        .as_ref()
+        .map_err(|e| format!("Failed to initialize Clang: {:?}", e).into())
+}
 
 #[derive(Debug, Clone)]
 pub struct SemanticInfo {
     pub symbol_name: String,
     pub symbol_kind: EntityKind,
     pub fully_qualified_name: String,
+    /// libclang's unified symbol resolution id, the same in every translation unit
+    pub usr: Option<String>,
     pub location: SourceLocation,
     pub type_info: Option<String>,
     pub access_specifier: Option<AccessSpecifier>,
@@ -25,6 +43,25 @@ pub struct SourceLocation {
     pub offset: u32,
 }
 
+/// One end of a `ReferenceEdge`: the symbol's USR, and where it is declared so the
+/// edge can also be matched to symbols stored without a USR
+#[derive(Debug, Clone)]
+pub struct ReferencedSymbol {
+    pub usr: String,
+    pub name: String,
+    pub location: SourceLocation,
+}
+
+/// A reference from the symbol enclosing `location` to another symbol, such as a
+/// call from a function body or a base class in a class declaration
+#[derive(Debug, Clone)]
+pub struct ReferenceEdge {
+    pub relationship_type: RelationshipType,
+    pub from: ReferencedSymbol,
+    pub to: ReferencedSymbol,
+    pub location: SourceLocation,
+}
+
 #[derive(Debug, Clone)]
 pub enum AccessSpecifier {
     Public,
@@ -47,9 +84,100 @@ pub struct InheritanceInfo {
     pub virtual_inheritance: bool,
 }
 
+/// Default memory ceiling for translation units kept alive between parses.
+pub const DEFAULT_UNIT_CACHE_BYTES: usize = 256 * 1024 * 1024;
+
 #[derive(Debug)]
 pub struct ClangParser {
     compile_flags: Vec<String>,
+    unit_cache_bytes: usize,
+    pch_cache: Option<Arc<PchCache>>,
+    compilation_database: Option<Arc<CompilationDatabase>>,
+    context: Option<ParserContext>,
+}
+
+/// Long-lived libclang state: one `Index` plus the translation units parsed through it.
+struct ParserContext {
+    // Units borrow `index`, so they are declared (and therefore dropped) first.
+    units: HashMap<PathBuf, CachedUnit>,
+    index: Box<Index<'static>>,
+    cached_bytes: usize,
+    clock: u64,
+    /// Parses served by reparsing a cached unit
+    reparses: u64,
+}
+
+// SAFETY: libclang allows an index and its translation units to be used from any
+// thread as long as they are not used concurrently; the context is only reachable
+// through `&mut ClangParser`.
+unsafe impl Send for ParserContext {}
+
+struct CachedUnit {
+    translation_unit: TranslationUnit<'static>,
+    memory_bytes: usize,
+    last_used: u64,
+}
+
+impl ParserContext {
+    fn new() -> Result<Self, Box<dyn std::error::Error>> {
+        Ok(Self {
+            units: HashMap::new(),
+            index: Box::new(Index::new(shared_clang()?, false, false)),
+            cached_bytes: 0,
+            clock: 0,
+            reparses: 0,
+        })
+    }
+
+    fn index(&self) -> &'static Index<'static> {
+        // SAFETY: the boxed index never moves and outlives every unit parsed from it,
+        // because `units` is dropped before `index` and units never leave the parser.
+        unsafe { &*(self.index.as_ref() as *const Index<'static>) }
+    }
+
+    fn remove(&mut self, file_path: &Path) -> Option<CachedUnit> {
+        let unit = self.units.remove(file_path)?;
+        self.cached_bytes -= unit.memory_bytes;
+        Some(unit)
+    }
+
+    fn insert(&mut self, file_path: PathBuf, mut unit: CachedUnit) {
+        self.clock += 1;
+        unit.last_used = self.clock;
+        unit.memory_bytes = unit.translation_unit.get_memory_usage().values().sum();
+        self.cached_bytes += unit.memory_bytes;
+        
+        if let Some(previous) = self.units.insert(file_path, unit) {
+            self.cached_bytes -= previous.memory_bytes;
+        }
+    }
+
+    /// Drops least recently used units until the cache fits in `limit_bytes`.
+    fn evict_to(&mut self, limit_bytes: usize) {
+        while self.cached_bytes > limit_bytes {
+            let oldest = self.units
+                .iter()
+                .min_by_key(|(_, unit)| unit.last_used)
+                .map(|(path, _)| path.clone());
+            
+            match oldest {
+                Some(path) => {
+                    self.remove(&path);
+                }
+                None => break,
+            }
+        }
+    }
+}
+
+impl fmt::Debug for ParserContext {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("ParserContext")
+            .field("cached_units", &self.units.len())
+            .field("cached_bytes", &self.cached_bytes)
+            .field("reparses", &self.reparses)
+            .finish()
+    }
 }
 
 impl ClangParser {
@@ -62,43 +190,164 @@ impl ClangParser {
         
         Ok(Self {
             compile_flags: flags,
+            unit_cache_bytes: DEFAULT_UNIT_CACHE_BYTES,
+            pch_cache: None,
+            compilation_database: None,
+            context: None,
         })
     }
 
-    pub fn parse_file(&self, file_path: &Path) -> Result<SemanticParseResult, Box<dyn std::error::Error>> {
-        let clang = Clang::new().map_err(|e| format!("Failed to initialize Clang: {:?}", e))?;
-        let index = Index::new(&clang, false, false);
+    /// Sets the memory budget for cached translation units; zero disables reuse
+    pub fn with_unit_cache_limit(mut self, limit_bytes: usize) -> Self {
+        self.unit_cache_bytes = limit_bytes;
+        self
+    }
+
+    /// Shares a precompiled-header cache for the include prefix of fresh parses
+    pub fn with_pch_cache(mut self, pch_cache: Arc<PchCache>) -> Self {
+        self.pch_cache = Some(pch_cache);
+        self
+    }
+
+    /// Uses each file's own compile command; files without an entry keep the default flags
+    pub fn with_compilation_database(mut self, compilation_database: Arc<CompilationDatabase>) -> Self {
+        self.compilation_database = Some(compilation_database);
+        self
+    }
+
+    /// Parses a file, reparsing its cached translation unit when one exists.
+    pub fn parse_file(&mut self, file_path: &Path) -> Result<SemanticParseResult, Box<dyn std::error::Error>> {
+        self.parse_with_content(file_path, None)
+    }
+
+    /// Like `parse_file`, over `content` instead of the file's bytes on disk: the
+    /// content is handed to libclang as an unsaved file, so edits not yet written and
+    /// buffers the caller already read are parsed as given.
+    pub fn parse_content(&mut self, file_path: &Path, content: &str) -> Result<SemanticParseResult, Box<dyn std::error::Error>> {
+        self.parse_with_content(file_path, Some(content))
+    }
+
+    fn parse_with_content(&mut self, file_path: &Path, content: Option<&str>) -> Result<SemanticParseResult, Box<dyn std::error::Error>> {
+        let unit = self.load_unit(file_path, content)?;
+        let result = self.collect_semantics(file_path, &unit.translation_unit);
+        self.store_unit(file_path, unit);
+        result
+    }
+
+    /// Drops the cached translation unit for a file, e.g. after it was deleted.
+    pub fn evict_unit(&mut self, file_path: &Path) {
+        if let Some(context) = self.context.as_mut() {
+            context.remove(file_path);
+        }
+    }
+
+    pub fn cached_unit_count(&self) -> usize {
+        self.context.as_ref().map_or(0, |context| context.units.len())
+    }
+
+    pub fn cached_unit_bytes(&self) -> usize {
+        self.context.as_ref().map_or(0, |context| context.cached_bytes)
+    }
+
+    fn load_unit(&mut self, file_path: &Path, content: Option<&str>) -> Result<CachedUnit, Box<dyn std::error::Error>> {
+        let context = match self.context {
+            Some(ref mut context) => context,
+            None => self.context.insert(ParserContext::new()?),
+        };
+        
+        let unsaved: Vec<Unsaved> = content.map(|content| Unsaved::new(file_path, content)).into_iter().collect();
+        
+        if let Some(cached) = context.remove(file_path) {
+            // A failed reparse invalidates the unit; fall back to a fresh parse.
+            if let Ok(translation_unit) = cached.translation_unit.reparse(&unsaved) {
+                context.reparses += 1;
+                return Ok(CachedUnit { translation_unit, memory_bytes: 0, last_used: 0 });
+            }
+        }
         
-        let translation_unit = index
+        let compile_flags = self.compilation_database
+            .as_ref()
+            .and_then(|database| database.flags_for(file_path))
+            .unwrap_or(&self.compile_flags);
+        
+        let mut arguments = compile_flags.to_vec();
+        if let Some(pch_cache) = &self.pch_cache {
+            let read_content;
+            let content = match content {
+                Some(content) => content,
+                None => {
+                    read_content = std::fs::read_to_string(file_path)?;
+                    &read_content
+                }
+            };
+            
+            if let Some(pch_path) = pch_cache.lookup_or_build(context.index(), content, compile_flags) {
+                arguments.push("-include-pch".to_string());
+                arguments.push(pch_path.to_string_lossy().to_string());
+            }
+        }
+        
+        let translation_unit = context
+            .index()
             .parser(file_path)
-            .arguments(&self.compile_flags)
+            .arguments(&arguments)
+            .unsaved(&unsaved)
+            .precompiled_preamble(self.unit_cache_bytes > 0)
             .parse()
             .map_err(|e| format!("Failed to parse file: {:?}", e))?;
+        
+        Ok(CachedUnit { translation_unit, memory_bytes: 0, last_used: 0 })
+    }
 
+    fn store_unit(&mut self, file_path: &Path, unit: CachedUnit) {
+        if self.unit_cache_bytes == 0 {
+            return;
+        }
+        
+        if let Some(context) = self.context.as_mut() {
+            context.insert(file_path.to_path_buf(), unit);
+            context.evict_to(self.unit_cache_bytes);
+        }
+    }
+
+    fn collect_semantics(
+        &self,
+        file_path: &Path,
+        translation_unit: &TranslationUnit<'static>,
+    ) -> Result<SemanticParseResult, Box<dyn std::error::Error>> {
         let mut symbols = Vec::new();
         let mut references = HashMap::new();
         let mut type_hierarchy = HashMap::new();
+        let mut edges = Vec::new();
 
         let entity = translation_unit.get_entity();
-        self.visit_entity_recursive(&entity, &mut symbols, &mut references, &mut type_hierarchy)?;
+        self.visit_entity_recursive(&entity, None, &mut symbols, &mut references, &mut type_hierarchy, &mut edges)?;
 
         Ok(SemanticParseResult {
             file_path: file_path.to_path_buf(),
             symbols,
             references,
             type_hierarchy,
+            edges,
         })
     }
 
+    /// Collects symbols and reference edges below `entity`. `container` is the
+    /// innermost enclosing function or class definition, the source of any edge found.
     fn visit_entity_recursive(
         &self,
         entity: &clang::Entity,
+        container: Option<&ReferencedSymbol>,
         symbols: &mut Vec<SemanticInfo>,
         references: &mut HashMap<String, Vec<SourceLocation>>,
         type_hierarchy: &mut HashMap<String, InheritanceInfo>,
+        edges: &mut Vec<ReferenceEdge>,
     ) -> Result<(), Box<dyn std::error::Error>> {
+        let kind = entity.get_kind();
+        let mut scope = None;
+        
         if let Some(location_info) = self.get_location_info(entity) {
-            match entity.get_kind() {
+            match kind {
                 EntityKind::ClassDecl | 
                 EntityKind::StructDecl | 
                 EntityKind::UnionDecl |
@@ -114,11 +363,11 @@ impl ClangParser {
                 EntityKind::TypedefDecl => {
                     let semantic_info = self.extract_semantic_info(entity, location_info)?;
                     
-                    if let Some(ref name) = entity.get_name() {
-                        references.entry(name.clone()).or_insert_with(Vec::new);
+                    if let Some(ref usr) = semantic_info.usr {
+                        references.entry(usr.clone()).or_insert_with(Vec::new);
                     }
                     
-                    if matches!(entity.get_kind(), EntityKind::ClassDecl | EntityKind::StructDecl) {
+                    if matches!(kind, EntityKind::ClassDecl | EntityKind::StructDecl) {
                         if let Some(inheritance) = self.extract_inheritance_info(entity)? {
                             if let Some(ref name) = entity.get_name() {
                                 type_hierarchy.insert(name.clone(), inheritance);
@@ -126,19 +375,103 @@ impl ClangParser {
                         }
                     }
                     
+                    // Declarations are recorded wherever they are, so classes in headers
+                    // get their bases and overrides from the TUs that include them.
+                    if let Some(symbol) = self.symbol_ref(entity) {
+                        self.collect_declaration_edges(entity, &symbol, edges);
+                        if entity.is_definition() && is_edge_scope(kind) {
+                            scope = Some(symbol);
+                        }
+                    }
+                    
                     symbols.push(semantic_info);
                 }
+                EntityKind::CallExpr |
+                EntityKind::DeclRefExpr |
+                EntityKind::MemberRefExpr |
+                EntityKind::TypeRef |
+                EntityKind::TemplateRef => {
+                    // Bodies are only walked for edges in the main file; each header's
+                    // function bodies would otherwise be recorded once per including TU.
+                    if let (Some(from), true) = (container, entity.is_in_main_file()) {
+                        if let Some(edge) = self.reference_edge(entity, from, location_info) {
+                            references.entry(edge.to.usr.clone()).or_insert_with(Vec::new).push(edge.location.clone());
+                            edges.push(edge);
+                        }
+                    }
+                }
                 _ => {}
             }
         }
 
+        // A base specifier's type reference is already its `Inherits` edge.
+        if kind == EntityKind::BaseSpecifier {
+            return Ok(());
+        }
+
+        let container = scope.as_ref().or(container);
         for child in entity.get_children() {
-            self.visit_entity_recursive(&child, symbols, references, type_hierarchy)?;
+            self.visit_entity_recursive(&child, container, symbols, references, type_hierarchy, edges)?;
         }
 
         Ok(())
     }
 
+    /// The USR, name and declaration of a symbol outside system headers
+    fn symbol_ref(&self, entity: &clang::Entity) -> Option<ReferencedSymbol> {
+        if entity.is_in_system_header() {
+            return None;
+        }
+        
+        Some(ReferencedSymbol {
+            usr: entity.get_usr()?.0,
+            name: entity.get_name()?,
+            location: self.get_location_info(entity)?,
+        })
+    }
+
+    /// `Inherits` edges to a class's bases and `Overrides` edges to the methods a method overrides
+    fn collect_declaration_edges(&self, entity: &clang::Entity, symbol: &ReferencedSymbol, edges: &mut Vec<ReferenceEdge>) {
+        let mut push = |relationship_type, target: &clang::Entity, location: Option<SourceLocation>| {
+            if let Some(to) = self.symbol_ref(target) {
+                let location = location.unwrap_or_else(|| symbol.location.clone());
+                edges.push(ReferenceEdge { relationship_type, from: symbol.clone(), to, location });
+            }
+        };
+        
+        match entity.get_kind() {
+            EntityKind::ClassDecl | EntityKind::StructDecl => {
+                for child in entity.get_children() {
+                    if child.get_kind() == EntityKind::BaseSpecifier {
+                        if let Some(base) = child.get_type().and_then(|base_type| base_type.get_declaration()) {
+                            push(RelationshipType::Inherits, &base, self.get_location_info(&child));
+                        }
+                    }
+                }
+            }
+            EntityKind::Method | EntityKind::Destructor => {
+                for overridden in entity.get_overridden_methods().unwrap_or_default() {
+                    push(RelationshipType::Overrides, &overridden, None);
+                }
+            }
+            _ => {}
+        }
+    }
+
+    /// A `Calls` or `Uses` edge from `from` to whatever the expression or type reference refers to
+    fn reference_edge(&self, entity: &clang::Entity, from: &ReferencedSymbol, location: SourceLocation) -> Option<ReferenceEdge> {
+        let referenced = entity.get_reference()?;
+        let relationship_type = match entity.get_kind() {
+            EntityKind::CallExpr => RelationshipType::Calls,
+            // The name of a called function is a reference too; the call already covers it.
+            _ if is_callable(referenced.get_kind()) => return None,
+            _ => RelationshipType::Uses,
+        };
+        
+        let to = self.symbol_ref(&referenced)?;
+        (to.usr != from.usr).then(|| ReferenceEdge { relationship_type, from: from.clone(), to, location })
+    }
+
     fn get_location_info(&self, entity: &clang::Entity) -> Option<SourceLocation> {
         if let Some(location) = entity.get_location() {
             let file_location = location.get_file_location();
@@ -181,6 +514,7 @@ impl ClangParser {
             symbol_name,
             symbol_kind,
             fully_qualified_name,
+            usr: entity.get_usr().map(|usr| usr.0),
             location,
             type_info,
             access_specifier,
@@ -263,33 +597,78 @@ impl ClangParser {
         }
     }
 
+    /// Where the symbol referenced or declared at a position is defined, if the
+    /// definition is visible from the file's translation unit
     pub fn find_definition(
-        &self,
-        _file_path: &Path,
-        _line: u32,
-        _column: u32,
+        &mut self,
+        file_path: &Path,
+        line: u32,
+        column: u32,
     ) -> Result<Option<SourceLocation>, Box<dyn std::error::Error>> {
-        // Simplified implementation - would need more complex logic
-        Ok(None)
+        let unit = self.load_unit(file_path, None)?;
+        let definition = self
+            .entity_at(&unit.translation_unit, file_path, line, column)
+            .and_then(|entity| entity.get_reference().unwrap_or(entity).get_definition())
+            .and_then(|definition| self.get_location_info(&definition));
+        self.store_unit(file_path, unit);
+        Ok(definition)
     }
 
+    /// References in the file's main source to the symbol referenced or declared at a
+    /// position. References from other files come from the stored symbol edges.
     pub fn find_references(
-        &self,
-        _file_path: &Path,
-        _line: u32,
-        _column: u32,
+        &mut self,
+        file_path: &Path,
+        line: u32,
+        column: u32,
     ) -> Result<Vec<SourceLocation>, Box<dyn std::error::Error>> {
-        // Simplified implementation - would need more complex logic
-        Ok(Vec::new())
+        let unit = self.load_unit(file_path, None)?;
+        let usr = self
+            .entity_at(&unit.translation_unit, file_path, line, column)
+            .and_then(|entity| entity.get_reference().unwrap_or(entity).get_usr());
+        let result = match usr {
+            Some(usr) => self
+                .collect_semantics(file_path, &unit.translation_unit)
+                .map(|mut semantics| semantics.references.remove(&usr.0).unwrap_or_default()),
+            None => Ok(Vec::new()),
+        };
+        self.store_unit(file_path, unit);
+        result
     }
+
+    fn entity_at<'tu>(
+        &self,
+        translation_unit: &'tu TranslationUnit<'static>,
+        file_path: &Path,
+        line: u32,
+        column: u32,
+    ) -> Option<clang::Entity<'tu>> {
+        translation_unit.get_file(file_path)?.get_location(line, column).get_entity()
+    }
+}
+
+/// Definitions whose bodies are the source of the edges found inside them
+fn is_edge_scope(kind: EntityKind) -> bool {
+    matches!(kind, EntityKind::ClassDecl | EntityKind::StructDecl | EntityKind::UnionDecl) || is_callable(kind)
+}
+
+fn is_callable(kind: EntityKind) -> bool {
+    matches!(
+        kind,
+        EntityKind::FunctionDecl | EntityKind::Method | EntityKind::Constructor | EntityKind::Destructor
+    )
 }
 
 #[derive(Debug)]
 pub struct SemanticParseResult {
     pub file_path: PathBuf,
     pub symbols: Vec<SemanticInfo>,
+    /// Reference locations in the main file by USR of the symbol referred to
     pub references: HashMap<String, Vec<SourceLocation>>,
     pub type_hierarchy: HashMap<String, InheritanceInfo>,
+    /// References between symbols: calls and uses in the main file, and bases and
+    /// overrides of every class and method declared outside system headers
+    pub edges: Vec<ReferenceEdge>,
 }
 
 impl SemanticParseResult {
@@ -342,4 +721,88 @@ mod tests {
         let parser = parser.unwrap();
         assert_eq!(parser.compile_flags, flags);
     }
+
+    #[test]
+    fn test_unit_cache_starts_empty() {
+        let parser = ClangParser::new(None)
+            .expect("Failed to create parser")
+            .with_unit_cache_limit(0);
+        
+        assert_eq!(parser.unit_cache_bytes, 0);
+        assert_eq!(parser.cached_unit_count(), 0);
+        assert_eq!(parser.cached_unit_bytes(), 0);
+    }
+
+    fn write_source(dir: &Path, name: &str) -> PathBuf {
+        let path = dir.join(name);
+        std::fs::write(&path, "struct Point { int x; int y; };\nint area(Point p) { return p.x * p.y; }\n")
+            .expect("Failed to write source");
+        path
+    }
+
+    #[test]
+    fn test_unit_cache_reuses_unit() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let source = write_source(temp_dir.path(), "point.cpp");
+        let mut parser = ClangParser::new(None).expect("Failed to create parser");
+
+        let first = parser.parse_file(&source).expect("Failed to parse");
+        assert_eq!(parser.cached_unit_count(), 1);
+        let bytes = parser.cached_unit_bytes();
+        assert!(bytes > 0);
+
+        let second = parser.parse_file(&source).expect("Failed to reparse");
+        let context = parser.context.as_ref().unwrap();
+        assert_eq!(context.reparses, 1);
+        assert_eq!(parser.cached_unit_count(), 1);
+        assert_eq!(first.symbols.len(), second.symbols.len());
+    }
+
+    #[test]
+    fn test_parse_content_ignores_disk() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let source = write_source(temp_dir.path(), "point.cpp");
+        let mut parser = ClangParser::new(None).expect("Failed to create parser");
+        let names = |result: &SemanticParseResult| -> Vec<String> {
+            result.symbols.iter().map(|symbol| symbol.symbol_name.clone()).collect()
+        };
+
+        let edited = parser.parse_content(&source, "int perimeter(int side) { return 4 * side; }\n").expect("Failed to parse");
+        assert!(names(&edited).contains(&"perimeter".to_string()));
+        assert!(!names(&edited).contains(&"area".to_string()));
+
+        // The cached unit is reparsed over the new content as well
+        let reverted = parser.parse_content(&source, &std::fs::read_to_string(&source).unwrap()).expect("Failed to reparse");
+        assert_eq!(parser.context.as_ref().unwrap().reparses, 1);
+        assert!(names(&reverted).contains(&"area".to_string()));
+    }
+
+    #[test]
+    fn test_unit_cache_evicts_least_recently_used() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let sources: Vec<PathBuf> = ["a.cpp", "b.cpp", "c.cpp"]
+            .iter()
+            .map(|name| write_source(temp_dir.path(), name))
+            .collect();
+
+        // Size one unit, then allow room for two of them but not three
+        let mut probe = ClangParser::new(None).expect("Failed to create parser");
+        probe.parse_file(&sources[0]).expect("Failed to parse");
+        let unit_bytes = probe.cached_unit_bytes();
+        let mut parser = ClangParser::new(None)
+            .expect("Failed to create parser")
+            .with_unit_cache_limit(unit_bytes * 5 / 2);
+
+        parser.parse_file(&sources[0]).expect("Failed to parse");
+        parser.parse_file(&sources[1]).expect("Failed to parse");
+        parser.parse_file(&sources[0]).expect("Failed to parse");
+        parser.parse_file(&sources[2]).expect("Failed to parse");
+
+        let units = &parser.context.as_ref().unwrap().units;
+        assert_eq!(units.len(), 2);
+        assert!(units.contains_key(&sources[0]));
+        assert!(!units.contains_key(&sources[1]));
+        assert!(units.contains_key(&sources[2]));
+        assert!(parser.cached_unit_bytes() <= unit_bytes * 5 / 2);
+    }
 }
\ No newline at end of file
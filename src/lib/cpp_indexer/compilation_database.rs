@@ -0,0 +1,276 @@
+use serde::Deserialize;
+use std::collections::HashMap;
+use std::fs;
+use std::path::{Component, Path, PathBuf};
+
+/// Options that take a path operand, as a separate argument or fused (`-Iinclude`).
+const PATH_OPTIONS: [&str; 7] = ["-I", "-isystem", "-iquote", "-idirafter", "-include", "-imacros", "-F"];
+
+/// Output and dependency-file options that are meaningless for indexing, with their operand.
+const DROPPED_OPTIONS_WITH_VALUE: [&str; 4] = ["-o", "-MF", "-MT", "-MQ"];
+
+/// Options dropped on their own.
+const DROPPED_OPTIONS: [&str; 6] = ["-c", "-M", "-MM", "-MD", "-MMD", "-MP"];
+
+/// One entry of a `compile_commands.json` file
+#[derive(Debug, Clone, Deserialize)]
+pub struct CompileCommand {
+    pub directory: PathBuf,
+    pub file: PathBuf,
+    #[serde(default)]
+    pub arguments: Option<Vec<String>>,
+    #[serde(default)]
+    pub command: Option<String>,
+    #[serde(default)]
+    pub output: Option<PathBuf>,
+}
+
+impl CompileCommand {
+    /// Absolute path of the entry's source file
+    pub fn source_path(&self) -> PathBuf {
+        normalize_path(&self.directory.join(&self.file))
+    }
+
+    /// The entry's compiler arguments reduced to what libclang needs to parse the file:
+    /// the compiler, input file and output options are removed and relative paths are
+    /// anchored at the entry's directory.
+    pub fn parse_flags(&self) -> Vec<String> {
+        let arguments = match (&self.arguments, &self.command) {
+            (Some(arguments), _) => arguments.clone(),
+            (None, Some(command)) => split_command(command),
+            (None, None) => Vec::new(),
+        };
+
+        let source_path = self.source_path();
+        let mut flags = vec!["-working-directory".to_string(), self.directory.to_string_lossy().to_string()];
+        let mut arguments = arguments.into_iter().skip(1);
+
+        while let Some(argument) = arguments.next() {
+            if DROPPED_OPTIONS.contains(&argument.as_str()) {
+                continue;
+            }
+
+            if DROPPED_OPTIONS_WITH_VALUE.contains(&argument.as_str()) {
+                arguments.next();
+                continue;
+            }
+
+            if argument.starts_with("-o") {
+                continue;
+            }
+
+            if !argument.starts_with('-') && normalize_path(&self.directory.join(&argument)) == source_path {
+                continue;
+            }
+
+            if PATH_OPTIONS.contains(&argument.as_str()) {
+                flags.push(argument);
+                if let Some(value) = arguments.next() {
+                    flags.push(self.anchor(&value));
+                }
+                continue;
+            }
+
+            let fused = PATH_OPTIONS
+                .iter()
+                .find(|option| argument.starts_with(**option) && argument.len() > option.len());
+
+            match fused {
+                Some(option) => flags.push(format!("{}{}", option, self.anchor(&argument[option.len()..]))),
+                None => flags.push(argument),
+            }
+        }
+
+        flags
+    }
+
+    fn anchor(&self, path: &str) -> String {
+        normalize_path(&self.directory.join(path)).to_string_lossy().to_string()
+    }
+}
+
+/// Per-file compile flags loaded from a `compile_commands.json`.
+#[derive(Debug, Default)]
+pub struct CompilationDatabase {
+    flags: Vec<Vec<String>>,
+    entries: HashMap<PathBuf, usize>,
+}
+
+impl CompilationDatabase {
+    pub fn load(path: &Path) -> Result<Self, Box<dyn std::error::Error>> {
+        let json = fs::read_to_string(path)
+            .map_err(|e| format!("Failed to read {}: {}", path.display(), e))?;
+        Self::from_json(&json)
+    }
+
+    pub fn from_json(json: &str) -> Result<Self, Box<dyn std::error::Error>> {
+        let commands: Vec<CompileCommand> = serde_json::from_str(json)
+            .map_err(|e| format!("Invalid compilation database: {}", e))?;
+        Ok(Self::from_commands(commands))
+    }
+
+    /// Builds the lookup table; when a file appears more than once the last entry wins.
+    pub fn from_commands(commands: Vec<CompileCommand>) -> Self {
+        let mut database = Self::default();
+
+        for command in commands {
+            let slot = database.flags.len();
+            database.flags.push(command.parse_flags());
+
+            let source_path = command.source_path();
+            if let Ok(canonical) = fs::canonicalize(&source_path) {
+                database.entries.insert(canonical, slot);
+            }
+            database.entries.insert(source_path, slot);
+        }
+
+        database
+    }
+
+    /// Flags for a file, or `None` if it has no entry (e.g. headers)
+    pub fn flags_for(&self, file_path: &Path) -> Option<&[String]> {
+        let absolute = match std::env::current_dir() {
+            Ok(current_dir) if file_path.is_relative() => current_dir.join(file_path),
+            _ => file_path.to_path_buf(),
+        };
+
+        self.entries
+            .get(&normalize_path(&absolute))
+            .or_else(|| fs::canonicalize(&absolute).ok().and_then(|canonical| self.entries.get(&canonical)))
+            .map(|&slot| self.flags[slot].as_slice())
+    }
+
+    /// Flags of every compile command
+    pub fn all_flags(&self) -> impl Iterator<Item = &[String]> {
+        self.flags.iter().map(Vec::as_slice)
+    }
+
+    pub fn contains(&self, file_path: &Path) -> bool {
+        self.flags_for(file_path).is_some()
+    }
+
+    /// Number of distinct compile commands
+    pub fn len(&self) -> usize {
+        self.flags.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.flags.is_empty()
+    }
+}
+
+/// Splits a shell command line into arguments, honouring quotes and backslash escapes.
+fn split_command(command: &str) -> Vec<String> {
+    let mut arguments = Vec::new();
+    let mut current = String::new();
+    let mut in_argument = false;
+    let mut quote = None;
+    let mut chars = command.chars();
+
+    while let Some(c) = chars.next() {
+        match (quote, c) {
+            (Some('\''), '\'') => quote = None,
+            (Some('\''), _) => current.push(c),
+            (Some('"'), '"') => quote = None,
+            (Some('"'), '\\') => match chars.next() {
+                Some(next) if matches!(next, '"' | '\\' | '$' | '`') => current.push(next),
+                Some(next) => {
+                    current.push('\\');
+                    current.push(next);
+                }
+                None => current.push('\\'),
+            },
+            (Some(_), _) => current.push(c),
+            (None, '\'' | '"') => {
+                quote = Some(c);
+                in_argument = true;
+            }
+            (None, '\\') => {
+                if let Some(next) = chars.next() {
+                    current.push(next);
+                }
+                in_argument = true;
+            }
+            (None, c) if c.is_whitespace() => {
+                if in_argument {
+                    arguments.push(std::mem::take(&mut current));
+                    in_argument = false;
+                }
+            }
+            (None, _) => {
+                current.push(c);
+                in_argument = true;
+            }
+        }
+    }
+
+    if in_argument {
+        arguments.push(current);
+    }
+
+    arguments
+}
+
+/// Resolves `.` and `..` lexically, without touching the filesystem.
+pub(crate) fn normalize_path(path: &Path) -> PathBuf {
+    let mut normalized = PathBuf::new();
+
+    for component in path.components() {
+        match component {
+            Component::CurDir => {}
+            Component::ParentDir => {
+                if !normalized.pop() {
+                    normalized.push(component);
+                }
+            }
+            _ => normalized.push(component),
+        }
+    }
+
+    normalized
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_split_command_handles_quotes() {
+        let arguments = split_command(r#"clang++ -DNAME="a b" -I 'my dir' -c src/main.cpp"#);
+        assert_eq!(arguments, vec!["clang++", "-DNAME=a b", "-I", "my dir", "-c", "src/main.cpp"]);
+    }
+
+    #[test]
+    fn test_parse_flags_strips_compiler_and_outputs() {
+        let command = CompileCommand {
+            directory: PathBuf::from("/work/build"),
+            file: PathBuf::from("../src/main.cpp"),
+            arguments: None,
+            command: Some("/usr/bin/c++ -std=c++20 -Iinclude -isystem ../third_party -DNDEBUG -o main.o -MD -MF main.d -c ../src/main.cpp".to_string()),
+            output: None,
+        };
+
+        assert_eq!(command.source_path(), PathBuf::from("/work/src/main.cpp"));
+        assert_eq!(command.parse_flags(), vec![
+            "-working-directory", "/work/build",
+            "-std=c++20",
+            "-I/work/build/include",
+            "-isystem", "/work/third_party",
+            "-DNDEBUG",
+        ]);
+    }
+
+    #[test]
+    fn test_flags_lookup_by_source_path() {
+        let json = r#"[
+            {"directory": "/work", "file": "src/a.cpp", "arguments": ["clang++", "-std=c++17", "-c", "src/a.cpp"]},
+            {"directory": "/work", "file": "/work/src/b.cpp", "command": "clang++ -std=c++20 -c /work/src/b.cpp"}
+        ]"#;
+        let database = CompilationDatabase::from_json(json).expect("Failed to parse database");
+
+        assert_eq!(database.len(), 2);
+        assert_eq!(database.flags_for(Path::new("/work/src/./a.cpp")).unwrap().last().unwrap(), "-std=c++17");
+        assert_eq!(database.flags_for(Path::new("/work/src/b.cpp")).unwrap().last().unwrap(), "-std=c++20");
+        assert!(!database.contains(Path::new("/work/src/a.h")));
+    }
+}
@@ -0,0 +1,207 @@
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
+
+/// Interned file path
+pub type FileId = u32;
+
+/// Include graph over interned file ids. Each file keeps its includes and its
+/// includers as sorted id arrays, so updating one file touches only its own edges
+/// and finding everything that must be re-indexed is one walk over reverse edges.
+/// Ids are never reused; a removed file keeps its id, and its includers keep
+/// pointing at it, so it is linked again if it reappears.
+#[derive(Debug, Default, Clone)]
+pub struct DependencyGraph {
+    paths: Vec<PathBuf>,
+    ids: HashMap<PathBuf, FileId>,
+    /// Files each file includes
+    includes: Vec<Vec<FileId>>,
+    /// Files including each file
+    included_by: Vec<Vec<FileId>>,
+    edge_count: usize,
+}
+
+impl DependencyGraph {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Builds a graph from `(file, included file)` pairs, e.g. ones loaded from storage
+    pub fn from_edges(edges: impl IntoIterator<Item = (PathBuf, PathBuf)>) -> Self {
+        let mut graph = Self::new();
+        for (file, included) in edges {
+            let (file, included) = (graph.intern(&file), graph.intern(&included));
+            graph.link(file, included);
+        }
+        graph
+    }
+
+    pub fn id(&self, path: &Path) -> Option<FileId> {
+        self.ids.get(path).copied()
+    }
+
+    pub fn path(&self, id: FileId) -> &Path {
+        &self.paths[id as usize]
+    }
+
+    /// Number of distinct files seen, including ones only known as includes
+    pub fn file_count(&self) -> usize {
+        self.paths.len()
+    }
+
+    pub fn edge_count(&self) -> usize {
+        self.edge_count
+    }
+
+    /// Replaces the includes of `file`
+    pub fn set_includes(&mut self, file: &Path, includes: &[PathBuf]) {
+        let file = self.intern(file);
+        let mut wanted: Vec<FileId> = includes.iter().map(|include| self.intern(include)).filter(|&id| id != file).collect();
+        wanted.sort_unstable();
+        wanted.dedup();
+
+        let previous = std::mem::take(&mut self.includes[file as usize]);
+        self.edge_count -= previous.len();
+        for old in previous {
+            if wanted.binary_search(&old).is_err() {
+                self.unlink_reverse(file, old);
+            }
+        }
+        for &new in &wanted {
+            insert_sorted(&mut self.included_by[new as usize], file);
+        }
+        self.edge_count += wanted.len();
+        self.includes[file as usize] = wanted;
+    }
+
+    /// Drops the includes of a deleted file; files including it keep their edges
+    pub fn remove_file(&mut self, file: &Path) {
+        if let Some(file) = self.id(file) {
+            let previous = std::mem::take(&mut self.includes[file as usize]);
+            self.edge_count -= previous.len();
+            for old in previous {
+                self.unlink_reverse(file, old);
+            }
+        }
+    }
+
+    /// Files `file` includes directly
+    pub fn includes_of(&self, file: &Path) -> Vec<PathBuf> {
+        self.id(file)
+            .map(|id| self.includes[id as usize].iter().map(|&include| self.paths[include as usize].clone()).collect())
+            .unwrap_or_default()
+    }
+
+    /// Whether any file includes `file`
+    pub fn is_included(&self, file: &Path) -> bool {
+        self.id(file).map_or(false, |id| !self.included_by[id as usize].is_empty())
+    }
+
+    /// Files that include `file` directly or transitively, i.e. the ones to re-index
+    /// when it changes, in breadth-first order
+    pub fn dependents_of(&self, file: &Path) -> Vec<PathBuf> {
+        let Some(start) = self.id(file) else {
+            return Vec::new();
+        };
+
+        let mut visited = vec![false; self.paths.len()];
+        visited[start as usize] = true;
+        let mut queue = vec![start];
+        let mut next = 0;
+
+        while next < queue.len() {
+            let current = queue[next];
+            next += 1;
+            for &dependent in &self.included_by[current as usize] {
+                if !std::mem::replace(&mut visited[dependent as usize], true) {
+                    queue.push(dependent);
+                }
+            }
+        }
+
+        queue[1..].iter().map(|&id| self.paths[id as usize].clone()).collect()
+    }
+
+    /// Included files that have at least one includer
+    pub fn included_files(&self) -> impl Iterator<Item = &Path> {
+        self.included_by
+            .iter()
+            .enumerate()
+            .filter(|(_, includers)| !includers.is_empty())
+            .map(|(id, _)| self.paths[id].as_path())
+    }
+
+    fn intern(&mut self, path: &Path) -> FileId {
+        if let Some(&id) = self.ids.get(path) {
+            return id;
+        }
+
+        let id = self.paths.len() as FileId;
+        self.paths.push(path.to_path_buf());
+        self.ids.insert(path.to_path_buf(), id);
+        self.includes.push(Vec::new());
+        self.included_by.push(Vec::new());
+        id
+    }
+
+    fn link(&mut self, file: FileId, included: FileId) {
+        if file != included && insert_sorted(&mut self.includes[file as usize], included) {
+            insert_sorted(&mut self.included_by[included as usize], file);
+            self.edge_count += 1;
+        }
+    }
+
+    fn unlink_reverse(&mut self, file: FileId, included: FileId) {
+        let includers = &mut self.included_by[included as usize];
+        if let Ok(position) = includers.binary_search(&file) {
+            includers.remove(position);
+        }
+    }
+}
+
+/// Inserts `id` keeping `ids` sorted; returns false if it was already there
+fn insert_sorted(ids: &mut Vec<FileId>, id: FileId) -> bool {
+    match ids.binary_search(&id) {
+        Ok(_) => false,
+        Err(position) => {
+            ids.insert(position, id);
+            true
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn paths(names: &[&str]) -> Vec<PathBuf> {
+        names.iter().map(PathBuf::from).collect()
+    }
+
+    #[test]
+    fn test_dependents_are_transitive() {
+        let mut graph = DependencyGraph::new();
+        graph.set_includes(Path::new("main.cpp"), &paths(&["app.h", "log.h"]));
+        graph.set_includes(Path::new("app.h"), &paths(&["log.h"]));
+        graph.set_includes(Path::new("test.cpp"), &paths(&["app.h"]));
+
+        let mut dependents = graph.dependents_of(Path::new("log.h"));
+        dependents.sort();
+        assert_eq!(dependents, paths(&["app.h", "main.cpp", "test.cpp"]));
+        assert!(graph.dependents_of(Path::new("main.cpp")).is_empty());
+        assert_eq!(graph.edge_count(), 4);
+    }
+
+    #[test]
+    fn test_set_includes_replaces_edges() {
+        let mut graph = DependencyGraph::from_edges([(PathBuf::from("main.cpp"), PathBuf::from("old.h"))]);
+        graph.set_includes(Path::new("main.cpp"), &paths(&["new.h"]));
+
+        assert!(graph.dependents_of(Path::new("old.h")).is_empty());
+        assert_eq!(graph.dependents_of(Path::new("new.h")), paths(&["main.cpp"]));
+        assert_eq!(graph.edge_count(), 1);
+
+        graph.remove_file(Path::new("main.cpp"));
+        assert!(!graph.is_included(Path::new("new.h")));
+        assert_eq!(graph.edge_count(), 0);
+    }
+}
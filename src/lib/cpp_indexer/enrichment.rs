@@ -0,0 +1,191 @@
+use crate::lib::cpp_indexer::symbol_extractor::SymbolExtractor;
+use crate::lib::cpp_indexer::watcher::ChangeSink;
+use crate::lib::metrics::{self, Stage};
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread;
+use tracing::{info, warn};
+
+/// A file stored with tree-sitter symbols only, and the includes stored with it
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct EnrichmentJob {
+    pub file_path: PathBuf,
+    pub dependencies: Vec<PathBuf>,
+    /// Hash and size stored for the file when it was queued; the enriched symbols
+    /// only replace that version of it
+    pub file_hash: String,
+    pub size_bytes: u64,
+}
+
+/// Outcome of an enrichment run
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct EnrichmentSummary {
+    pub enriched: usize,
+    pub failed: usize,
+    /// Files changed since they were queued, left to the write of their newer version
+    pub stale: usize,
+}
+
+/// Second tier of indexing: runs libclang over files the fast tier stored with
+/// tree-sitter symbols only and replaces each file's rows with the full extraction.
+/// One background thread works through the queue a file at a time, so it never takes
+/// threads from queries or the watcher, and each upgrade is a single replace that
+/// readers see either before or after. Dropping the queue stops it after the file in
+/// progress; files it did not reach stay in the syntax tier for the next run.
+pub struct EnrichmentQueue {
+    stop: Arc<AtomicBool>,
+    remaining: Arc<AtomicUsize>,
+    worker: Option<thread::JoinHandle<EnrichmentSummary>>,
+}
+
+impl EnrichmentQueue {
+    pub fn spawn(
+        jobs: Vec<EnrichmentJob>,
+        extractor: SymbolExtractor,
+        sink: Box<dyn ChangeSink>,
+    ) -> Result<Self, Box<dyn std::error::Error>> {
+        let stop = Arc::new(AtomicBool::new(false));
+        let remaining = Arc::new(AtomicUsize::new(jobs.len()));
+        info!("Queued {} files for libclang enrichment", jobs.len());
+
+        let worker = {
+            let (stop, remaining) = (Arc::clone(&stop), Arc::clone(&remaining));
+            thread::Builder::new()
+                .name("index-enrichment".to_string())
+                .spawn(move || run_enrichment(jobs, extractor, sink, &stop, &remaining))?
+        };
+
+        Ok(Self {
+            stop,
+            remaining,
+            worker: Some(worker),
+        })
+    }
+
+    /// Files not yet enriched
+    pub fn remaining(&self) -> usize {
+        self.remaining.load(Ordering::Relaxed)
+    }
+
+    /// Blocks until every queued file has been processed
+    pub fn wait(mut self) -> EnrichmentSummary {
+        self.worker
+            .take()
+            .and_then(|worker| worker.join().ok())
+            .unwrap_or_default()
+    }
+}
+
+impl Drop for EnrichmentQueue {
+    fn drop(&mut self) {
+        self.stop.store(true, Ordering::Relaxed);
+    }
+}
+
+fn run_enrichment(
+    jobs: Vec<EnrichmentJob>,
+    mut extractor: SymbolExtractor,
+    mut sink: Box<dyn ChangeSink>,
+    stop: &AtomicBool,
+    remaining: &AtomicUsize,
+) -> EnrichmentSummary {
+    let mut summary = EnrichmentSummary::default();
+
+    for job in jobs {
+        if stop.load(Ordering::Relaxed) {
+            break;
+        }
+
+        match enrich_file(&mut extractor, sink.as_mut(), &job) {
+            Ok(true) => summary.enriched += 1,
+            Ok(false) => summary.stale += 1,
+            Err(error) => {
+                // The file keeps its tree-sitter symbols and is retried next run.
+                warn!("Failed to enrich {}: {}", job.file_path.display(), error);
+                summary.failed += 1;
+            }
+        }
+        remaining.fetch_sub(1, Ordering::Relaxed);
+
+        // Enrichment is never urgent; let other work in first.
+        thread::yield_now();
+    }
+
+    info!(
+        "Enriched {} files with libclang ({} failed, {} changed since queued)",
+        summary.enriched, summary.failed, summary.stale
+    );
+    summary
+}
+
+/// Returns false if the file changed since it was queued: the watcher or the next run
+/// indexes the new version. A same-size edit is not noticed here; it is stored under
+/// the queued hash and replaced once the edit is indexed.
+fn enrich_file(
+    extractor: &mut SymbolExtractor,
+    sink: &mut dyn ChangeSink,
+    job: &EnrichmentJob,
+) -> Result<bool, Box<dyn std::error::Error>> {
+    let content = metrics::time(Stage::Read, || std::fs::read_to_string(&job.file_path))?;
+    if content.len() as u64 != job.size_bytes {
+        return Ok(false);
+    }
+
+    let mut extraction = extractor.extract_symbols_from_content(&job.file_path, &content)?;
+    extraction.content_hash = job.file_hash.clone();
+    // Each file is parsed once; dropping its parser state keeps memory flat over a long queue.
+    extractor.evict_cached_unit(&job.file_path);
+    sink.file_enriched(&job.file_path, &extraction, &job.dependencies)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::lib::cpp_indexer::symbol_extractor::ExtractionResult;
+    use crate::lib::storage::models::file_metadata::ExtractionTier;
+    use std::path::Path;
+    use std::sync::Mutex;
+
+    /// Records the tier of every extraction it receives
+    struct RecordingSink(Arc<Mutex<Vec<(PathBuf, ExtractionTier)>>>);
+
+    impl ChangeSink for RecordingSink {
+        fn file_indexed(&mut self, file_path: &Path, extraction: &ExtractionResult, _: &[PathBuf]) -> Result<(), Box<dyn std::error::Error>> {
+            self.0.lock().unwrap().push((file_path.to_path_buf(), extraction.tier));
+            Ok(())
+        }
+
+        fn file_removed(&mut self, _: &Path) -> Result<(), Box<dyn std::error::Error>> {
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn test_enrichment_stores_semantic_extraction() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let source = temp_dir.path().join("shape.cpp");
+        std::fs::write(&source, "class Shape { public: int sides; };\n").unwrap();
+
+        let stored = Arc::new(Mutex::new(Vec::new()));
+        let edited = temp_dir.path().join("edited.cpp");
+        std::fs::write(&edited, "int edited_since_queued();\n").unwrap();
+
+        let job = |file_path: PathBuf, size_bytes: u64| EnrichmentJob {
+            file_path,
+            dependencies: Vec::new(),
+            file_hash: "0".repeat(32),
+            size_bytes,
+        };
+        let jobs = vec![
+            job(source.clone(), 36),
+            job(temp_dir.path().join("deleted.cpp"), 0),
+            job(edited, 10),
+        ];
+        let extractor = SymbolExtractor::new(None).unwrap().with_unit_cache_limit(0);
+        let queue = EnrichmentQueue::spawn(jobs, extractor, Box::new(RecordingSink(Arc::clone(&stored)))).unwrap();
+
+        assert_eq!(queue.wait(), EnrichmentSummary { enriched: 1, failed: 1, stale: 1 });
+        assert_eq!(*stored.lock().unwrap(), vec![(source, ExtractionTier::Semantic)]);
+    }
+}
@@ -0,0 +1,106 @@
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
+use std::process::Command;
+
+/// Index modes of regular and executable files; symlinks and submodules are skipped
+const FILE_MODES: [&str; 2] = ["100644", "100755"];
+
+/// Blob ids git records for the tracked files of a work tree. A file whose work tree
+/// copy still matches git's index has exactly the content of its blob, so the id can
+/// stand in for a content hash without the file being read.
+#[derive(Debug, Clone, Default)]
+pub struct GitBlobs {
+    blobs: HashMap<PathBuf, String>,
+}
+
+impl GitBlobs {
+    /// Blob ids of the files under `root` that git's index tracks and that are not
+    /// modified in the work tree, keyed by `root` joined with their path. Fails if
+    /// `root` is not inside a git work tree or git cannot be run.
+    pub fn load(root: &Path) -> Result<Self, Box<dyn std::error::Error>> {
+        // Run from `root`, ls-files lists only the files below it, relative to it.
+        let staged = git(root, &["ls-files", "--stage", "-z"])?;
+        let mut blobs = HashMap::new();
+        for entry in staged.split('\0').filter(|entry| !entry.is_empty()) {
+            let Some((info, path)) = entry.split_once('\t') else {
+                continue;
+            };
+            let mut fields = info.split(' ');
+            let (Some(mode), Some(blob_id), Some(stage)) = (fields.next(), fields.next(), fields.next()) else {
+                continue;
+            };
+            // Unmerged paths only have entries for stages 1 to 3.
+            if stage == "0" && FILE_MODES.contains(&mode) {
+                blobs.insert(root.join(path), blob_id.to_string());
+            }
+        }
+
+        // Edited or deleted since they were staged: the blob no longer describes them.
+        let modified = git(root, &["ls-files", "--modified", "-z"])?;
+        for path in modified.split('\0').filter(|path| !path.is_empty()) {
+            blobs.remove(&root.join(path));
+        }
+
+        Ok(Self { blobs })
+    }
+
+    /// Blob id of `path` if git vouches for its current content
+    pub fn get(&self, path: &Path) -> Option<&str> {
+        self.blobs.get(path).map(String::as_str)
+    }
+
+    pub fn len(&self) -> usize {
+        self.blobs.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.blobs.is_empty()
+    }
+}
+
+fn git(root: &Path, args: &[&str]) -> Result<String, Box<dyn std::error::Error>> {
+    let output = Command::new("git")
+        .arg("-C")
+        .arg(root)
+        .args(args)
+        .output()
+        .map_err(|e| format!("Failed to run git: {}", e))?;
+    if !output.status.success() {
+        return Err(format!(
+            "git {} failed in {}: {}",
+            args.join(" "), root.display(), String::from_utf8_lossy(&output.stderr).trim()
+        ).into());
+    }
+    Ok(String::from_utf8(output.stdout)?)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::fs;
+
+    #[test]
+    fn test_blob_ids_of_unmodified_files() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let root = temp_dir.path();
+        if git(root, &["init", "-q"]).is_err() {
+            return; // git is not installed
+        }
+        fs::create_dir(root.join("src")).unwrap();
+        fs::write(root.join("src/main.cpp"), "hello\n").unwrap();
+        fs::write(root.join("src/util.cpp"), "int util();\n").unwrap();
+        fs::write(root.join("untracked.cpp"), "int x;\n").unwrap();
+        git(root, &["add", "src"]).unwrap();
+        fs::write(root.join("src/util.cpp"), "int util(int);\n").unwrap();
+
+        let blobs = GitBlobs::load(root).unwrap();
+        assert_eq!(blobs.get(&root.join("src/main.cpp")), Some("ce013625030ba8dba906f756967f9e9ca394464a"));
+        assert_eq!(blobs.get(&root.join("src/util.cpp")), None);
+        assert_eq!(blobs.get(&root.join("untracked.cpp")), None);
+
+        // Listing from a subdirectory keys the same files by the same paths
+        let nested = GitBlobs::load(&root.join("src")).unwrap();
+        assert_eq!(nested.get(&root.join("src/main.cpp")), blobs.get(&root.join("src/main.cpp")));
+        assert_eq!(nested.len(), 1);
+    }
+}
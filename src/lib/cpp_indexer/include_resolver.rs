@@ -0,0 +1,144 @@
+use crate::lib::cpp_indexer::compilation_database::{normalize_path, CompilationDatabase};
+use std::collections::{HashMap, HashSet};
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+
+/// Search-path options in the order the preprocessor consults them
+const SEARCH_OPTIONS: [&str; 4] = ["-iquote", "-I", "-isystem", "-idirafter"];
+
+/// Maps `#include` operands to files the way the preprocessor searches for them:
+/// the including file's directory first, then the `-iquote`, `-I`, `-isystem` and
+/// `-idirafter` directories, each in command-line order. Includes are recorded
+/// without their delimiters, so `<...>` includes also try the including directory.
+#[derive(Debug, Default)]
+pub struct IncludeResolver {
+    /// Directories from the indexer's own compile flags
+    search_dirs: Vec<PathBuf>,
+    compilation_database: Option<Arc<CompilationDatabase>>,
+    /// Directories for files without a compile command, e.g. headers: those of
+    /// every command, since a header is compiled as part of some translation unit
+    fallback_dirs: Vec<PathBuf>,
+    /// Whether each probed path is a file; cleared per indexing run
+    probed: HashMap<PathBuf, bool>,
+}
+
+impl IncludeResolver {
+    pub fn new(compile_flags: &[String]) -> Self {
+        let search_dirs = search_dirs(compile_flags);
+        Self {
+            fallback_dirs: search_dirs.clone(),
+            search_dirs,
+            ..Self::default()
+        }
+    }
+
+    pub fn with_compilation_database(mut self, compilation_database: Arc<CompilationDatabase>) -> Self {
+        let mut seen = HashSet::new();
+        self.fallback_dirs = compilation_database
+            .all_flags()
+            .flat_map(search_dirs)
+            .chain(self.search_dirs.iter().cloned())
+            .filter(|dir| seen.insert(dir.clone()))
+            .collect();
+        self.compilation_database = Some(compilation_database);
+        self
+    }
+
+    /// Forgets which files exist, so files created or deleted since are noticed
+    pub fn clear_cache(&mut self) {
+        self.probed.clear();
+    }
+
+    /// The file `include` refers to when `including_file` includes it, or `None`
+    /// when it is not found on the search path (e.g. system headers)
+    pub fn resolve(&mut self, including_file: &Path, include: &str) -> Option<PathBuf> {
+        let include = Path::new(include);
+        if include.is_absolute() {
+            let candidate = normalize_path(include);
+            return self.is_file(&candidate).then_some(candidate);
+        }
+
+        let command_dirs = self
+            .compilation_database
+            .as_ref()
+            .and_then(|database| database.flags_for(including_file))
+            .map(search_dirs);
+        let dirs = command_dirs.unwrap_or_else(|| self.fallback_dirs.clone());
+
+        including_file
+            .parent()
+            .into_iter()
+            .map(Path::to_path_buf)
+            .chain(dirs)
+            .map(|dir| normalize_path(&dir.join(include)))
+            .find(|candidate| self.is_file(candidate))
+    }
+
+    fn is_file(&mut self, candidate: &Path) -> bool {
+        if let Some(&exists) = self.probed.get(candidate) {
+            return exists;
+        }
+        let exists = candidate.is_file();
+        self.probed.insert(candidate.to_path_buf(), exists);
+        exists
+    }
+}
+
+/// Include search directories named in `flags`, separate (`-I dir`) or fused (`-Idir`)
+fn search_dirs(flags: &[String]) -> Vec<PathBuf> {
+    let mut by_option: [Vec<PathBuf>; SEARCH_OPTIONS.len()] = Default::default();
+    let mut flags = flags.iter();
+
+    while let Some(flag) = flags.next() {
+        for (slot, option) in SEARCH_OPTIONS.iter().enumerate() {
+            if flag == option {
+                if let Some(dir) = flags.next() {
+                    by_option[slot].push(PathBuf::from(dir));
+                }
+                break;
+            }
+            if let Some(dir) = flag.strip_prefix(option).filter(|dir| !dir.is_empty()) {
+                by_option[slot].push(PathBuf::from(dir));
+                break;
+            }
+        }
+    }
+
+    by_option.into_iter().flatten().collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_search_dirs_keep_preprocessor_order() {
+        let flags: Vec<String> = ["-isystem", "/sys", "-Isrc", "-iquote", "quoted", "-DNAME", "-I", "/abs", "-idirafter/late"]
+            .iter()
+            .map(|flag| flag.to_string())
+            .collect();
+
+        let dirs = search_dirs(&flags);
+        assert_eq!(dirs, ["quoted", "src", "/abs", "/sys", "/late"].iter().map(PathBuf::from).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_resolve_prefers_including_directory() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let root = temp_dir.path();
+        std::fs::create_dir_all(root.join("src")).unwrap();
+        std::fs::create_dir_all(root.join("include/util")).unwrap();
+        std::fs::write(root.join("src/config.h"), "").unwrap();
+        std::fs::write(root.join("include/config.h"), "").unwrap();
+        std::fs::write(root.join("include/util/log.h"), "").unwrap();
+
+        let flags = vec![format!("-I{}", root.join("include").display())];
+        let mut resolver = IncludeResolver::new(&flags);
+        let main = root.join("src/main.cpp");
+
+        assert_eq!(resolver.resolve(&main, "config.h"), Some(root.join("src/config.h")));
+        assert_eq!(resolver.resolve(&main, "util/log.h"), Some(root.join("include/util/log.h")));
+        assert_eq!(resolver.resolve(&main, "../include/util/log.h"), Some(root.join("include/util/log.h")));
+        assert_eq!(resolver.resolve(&main, "vector"), None);
+    }
+}
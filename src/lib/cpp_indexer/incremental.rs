@@ -1,227 +1,571 @@
-use crate::lib::cpp_indexer::symbol_extractor::{SymbolExtractor, ExtractedSymbol};
-use crate::lib::storage::models::file_metadata::FileMetadata;
+use crate::lib::cpp_indexer::clang_parser::ReferenceEdge;
+use crate::lib::cpp_indexer::compilation_database::CompilationDatabase;
+use crate::lib::cpp_indexer::dependency_graph::DependencyGraph;
+use crate::lib::cpp_indexer::git_blobs::GitBlobs;
+use crate::lib::cpp_indexer::include_resolver::IncludeResolver;
+use crate::lib::cpp_indexer::memory_budget::{MemoryBudget, Reservation};
+use crate::lib::cpp_indexer::merkle_tree::{FileNode, FileStat, MerkleTree};
+use crate::lib::cpp_indexer::pch_cache::{PchCache, PchCacheStats};
+use crate::lib::cpp_indexer::shard::ShardSpec;
+use crate::lib::cpp_indexer::symbol_extractor::{SymbolExtractor, ExtractedSymbol, ExtractionResult};
+use crate::lib::cpp_indexer::watcher::ChangeSink;
+use crate::lib::storage::models::file_metadata::{ExtractionTier, FileMetadata};
+use crate::lib::metrics::{self, Stage};
 use sha2::{Sha256, Digest};
-use std::collections::{HashMap, HashSet};
+use std::collections::{BTreeMap, HashMap, HashSet};
 use std::path::{Path, PathBuf};
-use std::time::{SystemTime, UNIX_EPOCH};
-use tokio::fs;
-use tokio::time::Instant;
+use std::sync::{Arc, Mutex};
+use std::time::{Instant, SystemTime, UNIX_EPOCH};
+use tokio::sync::mpsc;
+use tokio::task;
+use tracing::{debug, info};
+use walkdir::WalkDir;
+use xxhash_rust::xxh3::xxh3_128;
 
-#[derive(Debug, Clone)]
-pub struct FileNode {
-    pub path: PathBuf,
-    pub content_hash: String,
-    pub metadata_hash: String,
-    pub last_modified: u64,
-    pub size: u64,
-    pub dependencies: Vec<PathBuf>,
-    pub dependents: Vec<PathBuf>,
-    pub symbols_hash: String,
-}
+/// File extensions picked up by directory indexing.
+const CPP_EXTENSIONS: [&str; 7] = ["cpp", "cxx", "cc", "c", "hpp", "hxx", "h"];
 
-#[derive(Debug, Clone)]
-pub struct MerkleNode {
-    pub hash: String,
-    pub file_path: Option<PathBuf>,
-    pub children: Vec<String>,
-    pub is_leaf: bool,
-    pub last_updated: u64,
-}
+/// Subset of `CPP_EXTENSIONS` that only reach the compiler through an `#include`.
+const HEADER_EXTENSIONS: [&str; 3] = ["hpp", "hxx", "h"];
 
-#[derive(Debug)]
-pub struct MerkleTree {
-    nodes: HashMap<String, MerkleNode>,
-    root_hash: Option<String>,
-    file_to_hash: HashMap<PathBuf, String>,
+/// Files whose syntax trees are kept for incremental re-parsing of single-file updates;
+/// directory pipeline workers keep none.
+const TREE_CACHE_FILES: usize = 32;
+
+/// Bounded queue slots per parse worker between pipeline stages.
+const QUEUE_SLOTS_PER_WORKER: usize = 2;
+
+/// Estimated memory a file holds from being read until it is stored: a fixed share for
+/// parser state plus a multiple of its size for the text, syntax tree and symbols.
+const FILE_OVERHEAD_BYTES: usize = 1024 * 1024;
+const BYTES_PER_SOURCE_BYTE: usize = 16;
+
+/// Fraction of the memory budget the file cache may use before evicting entries.
+const FILE_CACHE_BUDGET_DIVISOR: usize = 8;
+
+pub struct IncrementalIndexer {
+    symbol_extractor: SymbolExtractor,
+    compile_flags: Option<Vec<String>>,
+    max_concurrent_tasks: usize,
+    pch_cache: Option<Arc<PchCache>>,
+    compilation_database: Option<Arc<CompilationDatabase>>,
+    current_tree: MerkleTree,
+    state_path: Option<PathBuf>,
+    file_cache: HashMap<PathBuf, CachedFile>,
+    /// Cached paths by last use, evicted oldest first
+    file_cache_recency: BTreeMap<u64, PathBuf>,
+    file_cache_clock: u64,
+    file_cache_bytes: usize,
+    dependency_graph: DependencyGraph,
+    include_resolver: IncludeResolver,
+    /// Directory runs store tree-sitter symbols only, leaving libclang to enrichment
+    defer_enrichment: bool,
+    /// Directory runs only visit this shard's files
+    shard: Option<Arc<ShardSpec>>,
+    /// Bounds the files in flight through directory runs and the size of `file_cache`
+    memory_budget: Option<Arc<MemoryBudget>>,
+    /// Directory runs take content hashes of clean tracked files from git
+    git_hashes: bool,
+    /// Tree of the base index when this indexer builds an overlay
+    base_tree: Option<MerkleTree>,
 }
 
-impl MerkleTree {
-    pub fn new() -> Self {
-        Self {
-            nodes: HashMap::new(),
-            root_hash: None,
-            file_to_hash: HashMap::new(),
-        }
+impl IncrementalIndexer {
+    pub fn new(compile_flags: Option<Vec<String>>) -> Result<Self, Box<dyn std::error::Error>> {
+        let symbol_extractor = SymbolExtractor::new(compile_flags.clone())?.with_tree_cache(TREE_CACHE_FILES);
+        let include_resolver = IncludeResolver::new(compile_flags.as_deref().unwrap_or_default());
+        
+        Ok(Self {
+            symbol_extractor,
+            compile_flags,
+            max_concurrent_tasks: num_cpus::get(),
+            pch_cache: None,
+            compilation_database: None,
+            current_tree: MerkleTree::new(),
+            state_path: None,
+            file_cache: HashMap::new(),
+            file_cache_recency: BTreeMap::new(),
+            file_cache_clock: 0,
+            file_cache_bytes: 0,
+            dependency_graph: DependencyGraph::new(),
+            include_resolver,
+            defer_enrichment: false,
+            shard: None,
+            memory_budget: None,
+            git_hashes: false,
+            base_tree: None,
+        })
     }
 
-    pub fn add_file_node(&mut self, file_node: FileNode) -> Result<(), Box<dyn std::error::Error>> {
-        let hash = self.compute_file_hash(&file_node)?;
-        
-        let merkle_node = MerkleNode {
-            hash: hash.clone(),
-            file_path: Some(file_node.path.clone()),
-            children: Vec::new(),
-            is_leaf: true,
-            last_updated: file_node.last_modified,
-        };
-        
-        self.nodes.insert(hash.clone(), merkle_node);
-        self.file_to_hash.insert(file_node.path, hash);
-        
-        self.recompute_root()?;
-        Ok(())
+    /// Restores the include graph persisted by a previous run, as `(file, included file)`
+    /// pairs, so changes to a header reach files indexed before the restart
+    pub fn with_dependencies(mut self, edges: impl IntoIterator<Item = (PathBuf, PathBuf)>) -> Self {
+        self.dependency_graph = DependencyGraph::from_edges(edges);
+        self
     }
 
-    pub fn remove_file_node(&mut self, file_path: &Path) -> Result<(), Box<dyn std::error::Error>> {
-        if let Some(hash) = self.file_to_hash.remove(file_path) {
-            self.nodes.remove(&hash);
-            self.recompute_root()?;
-        }
-        Ok(())
+    /// Files `file_path` includes, resolved against the include search path where possible
+    pub fn dependencies_of(&self, file_path: &Path) -> Vec<PathBuf> {
+        self.dependency_graph.includes_of(file_path)
     }
 
-    fn compute_file_hash(&self, file_node: &FileNode) -> Result<String, Box<dyn std::error::Error>> {
-        let mut hasher = Sha256::new();
-        hasher.update(&file_node.content_hash);
-        hasher.update(&file_node.metadata_hash);
-        hasher.update(&file_node.symbols_hash);
-        hasher.update(&file_node.last_modified.to_be_bytes());
-        
-        for dep in &file_node.dependencies {
-            hasher.update(dep.to_string_lossy().as_bytes());
+    /// Caps the number of parse workers used by `update_directory`
+    pub fn with_max_concurrent_tasks(mut self, max_concurrent_tasks: usize) -> Self {
+        self.max_concurrent_tasks = max_concurrent_tasks.max(1);
+        self
+    }
+
+    /// Restores the Merkle tree saved at `state_path` by a previous run, so unchanged files
+    /// are skipped after a restart; `update_directory` saves the tree back there
+    pub fn with_state_path(mut self, state_path: PathBuf) -> Result<Self, Box<dyn std::error::Error>> {
+        self.current_tree = MerkleTree::load(&state_path)?;
+        self.state_path = Some(state_path);
+        Ok(self)
+    }
+
+    /// Writes the current Merkle tree to the configured state path, if any
+    pub fn save_state(&self) -> Result<(), Box<dyn std::error::Error>> {
+        match &self.state_path {
+            Some(state_path) => self.current_tree.save(state_path),
+            None => Ok(()),
         }
-        
-        Ok(format!("{:x}", hasher.finalize()))
     }
 
-    fn recompute_root(&mut self) -> Result<(), Box<dyn std::error::Error>> {
-        let leaf_hashes: Vec<String> = self.nodes
-            .iter()
-            .filter(|(_, node)| node.is_leaf)
-            .map(|(hash, _)| hash.clone())
-            .collect();
+    /// Enables the shared precompiled-header cache for every parser this indexer creates
+    pub fn with_pch_cache(mut self, pch_cache: Arc<PchCache>) -> Self {
+        self.symbol_extractor = self.symbol_extractor.with_pch_cache(Arc::clone(&pch_cache));
+        self.pch_cache = Some(pch_cache);
+        self
+    }
+
+    /// Parses every file with its own compile command and indexes translation units before
+    /// headers, so `update_directory` stores headers with the semantics of the first
+    /// translation unit that includes them instead of parsing them again
+    pub fn with_compilation_database(mut self, compilation_database: Arc<CompilationDatabase>) -> Self {
+        self.symbol_extractor = self.symbol_extractor.with_compilation_database(Arc::clone(&compilation_database));
+        self.include_resolver = std::mem::take(&mut self.include_resolver).with_compilation_database(Arc::clone(&compilation_database));
+        self.compilation_database = Some(compilation_database);
+        self
+    }
+
+    /// Makes `update_directory` run tree-sitter only, so a fresh index is queryable as
+    /// soon as every file is stored; the results come back in the syntax tier for an
+    /// `EnrichmentQueue` to upgrade. Single-file updates keep the full extraction.
+    pub fn with_deferred_enrichment(mut self, defer_enrichment: bool) -> Self {
+        self.defer_enrichment = defer_enrichment;
+        self
+    }
+
+    /// Restricts `update_directory` to the files of `shard`, so the index built is one
+    /// part of a codebase split across several machines. Tracked files outside the
+    /// shard are treated as removed.
+    pub fn with_shard(mut self, shard: ShardSpec) -> Self {
+        self.shard = Some(Arc::new(shard));
+        self
+    }
+
+    /// Bounds the files in flight through directory runs. Filter workers wait for room
+    /// in `budget` before reading a file, and the room is returned once the file is
+    /// stored, so intake slows to the pace of the sink. The file cache is kept to a
+    /// share of the budget; evicted files are still known by their Merkle leaves.
+    /// This is not a cap on the indexer's memory: the Merkle tree, the dependency graph
+    /// and the header semantics a compilation database run collects are not counted,
+    /// so peak memory still grows with the number of files.
+    pub fn with_memory_budget(mut self, budget: Arc<MemoryBudget>) -> Self {
+        self.memory_budget = Some(budget);
+        self.evict_file_cache();
+        self
+    }
+
+    /// Uses the blob ids in git's index as the content hashes of tracked files that are
+    /// not modified in the work tree, so directory runs neither read nor hash them to
+    /// learn whether they changed. Outside a git work tree files are hashed as before.
+    /// Files last hashed without git are parsed once more when first seen with it.
+    pub fn with_git_hashes(mut self, git_hashes: bool) -> Self {
+        self.git_hashes = git_hashes;
+        self
+    }
+
+    /// Builds an overlay over the index `base` was saved for, with its paths already
+    /// under the directory to index. Directory runs then only index files whose content
+    /// differs from the base, drop tracked files that match the base again, and report
+    /// base files missing from the directory through `ChangeSink::base_file_removed`.
+    pub fn with_base_tree(mut self, base: MerkleTree) -> Self {
+        self.base_tree = Some(base);
+        self
+    }
+
+    /// Extractor with this indexer's parser settings, for the libclang enrichment pass
+    pub fn enrichment_extractor(&self) -> Result<SymbolExtractor, Box<dyn std::error::Error>> {
+        ParserSettings { syntax_only: false, ..self.parser_settings() }.build_extractor()
+    }
+
+    pub async fn index_file(&mut self, file_path: &Path) -> Result<IncrementalResult, Box<dyn std::error::Error>> {
+        Ok(self.index_file_with_symbols(file_path).await?.0)
+    }
+
+    /// Like `index_file`, also handing back the extraction when the file was re-parsed
+    pub async fn index_file_with_symbols(
+        &mut self,
+        file_path: &Path,
+    ) -> Result<(IncrementalResult, Option<ExtractionResult>), Box<dyn std::error::Error>> {
+        self.index_file_checked(file_path, false).await
+    }
+
+    /// Re-parses a file even if it is unchanged, e.g. because a header it includes changed
+    pub async fn reparse_file(
+        &mut self,
+        file_path: &Path,
+    ) -> Result<(IncrementalResult, Option<ExtractionResult>), Box<dyn std::error::Error>> {
+        self.index_file_checked(file_path, true).await
+    }
+
+    async fn index_file_checked(
+        &mut self,
+        file_path: &Path,
+        force: bool,
+    ) -> Result<(IncrementalResult, Option<ExtractionResult>), Box<dyn std::error::Error>> {
+        let start_time = Instant::now();
+        self.include_resolver.clear_cache();
         
-        if leaf_hashes.is_empty() {
-            self.root_hash = None;
-            return Ok(());
-        }
+        let path = file_path.to_path_buf();
+        let known = if force { None } else { self.cached_state(file_path) };
+        let check = task::spawn_blocking(move || check_file(&path, known.as_ref(), None, None).map_err(|e| e.to_string())).await??;
         
-        self.root_hash = Some(self.compute_tree_hash(&leaf_hashes)?);
-        Ok(())
+        match check {
+            FileCheck::Unchanged => Ok((skipped_result(file_path, start_time), None)),
+            FileCheck::Touched(stat) => {
+                self.record_stat(file_path, stat);
+                Ok((skipped_result(file_path, start_time), None))
+            }
+            FileCheck::Changed(changed) => {
+                let content = String::from_utf8(changed.content)?;
+                let mut extraction_result = self.symbol_extractor.extract_symbols_from_content(file_path, &content)?;
+                extraction_result.content_hash = changed.content_hash.clone();
+                
+                let result = self.merge_extraction(file_path, changed.metadata, changed.stat, changed.content_hash, &extraction_result, start_time)?;
+                Ok((result, Some(extraction_result)))
+            }
+        }
     }
 
-    fn compute_tree_hash(&mut self, hashes: &[String]) -> Result<String, Box<dyn std::error::Error>> {
-        if hashes.is_empty() {
-            return Ok(String::new());
-        }
+    pub async fn remove_file(&mut self, file_path: &Path) -> Result<IncrementalResult, Box<dyn std::error::Error>> {
+        let start_time = Instant::now();
         
-        if hashes.len() == 1 {
-            return Ok(hashes[0].clone());
-        }
+        let affected_files = self.get_affected_files(file_path)?;
         
-        let mut next_level = Vec::new();
+        self.uncache_file_node(file_path);
+        self.symbol_extractor.evict_cached_unit(file_path);
+        self.current_tree.remove_file_node(file_path)?;
+        self.dependency_graph.remove_file(file_path);
         
-        for chunk in hashes.chunks(2) {
-            let combined_hash = if chunk.len() == 2 {
-                self.combine_hashes(&chunk[0], &chunk[1])?
-            } else {
-                chunk[0].clone()
-            };
-            
-            let merkle_node = MerkleNode {
-                hash: combined_hash.clone(),
-                file_path: None,
-                children: chunk.iter().map(|h| h.clone()).collect(),
-                is_leaf: false,
-                last_updated: SystemTime::now().duration_since(UNIX_EPOCH)?.as_secs(),
-            };
-            
-            self.nodes.insert(combined_hash.clone(), merkle_node);
-            next_level.push(combined_hash);
-        }
+        let processing_time = start_time.elapsed();
         
-        self.compute_tree_hash(&next_level)
+        Ok(IncrementalResult {
+            file_path: file_path.to_path_buf(),
+            action: IndexAction::Removed,
+            affected_files,
+            symbols_extracted: 0,
+            processing_time_ms: processing_time.as_millis() as u32,
+        })
     }
 
-    fn combine_hashes(&self, hash1: &str, hash2: &str) -> Result<String, Box<dyn std::error::Error>> {
-        let mut hasher = Sha256::new();
-        hasher.update(hash1.as_bytes());
-        hasher.update(hash2.as_bytes());
-        Ok(format!("{:x}", hasher.finalize()))
+    /// Indexes a directory tree through a staged pipeline:
+    /// discovery -> hash/skip filter -> parse workers -> merge (this task).
+    ///
+    /// With a compilation database the tree is indexed in two passes: translation units
+    /// first, then headers. libclang's symbols and declaration edges for a header are
+    /// taken from the first TU that included it, so such a header only gets the
+    /// tree-sitter pass and is stored with both; the rest still get a full parse.
+    pub async fn update_directory(&mut self, directory_path: &Path) -> Result<Vec<IncrementalResult>, Box<dyn std::error::Error>> {
+        self.update_directory_into(directory_path, &mut DiscardChanges).await
     }
 
-    pub fn get_root_hash(&self) -> Option<&String> {
-        self.root_hash.as_ref()
+    /// Like `update_directory`, handing each file to `sink` as soon as it is merged, so
+    /// stored results become visible while the rest of the tree is still being parsed
+    pub async fn update_directory_into(
+        &mut self,
+        directory_path: &Path,
+        sink: &mut dyn ChangeSink,
+    ) -> Result<Vec<IncrementalResult>, Box<dyn std::error::Error>> {
+        let root = directory_path.to_path_buf();
+        self.include_resolver.clear_cache();
+        let git_blobs = self.load_git_blobs(&root).await;
+        
+        let mut header_semantics = HashMap::new();
+        let mut results = if self.compilation_database.is_some() {
+            let (mut results, headers) = self
+                .run_pipeline(PipelineInput::Directory { root, defer_headers: true }, HashSet::new(), git_blobs.clone(), &mut header_semantics, sink)
+                .await?;
+            let syntax_only: HashSet<PathBuf> = headers
+                .iter()
+                .filter(|header| header_semantics.contains_key(*header))
+                .cloned()
+                .collect();
+            
+            info!(
+                "{} of {} headers are covered by an indexed translation unit",
+                syntax_only.len(), headers.len()
+            );
+            
+            let (header_results, _) = self
+                .run_pipeline(PipelineInput::Files(headers), syntax_only, git_blobs, &mut header_semantics, sink)
+                .await?;
+            results.extend(header_results);
+            results
+        } else {
+            self.run_pipeline(PipelineInput::Directory { root, defer_headers: false }, HashSet::new(), git_blobs, &mut header_semantics, sink)
+                .await?
+                .0
+        };
+        
+        // Files the tree still remembers under this root but discovery no longer found
+        // were deleted, possibly while the indexer was not running.
+        let seen: HashSet<&Path> = results.iter().map(|result| result.file_path.as_path()).collect();
+        let vanished: Vec<PathBuf> = self.current_tree
+            .files()
+            .into_iter()
+            .map(|(path, _)| path)
+            .filter(|path| path.starts_with(directory_path) && !seen.contains(path.as_path()))
+            .collect();
+        let removed_from_base: Vec<PathBuf> = self.base_tree
+            .iter()
+            .flat_map(|base| base.files_under(directory_path))
+            .map(|(path, _)| path)
+            .filter(|path| !seen.contains(path.as_path()))
+            .collect();
+        for path in vanished {
+            results.push(self.remove_file(&path).await?);
+            sink.file_removed(&path)?;
+        }
+        for path in removed_from_base {
+            sink.base_file_removed(&path)?;
+        }
+        
+        results.sort_by(|a, b| a.file_path.cmp(&b.file_path));
+        sink.flush()?;
+        self.save_state()?;
+        sink.batch_applied(self.current_tree.get_root_hash().map(String::as_str));
+        
+        let indexed = results.iter().filter(|result| matches!(result.action, IndexAction::Indexed)).count();
+        match self.pch_cache.as_ref().map(|cache| cache.stats()) {
+            Some(stats) => info!(
+                "Indexed {} of {} files in {}; PCH cache hit rate {:.1}% ({} hits, {} misses)",
+                indexed, results.len(), directory_path.display(),
+                stats.hit_rate() * 100.0, stats.hits, stats.misses
+            ),
+            None => info!("Indexed {} of {} files in {}", indexed, results.len(), directory_path.display()),
+        }
+        if let Some(budget) = &self.memory_budget {
+            info!(
+                "Peak in-flight file memory {} of {} MiB; file cache holds {} files",
+                budget.peak() / (1024 * 1024), budget.limit() / (1024 * 1024), self.file_cache.len()
+            );
+        }
+        
+        Ok(results)
     }
 
-    pub fn has_changed(&self, other_root_hash: &str) -> bool {
-        match &self.root_hash {
-            Some(root) => root != other_root_hash,
-            None => !other_root_hash.is_empty(),
+    /// Blob ids of the clean tracked files under `root`, when git hashes are enabled
+    /// and `root` is in a git work tree
+    async fn load_git_blobs(&self, root: &Path) -> Option<Arc<GitBlobs>> {
+        if !self.git_hashes {
+            return None;
+        }
+        let root = root.to_path_buf();
+        match task::spawn_blocking(move || GitBlobs::load(&root).map_err(|e| e.to_string())).await {
+            Ok(Ok(blobs)) => {
+                info!("Git vouches for the content of {} tracked files", blobs.len());
+                Some(Arc::new(blobs))
+            }
+            Ok(Err(error)) => {
+                debug!("Hashing file contents; git blob ids are unavailable: {}", error);
+                None
+            }
+            Err(_) => None,
         }
     }
 
-    pub fn get_changed_files(&self, other: &MerkleTree) -> Vec<PathBuf> {
-        let mut changed_files = Vec::new();
+    /// Runs one pipeline pass, returning its results and any headers discovery deferred.
+    /// A pass that defers headers collects what its TUs found in them into
+    /// `header_semantics`; any other pass stores collected semantics with their header.
+    async fn run_pipeline(
+        &mut self,
+        input: PipelineInput,
+        syntax_only: HashSet<PathBuf>,
+        git_blobs: Option<Arc<GitBlobs>>,
+        header_semantics: &mut HashMap<PathBuf, HeaderSemantics>,
+        sink: &mut dyn ChangeSink,
+    ) -> Result<(Vec<IncrementalResult>, Vec<PathBuf>), Box<dyn std::error::Error>> {
+        let parse_workers = self.max_concurrent_tasks.max(1);
+        let filter_workers = (parse_workers / 2).max(1);
+        let queue_depth = parse_workers * QUEUE_SLOTS_PER_WORKER;
+        
+        let (path_tx, path_rx) = mpsc::channel::<PathBuf>(queue_depth);
+        let (parse_tx, parse_rx) = mpsc::channel::<PendingFile>(queue_depth);
+        let (output_tx, mut output_rx) = mpsc::channel::<StageOutput>(queue_depth);
+        let path_rx = Arc::new(Mutex::new(path_rx));
+        let parse_rx = Arc::new(Mutex::new(parse_rx));
+        
+        // Files restored from a persisted tree are only known by their leaves.
+        let mut known_files: HashMap<PathBuf, KnownFile> = self.current_tree
+            .files()
+            .into_iter()
+            .filter_map(|(path, leaf)| Some((path, (leaf.stat.unwrap_or_default(), leaf.content_hash.clone()?))))
+            .collect();
+        known_files.extend(
+            self.file_cache
+                .iter()
+                .map(|(path, cached)| (path.clone(), (cached.node.stat, cached.node.content_hash.clone())))
+        );
+        let base_files: HashMap<PathBuf, KnownFile> = self.base_tree
+            .iter()
+            .flat_map(MerkleTree::files)
+            .filter_map(|(path, leaf)| Some((path, (leaf.stat.unwrap_or_default(), leaf.content_hash.clone()?))))
+            .collect();
+        let filter = Arc::new(FilterState {
+            known_files,
+            base_files,
+            git_blobs,
+            syntax_only,
+            budget: self.memory_budget.clone(),
+        });
+        
+        let collect_headers_under = match &input {
+            PipelineInput::Directory { root, defer_headers: true } => Some(root.clone()),
+            _ => None,
+        };
+        let discovery_output = output_tx.clone();
+        let shard = self.shard.clone();
+        let discovery = task::spawn_blocking(move || match input {
+            PipelineInput::Directory { root, defer_headers } => {
+                discover_files(&root, defer_headers, shard.as_deref(), &path_tx, &discovery_output)
+            }
+            PipelineInput::Files(files) => {
+                for file in files {
+                    if path_tx.blocking_send(file).is_err() {
+                        break;
+                    }
+                }
+                Vec::new()
+            }
+        });
         
-        for (path, hash) in &self.file_to_hash {
-            match other.file_to_hash.get(path) {
-                Some(other_hash) if hash != other_hash => {
-                    changed_files.push(path.clone());
+        for _ in 0..filter_workers {
+            let paths = Arc::clone(&path_rx);
+            let filter = Arc::clone(&filter);
+            let parse_tx = parse_tx.clone();
+            let output_tx = output_tx.clone();
+            task::spawn_blocking(move || run_filter_worker(&paths, &filter, &parse_tx, &output_tx));
+        }
+        
+        for _ in 0..parse_workers {
+            let files = Arc::clone(&parse_rx);
+            let output_tx = output_tx.clone();
+            let settings = self.parser_settings();
+            task::spawn_blocking(move || run_parse_worker(settings, &files, &output_tx));
+        }
+        
+        drop(parse_tx);
+        drop(output_tx);
+        
+        // Single merge stage: the only place shared indexer state is mutated.
+        // Returning early drops the receiver, which unwinds every upstream stage.
+        let mut results = Vec::new();
+        while let Some(output) = output_rx.recv().await {
+            match output {
+                StageOutput::Skipped(result) => results.push(result),
+                StageOutput::Touched { path, stat, started } => {
+                    self.record_stat(&path, stat);
+                    results.push(skipped_result(&path, started));
                 }
-                None => {
-                    changed_files.push(path.clone());
+                StageOutput::MatchesBase { path, started } => {
+                    // The overlay's copy is dropped so queries see the base's again.
+                    self.remove_file(&path).await?;
+                    sink.file_removed(&path)?;
+                    results.push(skipped_result(&path, started));
                 }
-                _ => {}
+                StageOutput::Parsed(mut parsed) => {
+                    match &collect_headers_under {
+                        Some(root) => collect_header_semantics(&parsed.extraction, root, header_semantics),
+                        None => {
+                            if let Some(semantics) = header_semantics.remove(&parsed.path) {
+                                adopt_header_semantics(&mut parsed.extraction, semantics);
+                            }
+                        }
+                    }
+                    let result = self.merge_extraction(
+                        &parsed.path,
+                        parsed.metadata,
+                        parsed.stat,
+                        parsed.content_hash,
+                        &parsed.extraction,
+                        parsed.started,
+                    )?;
+                    sink.file_indexed(&parsed.path, &parsed.extraction, &self.dependency_graph.includes_of(&parsed.path))?;
+                    // The file is stored; its reservation goes back to the budget here.
+                    drop(parsed.reservation);
+                    results.push(result);
+                }
+                StageOutput::Failed(error) => return Err(error.into()),
             }
         }
         
-        changed_files
+        let deferred_headers = discovery.await?;
+        Ok((results, deferred_headers))
     }
-}
 
-pub struct IncrementalIndexer {
-    symbol_extractor: SymbolExtractor,
-    current_tree: MerkleTree,
-    file_cache: HashMap<PathBuf, FileNode>,
-    dependency_graph: HashMap<PathBuf, HashSet<PathBuf>>,
-}
+    fn parser_settings(&self) -> ParserSettings {
+        ParserSettings {
+            compile_flags: self.compile_flags.clone(),
+            pch_cache: self.pch_cache.clone(),
+            compilation_database: self.compilation_database.clone(),
+            syntax_only: self.defer_enrichment,
+        }
+    }
 
-impl IncrementalIndexer {
-    pub fn new(compile_flags: Option<Vec<String>>) -> Result<Self, Box<dyn std::error::Error>> {
-        let symbol_extractor = SymbolExtractor::new(compile_flags)?;
-        
-        Ok(Self {
-            symbol_extractor,
-            current_tree: MerkleTree::new(),
-            file_cache: HashMap::new(),
-            dependency_graph: HashMap::new(),
-        })
+    /// Stat and content hash recorded for a file, from this session or a restored tree
+    fn cached_state(&self, file_path: &Path) -> Option<KnownFile> {
+        match self.file_cache.get(file_path) {
+            Some(cached) => Some((cached.node.stat, cached.node.content_hash.clone())),
+            None => self.current_tree
+                .get_file(file_path)
+                .and_then(|leaf| Some((leaf.stat.unwrap_or_default(), leaf.content_hash.clone()?))),
+        }
     }
 
-    pub async fn index_file(&mut self, file_path: &Path) -> Result<IncrementalResult, Box<dyn std::error::Error>> {
-        let start_time = Instant::now();
-        
-        let file_metadata = self.get_file_metadata(file_path).await?;
-        let content_hash = self.compute_content_hash(file_path).await?;
-        
-        let needs_reindex = if let Some(cached_node) = self.file_cache.get(file_path) {
-            cached_node.content_hash != content_hash || 
-            cached_node.last_modified != file_metadata.last_modified.timestamp() as u64
-        } else {
-            true
-        };
-        
-        if !needs_reindex {
-            return Ok(IncrementalResult {
-                file_path: file_path.to_path_buf(),
-                action: IndexAction::Skipped,
-                affected_files: Vec::new(),
-                symbols_extracted: 0,
-                processing_time_ms: start_time.elapsed().as_millis() as u32,
-            });
+    /// Remembers the new stat of a file whose content hash did not change, which
+    /// counts as a use of its cache entry
+    fn record_stat(&mut self, file_path: &Path, stat: FileStat) {
+        if let Some(cached) = self.file_cache.get_mut(file_path) {
+            cached.node.stat = stat;
+            self.file_cache_clock += 1;
+            self.file_cache_recency.remove(&cached.last_used);
+            cached.last_used = self.file_cache_clock;
+            self.file_cache_recency.insert(cached.last_used, file_path.to_path_buf());
         }
-        
-        let extraction_result = self.symbol_extractor.extract_symbols(file_path).await?;
+        self.current_tree.update_stat(file_path, stat);
+    }
+
+    fn merge_extraction(
+        &mut self,
+        file_path: &Path,
+        file_metadata: FileMetadata,
+        stat: FileStat,
+        content_hash: String,
+        extraction_result: &ExtractionResult,
+        start_time: Instant,
+    ) -> Result<IncrementalResult, Box<dyn std::error::Error>> {
         let symbols_hash = self.compute_symbols_hash(&extraction_result.symbols)?;
         
-        let dependencies = self.extract_file_dependencies(&extraction_result.includes).await?;
+        let dependencies = self.extract_file_dependencies(file_path, &extraction_result.includes)?;
         let file_node = FileNode {
             path: file_path.to_path_buf(),
             content_hash,
             metadata_hash: self.compute_metadata_hash(&file_metadata)?,
             last_modified: file_metadata.last_modified.timestamp() as u64,
             size: file_metadata.size_bytes,
+            stat,
             dependencies: dependencies.clone(),
             dependents: Vec::new(),
             symbols_hash,
@@ -230,8 +574,8 @@ impl IncrementalIndexer {
         self.update_dependency_graph(file_path, &dependencies)?;
         let affected_files = self.get_affected_files(file_path)?;
         
-        self.file_cache.insert(file_path.to_path_buf(), file_node.clone());
-        self.current_tree.add_file_node(file_node)?;
+        self.current_tree.add_file_node(file_node.clone())?;
+        self.cache_file_node(file_node);
         
         let processing_time = start_time.elapsed();
         
@@ -244,61 +588,63 @@ impl IncrementalIndexer {
         })
     }
 
-    pub async fn remove_file(&mut self, file_path: &Path) -> Result<IncrementalResult, Box<dyn std::error::Error>> {
-        let start_time = Instant::now();
-        
-        let affected_files = self.get_affected_files(file_path)?;
-        
-        self.file_cache.remove(file_path);
-        self.current_tree.remove_file_node(file_path)?;
-        self.dependency_graph.remove(file_path);
-        
-        for (_, deps) in self.dependency_graph.iter_mut() {
-            deps.remove(file_path);
+    fn cache_file_node(&mut self, file_node: FileNode) {
+        self.file_cache_clock += 1;
+        let (path, bytes) = (file_node.path.clone(), cached_node_bytes(&file_node));
+        let cached = CachedFile { node: file_node, last_used: self.file_cache_clock };
+        if let Some(previous) = self.file_cache.insert(path.clone(), cached) {
+            self.file_cache_recency.remove(&previous.last_used);
+            self.file_cache_bytes -= cached_node_bytes(&previous.node);
         }
-        
-        let processing_time = start_time.elapsed();
-        
-        Ok(IncrementalResult {
-            file_path: file_path.to_path_buf(),
-            action: IndexAction::Removed,
-            affected_files,
-            symbols_extracted: 0,
-            processing_time_ms: processing_time.as_millis() as u32,
-        })
+        self.file_cache_recency.insert(self.file_cache_clock, path);
+        self.file_cache_bytes += bytes;
+        self.evict_file_cache();
     }
 
-    pub async fn update_directory(&mut self, directory_path: &Path) -> Result<Vec<IncrementalResult>, Box<dyn std::error::Error>> {
-        let mut results = Vec::new();
-        let cpp_extensions = [".cpp", ".cxx", ".cc", ".c", ".hpp", ".hxx", ".h"];
+    fn uncache_file_node(&mut self, file_path: &Path) {
+        if let Some(cached) = self.file_cache.remove(file_path) {
+            self.file_cache_recency.remove(&cached.last_used);
+            self.file_cache_bytes -= cached_node_bytes(&cached.node);
+        }
+    }
+
+    /// Drops the least recently used cache entries while the cache is over its share
+    /// of the budget
+    fn evict_file_cache(&mut self) {
+        let Some(budget) = &self.memory_budget else {
+            return;
+        };
+        let cache_limit = budget.limit() / FILE_CACHE_BUDGET_DIVISOR;
         
-        let mut entries = fs::read_dir(directory_path).await?;
-        while let Some(entry) = entries.next_entry().await? {
-            let path = entry.path();
-            
-            if path.is_file() {
-                if let Some(extension) = path.extension() {
-                    if cpp_extensions.iter().any(|&ext| extension == &ext[1..]) {
-                        let result = self.index_file(&path).await?;
-                        results.push(result);
-                    }
-                }
-            } else if path.is_dir() {
-                let sub_results = Box::pin(self.update_directory(&path)).await?;
-                results.extend(sub_results);
+        while self.file_cache_bytes > cache_limit {
+            let Some((_, path)) = self.file_cache_recency.pop_first() else {
+                break;
+            };
+            if let Some(cached) = self.file_cache.remove(&path) {
+                self.file_cache_bytes -= cached_node_bytes(&cached.node);
             }
         }
-        
-        Ok(results)
+    }
+
+    /// Indexed files at or below `path`, e.g. everything a deleted directory contained
+    pub fn tracked_files_under(&self, path: &Path) -> Vec<PathBuf> {
+        // Every indexed file has a tree leaf, including those restored from saved state.
+        self.current_tree
+            .files_under(path)
+            .into_iter()
+            .map(|(file, _)| file)
+            .collect()
     }
 
     pub fn get_index_status(&self) -> IndexStatus {
-        let total_files = self.file_cache.len();
-        let total_dependencies = self.dependency_graph.values().map(|deps| deps.len()).sum();
+        // Tree leaves cover every indexed file, including those evicted from the cache.
+        let total_files = self.current_tree.len();
+        let total_dependencies = self.dependency_graph.edge_count();
         
-        let file_types = self.file_cache
-            .keys()
-            .filter_map(|path| path.extension())
+        let file_types = self.current_tree
+            .files()
+            .iter()
+            .filter_map(|(path, _)| path.extension())
             .fold(HashMap::new(), |mut acc, ext| {
                 *acc.entry(ext.to_string_lossy().to_string()).or_insert(0) += 1;
                 acc
@@ -310,32 +656,10 @@ impl IncrementalIndexer {
             file_types,
             merkle_root: self.current_tree.get_root_hash().cloned(),
             last_updated: SystemTime::now().duration_since(UNIX_EPOCH).unwrap().as_secs(),
+            pch_cache: self.pch_cache.as_ref().map(|cache| cache.stats()),
         }
     }
 
-    async fn get_file_metadata(&self, file_path: &Path) -> Result<FileMetadata, Box<dyn std::error::Error>> {
-        let metadata = fs::metadata(file_path).await?;
-        let last_modified = metadata.modified()?.into();
-        
-        Ok(FileMetadata {
-            id: Some(0),
-            index_id: uuid::Uuid::new_v4(),
-            file_path: file_path.to_string_lossy().to_string(),
-            file_hash: String::new(),
-            last_modified,
-            size_bytes: metadata.len(),
-            symbol_count: 0,
-            indexed_at: chrono::Utc::now(),
-        })
-    }
-
-    async fn compute_content_hash(&self, file_path: &Path) -> Result<String, Box<dyn std::error::Error>> {
-        let content = fs::read(file_path).await?;
-        let mut hasher = Sha256::new();
-        hasher.update(&content);
-        Ok(format!("{:x}", hasher.finalize()))
-    }
-
     fn compute_symbols_hash(&self, symbols: &[ExtractedSymbol]) -> Result<String, Box<dyn std::error::Error>> {
         let mut hasher = Sha256::new();
         
@@ -357,12 +681,16 @@ impl IncrementalIndexer {
         Ok(format!("{:x}", hasher.finalize()))
     }
 
-    async fn extract_file_dependencies(&self, includes: &[String]) -> Result<Vec<PathBuf>, Box<dyn std::error::Error>> {
+    /// Files an extraction's includes refer to. Includes not found on the search path
+    /// are kept as written if they name a header, so they still link up by suffix.
+    fn extract_file_dependencies(&mut self, file_path: &Path, includes: &[String]) -> Result<Vec<PathBuf>, Box<dyn std::error::Error>> {
         let mut dependencies = Vec::new();
         
         for include in includes {
-            if include.ends_with(".h") || include.ends_with(".hpp") || include.ends_with(".hxx") {
-                dependencies.push(PathBuf::from(include));
+            match self.include_resolver.resolve(file_path, include) {
+                Some(resolved) => dependencies.push(resolved),
+                None if is_header_file(Path::new(include)) => dependencies.push(PathBuf::from(include)),
+                None => {}
             }
         }
         
@@ -370,53 +698,17 @@ impl IncrementalIndexer {
     }
 
     fn update_dependency_graph(&mut self, file_path: &Path, dependencies: &[PathBuf]) -> Result<(), Box<dyn std::error::Error>> {
-        let deps_set: HashSet<PathBuf> = dependencies.iter().cloned().collect();
-        self.dependency_graph.insert(file_path.to_path_buf(), deps_set);
-        
-        for dep in dependencies {
-            if let Some(cached_node) = self.file_cache.get_mut(dep) {
-                if !cached_node.dependents.contains(&file_path.to_path_buf()) {
-                    cached_node.dependents.push(file_path.to_path_buf());
-                }
-            }
-        }
-        
+        self.dependency_graph.set_includes(file_path, dependencies);
         Ok(())
     }
 
     fn get_affected_files(&self, file_path: &Path) -> Result<Vec<PathBuf>, Box<dyn std::error::Error>> {
-        let mut affected = Vec::new();
-        let mut visited = HashSet::new();
-        
-        self.collect_dependents_recursive(file_path, &mut affected, &mut visited);
-        
-        Ok(affected)
-    }
-
-    fn collect_dependents_recursive(
-        &self,
-        file_path: &Path,
-        affected: &mut Vec<PathBuf>,
-        visited: &mut HashSet<PathBuf>,
-    ) {
-        if visited.contains(file_path) {
-            return;
-        }
-        
-        visited.insert(file_path.to_path_buf());
-        
-        if let Some(file_node) = self.file_cache.get(file_path) {
-            for dependent in &file_node.dependents {
-                if !affected.contains(dependent) {
-                    affected.push(dependent.clone());
-                }
-                self.collect_dependents_recursive(dependent, affected, visited);
-            }
-        }
+        Ok(self.dependency_graph.dependents_of(file_path))
     }
 
     pub fn compare_with_previous(&self, previous_tree: &MerkleTree) -> ComparisonResult {
         let changed_files = self.current_tree.get_changed_files(previous_tree);
+        let removed_files = self.current_tree.get_removed_files(previous_tree);
         let has_changes = self.current_tree.has_changed(
             previous_tree.get_root_hash().unwrap_or(&String::new())
         );
@@ -424,12 +716,415 @@ impl IncrementalIndexer {
         ComparisonResult {
             has_changes,
             changed_files,
+            removed_files,
             current_root: self.current_tree.get_root_hash().cloned(),
             previous_root: previous_tree.get_root_hash().cloned(),
         }
     }
 }
 
+/// Where a pipeline pass gets its files from.
+enum PipelineInput {
+    Directory { root: PathBuf, defer_headers: bool },
+    Files(Vec<PathBuf>),
+}
+
+/// Everything a parse worker needs to build its own extractor.
+#[derive(Clone)]
+struct ParserSettings {
+    compile_flags: Option<Vec<String>>,
+    pch_cache: Option<Arc<PchCache>>,
+    compilation_database: Option<Arc<CompilationDatabase>>,
+    /// Skip libclang for every file, not just headers covered by a translation unit
+    syntax_only: bool,
+}
+
+impl ParserSettings {
+    fn build_extractor(self) -> Result<SymbolExtractor, Box<dyn std::error::Error>> {
+        // Files are parsed once per pass, so cached translation units would only cost memory.
+        let mut extractor = SymbolExtractor::new(self.compile_flags)?.with_unit_cache_limit(0);
+        
+        if let Some(pch_cache) = self.pch_cache {
+            extractor = extractor.with_pch_cache(pch_cache);
+        }
+        if let Some(compilation_database) = self.compilation_database {
+            extractor = extractor.with_compilation_database(compilation_database);
+        }
+        
+        Ok(extractor)
+    }
+}
+
+/// Stat and content hash of a file as last indexed.
+type KnownFile = (FileStat, String);
+
+/// What libclang found in a header while parsing a translation unit that includes it
+#[derive(Debug, Default)]
+struct HeaderSemantics {
+    symbols: Vec<ExtractedSymbol>,
+    /// Declaration edges from the header's symbols, e.g. its classes' bases
+    edges: Vec<ReferenceEdge>,
+}
+
+/// A node of `IncrementalIndexer::file_cache` and the clock tick it was last used at
+struct CachedFile {
+    node: FileNode,
+    last_used: u64,
+}
+
+/// What the hash/skip filter workers of one pipeline pass compare files against.
+struct FilterState {
+    known_files: HashMap<PathBuf, KnownFile>,
+    /// Files of the base index when building an overlay
+    base_files: HashMap<PathBuf, KnownFile>,
+    git_blobs: Option<Arc<GitBlobs>>,
+    syntax_only: HashSet<PathBuf>,
+    budget: Option<Arc<MemoryBudget>>,
+}
+
+/// Outcome of the tiered change check in `check_file`.
+enum FileCheck {
+    /// Stat matches the cached entry; the file was not read.
+    Unchanged,
+    /// Stat differs but the content hash does not.
+    Touched(FileStat),
+    Changed(ChangedFile),
+}
+
+/// A file that needs parsing, with the bytes already read for hashing.
+struct ChangedFile {
+    metadata: FileMetadata,
+    stat: FileStat,
+    content_hash: String,
+    content: Vec<u8>,
+    /// Budget held for the file until it is stored
+    reservation: Option<Reservation>,
+}
+
+/// Work item passed from the hash/skip filter to the parse workers.
+struct PendingFile {
+    path: PathBuf,
+    metadata: FileMetadata,
+    stat: FileStat,
+    content_hash: String,
+    content: String,
+    syntax_only: bool,
+    started: Instant,
+    reservation: Option<Reservation>,
+}
+
+/// A parsed file waiting for the merge stage.
+struct ParsedFile {
+    path: PathBuf,
+    metadata: FileMetadata,
+    stat: FileStat,
+    content_hash: String,
+    extraction: ExtractionResult,
+    started: Instant,
+    reservation: Option<Reservation>,
+}
+
+/// Messages delivered to the merge stage.
+enum StageOutput {
+    Skipped(IncrementalResult),
+    Touched { path: PathBuf, stat: FileStat, started: Instant },
+    /// A file the overlay tracks whose content is the base's again
+    MatchesBase { path: PathBuf, started: Instant },
+    Parsed(ParsedFile),
+    Failed(String),
+}
+
+type SharedReceiver<T> = Arc<Mutex<mpsc::Receiver<T>>>;
+
+/// Pulls the next item off a queue shared by several blocking workers.
+fn next_item<T>(receiver: &SharedReceiver<T>) -> Option<T> {
+    receiver.lock().ok()?.blocking_recv()
+}
+
+pub(crate) fn is_cpp_file(path: &Path) -> bool {
+    path.extension()
+        .map_or(false, |extension| CPP_EXTENSIONS.iter().any(|&ext| extension == ext))
+}
+
+pub(crate) fn is_header_file(path: &Path) -> bool {
+    path.extension()
+        .map_or(false, |extension| HEADER_EXTENSIONS.iter().any(|&ext| extension == ext))
+}
+
+/// Walks `root` feeding C++ files to the filter stage, only those of `shard` if given.
+/// With `defer_headers`, headers are held back and returned instead so they can be
+/// indexed after the translation units.
+fn discover_files(
+    root: &Path,
+    defer_headers: bool,
+    shard: Option<&ShardSpec>,
+    paths: &mpsc::Sender<PathBuf>,
+    output: &mpsc::Sender<StageOutput>,
+) -> Vec<PathBuf> {
+    let mut deferred = Vec::new();
+    
+    for entry in WalkDir::new(root).sort_by_file_name() {
+        let entry = match entry {
+            Ok(entry) => entry,
+            Err(error) => {
+                let _ = output.blocking_send(StageOutput::Failed(format!("Failed to walk {}: {}", root.display(), error)));
+                return deferred;
+            }
+        };
+        
+        if !entry.file_type().is_file() || !is_cpp_file(entry.path()) {
+            continue;
+        }
+        if shard.is_some_and(|shard| !shard.contains(root, entry.path())) {
+            continue;
+        }
+        
+        if defer_headers && is_header_file(entry.path()) {
+            deferred.push(entry.into_path());
+        } else if paths.blocking_send(entry.into_path()).is_err() {
+            break;
+        }
+    }
+    
+    deferred
+}
+
+/// An overlay compares a file it does not track against the base, so files the branch
+/// did not change are skipped like unchanged ones.
+fn run_filter_worker(
+    paths: &SharedReceiver<PathBuf>,
+    filter: &FilterState,
+    parse_tx: &mpsc::Sender<PendingFile>,
+    output: &mpsc::Sender<StageOutput>,
+) {
+    while let Some(path) = next_item(paths) {
+        let started = Instant::now();
+        let tracked = filter.known_files.get(&path);
+        let base = filter.base_files.get(&path);
+        let blob_id = filter.git_blobs.as_ref().and_then(|blobs| blobs.get(&path));
+        
+        let sent = match check_file(&path, tracked.or(base), blob_id, filter.budget.as_ref()) {
+            Ok(FileCheck::Changed(changed)) if base.is_some_and(|(_, base_hash)| *base_hash == changed.content_hash) => {
+                output.blocking_send(StageOutput::MatchesBase { path, started }).is_ok()
+            }
+            Ok(FileCheck::Changed(changed)) => match String::from_utf8(changed.content) {
+                Ok(content) => parse_tx.blocking_send(PendingFile {
+                    syntax_only: filter.syntax_only.contains(&path),
+                    path,
+                    metadata: changed.metadata,
+                    stat: changed.stat,
+                    content_hash: changed.content_hash,
+                    content,
+                    started,
+                    reservation: changed.reservation,
+                }).is_ok(),
+                Err(error) => {
+                    let _ = output.blocking_send(StageOutput::Failed(format!("Failed to read {}: {}", path.display(), error)));
+                    false
+                }
+            },
+            Ok(FileCheck::Touched(stat)) if tracked.is_some() => output.blocking_send(StageOutput::Touched { path, stat, started }).is_ok(),
+            Ok(FileCheck::Touched(_)) | Ok(FileCheck::Unchanged) => output.blocking_send(StageOutput::Skipped(skipped_result(&path, started))).is_ok(),
+            Err(error) => {
+                let _ = output.blocking_send(StageOutput::Failed(format!("Failed to read {}: {}", path.display(), error)));
+                false
+            }
+        };
+        
+        if !sent {
+            return;
+        }
+    }
+}
+
+/// Tiered change check: the stat is compared first and the file is only read and
+/// hashed when it differs, so an unchanged tree costs one `stat` per file. A git
+/// `blob_id` is the file's content hash, so a file git vouches for is never hashed and
+/// only read if it changed. With a `budget`, room for the file is reserved before it
+/// is read.
+fn check_file(
+    path: &Path,
+    known: Option<&KnownFile>,
+    blob_id: Option<&str>,
+    budget: Option<&Arc<MemoryBudget>>,
+) -> Result<FileCheck, Box<dyn std::error::Error>> {
+    let fs_metadata = std::fs::metadata(path)?;
+    let stat = FileStat::from_metadata(&fs_metadata);
+    
+    if known.map_or(false, |(known_stat, _)| *known_stat == stat) {
+        return Ok(FileCheck::Unchanged);
+    }
+    if let (Some(blob_id), Some((_, known_hash))) = (blob_id, known) {
+        if blob_id == known_hash {
+            return Ok(FileCheck::Touched(stat));
+        }
+    }
+    
+    let reservation = budget.map(|budget| budget.reserve(in_flight_bytes(stat.size)));
+    let content = metrics::time(Stage::Read, || std::fs::read(path))?;
+    let content_hash = match blob_id {
+        Some(blob_id) => blob_id.to_string(),
+        None => metrics::time(Stage::Hash, || hash_content(&content)),
+    };
+    
+    if known.map_or(false, |(_, known_hash)| *known_hash == content_hash) {
+        return Ok(FileCheck::Touched(stat));
+    }
+    
+    Ok(FileCheck::Changed(ChangedFile {
+        metadata: file_metadata_from(path, &fs_metadata)?,
+        stat,
+        content_hash,
+        content,
+        reservation,
+    }))
+}
+
+/// Estimated memory of a file of `size` bytes while it is parsed and merged
+fn in_flight_bytes(size: u64) -> usize {
+    FILE_OVERHEAD_BYTES.saturating_add((size as usize).saturating_mul(BYTES_PER_SOURCE_BYTE))
+}
+
+/// Approximate heap size of a cached `FileNode`
+fn cached_node_bytes(node: &FileNode) -> usize {
+    let path_bytes = |path: &PathBuf| path.as_os_str().len() + std::mem::size_of::<PathBuf>();
+    std::mem::size_of::<FileNode>()
+        + path_bytes(&node.path)
+        + node.content_hash.len()
+        + node.metadata_hash.len()
+        + node.symbols_hash.len()
+        + node.dependencies.iter().chain(&node.dependents).map(path_bytes).sum::<usize>()
+}
+
+fn run_parse_worker(
+    settings: ParserSettings,
+    files: &SharedReceiver<PendingFile>,
+    output: &mpsc::Sender<StageOutput>,
+) {
+    let syntax_only = settings.syntax_only;
+    // Each worker owns its extractor; the parsers keep mutable per-parse state.
+    let mut extractor = match settings.build_extractor() {
+        Ok(extractor) => extractor,
+        Err(error) => {
+            let _ = output.blocking_send(StageOutput::Failed(format!("Failed to create symbol extractor: {}", error)));
+            return;
+        }
+    };
+    
+    while let Some(file) = next_item(files) {
+        let extraction = if file.syntax_only || syntax_only {
+            extractor.extract_syntax_from_content(&file.path, &file.content)
+        } else {
+            extractor.extract_symbols_from_content(&file.path, &file.content)
+        };
+        
+        let message = match extraction {
+            Ok(extraction) => StageOutput::Parsed(ParsedFile {
+                path: file.path,
+                metadata: file.metadata,
+                stat: file.stat,
+                extraction: ExtractionResult { content_hash: file.content_hash.clone(), ..extraction },
+                content_hash: file.content_hash,
+                started: file.started,
+                reservation: file.reservation,
+            }),
+            Err(error) => StageOutput::Failed(format!("Failed to extract symbols from {}: {}", file.path.display(), error)),
+        };
+        
+        if output.blocking_send(message).is_err() {
+            return;
+        }
+    }
+}
+
+/// Records the symbols and edges a TU's semantic extraction found in headers under
+/// `root`, for headers no earlier TU already covered
+fn collect_header_semantics(extraction: &ExtractionResult, root: &Path, header_semantics: &mut HashMap<PathBuf, HeaderSemantics>) {
+    if extraction.tier != ExtractionTier::Semantic {
+        return;
+    }
+    
+    let mut found: HashMap<&Path, HeaderSemantics> = HashMap::new();
+    for symbol in &extraction.symbols {
+        let path = symbol.file_path.as_path();
+        if path != extraction.file_path && path.starts_with(root) && is_header_file(path) && !header_semantics.contains_key(path) {
+            found.entry(path).or_default().symbols.push(symbol.clone());
+        }
+    }
+    for edge in &extraction.edges {
+        if let Some(semantics) = found.get_mut(edge.from.location.file_path.as_path()) {
+            semantics.edges.push(edge.clone());
+        }
+    }
+    
+    for (path, semantics) in found {
+        header_semantics.insert(path.to_path_buf(), semantics);
+    }
+}
+
+/// Turns a header's tree-sitter extraction into a semantic one with the symbols and
+/// edges a TU found in it; tree-sitter symbols libclang also reported are dropped
+fn adopt_header_semantics(extraction: &mut ExtractionResult, semantics: HeaderSemantics) {
+    let located: HashSet<(u32, u32)> = semantics.symbols
+        .iter()
+        .map(|symbol| (symbol.start_line, symbol.start_column))
+        .collect();
+    let syntax_symbols = std::mem::replace(&mut extraction.symbols, semantics.symbols);
+    
+    extraction.clang_symbols = extraction.symbols.len();
+    extraction.symbols.extend(
+        syntax_symbols
+            .into_iter()
+            .filter(|symbol| !located.contains(&(symbol.start_line, symbol.start_column)))
+    );
+    extraction.edges = semantics.edges;
+    extraction.tier = ExtractionTier::Semantic;
+}
+
+fn file_metadata_from(file_path: &Path, metadata: &std::fs::Metadata) -> Result<FileMetadata, Box<dyn std::error::Error>> {
+    let last_modified = metadata.modified()?.into();
+    
+    Ok(FileMetadata {
+        id: Some(0),
+        index_id: uuid::Uuid::new_v4(),
+        file_path: file_path.to_string_lossy().to_string(),
+        file_hash: String::new(),
+        last_modified,
+        size_bytes: metadata.len(),
+        symbol_count: 0,
+        indexed_at: chrono::Utc::now(),
+    })
+}
+
+/// Sink for directory runs whose results are only returned
+struct DiscardChanges;
+
+impl ChangeSink for DiscardChanges {
+    fn file_indexed(&mut self, _: &Path, _: &ExtractionResult, _: &[PathBuf]) -> Result<(), Box<dyn std::error::Error>> {
+        Ok(())
+    }
+
+    fn file_removed(&mut self, _: &Path) -> Result<(), Box<dyn std::error::Error>> {
+        Ok(())
+    }
+}
+
+/// Change-detection hash, also stored as the hash of files git does not vouch for;
+/// the Merkle tree's own hashes stay SHA-256.
+pub fn hash_content(content: &[u8]) -> String {
+    format!("{:032x}", xxh3_128(content))
+}
+
+fn skipped_result(file_path: &Path, start_time: Instant) -> IncrementalResult {
+    IncrementalResult {
+        file_path: file_path.to_path_buf(),
+        action: IndexAction::Skipped,
+        affected_files: Vec::new(),
+        symbols_extracted: 0,
+        processing_time_ms: start_time.elapsed().as_millis() as u32,
+    }
+}
+
 #[derive(Debug, Clone)]
 pub enum IndexAction {
     Indexed,
@@ -453,12 +1148,14 @@ pub struct IndexStatus {
     pub file_types: HashMap<String, usize>,
     pub merkle_root: Option<String>,
     pub last_updated: u64,
+    pub pch_cache: Option<PchCacheStats>,
 }
 
 #[derive(Debug)]
 pub struct ComparisonResult {
     pub has_changes: bool,
     pub changed_files: Vec<PathBuf>,
+    pub removed_files: Vec<PathBuf>,
     pub current_root: Option<String>,
     pub previous_root: Option<String>,
 }
@@ -466,6 +1163,7 @@ pub struct ComparisonResult {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::lib::storage::models::code_element::{AccessModifier, SymbolType};
     use std::path::PathBuf;
 
     #[tokio::test]
@@ -474,62 +1172,268 @@ mod tests {
         assert!(indexer.is_ok());
     }
 
-    #[tokio::test]
-    async fn test_merkle_tree_creation() {
-        let mut tree = MerkleTree::new();
-        assert!(tree.get_root_hash().is_none());
+    #[test]
+    fn test_dependency_graph_update() {
+        let mut indexer = IncrementalIndexer::new(None).expect("Failed to create indexer");
         
-        let file_node = FileNode {
-            path: PathBuf::from("test.cpp"),
-            content_hash: "hash123".to_string(),
-            metadata_hash: "meta123".to_string(),
-            last_modified: 1234567890,
-            size: 1024,
-            dependencies: Vec::new(),
-            dependents: Vec::new(),
-            symbols_hash: "symbols123".to_string(),
-        };
+        let file_path = PathBuf::from("main.cpp");
+        let dependencies = vec![PathBuf::from("header1.h"), PathBuf::from("header2.h")];
         
-        let result = tree.add_file_node(file_node);
+        let result = indexer.update_dependency_graph(&file_path, &dependencies);
         assert!(result.is_ok());
-        assert!(tree.get_root_hash().is_some());
+        
+        assert_eq!(indexer.dependencies_of(&file_path), dependencies);
+        assert_eq!(indexer.get_affected_files(Path::new("header1.h")).unwrap(), vec![file_path]);
+        assert_eq!(indexer.get_index_status().total_dependencies, 2);
     }
 
-    #[tokio::test]
-    async fn test_file_hash_computation() {
-        let indexer = IncrementalIndexer::new(None).expect("Failed to create indexer");
+    #[test]
+    fn test_discover_files_filters_extensions() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        std::fs::create_dir(temp_dir.path().join("src")).unwrap();
+        std::fs::write(temp_dir.path().join("main.cpp"), "int main() {}").unwrap();
+        std::fs::write(temp_dir.path().join("notes.txt"), "not c++").unwrap();
+        std::fs::write(temp_dir.path().join("src").join("util.h"), "#pragma once").unwrap();
         
-        let file_node = FileNode {
-            path: PathBuf::from("test.cpp"),
-            content_hash: "content123".to_string(),
-            metadata_hash: "meta123".to_string(),
-            last_modified: 1234567890,
-            size: 1024,
-            dependencies: vec![PathBuf::from("header.h")],
+        let (path_tx, mut path_rx) = mpsc::channel(16);
+        let (output_tx, mut output_rx) = mpsc::channel(16);
+        let deferred = discover_files(temp_dir.path(), false, None, &path_tx, &output_tx);
+        drop(path_tx);
+        assert!(deferred.is_empty());
+        
+        let mut discovered = Vec::new();
+        while let Some(path) = path_rx.blocking_recv() {
+            discovered.push(path.strip_prefix(temp_dir.path()).unwrap().to_path_buf());
+        }
+        
+        assert_eq!(discovered, vec![PathBuf::from("main.cpp"), PathBuf::from("src/util.h")]);
+        assert!(output_rx.try_recv().is_err());
+    }
+
+    #[test]
+    fn test_check_file_compares_stat_before_hashing() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("main.cpp");
+        std::fs::write(&path, "int main() {}").unwrap();
+        
+        let changed = match check_file(&path, None, None, None).unwrap() {
+            FileCheck::Changed(changed) => changed,
+            _ => panic!("unknown file must be read"),
+        };
+        assert_eq!(changed.content, b"int main() {}");
+        
+        let known = (changed.stat, changed.content_hash.clone());
+        assert!(matches!(check_file(&path, Some(&known), None, None).unwrap(), FileCheck::Unchanged));
+        
+        let stale = (FileStat { modified_ns: 0, ..changed.stat }, changed.content_hash);
+        assert!(matches!(check_file(&path, Some(&stale), None, None).unwrap(), FileCheck::Touched(stat) if stat == changed.stat));
+        
+        let edited = (FileStat::default(), hash_content(b"int main() { return 1; }"));
+        assert!(matches!(check_file(&path, Some(&edited), None, None).unwrap(), FileCheck::Changed(_)));
+    }
+
+    #[test]
+    fn test_check_file_reserves_budget_until_dropped() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("main.cpp");
+        std::fs::write(&path, "int main() {}").unwrap();
+        let budget = Arc::new(MemoryBudget::new(usize::MAX));
+        
+        let changed = match check_file(&path, None, None, Some(&budget)).unwrap() {
+            FileCheck::Changed(changed) => changed,
+            _ => panic!("unknown file must be read"),
+        };
+        assert_eq!(budget.used(), in_flight_bytes(13));
+        
+        // A file skipped on its stat is never read, so it reserves nothing
+        assert!(matches!(check_file(&path, Some(&(changed.stat, changed.content_hash.clone())), None, Some(&budget)).unwrap(), FileCheck::Unchanged));
+        assert_eq!(budget.used(), in_flight_bytes(13));
+        
+        drop(changed);
+        assert_eq!(budget.used(), 0);
+    }
+
+    #[test]
+    fn test_check_file_trusts_git_blob_ids() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("main.cpp");
+        std::fs::write(&path, "int main() {}").unwrap();
+        let budget = Arc::new(MemoryBudget::new(usize::MAX));
+        let blob_id = "5e3a4ba0d1b2c3e4f5a6b7c8d9e0f1a2b3c4d5e6";
+        
+        // A touched file whose blob is the one indexed is not read at all
+        let known = (FileStat::default(), blob_id.to_string());
+        assert!(matches!(check_file(&path, Some(&known), Some(blob_id), Some(&budget)).unwrap(), FileCheck::Touched(_)));
+        assert_eq!(budget.peak(), 0);
+        
+        // A changed one is read for parsing but keeps the blob id as its hash
+        let stale = (FileStat::default(), hash_content(b"int main() {}"));
+        match check_file(&path, Some(&stale), Some(blob_id), None).unwrap() {
+            FileCheck::Changed(changed) => assert_eq!(changed.content_hash, blob_id),
+            _ => panic!("a new blob must be parsed"),
+        }
+    }
+
+    #[test]
+    fn test_file_cache_evicts_least_recently_used() {
+        let node = |name: &str| FileNode {
+            path: PathBuf::from(format!("/src/{}.cpp", name)),
+            content_hash: "c".repeat(64),
+            metadata_hash: "m".repeat(64),
+            last_modified: 0,
+            size: 0,
+            stat: FileStat::default(),
+            dependencies: Vec::new(),
             dependents: Vec::new(),
-            symbols_hash: "symbols123".to_string(),
+            symbols_hash: "s".repeat(64),
+        };
+        let node_bytes = cached_node_bytes(&node("a"));
+        let budget = Arc::new(MemoryBudget::new(node_bytes * 2 * FILE_CACHE_BUDGET_DIVISOR));
+        let mut indexer = IncrementalIndexer::new(None)
+            .expect("Failed to create indexer")
+            .with_memory_budget(budget);
+        
+        let cached = |indexer: &IncrementalIndexer| {
+            let mut paths: Vec<PathBuf> = indexer.file_cache.keys().cloned().collect();
+            paths.sort();
+            paths
         };
         
-        let tree = MerkleTree::new();
-        let hash1 = tree.compute_file_hash(&file_node);
-        let hash2 = tree.compute_file_hash(&file_node);
+        // Storing "a" again makes "b" the least recently used
+        for name in ["a", "b", "a", "c"] {
+            indexer.cache_file_node(node(name));
+        }
+        assert_eq!(cached(&indexer), vec![PathBuf::from("/src/a.cpp"), PathBuf::from("/src/c.cpp")]);
+        assert_eq!(indexer.file_cache_bytes, node_bytes * 2);
+        
+        // A touched stat is a use too
+        indexer.record_stat(Path::new("/src/a.cpp"), FileStat::default());
+        indexer.cache_file_node(node("d"));
+        assert_eq!(cached(&indexer), vec![PathBuf::from("/src/a.cpp"), PathBuf::from("/src/d.cpp")]);
         
-        assert!(hash1.is_ok());
-        assert!(hash2.is_ok());
-        assert_eq!(hash1.unwrap(), hash2.unwrap());
+        // A removed file leaves no slot behind to evict its next entry early
+        indexer.uncache_file_node(Path::new("/src/a.cpp"));
+        indexer.cache_file_node(node("a"));
+        indexer.cache_file_node(node("e"));
+        assert_eq!(cached(&indexer), vec![PathBuf::from("/src/a.cpp"), PathBuf::from("/src/e.cpp")]);
+        assert_eq!(indexer.file_cache_recency.len(), indexer.file_cache.len());
+        assert_eq!(indexer.file_cache_bytes, node_bytes * 2);
+    }
+
+    fn extracted(name: &str, file_path: &Path, line: u32, usr: Option<&str>) -> ExtractedSymbol {
+        ExtractedSymbol {
+            name: name.to_string(),
+            symbol_type: SymbolType::Class,
+            visibility: None,
+            file_path: file_path.to_path_buf(),
+            start_line: line,
+            end_line: line,
+            start_column: 7,
+            end_column: 7,
+            content: String::new(),
+            fully_qualified_name: name.to_string(),
+            namespace_path: Vec::new(),
+            dependencies: Vec::new(),
+            template_parameters: Vec::new(),
+            base_classes: Vec::new(),
+            member_functions: Vec::new(),
+            member_variables: Vec::new(),
+            signature: usr.map(|_| name.to_string()),
+            documentation: None,
+            is_definition: true,
+            is_declaration: false,
+            usr: usr.map(str::to_string),
+        }
+    }
+
+    fn extraction(file_path: &Path, symbols: Vec<ExtractedSymbol>, tier: ExtractionTier) -> ExtractionResult {
+        ExtractionResult {
+            file_path: file_path.to_path_buf(),
+            symbols,
+            includes: Vec::new(),
+            extraction_time_ms: 0,
+            tree_sitter_symbols: 0,
+            clang_symbols: 0,
+            tier,
+            edges: Vec::new(),
+            content_hash: String::new(),
+            content_size: 0,
+        }
     }
 
     #[test]
-    fn test_dependency_graph_update() {
-        let mut indexer = IncrementalIndexer::new(None).expect("Failed to create indexer");
+    fn test_header_semantics_come_from_first_tu() {
+        let (root, header) = (Path::new("/src"), Path::new("/src/shape.h"));
+        let main = Path::new("/src/main.cpp");
+        let mut header_semantics = HashMap::new();
         
-        let file_path = PathBuf::from("main.cpp");
-        let dependencies = vec![PathBuf::from("header1.h"), PathBuf::from("header2.h")];
+        let first = extraction(main, vec![
+            extracted("main", main, 1, Some("c:@F@main")),
+            extracted("Shape", header, 3, Some("c:@S@Shape")),
+            extracted("vector", Path::new("/usr/include/vector"), 9, Some("c:@N@std@S@vector")),
+        ], ExtractionTier::Semantic);
+        collect_header_semantics(&first, root, &mut header_semantics);
+        let later = extraction(Path::new("/src/other.cpp"), vec![extracted("Shape", header, 4, Some("c:@S@Shape"))], ExtractionTier::Semantic);
+        collect_header_semantics(&later, root, &mut header_semantics);
         
-        let result = indexer.update_dependency_graph(&file_path, &dependencies);
-        assert!(result.is_ok());
+        assert_eq!(header_semantics.len(), 1);
+        assert_eq!(header_semantics[header].symbols[0].start_line, 3);
+        
+        // The header's tree-sitter pass keeps libclang's view of symbols both saw
+        let mut stored = extraction(header, vec![
+            extracted("Shape", header, 3, None),
+            extracted("SHAPE_SIDES", header, 1, None),
+        ], ExtractionTier::Syntax);
+        adopt_header_semantics(&mut stored, header_semantics.remove(header).unwrap());
+        
+        assert_eq!(stored.tier, ExtractionTier::Semantic);
+        assert_eq!(stored.symbols.len(), 2);
+        assert_eq!(stored.symbols[0].usr.as_deref(), Some("c:@S@Shape"));
+        assert_eq!(stored.symbols[0].signature.as_deref(), Some("Shape"));
+        assert_eq!(stored.symbols[1].name, "SHAPE_SIDES");
+    }
+
+    /// Keeps the tier and symbols of every extraction it receives
+    struct RecordingSink(HashMap<PathBuf, (ExtractionTier, Vec<ExtractedSymbol>)>);
+
+    impl ChangeSink for RecordingSink {
+        fn file_indexed(&mut self, file_path: &Path, extraction: &ExtractionResult, _: &[PathBuf]) -> Result<(), Box<dyn std::error::Error>> {
+            self.0.insert(file_path.to_path_buf(), (extraction.tier, extraction.symbols.clone()));
+            Ok(())
+        }
+
+        fn file_removed(&mut self, _: &Path) -> Result<(), Box<dyn std::error::Error>> {
+            Ok(())
+        }
+    }
+
+    #[tokio::test]
+    async fn test_covered_header_is_stored_with_semantics() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let root = temp_dir.path().canonicalize().unwrap();
+        let header = root.join("shape.h");
+        std::fs::write(&header, "class Shape {\npublic:\n    int sides;\n};\n").unwrap();
+        std::fs::write(root.join("main.cpp"), "#include \"shape.h\"\nint main() { Shape s; return s.sides; }\n").unwrap();
+        let json = format!(
+            r#"[{{"directory": "{0}", "file": "main.cpp", "arguments": ["clang++", "-std=c++17", "-c", "main.cpp"]}}]"#,
+            root.display()
+        );
+        let database = Arc::new(CompilationDatabase::from_json(&json).unwrap());
+        let mut indexer = IncrementalIndexer::new(None)
+            .expect("Failed to create indexer")
+            .with_compilation_database(database);
         
-        assert!(indexer.dependency_graph.contains_key(&file_path));
-        assert_eq!(indexer.dependency_graph[&file_path].len(), 2);
+        let mut sink = RecordingSink(HashMap::new());
+        indexer.update_directory_into(&root, &mut sink).await.unwrap();
+        
+        let (tier, symbols) = sink.0.get(&header).expect("header must be stored");
+        assert_eq!(*tier, ExtractionTier::Semantic);
+        let sides = symbols
+            .iter()
+            .find(|symbol| symbol.name == "sides" && symbol.file_path == header)
+            .expect("field must be stored with the header");
+        assert!(sides.usr.is_some());
+        assert_eq!(sides.signature.as_deref(), Some("int"));
+        assert_eq!(sides.visibility, Some(AccessModifier::Public));
     }
-}
\ No newline at end of file
+}
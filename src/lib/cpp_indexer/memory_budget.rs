@@ -0,0 +1,124 @@
+use std::sync::{Arc, Condvar, Mutex, MutexGuard};
+
+/// Bytes of memory the files in flight through an indexing run may hold. A stage
+/// reserves an estimate before it queues a file and the reservation is returned when
+/// the file's data is dropped, after it was stored. Reserving waits while the budget is
+/// spent, so a slow sink throttles intake instead of letting queues grow.
+#[derive(Debug)]
+pub struct MemoryBudget {
+    limit: usize,
+    usage: Mutex<Usage>,
+    released: Condvar,
+}
+
+#[derive(Debug, Default)]
+struct Usage {
+    used: usize,
+    peak: usize,
+}
+
+/// Bytes held against a `MemoryBudget`, returned to it when dropped
+#[derive(Debug)]
+pub struct Reservation {
+    budget: Arc<MemoryBudget>,
+    bytes: usize,
+}
+
+impl MemoryBudget {
+    pub fn new(limit: usize) -> Self {
+        Self {
+            limit: limit.max(1),
+            usage: Mutex::default(),
+            released: Condvar::new(),
+        }
+    }
+
+    pub fn from_megabytes(limit_mb: usize) -> Self {
+        Self::new(limit_mb.saturating_mul(1024 * 1024))
+    }
+
+    pub fn limit(&self) -> usize {
+        self.limit
+    }
+
+    /// Bytes currently reserved
+    pub fn used(&self) -> usize {
+        self.usage().used
+    }
+
+    /// Most bytes reserved at once
+    pub fn peak(&self) -> usize {
+        self.usage().peak
+    }
+
+    /// Reserves `bytes`, waiting until they fit. A request larger than the whole budget
+    /// is granted once nothing else is reserved, so one huge file cannot stall a run.
+    pub fn reserve(self: &Arc<Self>, bytes: usize) -> Reservation {
+        let mut usage = self.usage();
+        while usage.used > 0 && usage.used + bytes > self.limit {
+            usage = self.released.wait(usage).unwrap_or_else(|poisoned| poisoned.into_inner());
+        }
+        usage.used += bytes;
+        usage.peak = usage.peak.max(usage.used);
+
+        Reservation { budget: Arc::clone(self), bytes }
+    }
+
+    fn usage(&self) -> MutexGuard<'_, Usage> {
+        self.usage.lock().unwrap_or_else(|poisoned| poisoned.into_inner())
+    }
+}
+
+impl Reservation {
+    pub fn bytes(&self) -> usize {
+        self.bytes
+    }
+}
+
+impl Drop for Reservation {
+    fn drop(&mut self) {
+        self.budget.usage().used -= self.bytes;
+        self.budget.released.notify_all();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::mpsc;
+    use std::thread;
+    use std::time::Duration;
+
+    #[test]
+    fn test_reserve_waits_for_release() {
+        let budget = Arc::new(MemoryBudget::new(100));
+        let first = budget.reserve(60);
+        assert_eq!(budget.used(), 60);
+
+        let (granted_tx, granted_rx) = mpsc::channel();
+        let waiter = {
+            let budget = Arc::clone(&budget);
+            thread::spawn(move || {
+                let second = budget.reserve(60);
+                granted_tx.send(second.bytes()).unwrap();
+            })
+        };
+
+        assert!(granted_rx.recv_timeout(Duration::from_millis(50)).is_err());
+        drop(first);
+        assert_eq!(granted_rx.recv_timeout(Duration::from_secs(5)).unwrap(), 60);
+        waiter.join().unwrap();
+
+        assert_eq!(budget.used(), 0);
+        assert_eq!(budget.peak(), 60);
+    }
+
+    #[test]
+    fn test_oversized_reservation_runs_alone() {
+        let budget = Arc::new(MemoryBudget::new(100));
+        let huge = budget.reserve(500);
+        assert_eq!((budget.used(), budget.peak()), (500, 500));
+        drop(huge);
+        assert_eq!(budget.reserve(100).bytes(), 100);
+    }
+}
@@ -0,0 +1,548 @@
+use serde::{Deserialize, Serialize};
+use sha2::{Sha256, Digest};
+use std::collections::BTreeMap;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::time::UNIX_EPOCH;
+
+/// Format version of the persisted tree; files with another version are ignored
+const STATE_VERSION: u32 = 2;
+
+/// The `stat` fields compared before a file is read: a match means it is unchanged
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, Serialize, Deserialize)]
+pub struct FileStat {
+    pub modified_ns: u64,
+    pub size: u64,
+    pub inode: u64,
+}
+
+impl FileStat {
+    pub fn from_metadata(metadata: &std::fs::Metadata) -> Self {
+        let modified_ns = metadata
+            .modified()
+            .ok()
+            .and_then(|modified| modified.duration_since(UNIX_EPOCH).ok())
+            .map_or(0, |since_epoch| since_epoch.as_nanos() as u64);
+
+        #[cfg(unix)]
+        let inode = std::os::unix::fs::MetadataExt::ino(metadata);
+        #[cfg(not(unix))]
+        let inode = 0;
+
+        Self { modified_ns, size: metadata.len(), inode }
+    }
+}
+
+#[derive(Debug, Clone)]
+pub struct FileNode {
+    pub path: PathBuf,
+    pub content_hash: String,
+    pub metadata_hash: String,
+    pub last_modified: u64,
+    pub size: u64,
+    pub stat: FileStat,
+    pub dependencies: Vec<PathBuf>,
+    pub dependents: Vec<PathBuf>,
+    pub symbols_hash: String,
+}
+
+/// A file leaf or a directory whose hash covers its children's names and hashes
+#[derive(Debug, Clone, Default, PartialEq, Serialize, Deserialize)]
+pub struct MerkleNode {
+    pub hash: String,
+    /// Children keyed by path component, in path order; empty for files
+    #[serde(default, skip_serializing_if = "BTreeMap::is_empty")]
+    pub children: BTreeMap<String, MerkleNode>,
+    pub is_leaf: bool,
+    pub last_updated: u64,
+    /// Content hash of a file leaf, used to skip unchanged files after a restart
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub content_hash: Option<String>,
+    /// Stat of a file leaf when it was last read; not part of `hash`
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub stat: Option<FileStat>,
+}
+
+/// Directory-shaped Merkle tree over indexed files. Changing a file rehashes only the
+/// directories on its path, and two trees are diffed by descending only into
+/// subtrees whose hashes differ.
+#[derive(Debug, Default)]
+pub struct MerkleTree {
+    root: MerkleNode,
+    file_count: usize,
+}
+
+#[derive(Serialize, Deserialize)]
+struct PersistedTree {
+    version: u32,
+    root: MerkleNode,
+}
+
+impl MerkleTree {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Loads a tree saved by `save`; a missing file yields an empty tree
+    pub fn load(path: &Path) -> Result<Self, Box<dyn std::error::Error>> {
+        let json = match fs::read_to_string(path) {
+            Ok(json) => json,
+            Err(e) if e.kind() == std::io::ErrorKind::NotFound => return Ok(Self::new()),
+            Err(e) => return Err(format!("Failed to read {}: {}", path.display(), e).into()),
+        };
+
+        let persisted: PersistedTree = serde_json::from_str(&json)
+            .map_err(|e| format!("Invalid Merkle tree state in {}: {}", path.display(), e))?;
+        if persisted.version != STATE_VERSION {
+            return Ok(Self::new());
+        }
+
+        let file_count = count_leaves(&persisted.root);
+        Ok(Self { root: persisted.root, file_count })
+    }
+
+    /// Writes the tree as JSON, replacing any previous state atomically
+    pub fn save(&self, path: &Path) -> Result<(), Box<dyn std::error::Error>> {
+        if let Some(parent) = path.parent().filter(|parent| !parent.as_os_str().is_empty()) {
+            fs::create_dir_all(parent)?;
+        }
+
+        let json = serde_json::to_string(&PersistedTree { version: STATE_VERSION, root: self.root.clone() })?;
+        let temp_path = path.with_extension("tmp");
+        fs::write(&temp_path, json)?;
+        fs::rename(&temp_path, path)?;
+        Ok(())
+    }
+
+    /// State file for an index, kept beside the SQLite database
+    pub fn path_for_index(database_path: &Path, index_name: &str) -> PathBuf {
+        let stem = database_path
+            .file_stem()
+            .map(|stem| stem.to_string_lossy().to_string())
+            .unwrap_or_else(|| "index".to_string());
+        let index_name: String = index_name
+            .chars()
+            .map(|c| if c.is_alphanumeric() || c == '-' || c == '_' { c } else { '_' })
+            .collect();
+
+        database_path
+            .parent()
+            .unwrap_or_else(|| Path::new("."))
+            .join(format!("{}-{}.merkle.json", stem, index_name))
+    }
+
+    pub fn add_file_node(&mut self, file_node: FileNode) -> Result<(), Box<dyn std::error::Error>> {
+        let leaf = MerkleNode {
+            hash: self.compute_file_hash(&file_node)?,
+            children: BTreeMap::new(),
+            is_leaf: true,
+            last_updated: file_node.last_modified,
+            content_hash: Some(file_node.content_hash),
+            stat: Some(file_node.stat),
+        };
+
+        let components = path_components(&file_node.path);
+        if components.is_empty() {
+            return Err("Cannot add an empty path to the Merkle tree".into());
+        }
+
+        let added = insert_leaf(&mut self.root, &components, leaf);
+        self.file_count = (self.file_count as isize + added) as usize;
+        Ok(())
+    }
+
+    pub fn remove_file_node(&mut self, file_path: &Path) -> Result<(), Box<dyn std::error::Error>> {
+        let components = path_components(file_path);
+        if !components.is_empty() && remove_leaf(&mut self.root, &components) {
+            self.file_count -= 1;
+        }
+        Ok(())
+    }
+
+    fn compute_file_hash(&self, file_node: &FileNode) -> Result<String, Box<dyn std::error::Error>> {
+        let mut hasher = Sha256::new();
+        hasher.update(&file_node.content_hash);
+        hasher.update(&file_node.metadata_hash);
+        hasher.update(&file_node.symbols_hash);
+        hasher.update(&file_node.last_modified.to_be_bytes());
+
+        for dep in &file_node.dependencies {
+            hasher.update(dep.to_string_lossy().as_bytes());
+        }
+
+        Ok(format!("{:x}", hasher.finalize()))
+    }
+
+    pub fn get_root_hash(&self) -> Option<&String> {
+        (!self.root.children.is_empty()).then(|| &self.root.hash)
+    }
+
+    pub fn has_changed(&self, other_root_hash: &str) -> bool {
+        match self.get_root_hash() {
+            Some(root) => root != other_root_hash,
+            None => !other_root_hash.is_empty(),
+        }
+    }
+
+    /// Number of files in the tree
+    pub fn len(&self) -> usize {
+        self.file_count
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.file_count == 0
+    }
+
+    /// Leaf for `file_path`, if the file is in the tree
+    pub fn get_file(&self, file_path: &Path) -> Option<&MerkleNode> {
+        let mut node = &self.root;
+        for component in path_components(file_path) {
+            node = node.children.get(&component)?;
+        }
+        node.is_leaf.then_some(node)
+    }
+
+    /// Records a new stat for a file whose content did not change, e.g. after a `touch`.
+    /// Returns false if the file is not in the tree.
+    pub fn update_stat(&mut self, file_path: &Path, stat: FileStat) -> bool {
+        let mut node = &mut self.root;
+        for component in path_components(file_path) {
+            match node.children.get_mut(&component) {
+                Some(child) => node = child,
+                None => return false,
+            }
+        }
+
+        if node.is_leaf {
+            node.stat = Some(stat);
+        }
+        node.is_leaf
+    }
+
+    /// Every file leaf with its path, in path order
+    pub fn files(&self) -> Vec<(PathBuf, &MerkleNode)> {
+        let mut files = Vec::with_capacity(self.file_count);
+        collect_leaves(&self.root, &mut PathBuf::new(), &mut files);
+        files
+    }
+
+    /// File leaves at or below `path`, in path order
+    pub fn files_under(&self, path: &Path) -> Vec<(PathBuf, &MerkleNode)> {
+        let mut node = &self.root;
+        for component in path_components(path) {
+            match node.children.get(&component) {
+                Some(child) => node = child,
+                None => return Vec::new(),
+            }
+        }
+
+        if node.is_leaf {
+            return vec![(path.to_path_buf(), node)];
+        }
+        let mut files = Vec::new();
+        collect_leaves(node, &mut path.to_path_buf(), &mut files);
+        files
+    }
+
+    /// Adds the files of `other`, a tree over the same codebase checked out at
+    /// `other_root`, moving them under `root`. Files `self` already has are kept.
+    /// Returns the number of files added.
+    pub fn merge(&mut self, other: &MerkleTree, other_root: &Path, root: &Path) -> usize {
+        let mut added = 0;
+        for (path, leaf) in other.files() {
+            let path = match path.strip_prefix(other_root) {
+                Ok(relative) => root.join(relative),
+                Err(_) => path,
+            };
+            let components = path_components(&path);
+            if components.is_empty() || self.get_file(&path).is_some() {
+                continue;
+            }
+            added += insert_leaf(&mut self.root, &components, leaf.clone());
+        }
+
+        self.file_count = (self.file_count as isize + added) as usize;
+        added.max(0) as usize
+    }
+
+    /// Files that are new or changed in `self` relative to `other`
+    pub fn get_changed_files(&self, other: &MerkleTree) -> Vec<PathBuf> {
+        let mut changed_files = Vec::new();
+        diff_nodes(&self.root, Some(&other.root), &mut PathBuf::new(), &mut changed_files);
+        changed_files
+    }
+
+    /// Files present in `other` that `self` no longer has
+    pub fn get_removed_files(&self, other: &MerkleTree) -> Vec<PathBuf> {
+        let mut removed_files = Vec::new();
+        collect_missing(&other.root, &self.root, &mut PathBuf::new(), &mut removed_files);
+        removed_files
+    }
+}
+
+fn path_components(path: &Path) -> Vec<String> {
+    path.components()
+        .map(|component| component.as_os_str().to_string_lossy().to_string())
+        .collect()
+}
+
+/// Inserts `leaf` below `node` and rehashes every directory on the way back up.
+/// Returns the change in the number of files; a file replacing a directory (or the
+/// reverse) drops whatever was there before.
+fn insert_leaf(node: &mut MerkleNode, components: &[String], leaf: MerkleNode) -> isize {
+    let (name, rest) = components.split_first().expect("components are never empty");
+
+    let added = if rest.is_empty() {
+        1 - node.children.insert(name.clone(), leaf).map_or(0, |previous| count_leaves(&previous) as isize)
+    } else {
+        let child = node.children.entry(name.clone()).or_default();
+        let replaced = if child.is_leaf {
+            *child = MerkleNode::default();
+            1
+        } else {
+            0
+        };
+        insert_leaf(child, rest, leaf) - replaced
+    };
+
+    rehash_directory(node);
+    added
+}
+
+/// Removes a leaf, pruning directories it leaves empty. Returns true if it existed.
+fn remove_leaf(node: &mut MerkleNode, components: &[String]) -> bool {
+    let (name, rest) = components.split_first().expect("components are never empty");
+
+    let removed = match node.children.get_mut(name) {
+        Some(child) if rest.is_empty() && child.is_leaf => {
+            node.children.remove(name);
+            true
+        }
+        Some(child) if !rest.is_empty() && !child.is_leaf => {
+            let removed = remove_leaf(child, rest);
+            if child.children.is_empty() {
+                node.children.remove(name);
+            }
+            removed
+        }
+        _ => false,
+    };
+
+    if removed {
+        rehash_directory(node);
+    }
+    removed
+}
+
+fn rehash_directory(node: &mut MerkleNode) {
+    let mut hasher = Sha256::new();
+    for (name, child) in &node.children {
+        hasher.update(if child.is_leaf { b"f" } else { b"d" });
+        hasher.update(name.as_bytes());
+        hasher.update([0u8]);
+        hasher.update(child.hash.as_bytes());
+    }
+
+    node.hash = format!("{:x}", hasher.finalize());
+    node.last_updated = node.children.values().map(|child| child.last_updated).max().unwrap_or(0);
+}
+
+fn count_leaves(node: &MerkleNode) -> usize {
+    if node.is_leaf {
+        1
+    } else {
+        node.children.values().map(count_leaves).sum()
+    }
+}
+
+fn collect_leaves<'a>(node: &'a MerkleNode, path: &mut PathBuf, files: &mut Vec<(PathBuf, &'a MerkleNode)>) {
+    for (name, child) in &node.children {
+        path.push(name);
+        if child.is_leaf {
+            files.push((path.clone(), child));
+        } else {
+            collect_leaves(child, path, files);
+        }
+        path.pop();
+    }
+}
+
+/// Collects leaves of `node` that are absent from or differ in `other`, skipping
+/// subtrees whose hashes already match.
+fn diff_nodes(node: &MerkleNode, other: Option<&MerkleNode>, path: &mut PathBuf, changed: &mut Vec<PathBuf>) {
+    if let Some(other) = other {
+        if other.hash == node.hash && other.is_leaf == node.is_leaf {
+            return;
+        }
+    }
+
+    if node.is_leaf {
+        changed.push(path.clone());
+        return;
+    }
+
+    let other_children = other.filter(|other| !other.is_leaf).map(|other| &other.children);
+    for (name, child) in &node.children {
+        path.push(name);
+        diff_nodes(child, other_children.and_then(|children| children.get(name)), path, changed);
+        path.pop();
+    }
+}
+
+/// Collects leaves of `previous` with no leaf at the same path in `current`
+fn collect_missing(previous: &MerkleNode, current: &MerkleNode, path: &mut PathBuf, missing: &mut Vec<PathBuf>) {
+    if previous.hash == current.hash && previous.is_leaf == current.is_leaf {
+        return;
+    }
+
+    for (name, child) in &previous.children {
+        path.push(name);
+        match current.children.get(name) {
+            Some(current_child) if current_child.is_leaf == child.is_leaf => {
+                if !child.is_leaf {
+                    collect_missing(child, current_child, path, missing);
+                }
+            }
+            _ if child.is_leaf => missing.push(path.clone()),
+            _ => {
+                let mut leaves = Vec::new();
+                collect_leaves(child, path, &mut leaves);
+                missing.extend(leaves.into_iter().map(|(leaf_path, _)| leaf_path));
+            }
+        }
+        path.pop();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn file_node(path: &str, content_hash: &str) -> FileNode {
+        FileNode {
+            path: PathBuf::from(path),
+            content_hash: content_hash.to_string(),
+            metadata_hash: "meta".to_string(),
+            last_modified: 1234567890,
+            size: 1024,
+            stat: FileStat::default(),
+            dependencies: Vec::new(),
+            dependents: Vec::new(),
+            symbols_hash: "symbols".to_string(),
+        }
+    }
+
+    fn create_test_tree() -> MerkleTree {
+        let mut tree = MerkleTree::new();
+        for path in ["src/main.cpp", "src/util/string.cpp", "src/util/string.h", "include/api.h"] {
+            tree.add_file_node(file_node(path, "v1")).unwrap();
+        }
+        tree
+    }
+
+    #[test]
+    fn test_merkle_tree_creation() {
+        let mut tree = MerkleTree::new();
+        assert!(tree.get_root_hash().is_none());
+
+        let result = tree.add_file_node(file_node("test.cpp", "hash123"));
+        assert!(result.is_ok());
+        assert!(tree.get_root_hash().is_some());
+    }
+
+    #[test]
+    fn test_file_hash_computation() {
+        let mut file_node = file_node("test.cpp", "content123");
+        file_node.dependencies = vec![PathBuf::from("header.h")];
+
+        let tree = MerkleTree::new();
+        let hash1 = tree.compute_file_hash(&file_node);
+        let hash2 = tree.compute_file_hash(&file_node);
+
+        assert!(hash1.is_ok());
+        assert!(hash2.is_ok());
+        assert_eq!(hash1.unwrap(), hash2.unwrap());
+    }
+
+    #[test]
+    fn test_root_hash_is_order_independent() {
+        let mut reversed = MerkleTree::new();
+        for path in ["include/api.h", "src/util/string.h", "src/util/string.cpp", "src/main.cpp"] {
+            reversed.add_file_node(file_node(path, "v1")).unwrap();
+        }
+
+        let tree = create_test_tree();
+        assert_eq!(tree.get_root_hash(), reversed.get_root_hash());
+        assert_eq!(tree.len(), 4);
+    }
+
+    #[test]
+    fn test_changed_and_removed_files() {
+        let previous = create_test_tree();
+        let mut current = create_test_tree();
+        current.add_file_node(file_node("src/util/string.h", "v2")).unwrap();
+        current.add_file_node(file_node("src/new.cpp", "v1")).unwrap();
+        current.remove_file_node(Path::new("include/api.h")).unwrap();
+
+        assert_eq!(current.get_changed_files(&previous), vec![PathBuf::from("src/new.cpp"), PathBuf::from("src/util/string.h")]);
+        assert_eq!(current.get_removed_files(&previous), vec![PathBuf::from("include/api.h")]);
+        assert!(previous.get_changed_files(&create_test_tree()).is_empty());
+    }
+
+    #[test]
+    fn test_remove_restores_previous_root() {
+        let mut tree = create_test_tree();
+        let root = tree.get_root_hash().cloned();
+
+        tree.add_file_node(file_node("tools/gen/main.cpp", "v1")).unwrap();
+        assert_ne!(tree.get_root_hash().cloned(), root);
+
+        tree.remove_file_node(Path::new("tools/gen/main.cpp")).unwrap();
+        assert_eq!(tree.get_root_hash().cloned(), root);
+        assert!(tree.get_file(Path::new("tools/gen/main.cpp")).is_none());
+        assert_eq!(tree.len(), 4);
+    }
+
+    #[test]
+    fn test_merge_rebases_shard_trees() {
+        let mut tree = MerkleTree::new();
+        tree.add_file_node(file_node("/a/src/main.cpp", "v1")).unwrap();
+        tree.add_file_node(file_node("/a/include/api.h", "v1")).unwrap();
+
+        let mut shard = MerkleTree::new();
+        shard.add_file_node(file_node("/b/src/util/string.cpp", "v1")).unwrap();
+        shard.add_file_node(file_node("/b/include/api.h", "v2")).unwrap();
+
+        assert_eq!(tree.merge(&shard, Path::new("/b"), Path::new("/a")), 1);
+        assert_eq!(tree.len(), 3);
+        assert!(tree.get_file(Path::new("/a/src/util/string.cpp")).is_some());
+        assert_eq!(tree.get_file(Path::new("/a/include/api.h")).unwrap().content_hash.as_deref(), Some("v1"));
+
+        let mut whole = MerkleTree::new();
+        for path in ["/a/src/main.cpp", "/a/include/api.h", "/a/src/util/string.cpp"] {
+            whole.add_file_node(file_node(path, "v1")).unwrap();
+        }
+        assert_eq!(tree.get_root_hash(), whole.get_root_hash());
+    }
+
+    #[test]
+    fn test_save_and_load_round_trip() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let state_path = temp_dir.path().join("state").join("index.merkle.json");
+
+        let tree = create_test_tree();
+        tree.save(&state_path).unwrap();
+        let loaded = MerkleTree::load(&state_path).unwrap();
+
+        assert_eq!(loaded.get_root_hash(), tree.get_root_hash());
+        assert_eq!(loaded.len(), 4);
+        assert_eq!(loaded.get_file(Path::new("src/main.cpp")).unwrap().content_hash.as_deref(), Some("v1"));
+
+        let mut touched = loaded;
+        let stat = FileStat { modified_ns: 1, size: 2, inode: 3 };
+        assert!(touched.update_stat(Path::new("src/main.cpp"), stat));
+        assert_eq!(touched.get_file(Path::new("src/main.cpp")).unwrap().stat, Some(stat));
+        assert_eq!(touched.get_root_hash(), tree.get_root_hash());
+        assert!(MerkleTree::load(&temp_dir.path().join("missing.json")).unwrap().is_empty());
+    }
+}
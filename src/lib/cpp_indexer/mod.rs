@@ -7,8 +7,28 @@ pub mod tree_sitter_parser;
 pub mod clang_parser;
 pub mod symbol_extractor;
 pub mod incremental;
+pub mod merkle_tree;
+pub mod watcher;
+pub mod pch_cache;
+pub mod compilation_database;
+pub mod include_resolver;
+pub mod dependency_graph;
+pub mod enrichment;
+pub mod shard;
+pub mod memory_budget;
+pub mod git_blobs;
 
 pub use tree_sitter_parser::{TreeSitterParser, ParseResult, ParsedNode};
-pub use clang_parser::{ClangParser, SemanticParseResult, SemanticInfo, SourceLocation};
+pub use clang_parser::{ClangParser, SemanticParseResult, SemanticInfo, SourceLocation, ReferenceEdge, ReferencedSymbol};
 pub use symbol_extractor::{SymbolExtractor, ExtractionResult, ExtractedSymbol};
-pub use incremental::{IncrementalIndexer, IncrementalResult, IndexStatus, IndexAction};
\ No newline at end of file
+pub use incremental::{hash_content, IncrementalIndexer, IncrementalResult, IndexStatus, IndexAction};
+pub use merkle_tree::{MerkleTree, MerkleNode, FileNode, FileStat};
+pub use watcher::{IndexWatcher, WatchSettings, ChangeSink};
+pub use pch_cache::{PchCache, PchCacheStats};
+pub use compilation_database::{CompilationDatabase, CompileCommand};
+pub use include_resolver::IncludeResolver;
+pub use dependency_graph::{DependencyGraph, FileId};
+pub use enrichment::{EnrichmentQueue, EnrichmentJob, EnrichmentSummary};
+pub use shard::ShardSpec;
+pub use memory_budget::{MemoryBudget, Reservation};
+pub use git_blobs::GitBlobs;
\ No newline at end of file
@@ -0,0 +1,265 @@
+use clang::Index;
+use sha2::{Sha256, Digest};
+use std::collections::{HashMap, HashSet};
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+
+/// On-disk cache of precompiled headers built from the leading system includes of a
+/// translation unit. Keys combine that include prefix with the compile flags, so TUs
+/// with the same heavy header preamble share one PCH.
+#[derive(Debug)]
+pub struct PchCache {
+    directory: PathBuf,
+    hits: AtomicU64,
+    misses: AtomicU64,
+    failures: AtomicU64,
+    build_locks: Mutex<HashMap<String, Arc<Mutex<()>>>>,
+    failed_keys: Mutex<HashSet<String>>,
+}
+
+/// Snapshot of cache effectiveness for indexing summaries
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct PchCacheStats {
+    pub hits: u64,
+    pub misses: u64,
+    pub failures: u64,
+}
+
+impl PchCacheStats {
+    /// Fraction of eligible translation units served from an existing PCH
+    pub fn hit_rate(&self) -> f64 {
+        let lookups = self.hits + self.misses;
+        if lookups == 0 {
+            0.0
+        } else {
+            self.hits as f64 / lookups as f64
+        }
+    }
+}
+
+impl PchCache {
+    /// Creates a cache rooted at `directory`, creating it if needed
+    pub fn new(directory: PathBuf) -> Result<Self, Box<dyn std::error::Error>> {
+        fs::create_dir_all(&directory)?;
+
+        Ok(Self {
+            directory,
+            hits: AtomicU64::new(0),
+            misses: AtomicU64::new(0),
+            failures: AtomicU64::new(0),
+            build_locks: Mutex::new(HashMap::new()),
+            failed_keys: Mutex::new(HashSet::new()),
+        })
+    }
+
+    /// Creates the cache in a `<database>-pch` directory beside the SQLite file
+    pub fn for_database(database_path: &Path) -> Result<Self, Box<dyn std::error::Error>> {
+        Self::new(Self::directory_for_database(database_path))
+    }
+
+    pub fn directory_for_database(database_path: &Path) -> PathBuf {
+        let stem = database_path
+            .file_stem()
+            .map(|stem| stem.to_string_lossy().to_string())
+            .unwrap_or_else(|| "index".to_string());
+
+        database_path
+            .parent()
+            .unwrap_or_else(|| Path::new("."))
+            .join(format!("{}-pch", stem))
+    }
+
+    pub fn directory(&self) -> &Path {
+        &self.directory
+    }
+
+    pub fn stats(&self) -> PchCacheStats {
+        PchCacheStats {
+            hits: self.hits.load(Ordering::Relaxed),
+            misses: self.misses.load(Ordering::Relaxed),
+            failures: self.failures.load(Ordering::Relaxed),
+        }
+    }
+
+    /// Returns a PCH covering the file's include prefix, building it on first use.
+    /// `None` means the file has no shareable prefix or the PCH could not be built.
+    pub fn lookup_or_build(
+        &self,
+        index: &Index<'_>,
+        content: &str,
+        compile_flags: &[String],
+    ) -> Option<PathBuf> {
+        let prefix = include_prefix(content);
+        if prefix.is_empty() {
+            return None;
+        }
+
+        let key = cache_key(&prefix, compile_flags);
+        let pch_path = self.directory.join(format!("{}.pch", key));
+
+        if pch_path.exists() {
+            self.hits.fetch_add(1, Ordering::Relaxed);
+            return Some(pch_path);
+        }
+
+        if self.failed_keys.lock().map_or(false, |failed| failed.contains(&key)) {
+            return None;
+        }
+
+        // Only one worker builds a given key; the others wait and then reuse it.
+        let build_lock = {
+            let mut locks = self.build_locks.lock().ok()?;
+            Arc::clone(locks.entry(key.clone()).or_default())
+        };
+        let _guard = build_lock.lock().ok()?;
+
+        if pch_path.exists() {
+            self.hits.fetch_add(1, Ordering::Relaxed);
+            return Some(pch_path);
+        }
+
+        self.misses.fetch_add(1, Ordering::Relaxed);
+        match self.build(index, &key, &prefix, compile_flags, &pch_path) {
+            Ok(()) => Some(pch_path),
+            Err(_) => {
+                self.failures.fetch_add(1, Ordering::Relaxed);
+                if let Ok(mut failed) = self.failed_keys.lock() {
+                    failed.insert(key);
+                }
+                None
+            }
+        }
+    }
+
+    /// Removes every cached PCH, e.g. after a toolchain or system header upgrade
+    pub fn clear(&self) -> Result<(), Box<dyn std::error::Error>> {
+        for entry in fs::read_dir(&self.directory)? {
+            let path = entry?.path();
+            if path.is_file() {
+                fs::remove_file(path)?;
+            }
+        }
+
+        if let Ok(mut failed) = self.failed_keys.lock() {
+            failed.clear();
+        }
+        Ok(())
+    }
+
+    fn build(
+        &self,
+        index: &Index<'_>,
+        key: &str,
+        prefix: &[&str],
+        compile_flags: &[String],
+        pch_path: &Path,
+    ) -> Result<(), Box<dyn std::error::Error>> {
+        let header_path = self.directory.join(format!("{}.hpp", key));
+        fs::write(&header_path, prefix.join("\n") + "\n")?;
+
+        let mut arguments = compile_flags.to_vec();
+        arguments.push("-x".to_string());
+        arguments.push("c++-header".to_string());
+
+        let translation_unit = index
+            .parser(&header_path)
+            .arguments(&arguments)
+            .parse()
+            .map_err(|e| format!("Failed to parse PCH header: {:?}", e))?;
+
+        // Write under a temporary name so readers never observe a partial file.
+        let temp_path = pch_path.with_extension("pch.tmp");
+        translation_unit
+            .save(&temp_path)
+            .map_err(|e| format!("Failed to save PCH: {:?}", e))?;
+        fs::rename(&temp_path, pch_path)?;
+        Ok(())
+    }
+}
+
+/// Leading run of `#include <...>` directives, skipping blank lines, comments and
+/// `#pragma once`. Quoted includes end the prefix since they resolve per directory.
+pub fn include_prefix(content: &str) -> Vec<&str> {
+    let mut prefix = Vec::new();
+    let mut in_block_comment = false;
+
+    for line in content.lines() {
+        let trimmed = line.trim();
+
+        if in_block_comment {
+            if trimmed.contains("*/") {
+                in_block_comment = false;
+            }
+            continue;
+        }
+
+        if trimmed.is_empty() || trimmed.starts_with("//") || trimmed == "#pragma once" {
+            continue;
+        }
+
+        if trimmed.starts_with("/*") {
+            in_block_comment = !trimmed.contains("*/");
+            continue;
+        }
+
+        let directive = trimmed.trim_start_matches('#').trim_start();
+        if trimmed.starts_with('#') && directive.starts_with("include") && directive.contains('<') {
+            prefix.push(trimmed);
+        } else {
+            break;
+        }
+    }
+
+    prefix
+}
+
+fn cache_key(prefix: &[&str], compile_flags: &[String]) -> String {
+    let mut hasher = Sha256::new();
+    for flag in compile_flags {
+        hasher.update(flag.as_bytes());
+        hasher.update([0u8]);
+    }
+    for line in prefix {
+        hasher.update(line.as_bytes());
+        hasher.update([b'\n']);
+    }
+    format!("{:x}", hasher.finalize())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_include_prefix_stops_at_code() {
+        let content = "// header\n#pragma once\n\n#include <vector>\n#include <string>\n#include \"local.h\"\n#include <map>\n";
+        assert_eq!(include_prefix(content), vec!["#include <vector>", "#include <string>"]);
+
+        assert!(include_prefix("int main() {}\n#include <vector>\n").is_empty());
+    }
+
+    #[test]
+    fn test_cache_key_depends_on_flags() {
+        let prefix = vec!["#include <vector>"];
+        let cpp17 = cache_key(&prefix, &["-std=c++17".to_string()]);
+        let cpp20 = cache_key(&prefix, &["-std=c++20".to_string()]);
+
+        assert_ne!(cpp17, cpp20);
+        assert_eq!(cpp17, cache_key(&prefix, &["-std=c++17".to_string()]));
+    }
+
+    #[test]
+    fn test_directory_for_database() {
+        let directory = PchCache::directory_for_database(Path::new("/data/cpp-index.db"));
+        assert_eq!(directory, PathBuf::from("/data/cpp-index-pch"));
+    }
+
+    #[test]
+    fn test_hit_rate() {
+        let stats = PchCacheStats { hits: 3, misses: 1, failures: 0 };
+        assert!((stats.hit_rate() - 0.75).abs() < f64::EPSILON);
+        assert_eq!(PchCacheStats::default().hit_rate(), 0.0);
+    }
+}
@@ -0,0 +1,103 @@
+use std::collections::HashSet;
+use std::fs;
+use std::path::{Path, PathBuf};
+use xxhash_rust::xxh3::xxh3_64;
+
+/// The part of a codebase one machine indexes when a large tree is split across
+/// several. Each node builds a partial index of its shard and `index merge` joins the
+/// shard databases into one.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum ShardSpec {
+    /// Files whose path relative to the root hashes to `shard` modulo `count`
+    Hash { shard: u32, count: u32 },
+    /// An explicit list of files, relative to the root
+    Files(HashSet<PathBuf>),
+}
+
+impl ShardSpec {
+    /// Parses `K/N`, shard K of N counting from 0
+    pub fn parse(spec: &str) -> Result<Self, Box<dyn std::error::Error>> {
+        let (shard, count) = spec
+            .split_once('/')
+            .ok_or_else(|| format!("Shard must be given as K/N, got '{}'", spec))?;
+        let shard: u32 = shard.trim().parse().map_err(|_| format!("Invalid shard number in '{}'", spec))?;
+        let count: u32 = count.trim().parse().map_err(|_| format!("Invalid shard count in '{}'", spec))?;
+
+        if count == 0 || shard >= count {
+            return Err(format!("Shard {} is out of range for {} shards", shard, count).into());
+        }
+        Ok(ShardSpec::Hash { shard, count })
+    }
+
+    /// Reads one path per line, skipping blank lines and `#` comments. Absolute paths
+    /// under `root` are made relative to it.
+    pub fn from_file_list(list_path: &Path, root: &Path) -> Result<Self, Box<dyn std::error::Error>> {
+        let list = fs::read_to_string(list_path)
+            .map_err(|e| format!("Failed to read {}: {}", list_path.display(), e))?;
+
+        let files = list
+            .lines()
+            .map(str::trim)
+            .filter(|line| !line.is_empty() && !line.starts_with('#'))
+            .map(|line| {
+                let path = Path::new(line);
+                path.strip_prefix(root).unwrap_or(path).to_path_buf()
+            })
+            .collect();
+        Ok(ShardSpec::Files(files))
+    }
+
+    /// Whether `path`, found while walking `root`, belongs to this shard
+    pub fn contains(&self, root: &Path, path: &Path) -> bool {
+        let relative = path.strip_prefix(root).unwrap_or(path);
+        match self {
+            ShardSpec::Hash { shard, count } => shard_of(relative, *count) == *shard,
+            ShardSpec::Files(files) => files.contains(relative),
+        }
+    }
+}
+
+/// Hashes the path with `/` separators, so every node assigns a file to the same shard
+/// whatever its platform or checkout location
+fn shard_of(relative: &Path, count: u32) -> u32 {
+    let key: Vec<_> = relative.components().map(|component| component.as_os_str().to_string_lossy()).collect();
+    (xxh3_64(key.join("/").as_bytes()) % count as u64) as u32
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_hash_shards_partition_files() {
+        assert!(ShardSpec::parse("4/4").is_err());
+        assert!(ShardSpec::parse("1").is_err());
+
+        let root = Path::new("/work/project");
+        let shards: Vec<ShardSpec> = (0..4).map(|shard| ShardSpec::parse(&format!("{}/4", shard)).unwrap()).collect();
+        for n in 0..100 {
+            let path = root.join(format!("src/module{}/file{}.cpp", n % 7, n));
+            assert_eq!(shards.iter().filter(|shard| shard.contains(root, &path)).count(), 1);
+        }
+
+        // The assignment only depends on the path below the root
+        let elsewhere = Path::new("/home/ci/checkout");
+        let relative = Path::new("src/module1/file1.cpp");
+        for shard in &shards {
+            assert_eq!(shard.contains(root, &root.join(relative)), shard.contains(elsewhere, &elsewhere.join(relative)));
+        }
+    }
+
+    #[test]
+    fn test_file_list_shard() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let root = temp_dir.path().join("project");
+        let list_path = temp_dir.path().join("files.txt");
+        fs::write(&list_path, format!("# shard 0\nsrc/main.cpp\n\n{}\n", root.join("include/api.h").display())).unwrap();
+
+        let shard = ShardSpec::from_file_list(&list_path, &root).unwrap();
+        assert!(shard.contains(&root, &root.join("src/main.cpp")));
+        assert!(shard.contains(&root, &root.join("include/api.h")));
+        assert!(!shard.contains(&root, &root.join("src/other.cpp")));
+    }
+}
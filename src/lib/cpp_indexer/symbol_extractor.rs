@@ -1,9 +1,14 @@
 use crate::lib::cpp_indexer::tree_sitter_parser::{TreeSitterParser, ParseResult, ParsedNode};
-use crate::lib::cpp_indexer::clang_parser::{ClangParser, SemanticParseResult, SemanticInfo};
+use crate::lib::cpp_indexer::clang_parser::{ClangParser, ReferenceEdge, SemanticParseResult, SemanticInfo};
+use crate::lib::cpp_indexer::compilation_database::CompilationDatabase;
+use crate::lib::cpp_indexer::pch_cache::PchCache;
 use crate::lib::storage::models::code_element::{SymbolType, AccessModifier};
+use crate::lib::storage::models::file_metadata::ExtractionTier;
+use crate::lib::metrics::{self, Stage};
 use clang::EntityKind;
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet};
 use std::path::{Path, PathBuf};
+use std::sync::Arc;
 use tokio::time::Instant;
 
 #[derive(Debug, Clone)]
@@ -28,6 +33,8 @@ pub struct ExtractedSymbol {
     pub documentation: Option<String>,
     pub is_definition: bool,
     pub is_declaration: bool,
+    /// libclang USR; `None` for symbols only tree-sitter saw
+    pub usr: Option<String>,
 }
 
 pub struct SymbolExtractor {
@@ -46,13 +53,50 @@ impl SymbolExtractor {
         })
     }
 
+    /// Sets the memory budget for translation units the clang parser keeps for reparsing
+    pub fn with_unit_cache_limit(mut self, limit_bytes: usize) -> Self {
+        self.clang_parser = self.clang_parser.with_unit_cache_limit(limit_bytes);
+        self
+    }
+
+    /// Lets the clang parser reuse precompiled headers for shared include prefixes
+    pub fn with_pch_cache(mut self, pch_cache: Arc<PchCache>) -> Self {
+        self.clang_parser = self.clang_parser.with_pch_cache(pch_cache);
+        self
+    }
+
+    /// Parses each file with the flags from its compile command
+    pub fn with_compilation_database(mut self, compilation_database: Arc<CompilationDatabase>) -> Self {
+        self.clang_parser = self.clang_parser.with_compilation_database(compilation_database);
+        self
+    }
+
+    /// Keeps syntax trees of up to `files` recently parsed files, so re-extracting an
+    /// edited file re-parses it incrementally
+    pub fn with_tree_cache(mut self, files: usize) -> Self {
+        self.tree_sitter_parser = self.tree_sitter_parser.with_tree_cache(files);
+        self
+    }
+
+    /// Releases any cached parser state held for a file.
+    pub fn evict_cached_unit(&mut self, file_path: &Path) {
+        self.clang_parser.evict_unit(file_path);
+        self.tree_sitter_parser.evict(file_path);
+    }
+
     pub async fn extract_symbols(&mut self, file_path: &Path) -> Result<ExtractionResult, Box<dyn std::error::Error>> {
+        let content = tokio::fs::read_to_string(file_path).await?;
+        self.extract_symbols_from_content(file_path, &content)
+    }
+
+    /// Synchronous extraction over already-loaded content, for use on blocking worker threads.
+    pub fn extract_symbols_from_content(&mut self, file_path: &Path, content: &str) -> Result<ExtractionResult, Box<dyn std::error::Error>> {
         let start_time = Instant::now();
+
+        let tree_sitter_result = metrics::time(Stage::TreeSitter, || self.tree_sitter_parser.parse_content(content, file_path))?;
+        let clang_result = metrics::time(Stage::Clang, || self.clang_parser.parse_content(file_path, content))?;
         
-        let tree_sitter_result = self.tree_sitter_parser.parse_file(file_path).await?;
-        let clang_result = self.clang_parser.parse_file(file_path)?;
-        
-        let symbols = self.merge_parser_results(&tree_sitter_result, &clang_result)?;
+        let symbols = metrics::time(Stage::Merge, || self.merge_parser_results(&tree_sitter_result, &clang_result))?;
         
         let extraction_time = start_time.elapsed();
         
@@ -63,46 +107,70 @@ impl SymbolExtractor {
             extraction_time_ms: extraction_time.as_millis() as u32,
             tree_sitter_symbols: tree_sitter_result.symbols.len(),
             clang_symbols: clang_result.symbols.len(),
+            tier: ExtractionTier::Semantic,
+            edges: clang_result.edges,
+            content_hash: String::new(),
+            content_size: content.len() as u64,
+        })
+    }
+
+    /// Tree-sitter only extraction, for headers whose semantics already arrive through an including TU
+    /// and for the fast first tier of deferred enrichment.
+    pub fn extract_syntax_from_content(&mut self, file_path: &Path, content: &str) -> Result<ExtractionResult, Box<dyn std::error::Error>> {
+        let start_time = Instant::now();
+
+        let tree_sitter_result = metrics::time(Stage::TreeSitter, || self.tree_sitter_parser.parse_content(content, file_path))?;
+        let clang_result = SemanticParseResult {
+            file_path: file_path.to_path_buf(),
+            symbols: Vec::new(),
+            references: HashMap::new(),
+            type_hierarchy: HashMap::new(),
+            edges: Vec::new(),
+        };
+        
+        let symbols = metrics::time(Stage::Merge, || self.merge_parser_results(&tree_sitter_result, &clang_result))?;
+        
+        Ok(ExtractionResult {
+            file_path: file_path.to_path_buf(),
+            symbols,
+            includes: tree_sitter_result.includes,
+            extraction_time_ms: start_time.elapsed().as_millis() as u32,
+            tree_sitter_symbols: tree_sitter_result.symbols.len(),
+            clang_symbols: 0,
+            tier: ExtractionTier::Syntax,
+            edges: Vec::new(),
+            content_hash: String::new(),
+            content_size: content.len() as u64,
         })
     }
 
-    fn merge_parser_results(
+    pub fn merge_parser_results(
         &self,
         tree_sitter_result: &ParseResult,
         clang_result: &SemanticParseResult,
     ) -> Result<Vec<ExtractedSymbol>, Box<dyn std::error::Error>> {
         let mut symbols = Vec::new();
-        let mut processed_locations = std::collections::HashSet::new();
+        // Symbols are deduplicated by location; clang results may span several files.
+        let mut file_ids: HashMap<&Path, u32> = HashMap::new();
+        let mut processed_locations: HashSet<(u32, u32, u32)> = HashSet::new();
+        fn location_key<'a>(file_ids: &mut HashMap<&'a Path, u32>, file_path: &'a Path, line: u32, column: u32) -> (u32, u32, u32) {
+            let next_id = file_ids.len() as u32;
+            (*file_ids.entry(file_path).or_insert(next_id), line, column)
+        }
 
         for semantic_info in &clang_result.symbols {
-            let extracted_symbol = self.convert_semantic_to_extracted(semantic_info, clang_result)?;
-            
-            let location_key = format!(
-                "{}:{}:{}",
-                extracted_symbol.file_path.display(),
-                extracted_symbol.start_line,
-                extracted_symbol.start_column
-            );
-            
-            if !processed_locations.contains(&location_key) {
-                processed_locations.insert(location_key);
-                symbols.push(extracted_symbol);
+            let location = &semantic_info.location;
+            if processed_locations.insert(location_key(&mut file_ids, &location.file_path, location.line, location.column)) {
+                symbols.push(self.convert_semantic_to_extracted(semantic_info, clang_result)?);
             }
         }
 
         for parsed_node in &tree_sitter_result.symbols {
-            let extracted_symbol = self.convert_parsed_to_extracted(parsed_node, &tree_sitter_result.file_path)?;
-            
-            let location_key = format!(
-                "{}:{}:{}",
-                extracted_symbol.file_path.display(),
-                extracted_symbol.start_line,
-                extracted_symbol.start_column
-            );
-            
-            if !processed_locations.contains(&location_key) {
-                processed_locations.insert(location_key);
-                symbols.push(extracted_symbol);
+            let (line, column) = (parsed_node.start_row as u32 + 1, parsed_node.start_col as u32);
+            let key = location_key(&mut file_ids, &tree_sitter_result.file_path, line, column);
+            if processed_locations.insert(key) {
+                let text = tree_sitter_result.text(parsed_node);
+                symbols.push(self.convert_parsed_to_extracted(parsed_node, text, &tree_sitter_result.file_path)?);
             }
         }
 
@@ -157,18 +225,20 @@ impl SymbolExtractor {
             documentation: None,
             is_definition: semantic_info.is_definition,
             is_declaration: semantic_info.is_declaration,
+            usr: semantic_info.usr.clone(),
         })
     }
 
     fn convert_parsed_to_extracted(
         &self,
         parsed_node: &ParsedNode,
+        text: &str,
         file_path: &PathBuf,
     ) -> Result<ExtractedSymbol, Box<dyn std::error::Error>> {
-        let symbol_type = self.parse_kind_to_symbol_type(&parsed_node.kind);
+        let symbol_type = self.parse_kind_to_symbol_type(parsed_node.kind);
         
         Ok(ExtractedSymbol {
-            name: parsed_node.name.as_ref().unwrap_or(&parsed_node.text).clone(),
+            name: text.to_string(),
             symbol_type,
             visibility: None,
             file_path: file_path.clone(),
@@ -176,8 +246,8 @@ impl SymbolExtractor {
             end_line: parsed_node.end_row as u32 + 1,
             start_column: parsed_node.start_col as u32,
             end_column: parsed_node.end_col as u32,
-            content: parsed_node.text.clone(),
-            fully_qualified_name: parsed_node.name.as_ref().unwrap_or(&parsed_node.text).clone(),
+            content: text.to_string(),
+            fully_qualified_name: text.to_string(),
             namespace_path: Vec::new(),
             dependencies: Vec::new(),
             template_parameters: Vec::new(),
@@ -188,6 +258,7 @@ impl SymbolExtractor {
             documentation: None,
             is_definition: true,
             is_declaration: false,
+            usr: None,
         })
     }
 
@@ -307,7 +378,7 @@ impl SymbolExtractor {
                 symbol.base_classes = inheritance_info.base_classes.clone();
             }
             
-            if let Some(references) = clang_result.references.get(&symbol.name) {
+            if let Some(references) = symbol.usr.as_ref().and_then(|usr| clang_result.references.get(usr)) {
                 symbol.dependencies.extend(
                     references
                         .iter()
@@ -374,6 +445,14 @@ pub struct ExtractionResult {
     pub extraction_time_ms: u32,
     pub tree_sitter_symbols: usize,
     pub clang_symbols: usize,
+    /// `Syntax` when libclang was skipped and the file still needs enrichment
+    pub tier: ExtractionTier,
+    /// Reference edges libclang found; empty for syntax-only extraction
+    pub edges: Vec<ReferenceEdge>,
+    /// Content hash of the parsed text, stored as the file's hash: a git blob id or a
+    /// `hash_content` digest. Empty until the caller that read the file sets it.
+    pub content_hash: String,
+    pub content_size: u64,
 }
 
 impl ExtractionResult {
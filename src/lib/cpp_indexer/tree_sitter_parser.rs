@@ -1,30 +1,128 @@
-use std::collections::HashMap;
-use std::path::Path;
+use std::borrow::Cow;
+use std::collections::{HashMap, HashSet};
+use std::ops::Range;
+use std::path::{Path, PathBuf};
 use tokio::fs;
-use tree_sitter::{Language, Parser, Query, QueryCursor, Tree};
+use tree_sitter::{InputEdit, Language, Node, Parser, Point, Query, QueryCursor, Tree};
 
 extern "C" {
     fn tree_sitter_cpp() -> Language;
 }
 
-#[derive(Debug, Clone)]
+/// Extraction query: symbol patterns followed by the include pattern, so one pass over
+/// the tree finds both
+const EXTRACTION_QUERY: &str = r#"
+    (class_specifier
+      name: (type_identifier) @class.name) @class.definition
+
+    (struct_specifier
+      name: (type_identifier) @struct.name) @struct.definition
+
+    (function_definition
+      declarator: [
+        (function_declarator
+          declarator: (identifier) @function.name)
+        (function_declarator
+          declarator: (qualified_identifier
+            name: (identifier) @function.name))
+      ]) @function.definition
+
+    (declaration
+      declarator: [
+        (function_declarator
+          declarator: (identifier) @function.name)
+        (function_declarator
+          declarator: (qualified_identifier
+            name: (identifier) @function.name))
+      ]) @function.declaration
+
+    (field_declaration
+      declarator: (field_declarator
+        declarator: (identifier) @field.name)) @field.definition
+
+    (declaration
+      declarator: (init_declarator
+        declarator: (identifier) @variable.name)) @variable.definition
+
+    (enum_specifier
+      name: (type_identifier) @enum.name) @enum.definition
+
+    (enumerator
+      name: (identifier) @enum.member.name) @enum.member.definition
+
+    (namespace_definition
+      name: (identifier) @namespace.name) @namespace.definition
+
+    (using_declaration
+      (qualified_identifier
+        name: (identifier) @using.name)) @using.declaration
+
+    (type_definition
+      declarator: (type_identifier) @typedef.name) @typedef.definition
+
+    (template_declaration
+      [
+        (class_specifier
+          name: (type_identifier) @template.class.name)
+        (function_definition
+          declarator: (function_declarator
+            declarator: (identifier) @template.function.name))
+      ]) @template.definition
+
+    (preproc_include
+      path: [
+        (string_literal)
+        (system_lib_string)
+      ] @include)
+    "#;
+
+/// Every capture name in `EXTRACTION_QUERY`, so nodes can name their kind without
+/// allocating
+const CAPTURE_KINDS: [&str; 25] = [
+    "class.name", "class.definition",
+    "struct.name", "struct.definition",
+    "function.name", "function.definition", "function.declaration",
+    "field.name", "field.definition",
+    "variable.name", "variable.definition",
+    "enum.name", "enum.definition",
+    "enum.member.name", "enum.member.definition",
+    "namespace.name", "namespace.definition",
+    "using.name", "using.declaration",
+    "typedef.name", "typedef.definition",
+    "template.class.name", "template.function.name", "template.definition",
+    "include",
+];
+
+/// A captured node, by position only; its text is borrowed from the source on demand
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub struct ParsedNode {
-    pub kind: String,
-    pub name: Option<String>,
+    pub kind: &'static str,
     pub start_byte: usize,
     pub end_byte: usize,
     pub start_row: usize,
     pub start_col: usize,
     pub end_row: usize,
     pub end_col: usize,
-    pub text: String,
+}
+
+impl ParsedNode {
+    /// The node's text in the `source` it was parsed from
+    pub fn text<'a>(&self, source: &'a str) -> &'a str {
+        source.get(self.start_byte..self.end_byte).unwrap_or("")
+    }
 }
 
 pub struct TreeSitterParser {
     parser: Parser,
     query_cursor: QueryCursor,
-    symbols_query: Query,
-    includes_query: Query,
+    query: Query,
+    /// `CAPTURE_KINDS` entry of each capture index of `query`
+    capture_kinds: Vec<&'static str>,
+    include_capture: u32,
+    trees: HashMap<PathBuf, CachedTree>,
+    tree_cache_limit: usize,
+    /// Parse counter, for evicting the least recently parsed tree
+    uses: u64,
 }
 
 impl TreeSitterParser {
@@ -33,212 +131,340 @@ impl TreeSitterParser {
         let mut parser = Parser::new();
         parser.set_language(language)?;
 
-        let symbols_query = Query::new(
-            language,
-            r#"
-            (class_specifier
-              name: (type_identifier) @class.name) @class.definition
-
-            (struct_specifier
-              name: (type_identifier) @struct.name) @struct.definition
-
-            (function_definition
-              declarator: [
-                (function_declarator
-                  declarator: (identifier) @function.name)
-                (function_declarator
-                  declarator: (qualified_identifier
-                    name: (identifier) @function.name))
-              ]) @function.definition
-
-            (declaration
-              declarator: [
-                (function_declarator
-                  declarator: (identifier) @function.name)
-                (function_declarator
-                  declarator: (qualified_identifier
-                    name: (identifier) @function.name))
-              ]) @function.declaration
-
-            (field_declaration
-              declarator: (field_declarator
-                declarator: (identifier) @field.name)) @field.definition
-
-            (declaration
-              declarator: (init_declarator
-                declarator: (identifier) @variable.name)) @variable.definition
-
-            (enum_specifier
-              name: (type_identifier) @enum.name) @enum.definition
-
-            (enumerator
-              name: (identifier) @enum.member.name) @enum.member.definition
-
-            (namespace_definition
-              name: (identifier) @namespace.name) @namespace.definition
-
-            (using_declaration
-              (qualified_identifier
-                name: (identifier) @using.name)) @using.declaration
-
-            (type_definition
-              declarator: (type_identifier) @typedef.name) @typedef.definition
-
-            (template_declaration
-              [
-                (class_specifier
-                  name: (type_identifier) @template.class.name)
-                (function_definition
-                  declarator: (function_declarator
-                    declarator: (identifier) @template.function.name))
-              ]) @template.definition
-            "#,
-        )?;
-
-        let includes_query = Query::new(
-            language,
-            r#"
-            (preproc_include
-              path: [
-                (string_literal) @include.path
-                (system_lib_string) @include.system_path
-              ]) @include.directive
-            "#,
-        )?;
+        let query = Query::new(language, EXTRACTION_QUERY)?;
+        let capture_kinds = query
+            .capture_names()
+            .iter()
+            .map(|name| {
+                CAPTURE_KINDS
+                    .iter()
+                    .find(|&&kind| kind == name)
+                    .copied()
+                    .ok_or_else(|| format!("Capture @{} is missing from CAPTURE_KINDS", name))
+            })
+            .collect::<Result<Vec<_>, _>>()?;
+        let include_capture = query.capture_index_for_name("include").ok_or("Extraction query has no @include capture")?;
 
         Ok(Self {
             parser,
             query_cursor: QueryCursor::new(),
-            symbols_query,
-            includes_query,
+            query,
+            capture_kinds,
+            include_capture,
+            trees: HashMap::new(),
+            tree_cache_limit: 0,
+            uses: 0,
         })
     }
 
-    pub async fn parse_file(&mut self, file_path: &Path) -> Result<ParseResult, Box<dyn std::error::Error>> {
+    /// Keeps the trees of up to `limit` recently parsed files so re-parsing one of them
+    /// after an edit reuses its previous tree and re-queries only what changed
+    pub fn with_tree_cache(mut self, limit: usize) -> Self {
+        self.tree_cache_limit = limit;
+        self
+    }
+
+    /// Drops the cached tree for a file, e.g. once it is deleted
+    pub fn evict(&mut self, file_path: &Path) {
+        self.trees.remove(file_path);
+    }
+
+    pub async fn parse_file(&mut self, file_path: &Path) -> Result<ParseResult<'static>, Box<dyn std::error::Error>> {
         let content = fs::read_to_string(file_path).await?;
-        self.parse_content(&content, file_path)
+        let ParseResult { symbols, includes, tree, .. } = self.parse_content(&content, file_path)?;
+        Ok(ParseResult { file_path: file_path.to_path_buf(), symbols, includes, tree, content: Cow::Owned(content) })
     }
 
-    pub fn parse_content(&mut self, content: &str, file_path: &Path) -> Result<ParseResult, Box<dyn std::error::Error>> {
-        let tree = self.parser.parse(content, None).ok_or("Failed to parse content")?;
-        
-        let symbols = self.extract_symbols(&tree, content)?;
-        let includes = self.extract_includes(&tree, content)?;
-        
-        Ok(ParseResult {
+    /// Parses `content`; when the file's previous tree is cached, the edit is worked
+    /// out by diffing against the previous content and the parse is incremental
+    pub fn parse_content<'a>(&mut self, content: &'a str, file_path: &Path) -> Result<ParseResult<'a>, Box<dyn std::error::Error>> {
+        let edits: Vec<InputEdit> = match self.trees.get(file_path) {
+            Some(cached) => compute_edit(&cached.content, content).into_iter().collect(),
+            None => Vec::new(),
+        };
+        self.parse_with_edits(content, file_path, &edits)
+    }
+
+    /// Parses `content`, reusing the cached tree of the previous version adjusted by
+    /// `edits`, which must turn that version into `content`. Without a cached tree
+    /// the file is parsed from scratch.
+    pub fn parse_with_edits<'a>(
+        &mut self,
+        content: &'a str,
+        file_path: &Path,
+        edits: &[InputEdit],
+    ) -> Result<ParseResult<'a>, Box<dyn std::error::Error>> {
+        let parsed = match self.trees.remove(file_path) {
+            Some(cached) if edits.is_empty() && cached.content == content => cached.parsed,
+            Some(cached) => self.reparse(cached.parsed, content, edits)?,
+            None => self.parse_fresh(content)?,
+        };
+
+        let includes = parsed.includes.iter().map(|include| include_path(include.text(content)).to_string()).collect();
+        if self.tree_cache_limit == 0 {
+            return Ok(ParseResult {
+                file_path: file_path.to_path_buf(),
+                symbols: parsed.symbols,
+                includes,
+                tree: Some(parsed.tree),
+                content: Cow::Borrowed(content),
+            });
+        }
+
+        let result = ParseResult {
             file_path: file_path.to_path_buf(),
-            symbols,
+            symbols: parsed.symbols.clone(),
             includes,
-            tree: Some(tree),
-            content: content.to_string(),
-        })
+            tree: Some(parsed.tree.clone()),
+            content: Cow::Borrowed(content),
+        };
+        self.remember(file_path, CachedTree { parsed, content: content.to_string(), last_used: 0 });
+        Ok(result)
     }
 
-    fn extract_symbols(&mut self, tree: &Tree, content: &str) -> Result<Vec<ParsedNode>, Box<dyn std::error::Error>> {
-        let mut symbols = Vec::new();
-        let captures = self.query_cursor.matches(&self.symbols_query, tree.root_node(), content.as_bytes());
-
-        for match_ in captures {
-            for capture in match_.captures {
-                let node = capture.node;
-                let capture_name = &self.symbols_query.capture_names()[capture.index as usize];
-                
-                let text = node.utf8_text(content.as_bytes()).unwrap_or("");
-                
-                let symbol = ParsedNode {
-                    kind: capture_name.to_string(),
-                    name: Some(text.to_string()),
-                    start_byte: node.start_byte(),
-                    end_byte: node.end_byte(),
-                    start_row: node.start_position().row,
-                    start_col: node.start_position().column,
-                    end_row: node.end_position().row,
-                    end_col: node.end_position().column,
-                    text: text.to_string(),
-                };
-                
-                symbols.push(symbol);
+    fn parse_fresh(&mut self, content: &str) -> Result<ParsedTree, Box<dyn std::error::Error>> {
+        let tree = self.parser.parse(content, None).ok_or("Failed to parse content")?;
+        let (symbols, includes) = self.run_query(&tree, content, &[0..content.len()]);
+
+        Ok(ParsedTree { tree, symbols, includes })
+    }
+
+    /// Applies `edits` to the previous tree, re-parses, and re-runs the query only
+    /// over the ranges whose syntax or text changed; everything else is shifted
+    fn reparse(&mut self, previous: ParsedTree, content: &str, edits: &[InputEdit]) -> Result<ParsedTree, Box<dyn std::error::Error>> {
+        let ParsedTree { tree: mut old_tree, mut symbols, mut includes } = previous;
+        for edit in edits {
+            old_tree.edit(edit);
+            shift_nodes(&mut symbols, edit);
+            shift_nodes(&mut includes, edit);
+        }
+
+        let tree = self.parser.parse(content, Some(&old_tree)).ok_or("Failed to parse content")?;
+
+        // A rename leaves the syntax alone, so edited text is re-queried as well.
+        let mut ranges: Vec<Range<usize>> = old_tree.changed_ranges(&tree).map(|range| range.start_byte..range.end_byte).collect();
+        ranges.extend(
+            edits
+                .iter()
+                .map(|edit| edit.start_byte.saturating_sub(1)..(edit.new_end_byte + 1).min(content.len())),
+        );
+        let ranges = merge_ranges(ranges);
+
+        let (new_symbols, new_includes) = self.run_query(&tree, content, &ranges);
+        replace_in_ranges(&mut symbols, new_symbols, &ranges);
+        replace_in_ranges(&mut includes, new_includes, &ranges);
+
+        Ok(ParsedTree { tree, symbols, includes })
+    }
+
+    fn remember(&mut self, file_path: &Path, mut cached: CachedTree) {
+        self.uses += 1;
+        cached.last_used = self.uses;
+        if self.trees.len() >= self.tree_cache_limit {
+            let oldest = self.trees.iter().min_by_key(|(_, tree)| tree.last_used).map(|(path, _)| path.clone());
+            if let Some(oldest) = oldest {
+                self.trees.remove(&oldest);
             }
         }
-        
-        Ok(symbols)
+        self.trees.insert(file_path.to_path_buf(), cached);
     }
 
-    fn extract_includes(&mut self, tree: &Tree, content: &str) -> Result<Vec<String>, Box<dyn std::error::Error>> {
+    /// Runs the extraction query once over `ranges` with the parser's own cursor.
+    /// Returns the symbol and include captures of matches touching them; captures are
+    /// positions only, so nothing is allocated per capture beyond its slot in the result.
+    fn run_query(&mut self, tree: &Tree, content: &str, ranges: &[Range<usize>]) -> (Vec<ParsedNode>, Vec<ParsedNode>) {
+        let mut symbols = Vec::new();
         let mut includes = Vec::new();
-        let captures = self.query_cursor.matches(&self.includes_query, tree.root_node(), content.as_bytes());
-
-        for match_ in captures {
-            for capture in match_.captures {
-                let node = capture.node;
-                let text = node.utf8_text(content.as_bytes()).unwrap_or("");
-                
-                let include_path = text.trim_matches('"').trim_matches('<').trim_matches('>');
-                includes.push(include_path.to_string());
+
+        for range in ranges {
+            self.query_cursor.set_byte_range(range.clone());
+            for match_ in self.query_cursor.matches(&self.query, tree.root_node(), content.as_bytes()) {
+                for capture in match_.captures {
+                    let node = parsed_node(capture.node, self.capture_kinds[capture.index as usize]);
+                    if capture.index == self.include_capture {
+                        includes.push(node);
+                    } else {
+                        symbols.push(node);
+                    }
+                }
             }
         }
-        
-        Ok(includes)
+
+        (symbols, includes)
+    }
+
+    /// Node at a 0-based line and column of a file whose tree is cached
+    pub fn node_at(&self, file_path: &Path, line: usize, column: usize) -> Option<ParsedNode> {
+        let cached = self.trees.get(file_path)?;
+        self.get_node_at_position(&cached.parsed.tree, &cached.content, line, column)
     }
 
     pub fn get_node_at_position(&self, tree: &Tree, content: &str, line: usize, column: usize) -> Option<ParsedNode> {
         let byte_offset = self.position_to_byte_offset(content, line, column)?;
         let node = tree.root_node().descendant_for_byte_range(byte_offset, byte_offset)?;
-        
-        let text = node.utf8_text(content.as_bytes()).ok()?;
-        
-        Some(ParsedNode {
-            kind: node.kind().to_string(),
-            name: None,
-            start_byte: node.start_byte(),
-            end_byte: node.end_byte(),
-            start_row: node.start_position().row,
-            start_col: node.start_position().column,
-            end_row: node.end_position().row,
-            end_col: node.end_position().column,
-            text: text.to_string(),
-        })
+        Some(parsed_node(node, node.kind()))
     }
 
+    /// Byte offset of a 0-based line and character column, if the line is that long
     fn position_to_byte_offset(&self, content: &str, line: usize, column: usize) -> Option<usize> {
-        let mut current_line = 0;
-        
-        for (i, ch) in content.char_indices() {
-            if current_line == line {
-                if column == 0 {
-                    return Some(i);
-                }
-                let mut current_col = 0;
-                for (j, _) in content[i..].char_indices() {
-                    if current_col == column {
-                        return Some(i + j);
-                    }
-                    current_col += 1;
-                    if content.chars().nth((i + j) / 4).unwrap_or('\0') == '\n' {
-                        break;
-                    }
-                }
-            }
-            
-            if ch == '\n' {
-                current_line += 1;
-            }
+        let line_start = if line == 0 {
+            0
+        } else {
+            content.match_indices('\n').nth(line - 1)?.0 + 1
+        };
+        let line_text = content[line_start..].split('\n').next().unwrap_or("");
+
+        match line_text.char_indices().nth(column) {
+            Some((offset, _)) => Some(line_start + offset),
+            None if line_text.chars().count() == column => Some(line_start + line_text.len()),
+            None => None,
+        }
+    }
+}
+
+/// A syntax tree with what the extraction query found in it
+struct ParsedTree {
+    tree: Tree,
+    symbols: Vec<ParsedNode>,
+    includes: Vec<ParsedNode>,
+}
+
+/// Last tree of a file, with the content it was parsed from for diffing the next version
+struct CachedTree {
+    parsed: ParsedTree,
+    content: String,
+    last_used: u64,
+}
+
+fn parsed_node(node: Node<'_>, kind: &'static str) -> ParsedNode {
+    ParsedNode {
+        kind,
+        start_byte: node.start_byte(),
+        end_byte: node.end_byte(),
+        start_row: node.start_position().row,
+        start_col: node.start_position().column,
+        end_row: node.end_position().row,
+        end_col: node.end_position().column,
+    }
+}
+
+/// An include operand without its `"..."` or `<...>` delimiters
+fn include_path(operand: &str) -> &str {
+    operand.trim_matches('"').trim_matches('<').trim_matches('>')
+}
+
+/// The single edit turning `old` into `new`: the bytes between their common prefix
+/// and common suffix. `None` if they are equal.
+pub fn compute_edit(old: &str, new: &str) -> Option<InputEdit> {
+    if old == new {
+        return None;
+    }
+
+    let mut prefix = old.bytes().zip(new.bytes()).take_while(|(a, b)| a == b).count();
+    while !old.is_char_boundary(prefix) || !new.is_char_boundary(prefix) {
+        prefix -= 1;
+    }
+
+    let max_suffix = old.len().min(new.len()) - prefix;
+    let mut suffix = old.bytes().rev().zip(new.bytes().rev()).take(max_suffix).take_while(|(a, b)| a == b).count();
+    while !old.is_char_boundary(old.len() - suffix) || !new.is_char_boundary(new.len() - suffix) {
+        suffix -= 1;
+    }
+
+    let (old_end, new_end) = (old.len() - suffix, new.len() - suffix);
+    Some(InputEdit {
+        start_byte: prefix,
+        old_end_byte: old_end,
+        new_end_byte: new_end,
+        start_position: point_at(old, prefix),
+        old_end_position: point_at(old, old_end),
+        new_end_position: point_at(new, new_end),
+    })
+}
+
+/// Row and byte column of `offset`, as tree-sitter counts them
+fn point_at(text: &str, offset: usize) -> Point {
+    let before = &text.as_bytes()[..offset];
+    match before.iter().rposition(|&byte| byte == b'\n') {
+        Some(newline) => Point::new(before.iter().filter(|&&byte| byte == b'\n').count(), offset - newline - 1),
+        None => Point::new(0, offset),
+    }
+}
+
+/// Moves nodes after `edit` to their new position and drops the ones it touched
+fn shift_nodes(nodes: &mut Vec<ParsedNode>, edit: &InputEdit) {
+    nodes.retain_mut(|node| {
+        if node.end_byte <= edit.start_byte {
+            return true;
+        }
+        if node.start_byte < edit.old_end_byte {
+            return false;
+        }
+
+        node.start_byte = node.start_byte - edit.old_end_byte + edit.new_end_byte;
+        node.end_byte = node.end_byte - edit.old_end_byte + edit.new_end_byte;
+        (node.start_row, node.start_col) = shift_point(node.start_row, node.start_col, edit);
+        (node.end_row, node.end_col) = shift_point(node.end_row, node.end_col, edit);
+        true
+    });
+}
+
+fn shift_point(row: usize, column: usize, edit: &InputEdit) -> (usize, usize) {
+    let (old_end, new_end) = (edit.old_end_position, edit.new_end_position);
+    if row == old_end.row {
+        (new_end.row, column - old_end.column + new_end.column)
+    } else {
+        (row - old_end.row + new_end.row, column)
+    }
+}
+
+/// Swaps the cached nodes touching re-queried `ranges`, and the cached copies of every
+/// re-found capture, for the `fresh` captures, keeping document order. A re-found
+/// match of a container such as a namespace spans far more than the ranges; the
+/// nodes inside it that the ranges miss were not re-queried and are kept.
+fn replace_in_ranges(nodes: &mut Vec<ParsedNode>, fresh: Vec<ParsedNode>, ranges: &[Range<usize>]) {
+    // A match touching two ranges is found once per range.
+    let mut seen = HashSet::with_capacity(fresh.len());
+    let fresh: Vec<ParsedNode> = fresh.into_iter().filter(|node| seen.insert(*node)).collect();
+
+    nodes.retain(|node| {
+        let end = node.end_byte.max(node.start_byte + 1);
+        !seen.contains(node) && !ranges.iter().any(|range| node.start_byte < range.end && range.start < end)
+    });
+    nodes.extend(fresh);
+    // Stable, so captures of one match keep their order.
+    nodes.sort_by_key(|node| node.start_byte);
+}
+
+/// Sorts ranges and joins overlapping or touching ones
+fn merge_ranges(mut ranges: Vec<Range<usize>>) -> Vec<Range<usize>> {
+    ranges.sort_by_key(|range| range.start);
+    let mut merged: Vec<Range<usize>> = Vec::with_capacity(ranges.len());
+    for range in ranges {
+        match merged.last_mut() {
+            Some(last) if range.start <= last.end => last.end = last.end.max(range.end),
+            _ => merged.push(range),
         }
-        
-        None
     }
+    merged
 }
 
 #[derive(Debug)]
-pub struct ParseResult {
+pub struct ParseResult<'a> {
     pub file_path: std::path::PathBuf,
     pub symbols: Vec<ParsedNode>,
     pub includes: Vec<String>,
     pub tree: Option<Tree>,
-    pub content: String,
+    /// Source the nodes' positions refer to
+    pub content: Cow<'a, str>,
 }
 
-impl ParseResult {
+impl ParseResult<'_> {
+    /// Text of one of this result's nodes
+    pub fn text(&self, node: &ParsedNode) -> &str {
+        node.text(&self.content)
+    }
+
     pub fn get_symbols_by_type(&self, symbol_type: &str) -> Vec<&ParsedNode> {
         self.symbols
             .iter()
@@ -307,5 +533,88 @@ int main() {
         assert_eq!(parse_result.includes.len(), 2);
         assert!(parse_result.includes.contains(&"iostream".to_string()));
         assert!(parse_result.includes.contains(&"local_header.h".to_string()));
+        assert!(parse_result.get_symbols_by_type("function").iter().any(|node| parse_result.text(node) == "main"));
+    }
+
+    fn node(start_byte: usize, end_byte: usize, row: usize, col: usize) -> ParsedNode {
+        ParsedNode {
+            kind: "function.name",
+            start_byte,
+            end_byte,
+            start_row: row,
+            start_col: col,
+            end_row: row,
+            end_col: col + end_byte - start_byte,
+        }
+    }
+
+    #[test]
+    fn test_compute_edit_spans_changed_bytes() {
+        let old = "int a;\nint b;\nint c;\n";
+        let new = "int a;\nlong x;\nint c;\n";
+        let edit = compute_edit(old, new).unwrap();
+
+        assert_eq!((edit.start_byte, edit.old_end_byte, edit.new_end_byte), (7, 12, 13));
+        assert_eq!(edit.start_position, Point::new(1, 0));
+        assert_eq!(edit.old_end_position, Point::new(1, 5));
+        assert_eq!(edit.new_end_position, Point::new(1, 6));
+        assert!(compute_edit(old, old).is_none());
+
+        let inserted = compute_edit("ab", "a\u{e9}b").unwrap();
+        assert_eq!((inserted.start_byte, inserted.old_end_byte, inserted.new_end_byte), (1, 1, 3));
+    }
+
+    #[test]
+    fn test_shift_nodes_moves_later_nodes_and_drops_touched_ones() {
+        let edit = compute_edit("int a;\nint b;\nint c;\n", "int a;\nlong x;\nint c;\n").unwrap();
+        let mut nodes = vec![node(4, 5, 0, 4), node(11, 12, 1, 4), node(18, 19, 2, 4)];
+
+        shift_nodes(&mut nodes, &edit);
+
+        assert_eq!(nodes.len(), 2);
+        assert_eq!((nodes[0].start_byte, nodes[0].start_row), (4, 0));
+        assert_eq!((nodes[1].start_byte, nodes[1].end_byte, nodes[1].start_row, nodes[1].start_col), (19, 20, 2, 4));
     }
-}
\ No newline at end of file
+
+    #[test]
+    fn test_reparse_inside_namespace_keeps_sibling_symbols() {
+        let old = r#"
+namespace n {
+class A {
+public:
+    void first() { int a = 1; }
+};
+
+class B {
+public:
+    void second() { int b = 2; }
+};
+
+int helper(int x) { return x; }
+}
+"#;
+        let new = old.replace("int a = 1;", "int a = 1; a += 41;");
+        let path = PathBuf::from("edited.cpp");
+
+        let mut incremental = TreeSitterParser::new().expect("Failed to create parser").with_tree_cache(4);
+        incremental.parse_content(old, &path).unwrap();
+        let edited = incremental.parse_content(&new, &path).unwrap();
+
+        let mut fresh_parser = TreeSitterParser::new().expect("Failed to create parser");
+        let fresh = fresh_parser.parse_content(&new, &path).unwrap();
+
+        let symbol_set = |result: &ParseResult| {
+            let mut symbols: Vec<(&str, String)> = result.symbols.iter().map(|node| (node.kind, result.text(node).to_string())).collect();
+            symbols.sort();
+            symbols
+        };
+        assert_eq!(symbol_set(&edited), symbol_set(&fresh));
+        assert!(edited.symbols.iter().any(|node| node.kind == "class.name" && edited.text(node) == "B"));
+        assert!(edited.symbols.iter().any(|node| edited.text(node) == "helper"));
+    }
+
+    #[test]
+    fn test_merge_ranges() {
+        assert_eq!(merge_ranges(vec![10..12, 0..3, 2..5, 12..14]), vec![0..5, 10..14]);
+    }
+}
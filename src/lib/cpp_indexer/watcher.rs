@@ -0,0 +1,365 @@
+use crate::lib::cpp_indexer::incremental::{is_cpp_file, is_header_file, IncrementalIndexer};
+use crate::lib::cpp_indexer::symbol_extractor::ExtractionResult;
+use notify::{Event, EventKind, RecommendedWatcher, RecursiveMode, Watcher};
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, HashMap};
+use std::path::{Path, PathBuf};
+use std::thread;
+use std::time::Duration;
+use tokio::sync::mpsc;
+use tokio::time::Instant;
+use tracing::{info, warn};
+use walkdir::WalkDir;
+
+/// Quiet period after the last event before a burst is applied
+const DEFAULT_DEBOUNCE: Duration = Duration::from_millis(250);
+
+/// Longest a change waits while events keep arriving, e.g. during a large checkout
+const DEFAULT_MAX_DELAY: Duration = Duration::from_secs(2);
+
+/// Receives the index changes the watcher makes, e.g. to persist them
+pub trait ChangeSink: Send {
+    /// `dependencies` are the files `file_path` includes, resolved where possible
+    fn file_indexed(
+        &mut self,
+        file_path: &Path,
+        extraction: &ExtractionResult,
+        dependencies: &[PathBuf],
+    ) -> Result<(), Box<dyn std::error::Error>>;
+    fn file_removed(&mut self, file_path: &Path) -> Result<(), Box<dyn std::error::Error>>;
+    /// Enrichment of the version of `file_path` stored with `extraction.content_hash`;
+    /// returns false if a newer version replaced it meanwhile and nothing was stored
+    fn file_enriched(
+        &mut self,
+        file_path: &Path,
+        extraction: &ExtractionResult,
+        dependencies: &[PathBuf],
+    ) -> Result<bool, Box<dyn std::error::Error>> {
+        self.file_indexed(file_path, extraction, dependencies)?;
+        Ok(true)
+    }
+    /// Building an overlay: `file_path` is still in the base index but was deleted on
+    /// the overlay's branch
+    fn base_file_removed(&mut self, _file_path: &Path) -> Result<(), Box<dyn std::error::Error>> {
+        Ok(())
+    }
+    /// Stores anything the sink still holds back. Called before the index state is
+    /// saved, so the saved state never covers files that were not stored.
+    fn flush(&mut self) -> Result<(), Box<dyn std::error::Error>> {
+        Ok(())
+    }
+    /// Called after each batch once the index state is saved
+    fn batch_applied(&mut self, _merkle_root: Option<&str>) {}
+}
+
+#[derive(Debug, Clone)]
+pub struct WatchSettings {
+    pub debounce: Duration,
+    pub max_delay: Duration,
+    /// Patterns in `Config::ignore_patterns` form: `dir/`, `*.ext` or a path component
+    pub ignore_patterns: Vec<String>,
+}
+
+impl Default for WatchSettings {
+    fn default() -> Self {
+        Self {
+            debounce: DEFAULT_DEBOUNCE,
+            max_delay: DEFAULT_MAX_DELAY,
+            ignore_patterns: Vec::new(),
+        }
+    }
+}
+
+impl WatchSettings {
+    pub fn with_debounce(mut self, debounce: Duration) -> Self {
+        self.debounce = debounce;
+        self
+    }
+
+    pub fn with_max_delay(mut self, max_delay: Duration) -> Self {
+        self.max_delay = max_delay;
+        self
+    }
+
+    pub fn with_ignore_patterns(mut self, ignore_patterns: Vec<String>) -> Self {
+        self.ignore_patterns = ignore_patterns;
+        self
+    }
+}
+
+/// Keeps an index current by watching its root directory. Events are debounced and
+/// coalesced, then applied in priority order by a dedicated thread, so re-indexing
+/// never runs on the threads serving queries. Dropping the watcher stops it once the
+/// batch in progress is done.
+pub struct IndexWatcher {
+    _watcher: RecommendedWatcher,
+}
+
+impl IndexWatcher {
+    pub fn spawn(
+        root: PathBuf,
+        indexer: IncrementalIndexer,
+        sink: Box<dyn ChangeSink>,
+        settings: WatchSettings,
+    ) -> Result<Self, Box<dyn std::error::Error>> {
+        let (event_tx, events) = mpsc::unbounded_channel();
+        let mut watcher = notify::recommended_watcher(move |event: notify::Result<Event>| match event {
+            Ok(event) => {
+                let _ = event_tx.send(event);
+            }
+            Err(error) => warn!("File watch error: {}", error),
+        })?;
+        watcher.watch(&root, RecursiveMode::Recursive)?;
+
+        let worker = WatchWorker {
+            root: root.clone(),
+            indexer,
+            sink,
+            settings,
+            events,
+            queue: ChangeQueue::default(),
+        };
+
+        thread::Builder::new()
+            .name("index-watcher".to_string())
+            .spawn(move || match tokio::runtime::Builder::new_current_thread().enable_all().build() {
+                Ok(runtime) => runtime.block_on(worker.run()),
+                Err(error) => warn!("Failed to start index watcher: {}", error),
+            })?;
+
+        info!("Watching {} for changes", root.display());
+        Ok(Self { _watcher: watcher })
+    }
+}
+
+/// Order in which queued changes are applied; earlier variants go first
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+enum ChangePriority {
+    /// Deleted paths, so queries stop returning symbols from files that are gone
+    Removal,
+    Source,
+    Header,
+    /// Files re-parsed because something they include changed
+    Dependent,
+}
+
+/// Pending paths, coalesced by path and popped by priority, then arrival order.
+/// Re-queuing a path only ever raises its priority; stale heap entries are skipped.
+#[derive(Default)]
+struct ChangeQueue {
+    queued: HashMap<PathBuf, ChangePriority>,
+    heap: BinaryHeap<Reverse<(ChangePriority, u64, PathBuf)>>,
+    sequence: u64,
+}
+
+impl ChangeQueue {
+    fn push(&mut self, path: PathBuf, priority: ChangePriority) {
+        if self.queued.get(&path).map_or(false, |&queued| queued <= priority) {
+            return;
+        }
+
+        self.sequence += 1;
+        self.queued.insert(path.clone(), priority);
+        self.heap.push(Reverse((priority, self.sequence, path)));
+    }
+
+    fn pop(&mut self) -> Option<(PathBuf, ChangePriority)> {
+        while let Some(Reverse((priority, _, path))) = self.heap.pop() {
+            if self.queued.get(&path) == Some(&priority) {
+                self.queued.remove(&path);
+                return Some((path, priority));
+            }
+        }
+        None
+    }
+
+    fn len(&self) -> usize {
+        self.queued.len()
+    }
+}
+
+struct WatchWorker {
+    root: PathBuf,
+    indexer: IncrementalIndexer,
+    sink: Box<dyn ChangeSink>,
+    settings: WatchSettings,
+    events: mpsc::UnboundedReceiver<Event>,
+    queue: ChangeQueue,
+}
+
+impl WatchWorker {
+    async fn run(mut self) {
+        while let Some(event) = self.events.recv().await {
+            self.enqueue(event);
+
+            // Let the burst settle: wait for a quiet period, but never past `max_delay`.
+            let deadline = Instant::now() + self.settings.max_delay;
+            loop {
+                let remaining = deadline.saturating_duration_since(Instant::now());
+                if remaining.is_zero() {
+                    break;
+                }
+                match tokio::time::timeout(self.settings.debounce.min(remaining), self.events.recv()).await {
+                    Ok(Some(event)) => self.enqueue(event),
+                    Ok(None) | Err(_) => break,
+                }
+            }
+
+            self.drain().await;
+        }
+    }
+
+    fn enqueue(&mut self, event: Event) {
+        if matches!(event.kind, EventKind::Access(_)) {
+            return;
+        }
+
+        for path in event.paths {
+            if let Some(priority) = self.classify(&path) {
+                self.queue.push(path, priority);
+            }
+        }
+    }
+
+    /// Priority for a changed path, or `None` if it is ignored or not C++. Paths that no
+    /// longer exist may have been directories, so they are kept whatever their name.
+    fn classify(&self, path: &Path) -> Option<ChangePriority> {
+        let relative = path.strip_prefix(&self.root).unwrap_or(path);
+        if is_ignored(relative, &self.settings.ignore_patterns) {
+            return None;
+        }
+
+        if !path.exists() {
+            Some(ChangePriority::Removal)
+        } else if path.is_dir() {
+            Some(ChangePriority::Source)
+        } else if !is_cpp_file(path) {
+            None
+        } else if is_header_file(path) {
+            Some(ChangePriority::Header)
+        } else {
+            Some(ChangePriority::Source)
+        }
+    }
+
+    async fn drain(&mut self) {
+        let started = Instant::now();
+        let mut applied = 0;
+
+        while let Some((path, priority)) = self.queue.pop() {
+            self.apply(&path, priority).await;
+            applied += 1;
+
+            // Events that arrived meanwhile join the queue instead of waiting for the next batch.
+            while let Ok(event) = self.events.try_recv() {
+                self.enqueue(event);
+            }
+        }
+
+        if let Err(error) = self.sink.flush() {
+            // The saved state would claim the unstored files are indexed.
+            warn!("Failed to store indexed files; index state not saved: {}", error);
+        } else if let Err(error) = self.indexer.save_state() {
+            warn!("Failed to save index state: {}", error);
+        }
+        self.sink.batch_applied(self.indexer.get_index_status().merkle_root.as_deref());
+        info!("Applied {} file changes in {:?}", applied, started.elapsed());
+    }
+
+    async fn apply(&mut self, path: &Path, priority: ChangePriority) {
+        if path.is_dir() {
+            // A directory that appeared at once (checkout, rename) reports no events for its files.
+            for entry in WalkDir::new(path).into_iter().filter_map(Result::ok) {
+                if entry.file_type().is_file() {
+                    if let Some(priority) = self.classify(entry.path()) {
+                        self.queue.push(entry.into_path(), priority);
+                    }
+                }
+            }
+            return;
+        }
+
+        if !path.exists() {
+            for file in self.indexer.tracked_files_under(path) {
+                let removed = self.indexer.remove_file(&file).await.map_err(|e| e.to_string())
+                    .and_then(|_| self.sink.file_removed(&file).map_err(|e| e.to_string()));
+                if let Err(error) = removed {
+                    warn!("Failed to remove {} from the index: {}", file.display(), error);
+                }
+            }
+            return;
+        }
+
+        let indexed = if priority == ChangePriority::Dependent {
+            self.indexer.reparse_file(path).await
+        } else {
+            self.indexer.index_file_with_symbols(path).await
+        };
+
+        match indexed {
+            Ok((result, Some(extraction))) => {
+                let dependencies = self.indexer.dependencies_of(path);
+                if let Err(error) = self.sink.file_indexed(path, &extraction, &dependencies) {
+                    warn!("Failed to store {}: {}", path.display(), error);
+                }
+                for dependent in result.affected_files {
+                    self.queue.push(dependent, ChangePriority::Dependent);
+                }
+            }
+            Ok((_, None)) => {}
+            Err(error) => warn!("Failed to index {}: {}", path.display(), error),
+        }
+
+        if self.queue.len() > 0 {
+            // Hand the thread back between files so shutdown and new events are noticed.
+            tokio::task::yield_now().await;
+        }
+    }
+}
+
+/// Whether `relative` matches one of `Config::ignore_patterns`: `dir/` matches a
+/// directory anywhere in the path, `*suffix` matches the file name's end, and
+/// anything else must equal a whole path component.
+pub fn is_ignored(relative: &Path, patterns: &[String]) -> bool {
+    let file_name = relative.file_name().map(|name| name.to_string_lossy());
+
+    patterns.iter().any(|pattern| {
+        if let Some(suffix) = pattern.strip_prefix('*') {
+            file_name.as_deref().map_or(false, |name| name.ends_with(suffix))
+        } else {
+            let component = pattern.trim_end_matches('/');
+            relative.components().any(|part| part.as_os_str() == component)
+        }
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_is_ignored_matches_config_patterns() {
+        let patterns: Vec<String> = ["build/", ".git/", "*.o"].iter().map(|p| p.to_string()).collect();
+
+        assert!(is_ignored(Path::new("build/gen/main.cpp"), &patterns));
+        assert!(is_ignored(Path::new("src/.git/HEAD"), &patterns));
+        assert!(is_ignored(Path::new("src/main.o"), &patterns));
+        assert!(!is_ignored(Path::new("src/build.cpp"), &patterns));
+        assert!(!is_ignored(Path::new("src/main.cpp"), &patterns));
+    }
+
+    #[test]
+    fn test_change_queue_coalesces_and_orders() {
+        let mut queue = ChangeQueue::default();
+        queue.push(PathBuf::from("b.h"), ChangePriority::Header);
+        queue.push(PathBuf::from("a.cpp"), ChangePriority::Source);
+        queue.push(PathBuf::from("b.h"), ChangePriority::Header);
+        queue.push(PathBuf::from("c.cpp"), ChangePriority::Dependent);
+        queue.push(PathBuf::from("c.cpp"), ChangePriority::Removal);
+        assert_eq!(queue.len(), 3);
+
+        let order: Vec<PathBuf> = std::iter::from_fn(|| queue.pop().map(|(path, _)| path)).collect();
+        assert_eq!(order, vec![PathBuf::from("c.cpp"), PathBuf::from("a.cpp"), PathBuf::from("b.h")]);
+        assert_eq!(queue.len(), 0);
+    }
+}
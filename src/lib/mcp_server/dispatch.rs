@@ -0,0 +1,197 @@
+use serde_json::Value;
+use std::collections::HashMap;
+use std::future::Future;
+use std::sync::{Arc, Mutex};
+use tokio::sync::{mpsc, oneshot, Semaphore};
+use tracing::{debug, warn};
+
+use super::server::{McpError, McpResponse};
+
+/// JSON-RPC error code for a request cancelled by the client
+pub const REQUEST_CANCELLED: i32 = -32800;
+
+/// Default number of tool calls and resource reads executing at once
+pub const DEFAULT_MAX_IN_FLIGHT: usize = 16;
+
+/// Where a request runs: reads run concurrently, writes one at a time in arrival order
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Lane {
+    Read,
+    Write,
+}
+
+/// Runs requests as independent tasks so a slow call never holds up the ones
+/// queued behind it. Responses are sent as each request finishes, so they may go
+/// out in a different order than the requests arrived; clients match them by `id`.
+#[derive(Debug, Clone)]
+pub struct RequestDispatcher {
+    permits: Arc<Semaphore>,
+    write_lane: Arc<tokio::sync::Mutex<()>>,
+    /// Cancellation handles of requests that have not responded yet, by request id
+    pending: Arc<Mutex<HashMap<String, oneshot::Sender<()>>>>,
+}
+
+impl RequestDispatcher {
+    pub fn new(max_in_flight: usize) -> Self {
+        Self {
+            permits: Arc::new(Semaphore::new(max_in_flight.max(1))),
+            write_lane: Arc::new(tokio::sync::Mutex::new(())),
+            pending: Arc::new(Mutex::new(HashMap::new())),
+        }
+    }
+
+    /// Runs `work` on `lane` and sends its response, or a cancellation error if the
+    /// client cancels it first
+    pub fn spawn<F>(&self, id: Value, lane: Lane, work: F, responses: mpsc::Sender<McpResponse>)
+    where
+        F: Future<Output = McpResponse> + Send + 'static,
+    {
+        let key = request_key(&id);
+        let (cancel_tx, cancel_rx) = oneshot::channel();
+        if let Ok(mut pending) = self.pending.lock() {
+            pending.insert(key.clone(), cancel_tx);
+        }
+
+        let dispatcher = self.clone();
+        tokio::spawn(async move {
+            let response = dispatcher.execute(id, lane, work, cancel_rx).await;
+            dispatcher.finish(&key);
+
+            if let Err(e) = responses.send(response).await {
+                warn!("Failed to queue response: {}", e);
+            }
+        });
+    }
+
+    /// Cancels the request with `id`; returns false if it already finished
+    pub fn cancel(&self, id: &Value) -> bool {
+        let cancel = self.pending.lock().ok().and_then(|mut pending| pending.remove(&request_key(id)));
+        let cancelled = cancel.map_or(false, |cancel| cancel.send(()).is_ok());
+        debug!("Cancel request {}: {}", id, if cancelled { "cancelled" } else { "not in flight" });
+        cancelled
+    }
+
+    /// Requests dispatched but not yet responded to, including queued ones
+    pub fn in_flight(&self) -> usize {
+        self.pending.lock().map_or(0, |pending| pending.len())
+    }
+
+    async fn execute<F>(&self, id: Value, lane: Lane, work: F, mut cancel: oneshot::Receiver<()>) -> McpResponse
+    where
+        F: Future<Output = McpResponse>,
+    {
+        // A sender dropped without sending (the id was reused) is not a cancellation.
+        let _write_guard = match lane {
+            Lane::Write => tokio::select! {
+                guard = self.write_lane.clone().lock_owned() => Some(guard),
+                Ok(()) = &mut cancel => return cancelled_response(id),
+            },
+            Lane::Read => None,
+        };
+
+        let _permit = tokio::select! {
+            permit = self.permits.clone().acquire_owned() => permit.ok(),
+            Ok(()) = &mut cancel => return cancelled_response(id),
+        };
+
+        match lane {
+            Lane::Read => tokio::select! {
+                response = work => response,
+                Ok(()) = &mut cancel => cancelled_response(id),
+            },
+            // Once started, a write runs to completion so the index is never left half-updated.
+            Lane::Write => work.await,
+        }
+    }
+
+    /// Drops the request's cancellation handle unless its id has been reused since
+    fn finish(&self, key: &str) {
+        if let Ok(mut pending) = self.pending.lock() {
+            if pending.get(key).map_or(false, |cancel| cancel.is_closed()) {
+                pending.remove(key);
+            }
+        }
+    }
+}
+
+impl Default for RequestDispatcher {
+    fn default() -> Self {
+        Self::new(DEFAULT_MAX_IN_FLIGHT)
+    }
+}
+
+/// Ids 1 and "1" are different requests, so keys keep the JSON form
+pub fn request_key(id: &Value) -> String {
+    id.to_string()
+}
+
+fn cancelled_response(id: Value) -> McpResponse {
+    McpResponse {
+        jsonrpc: "2.0".to_string(),
+        id,
+        result: None,
+        raw_result: None,
+        error: Some(McpError {
+            code: REQUEST_CANCELLED,
+            message: "Request cancelled".to_string(),
+            data: None,
+        }),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+    use std::time::Duration;
+
+    async fn slow(id: Value, delay_ms: u64) -> McpResponse {
+        tokio::time::sleep(Duration::from_millis(delay_ms)).await;
+        McpResponse {
+            jsonrpc: "2.0".to_string(),
+            id,
+            result: Some(json!({})),
+            raw_result: None,
+            error: None,
+        }
+    }
+
+    #[tokio::test]
+    async fn test_reads_do_not_wait_for_slow_requests() {
+        let dispatcher = RequestDispatcher::new(4);
+        let (tx, mut rx) = mpsc::channel(8);
+
+        dispatcher.spawn(json!(1), Lane::Write, slow(json!(1), 200), tx.clone());
+        dispatcher.spawn(json!(2), Lane::Read, slow(json!(2), 0), tx.clone());
+
+        assert_eq!(rx.recv().await.unwrap().id, json!(2));
+        assert_eq!(rx.recv().await.unwrap().id, json!(1));
+        assert_eq!(dispatcher.in_flight(), 0);
+    }
+
+    #[tokio::test]
+    async fn test_writes_run_in_arrival_order() {
+        let dispatcher = RequestDispatcher::new(4);
+        let (tx, mut rx) = mpsc::channel(8);
+
+        dispatcher.spawn(json!("a"), Lane::Write, slow(json!("a"), 50), tx.clone());
+        dispatcher.spawn(json!("b"), Lane::Write, slow(json!("b"), 0), tx.clone());
+
+        assert_eq!(rx.recv().await.unwrap().id, json!("a"));
+        assert_eq!(rx.recv().await.unwrap().id, json!("b"));
+    }
+
+    #[tokio::test]
+    async fn test_cancel_replies_with_request_cancelled() {
+        let dispatcher = RequestDispatcher::new(4);
+        let (tx, mut rx) = mpsc::channel(8);
+
+        dispatcher.spawn(json!(7), Lane::Read, slow(json!(7), 10_000), tx.clone());
+        assert!(dispatcher.cancel(&json!(7)));
+        assert!(!dispatcher.cancel(&json!(7)));
+
+        let response = rx.recv().await.unwrap();
+        assert_eq!(response.id, json!(7));
+        assert_eq!(response.error.unwrap().code, REQUEST_CANCELLED);
+    }
+}
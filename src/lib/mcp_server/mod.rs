@@ -4,11 +4,17 @@
 // for serving C++ codebase indices over STDIO transport.
 
 pub mod server;
+pub mod dispatch;
+pub mod result_cache;
+pub mod session_log;
 pub mod tool_handlers;
 pub mod resource_handlers;
 pub mod transport;
 
 pub use server::{McpServer, ServerInfo, ServerCapabilities};
-pub use tool_handlers::ToolHandlers;
+pub use tool_handlers::{ToolHandlers, IndexUpdateSink};
 pub use resource_handlers::ResourceHandlers;
-pub use transport::Transport;
\ No newline at end of file
+pub use transport::Transport;
+pub use dispatch::{Lane, RequestDispatcher};
+pub use result_cache::{ResultCache, CacheStats};
+pub use session_log::SessionLog;
\ No newline at end of file
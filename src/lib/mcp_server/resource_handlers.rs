@@ -1,7 +1,11 @@
 use anyhow::{anyhow, Result};
 use serde_json::{json, Value};
+use std::sync::Arc;
 use tracing::{info, instrument};
 
+use crate::lib::metrics;
+use super::result_cache::ResultCache;
+
 // TODO: Enable when repository interface is finalized
 // use crate::lib::storage::repository::Repository;
 
@@ -13,6 +17,7 @@ use tracing::{info, instrument};
 #[derive(Debug, Clone)]
 pub struct ResourceHandlers {
     // TODO: Add repository when available
+    result_cache: Option<Arc<ResultCache>>,
 }
 
 impl ResourceHandlers {
@@ -20,9 +25,16 @@ impl ResourceHandlers {
     pub fn new() -> Result<Self> {
         Ok(Self {
             // TODO: Initialize dependencies
+            result_cache: None,
         })
     }
 
+    /// Report hit and miss counts of the tool result cache in `index://metadata`
+    pub fn with_result_cache(mut self, result_cache: Option<Arc<ResultCache>>) -> Self {
+        self.result_cache = result_cache;
+        self
+    }
+
     /// Handle MCP resource read request
     #[instrument(skip(self))]
     pub async fn handle_resource_read(&self, uri: &str) -> Result<Value> {
@@ -31,6 +43,8 @@ impl ResourceHandlers {
         match uri {
             "index://metadata" => self.handle_index_metadata().await,
             "index://schema" => self.handle_database_schema().await,
+            "index://metrics" => self.handle_metrics(uri, false),
+            "index://metrics?format=prometheus" => self.handle_metrics(uri, true),
             uri if uri.starts_with("index://") => self.handle_index_specific_resource(uri).await,
             _ => Err(anyhow!("Unknown resource URI: {}", uri)),
         }
@@ -60,9 +74,10 @@ impl ResourceHandlers {
                         "total_symbols": 0,
                         "total_size_bytes": 0
                     },
+                    "result_cache": self.result_cache.as_ref().map(|cache| cache.stats()),
                     "capabilities": {
                         "incremental_indexing": true,
-                        "file_watching": false, // Not yet implemented
+                        "file_watching": true,
                         "semantic_analysis": true,
                         "cross_references": true,
                         "documentation_extraction": true
@@ -77,6 +92,23 @@ impl ResourceHandlers {
         }))
     }
 
+    /// Stage and tool latency histograms, as JSON or in Prometheus text format
+    fn handle_metrics(&self, uri: &str, prometheus: bool) -> Result<Value> {
+        let (mime_type, text) = if prometheus {
+            ("text/plain; version=0.0.4", metrics::global().to_prometheus())
+        } else {
+            ("application/json", serde_json::to_string_pretty(&metrics::global().snapshot())?)
+        };
+
+        Ok(json!({
+            "contents": [{
+                "uri": uri,
+                "mimeType": mime_type,
+                "text": text
+            }]
+        }))
+    }
+
     /// Handle database schema resource
     #[instrument(skip(self))]
     async fn handle_database_schema(&self) -> Result<Value> {
@@ -297,6 +329,21 @@ mod tests {
         assert_eq!(result["contents"][0]["mimeType"], "application/json");
     }
 
+    #[tokio::test]
+    async fn test_metrics_resource() {
+        let handlers = ResourceHandlers::new().unwrap();
+        metrics::record(metrics::Stage::Clang, std::time::Duration::from_millis(5));
+
+        let result = handlers.handle_resource_read("index://metrics").await.unwrap();
+        let snapshot: Value = serde_json::from_str(result["contents"][0]["text"].as_str().unwrap()).unwrap();
+        assert!(snapshot["stages"]["clang"]["count"].as_u64().unwrap() >= 1);
+        assert!(snapshot["stages"]["db_write"].is_object());
+
+        let result = handlers.handle_resource_read("index://metrics?format=prometheus").await.unwrap();
+        assert!(result["contents"][0]["mimeType"].as_str().unwrap().starts_with("text/plain"));
+        assert!(result["contents"][0]["text"].as_str().unwrap().contains("cpp_index_stage_duration_seconds_count{stage=\"clang\"}"));
+    }
+
     #[tokio::test]
     async fn test_unknown_resource() {
         let handlers = ResourceHandlers::new().unwrap();
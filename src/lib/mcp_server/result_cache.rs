@@ -0,0 +1,193 @@
+use serde::Serialize;
+use serde_json::value::RawValue;
+use std::collections::{BTreeMap, HashMap};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Mutex;
+use uuid::Uuid;
+
+/// Default number of cached tool results
+pub const DEFAULT_CACHE_ENTRIES: usize = 1024;
+
+/// Default total size of cached results
+pub const DEFAULT_CACHE_BYTES: usize = 64 * 1024 * 1024;
+
+/// Identifies one tool result. The write generation changes whenever the index
+/// content does, so entries from before a write simply stop matching and age out
+/// of the LRU.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct CacheKey {
+    pub tool: String,
+    /// Arguments serialized with sorted keys, so equal arguments give equal keys
+    pub arguments: String,
+    pub index_id: Uuid,
+    pub merkle_root: String,
+    /// Index write generation read from storage when the call started
+    pub write_generation: u64,
+}
+
+impl CacheKey {
+    pub fn new(tool: &str, arguments: &serde_json::Value, index_id: Uuid, merkle_root: &str, write_generation: u64) -> Self {
+        Self {
+            tool: tool.to_string(),
+            arguments: arguments.to_string(),
+            index_id,
+            merkle_root: merkle_root.to_string(),
+            write_generation,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct CacheStats {
+    pub hits: u64,
+    pub misses: u64,
+    pub evictions: u64,
+    pub entries: usize,
+    pub bytes: usize,
+}
+
+/// Bounded LRU of serialized tool results; hits return the stored JSON as-is
+#[derive(Debug)]
+pub struct ResultCache {
+    max_entries: usize,
+    max_bytes: usize,
+    state: Mutex<CacheState>,
+    hits: AtomicU64,
+    misses: AtomicU64,
+    evictions: AtomicU64,
+}
+
+#[derive(Debug, Default)]
+struct CacheState {
+    entries: HashMap<CacheKey, CacheEntry>,
+    /// Keys by last use, oldest first
+    recency: BTreeMap<u64, CacheKey>,
+    tick: u64,
+    bytes: usize,
+}
+
+#[derive(Debug)]
+struct CacheEntry {
+    result: Box<RawValue>,
+    last_used: u64,
+}
+
+impl ResultCache {
+    pub fn new(max_entries: usize, max_bytes: usize) -> Self {
+        Self {
+            max_entries: max_entries.max(1),
+            max_bytes,
+            state: Mutex::new(CacheState::default()),
+            hits: AtomicU64::new(0),
+            misses: AtomicU64::new(0),
+            evictions: AtomicU64::new(0),
+        }
+    }
+
+    pub fn get(&self, key: &CacheKey) -> Option<Box<RawValue>> {
+        let mut state = self.state.lock().ok()?;
+        let state = &mut *state;
+        state.tick += 1;
+
+        match state.entries.get_mut(key) {
+            Some(entry) => {
+                state.recency.remove(&entry.last_used);
+                entry.last_used = state.tick;
+                state.recency.insert(state.tick, key.clone());
+                self.hits.fetch_add(1, Ordering::Relaxed);
+                Some(entry.result.clone())
+            }
+            None => {
+                self.misses.fetch_add(1, Ordering::Relaxed);
+                None
+            }
+        }
+    }
+
+    /// Stores `result`, evicting the least recently used entries to stay in bounds.
+    /// Results larger than the whole byte budget are not cached.
+    pub fn insert(&self, key: CacheKey, result: Box<RawValue>) {
+        let size = result.get().len();
+        if size > self.max_bytes {
+            return;
+        }
+
+        let Ok(mut state) = self.state.lock() else { return };
+        state.tick += 1;
+        let tick = state.tick;
+
+        if let Some(previous) = state.entries.insert(key.clone(), CacheEntry { result, last_used: tick }) {
+            state.recency.remove(&previous.last_used);
+            state.bytes -= previous.result.get().len();
+        }
+        state.recency.insert(tick, key);
+        state.bytes += size;
+
+        while state.entries.len() > self.max_entries || state.bytes > self.max_bytes {
+            let Some((_, oldest)) = state.recency.pop_first() else { break };
+            if let Some(evicted) = state.entries.remove(&oldest) {
+                state.bytes -= evicted.result.get().len();
+                self.evictions.fetch_add(1, Ordering::Relaxed);
+            }
+        }
+    }
+
+    pub fn stats(&self) -> CacheStats {
+        let (entries, bytes) = self.state.lock().map_or((0, 0), |state| (state.entries.len(), state.bytes));
+        CacheStats {
+            hits: self.hits.load(Ordering::Relaxed),
+            misses: self.misses.load(Ordering::Relaxed),
+            evictions: self.evictions.load(Ordering::Relaxed),
+            entries,
+            bytes,
+        }
+    }
+}
+
+impl Default for ResultCache {
+    fn default() -> Self {
+        Self::new(DEFAULT_CACHE_ENTRIES, DEFAULT_CACHE_BYTES)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+
+    fn raw(text: &str) -> Box<RawValue> {
+        RawValue::from_string(text.to_string()).unwrap()
+    }
+
+    fn key(tool: &str, index_id: Uuid, root: &str) -> CacheKey {
+        CacheKey::new(tool, &json!({"index_name": "main", "symbol_id": 1}), index_id, root, 0)
+    }
+
+    #[test]
+    fn test_new_merkle_root_misses() {
+        let cache = ResultCache::default();
+        let index_id = Uuid::new_v4();
+
+        cache.insert(key("get_symbol_details", index_id, "root-a"), raw(r#"{"name":"a"}"#));
+        assert_eq!(cache.get(&key("get_symbol_details", index_id, "root-a")).unwrap().get(), r#"{"name":"a"}"#);
+        assert!(cache.get(&key("get_symbol_details", index_id, "root-b")).is_none());
+
+        let stats = cache.stats();
+        assert_eq!((stats.hits, stats.misses, stats.entries), (1, 1, 1));
+    }
+
+    #[test]
+    fn test_evicts_least_recently_used() {
+        let cache = ResultCache::new(2, DEFAULT_CACHE_BYTES);
+        let index_id = Uuid::new_v4();
+
+        cache.insert(key("a", index_id, "r"), raw("1"));
+        cache.insert(key("b", index_id, "r"), raw("2"));
+        assert!(cache.get(&key("a", index_id, "r")).is_some());
+        cache.insert(key("c", index_id, "r"), raw("3"));
+
+        assert!(cache.get(&key("b", index_id, "r")).is_none());
+        assert!(cache.get(&key("a", index_id, "r")).is_some());
+        assert_eq!(cache.stats().evictions, 1);
+    }
+}
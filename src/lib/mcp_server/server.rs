@@ -1,16 +1,27 @@
 use anyhow::{anyhow, Result};
+use serde::de::DeserializeOwned;
 use serde::{Deserialize, Serialize};
+use serde_json::value::RawValue;
 use serde_json::{json, Value};
 use std::collections::HashMap;
+use std::time::{Duration, Instant};
+use tokio::io::{AsyncRead, AsyncWrite};
 use tokio::sync::mpsc;
-use tracing::{error, info, instrument, warn};
+use tokio::time::MissedTickBehavior;
+use tracing::{debug, error, info, instrument, warn};
 use uuid::Uuid;
 
 // TODO: Enable when repository interface is finalized
 // use crate::lib::storage::repository::Repository;
+use super::dispatch::{Lane, RequestDispatcher};
 use super::tool_handlers::ToolHandlers;
 use super::resource_handlers::ResourceHandlers;
+use super::session_log::SessionLog;
 use super::transport::Transport;
+use crate::lib::storage::StorageError;
+
+/// How often buffered session activity is written and idle sessions are dropped
+const SESSION_SWEEP_INTERVAL: Duration = Duration::from_secs(5);
 
 /// MCP Protocol Implementation
 /// 
@@ -29,10 +40,16 @@ pub struct McpServer {
     resource_handlers: ResourceHandlers,
     /// Transport layer for message handling
     transport: Transport,
+    /// Runs tool calls and resource reads concurrently
+    dispatcher: RequestDispatcher,
     // TODO: Add database repository when available
     // repository: Repository,
     /// Active sessions
     sessions: HashMap<String, McpSession>,
+    /// Session the next tool calls are accounted to, the last one initialized
+    current_session: Option<Uuid>,
+    /// Query counts and durations waiting to be written
+    session_log: SessionLog,
 }
 
 /// Server information sent during initialization
@@ -134,6 +151,11 @@ pub enum McpRequest {
         id: Value,
         params: Option<Value>,
     },
+    /// Cancels an in-flight request; a notification, so it carries no id
+    #[serde(rename = "$/cancelRequest", alias = "notifications/cancelled")]
+    CancelRequest {
+        params: CancelParams,
+    },
 }
 
 /// Initialize request parameters
@@ -146,6 +168,13 @@ pub struct InitializeParams {
     pub capabilities: Option<Value>,
 }
 
+/// Cancel notification parameters
+#[derive(Debug, Clone, Deserialize)]
+pub struct CancelParams {
+    #[serde(alias = "requestId")]
+    pub id: Value,
+}
+
 /// Tool call request parameters
 #[derive(Debug, Clone, Deserialize)]
 pub struct ToolCallParams {
@@ -166,6 +195,9 @@ pub struct McpResponse {
     pub id: Value,
     #[serde(skip_serializing_if = "Option::is_none")]
     pub result: Option<Value>,
+    /// Result that is already serialized, e.g. from the result cache; sent as `result`
+    #[serde(rename = "result", skip_serializing_if = "Option::is_none")]
+    pub raw_result: Option<Box<RawValue>>,
     #[serde(skip_serializing_if = "Option::is_none")]
     pub error: Option<McpError>,
 }
@@ -179,6 +211,120 @@ pub struct McpError {
     pub data: Option<Value>,
 }
 
+/// JSON-RPC error codes for requests that cannot be dispatched
+pub const INVALID_REQUEST: i32 = -32600;
+pub const METHOD_NOT_FOUND: i32 = -32601;
+pub const INVALID_PARAMS: i32 = -32602;
+
+/// `initialize` result
+#[derive(Serialize)]
+struct InitializeResult<'a> {
+    #[serde(rename = "protocolVersion")]
+    protocol_version: &'a str,
+    #[serde(rename = "serverInfo")]
+    server_info: &'a ServerInfo,
+    capabilities: &'a ServerCapabilities,
+}
+
+#[derive(Serialize)]
+struct ToolsListResult<'a> {
+    tools: &'a [ToolCapability],
+}
+
+#[derive(Serialize)]
+struct ResourcesListResult<'a> {
+    resources: &'a [ResourceCapability],
+}
+
+#[derive(Serialize)]
+struct PromptsListResult<'a> {
+    prompts: &'a [PromptCapability],
+}
+
+impl McpRequest {
+    /// The request id; `None` for notifications
+    pub fn id(&self) -> Option<&Value> {
+        match self {
+            McpRequest::Initialize { id, .. }
+            | McpRequest::ToolsCall { id, .. }
+            | McpRequest::ResourcesRead { id, .. }
+            | McpRequest::ResourcesList { id, .. }
+            | McpRequest::ToolsList { id, .. }
+            | McpRequest::PromptsList { id, .. }
+            | McpRequest::Ping { id, .. } => Some(id),
+            McpRequest::CancelRequest { .. } => None,
+        }
+    }
+
+    /// Builds a request from a message already split into its fields, so only
+    /// `params` is deserialized. Method names match the serde renames above.
+    pub fn from_parts(method: &str, id: Option<Value>, params: Option<&RawValue>) -> std::result::Result<Self, McpError> {
+        let id = id.ok_or_else(|| McpError {
+            code: INVALID_REQUEST,
+            message: format!("Missing id for {}", method),
+            data: None,
+        });
+
+        Ok(match method {
+            "initialize" => McpRequest::Initialize { id: id?, params: parse_params(params)? },
+            "tools/call" => McpRequest::ToolsCall { id: id?, params: parse_params(params)? },
+            "resources/read" => McpRequest::ResourcesRead { id: id?, params: parse_params(params)? },
+            "resources/list" => McpRequest::ResourcesList { id: id?, params: parse_params(params)? },
+            "tools/list" => McpRequest::ToolsList { id: id?, params: parse_params(params)? },
+            "prompts/list" => McpRequest::PromptsList { id: id?, params: parse_params(params)? },
+            "ping" => McpRequest::Ping { id: id?, params: parse_params(params)? },
+            "$/cancelRequest" | "notifications/cancelled" => McpRequest::CancelRequest { params: parse_params(params)? },
+            _ => {
+                return Err(McpError {
+                    code: METHOD_NOT_FOUND,
+                    message: format!("Method not found: {}", method),
+                    data: None,
+                })
+            }
+        })
+    }
+}
+
+fn parse_params<T: DeserializeOwned>(params: Option<&RawValue>) -> std::result::Result<T, McpError> {
+    serde_json::from_str(params.map_or("null", RawValue::get)).map_err(|e| McpError {
+        code: INVALID_PARAMS,
+        message: format!("Invalid params: {}", e),
+        data: None,
+    })
+}
+
+/// JSON-RPC code of a failed tool call: invalid params when storage refused an
+/// argument the client sent, such as a malformed cursor, and an internal error otherwise
+fn tool_error_code(error: &anyhow::Error) -> i32 {
+    match error.downcast_ref::<StorageError>() {
+        Some(StorageError::InvalidArgument(_)) => INVALID_PARAMS,
+        _ => -32603,
+    }
+}
+
+impl McpResponse {
+    /// Successful response with `result` serialized straight from its typed form
+    pub fn success<T: Serialize + ?Sized>(id: Value, result: &T) -> Result<Self> {
+        Ok(Self {
+            jsonrpc: "2.0".to_string(),
+            id,
+            result: None,
+            raw_result: Some(serde_json::value::to_raw_value(result)?),
+            error: None,
+        })
+    }
+
+    pub fn failure(id: Value, error: McpError) -> Self {
+        Self {
+            jsonrpc: "2.0".to_string(),
+            id,
+            result: None,
+            raw_result: None,
+            error: Some(error),
+        }
+    }
+}
+
 impl McpServer {
     /// Create new MCP server instance
     pub fn new() -> Result<Self> {
@@ -201,11 +347,28 @@ impl McpServer {
             tool_handlers,
             resource_handlers,
             transport,
+            dispatcher: RequestDispatcher::default(),
             // repository,
             sessions: HashMap::new(),
+            current_session: None,
+            session_log: SessionLog::default(),
         })
     }
 
+    /// Replace the tool handlers, e.g. with ones backed by an open repository
+    pub fn with_tool_handlers(mut self, tool_handlers: ToolHandlers) -> Self {
+        self.resource_handlers = self.resource_handlers.with_result_cache(tool_handlers.result_cache());
+        self.session_log = tool_handlers.session_log();
+        self.tool_handlers = tool_handlers;
+        self
+    }
+
+    /// Limit how many tool calls and resource reads execute at once
+    pub fn with_max_in_flight(mut self, max_in_flight: usize) -> Self {
+        self.dispatcher = RequestDispatcher::new(max_in_flight);
+        self
+    }
+
     /// Build server capabilities from tool and resource specifications
     fn build_capabilities() -> Result<ServerCapabilities> {
         // Load tool specifications from embedded JSON
@@ -237,6 +400,12 @@ impl McpServer {
                 name: "Database Schema".to_string(),
                 description: "SQLite database schema information".to_string(),
             },
+            ResourceCapability {
+                uri: "index://metrics".to_string(),
+                mime_type: "application/json".to_string(),
+                name: "Latency Metrics".to_string(),
+                description: "Per-stage indexing and per-tool query latency histograms; add ?format=prometheus for Prometheus text".to_string(),
+            },
         ];
 
         let prompts = vec![];
@@ -251,43 +420,107 @@ impl McpServer {
     /// Start the MCP server
     #[instrument(skip(self))]
     pub async fn start(&mut self) -> Result<()> {
+        self.serve(tokio::io::stdin(), tokio::io::stdout()).await
+    }
+
+    /// Run the server over `input` and `output` instead of STDIO until `input` closes
+    #[instrument(skip_all)]
+    pub async fn serve<R, W>(&mut self, input: R, output: W) -> Result<()>
+    where
+        R: AsyncRead + Unpin + Send + 'static,
+        W: AsyncWrite + Unpin + Send + 'static,
+    {
         info!("Starting MCP server: {}", self.info.name);
         
         let (tx, mut rx) = mpsc::channel::<McpRequest>(100);
         
         // Start transport layer
-        self.transport.start(tx).await?;
-
-        // Main message processing loop
-        while let Some(request) = rx.recv().await {
-            match self.handle_request(request).await {
-                Ok(response) => {
-                    if let Err(e) = self.transport.send_response(response).await {
-                        error!("Failed to send response: {}", e);
-                    }
+        self.transport.start_with_io(tx, input, output).await?;
+        let responses = self.transport.response_sender()?;
+
+        // Session bookkeeping runs on its own tick rather than per request.
+        let mut sweep = tokio::time::interval_at(tokio::time::Instant::now() + SESSION_SWEEP_INTERVAL, SESSION_SWEEP_INTERVAL);
+        sweep.set_missed_tick_behavior(MissedTickBehavior::Delay);
+
+        // Main message processing loop. Tool calls and resource reads are dispatched
+        // so a slow one never delays the requests behind it; the rest answer inline.
+        loop {
+            let request = tokio::select! {
+                request = rx.recv() => match request {
+                    Some(request) => request,
+                    None => break,
+                },
+                _ = sweep.tick() => {
+                    self.sweep_sessions();
+                    continue;
+                }
+            };
+
+            match request {
+                McpRequest::ToolsCall { id, params } => {
+                    let lane = if ToolHandlers::is_write_tool(&params.name) { Lane::Write } else { Lane::Read };
+                    self.touch_current_session();
+                    let work = Self::handle_tools_call(self.tool_handlers.clone(), self.accounting(), id.clone(), params);
+                    self.dispatcher.spawn(id, lane, work, responses.clone());
+                }
+                McpRequest::ResourcesRead { id, params } => {
+                    let work = Self::handle_resources_read(self.resource_handlers.clone(), id.clone(), params);
+                    self.dispatcher.spawn(id, Lane::Read, work, responses.clone());
                 }
-                Err(e) => {
-                    error!("Request handling failed: {}", e);
-                    // Send error response if possible
+                request => {
+                    let id = request.id().cloned();
+                    let response = match self.handle_request(request).await {
+                        Ok(response) => response,
+                        Err(e) => {
+                            error!("Request handling failed: {}", e);
+                            // Every request gets an answer, or a batch holding it would never be sent.
+                            id.map(|id| McpResponse::failure(id, McpError {
+                                code: -32603,
+                                message: format!("Request handling failed: {}", e),
+                                data: None,
+                            }))
+                        }
+                    };
+                    if let Some(response) = response {
+                        if let Err(e) = self.transport.send_response(response).await {
+                            error!("Failed to send response: {}", e);
+                        }
+                    }
                 }
             }
         }
 
+        let session_log = self.session_log.clone();
+        match tokio::task::spawn_blocking(move || session_log.flush()).await {
+            Ok(Ok(written)) => debug!("Wrote activity of {} sessions at shutdown", written),
+            Ok(Err(e)) => warn!("Failed to write session activity: {}", e),
+            Err(e) => warn!("Session activity flush did not finish: {}", e),
+        }
+
+        let stats = self.transport.stats();
+        info!(
+            "Transport handled {} messages ({:.1}/s), {} bytes ({:.0}/s)",
+            stats.messages_received + stats.messages_sent,
+            stats.messages_per_second(),
+            stats.bytes_received + stats.bytes_sent,
+            stats.bytes_per_second(),
+        );
         Ok(())
     }
 
-    /// Handle incoming MCP requests
-    #[instrument(skip(self))]
-    async fn handle_request(&mut self, request: McpRequest) -> Result<McpResponse> {
-        match request {
+    /// Handle incoming MCP requests; notifications produce no response
+    #[instrument(level = "debug", skip_all)]
+    async fn handle_request(&mut self, request: McpRequest) -> Result<Option<McpResponse>> {
+        let response = match request {
             McpRequest::Initialize { id, params } => {
                 self.handle_initialize(id, params).await
             }
             McpRequest::ToolsCall { id, params } => {
-                self.handle_tools_call(id, params).await
+                self.touch_current_session();
+                Ok(Self::handle_tools_call(self.tool_handlers.clone(), self.accounting(), id, params).await)
             }
             McpRequest::ResourcesRead { id, params } => {
-                self.handle_resources_read(id, params).await
+                Ok(Self::handle_resources_read(self.resource_handlers.clone(), id, params).await)
             }
             McpRequest::ResourcesList { id, .. } => {
                 self.handle_resources_list(id).await
@@ -301,7 +534,12 @@ impl McpServer {
             McpRequest::Ping { id, .. } => {
                 self.handle_ping(id).await
             }
-        }
+            McpRequest::CancelRequest { params } => {
+                self.dispatcher.cancel(&params.id);
+                return Ok(None);
+            }
+        };
+        response.map(Some)
     }
 
     /// Handle initialization request
@@ -316,7 +554,11 @@ impl McpServer {
         }
 
         // Create new session
-        let session_id = Uuid::new_v4().to_string();
+        let session_uuid = Uuid::new_v4();
+        self.session_log.open(session_uuid, &params.client_info.name);
+        self.current_session = Some(session_uuid);
+        
+        let session_id = session_uuid.to_string();
         let session = McpSession {
             id: session_id.clone(),
             client_info: Some(params.client_info),
@@ -327,72 +569,74 @@ impl McpServer {
         self.sessions.insert(session_id, session);
 
         // Send initialization response
-        let result = json!({
-            "protocolVersion": "2024-11-05",
-            "serverInfo": self.info,
-            "capabilities": self.capabilities
-        });
-
-        Ok(McpResponse {
-            jsonrpc: "2.0".to_string(),
-            id,
-            result: Some(result),
-            error: None,
+        McpResponse::success(id, &InitializeResult {
+            protocol_version: "2024-11-05",
+            server_info: &self.info,
+            capabilities: &self.capabilities,
         })
     }
 
-    /// Handle tool call request
-    #[instrument(skip(self))]
-    async fn handle_tools_call(&mut self, id: Value, params: ToolCallParams) -> Result<McpResponse> {
-        info!("Handling tool call: {}", params.name);
+    /// Handle tool call request, recording it against `session` once answered
+    #[instrument(level = "debug", skip(tool_handlers, session, params), fields(tool = %params.name))]
+    async fn handle_tools_call(
+        tool_handlers: ToolHandlers,
+        session: Option<(SessionLog, Uuid)>,
+        id: Value,
+        params: ToolCallParams,
+    ) -> McpResponse {
+        debug!("Handling tool call: {}", params.name);
         
-        match self.tool_handlers.handle_tool_call(&params.name, params.arguments).await {
-            Ok(result) => Ok(McpResponse {
+        let started = Instant::now();
+        let outcome = tool_handlers.call_tool(&params.name, params.arguments).await;
+        if let Some((session_log, session_id)) = session {
+            session_log.record_query(session_id, started.elapsed());
+        }
+        
+        match outcome {
+            Ok(result) => McpResponse {
                 jsonrpc: "2.0".to_string(),
                 id,
-                result: Some(result),
+                result: None,
+                raw_result: Some(result),
                 error: None,
-            }),
+            },
             Err(e) => {
                 error!("Tool call failed: {}", e);
-                Ok(McpResponse {
-                    jsonrpc: "2.0".to_string(),
-                    id,
-                    result: None,
-                    error: Some(McpError {
-                        code: -32603, // Internal error
-                        message: format!("Tool execution failed: {}", e),
-                        data: None,
-                    }),
+                McpResponse::failure(id, McpError {
+                    code: tool_error_code(&e),
+                    message: format!("Tool execution failed: {}", e),
+                    data: None,
                 })
             }
         }
     }
 
     /// Handle resource read request
-    #[instrument(skip(self))]
-    async fn handle_resources_read(&mut self, id: Value, params: ResourceReadParams) -> Result<McpResponse> {
-        info!("Reading resource: {}", params.uri);
+    #[instrument(level = "debug", skip(resource_handlers, params), fields(uri = %params.uri))]
+    async fn handle_resources_read(resource_handlers: ResourceHandlers, id: Value, params: ResourceReadParams) -> McpResponse {
+        debug!("Reading resource: {}", params.uri);
         
-        match self.resource_handlers.handle_resource_read(&params.uri).await {
-            Ok(result) => Ok(McpResponse {
+        match resource_handlers.handle_resource_read(&params.uri).await {
+            Ok(result) => McpResponse {
                 jsonrpc: "2.0".to_string(),
                 id,
                 result: Some(result),
+                raw_result: None,
                 error: None,
-            }),
+            },
             Err(e) => {
                 error!("Resource read failed: {}", e);
-                Ok(McpResponse {
+                McpResponse {
                     jsonrpc: "2.0".to_string(),
                     id,
                     result: None,
+                    raw_result: None,
                     error: Some(McpError {
                         code: -32603,
                         message: format!("Resource read failed: {}", e),
                         data: None,
                     }),
-                })
+                }
             }
         }
     }
@@ -400,46 +644,19 @@ impl McpServer {
     /// Handle resources list request
     #[instrument(skip(self))]
     async fn handle_resources_list(&self, id: Value) -> Result<McpResponse> {
-        let result = json!({
-            "resources": self.capabilities.resources
-        });
-
-        Ok(McpResponse {
-            jsonrpc: "2.0".to_string(),
-            id,
-            result: Some(result),
-            error: None,
-        })
+        McpResponse::success(id, &ResourcesListResult { resources: &self.capabilities.resources })
     }
 
     /// Handle tools list request
     #[instrument(skip(self))]
     async fn handle_tools_list(&self, id: Value) -> Result<McpResponse> {
-        let result = json!({
-            "tools": self.capabilities.tools
-        });
-
-        Ok(McpResponse {
-            jsonrpc: "2.0".to_string(),
-            id,
-            result: Some(result),
-            error: None,
-        })
+        McpResponse::success(id, &ToolsListResult { tools: &self.capabilities.tools })
     }
 
     /// Handle prompts list request
     #[instrument(skip(self))]
     async fn handle_prompts_list(&self, id: Value) -> Result<McpResponse> {
-        let result = json!({
-            "prompts": self.capabilities.prompts
-        });
-
-        Ok(McpResponse {
-            jsonrpc: "2.0".to_string(),
-            id,
-            result: Some(result),
-            error: None,
-        })
+        McpResponse::success(id, &PromptsListResult { prompts: &self.capabilities.prompts })
     }
 
     /// Handle ping request
@@ -449,10 +666,37 @@ impl McpServer {
             jsonrpc: "2.0".to_string(),
             id,
             result: Some(json!({})),
+            raw_result: None,
             error: None,
         })
     }
 
+    /// Where the current session's tool calls are recorded
+    fn accounting(&self) -> Option<(SessionLog, Uuid)> {
+        self.current_session.map(|session_id| (self.session_log.clone(), session_id))
+    }
+
+    fn touch_current_session(&mut self) {
+        if let Some(session) = self.current_session.and_then(|id| self.sessions.get_mut(&id.to_string())) {
+            session.last_activity = chrono::Utc::now();
+        }
+    }
+
+    /// Periodic session upkeep: drops expired sessions and writes buffered activity on
+    /// a blocking thread, so neither happens on a request
+    fn sweep_sessions(&mut self) {
+        self.cleanup_sessions();
+        
+        if self.session_log.pending_sessions() > 0 {
+            let session_log = self.session_log.clone();
+            tokio::task::spawn_blocking(move || {
+                if let Err(e) = session_log.flush() {
+                    warn!("Failed to write session activity: {}", e);
+                }
+            });
+        }
+    }
+
     /// Cleanup expired sessions
     pub fn cleanup_sessions(&mut self) {
         let cutoff = chrono::Utc::now() - chrono::Duration::hours(24);
@@ -479,6 +723,13 @@ mod tests {
         assert_eq!(server.session_count(), 0);
     }
 
+    #[test]
+    fn test_invalid_cursor_is_invalid_params() {
+        let cursor = anyhow::Error::new(StorageError::InvalidArgument("Invalid cursor: zz".to_string()));
+        assert_eq!(tool_error_code(&cursor), INVALID_PARAMS);
+        assert_eq!(tool_error_code(&anyhow!("disk full")), -32603);
+    }
+
     #[tokio::test] 
     async fn test_capabilities_building() {
         let capabilities = McpServer::build_capabilities().unwrap();
@@ -500,4 +751,26 @@ mod tests {
         assert!(tool_names.contains(&"get_file_symbols"));
         assert!(tool_names.contains(&"update_file"));
     }
+
+    #[test]
+    fn test_raw_result_is_sent_as_result() {
+        let response = McpResponse {
+            jsonrpc: "2.0".to_string(),
+            id: json!(1),
+            result: None,
+            raw_result: Some(RawValue::from_string(r#"{"symbols":[]}"#.to_string()).unwrap()),
+            error: None,
+        };
+
+        assert_eq!(serde_json::to_string(&response).unwrap(), r#"{"jsonrpc":"2.0","id":1,"result":{"symbols":[]}}"#);
+    }
+
+    #[test]
+    fn test_cancel_notification_parsing() {
+        let lsp: McpRequest = serde_json::from_value(json!({"method": "$/cancelRequest", "params": {"id": 3}})).unwrap();
+        let mcp: McpRequest = serde_json::from_value(json!({"method": "notifications/cancelled", "params": {"requestId": "a"}})).unwrap();
+
+        assert!(matches!(lsp, McpRequest::CancelRequest { params } if params.id == json!(3)));
+        assert!(matches!(mcp, McpRequest::CancelRequest { params } if params.id == json!("a")));
+    }
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+use anyhow::Result;
+use std::collections::HashMap;
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::time::Duration;
+use uuid::Uuid;
+
+use crate::lib::storage::models::mcp_query_session::SessionActivity;
+use crate::lib::storage::{ConnectionPool, StorageError};
+
+/// Client name stored for a session that ran queries without initializing
+const UNKNOWN_CLIENT: &str = "unknown";
+
+/// Session activity recorded on the request path and written to the database in
+/// batches. Recording a query only updates a map entry; `flush` writes everything
+/// buffered since the previous flush in one transaction, off the request path.
+#[derive(Debug, Clone, Default)]
+pub struct SessionLog {
+    pending: Arc<Mutex<HashMap<Uuid, SessionActivity>>>,
+    database: Option<Arc<ConnectionPool>>,
+}
+
+impl SessionLog {
+    /// Buffers activity for `database`; without one, flushing discards it
+    pub fn new(database: Option<Arc<ConnectionPool>>) -> Self {
+        Self {
+            pending: Arc::default(),
+            database,
+        }
+    }
+
+    /// Starts a session; it is stored with the next flush even if it runs no query
+    pub fn open(&self, session_id: Uuid, client_name: &str) {
+        self.pending().entry(session_id).or_insert_with(|| SessionActivity::new(session_id, client_name.to_string()));
+    }
+
+    /// Records a query of `session_id` that took `elapsed`
+    pub fn record_query(&self, session_id: Uuid, elapsed: Duration) {
+        self.pending()
+            .entry(session_id)
+            .or_insert_with(|| SessionActivity::new(session_id, UNKNOWN_CLIENT.to_string()))
+            .record_query(elapsed);
+    }
+
+    /// Number of sessions with activity not written yet
+    pub fn pending_sessions(&self) -> usize {
+        self.pending().len()
+    }
+
+    /// Writes the buffered activity in one transaction and returns the number of
+    /// sessions written. On failure the activity is kept for the next flush.
+    pub fn flush(&self) -> Result<usize> {
+        let batch: Vec<SessionActivity> = self.pending().drain().map(|(_, activity)| activity).collect();
+        let Some(database) = &self.database else {
+            return Ok(0);
+        };
+        if batch.is_empty() {
+            return Ok(0);
+        }
+
+        let written = database.write().map_err(StorageError::from).and_then(|repository| repository.record_session_activity(&batch));
+        match written {
+            Ok(()) => Ok(batch.len()),
+            Err(e) => {
+                self.restore(batch);
+                Err(e.into())
+            }
+        }
+    }
+
+    /// Puts back a batch that could not be written, ahead of activity recorded since
+    fn restore(&self, batch: Vec<SessionActivity>) {
+        let mut pending = self.pending();
+        for mut activity in batch {
+            if let Some(later) = pending.remove(&activity.session_id) {
+                activity.merge(later);
+            }
+            pending.insert(activity.session_id, activity);
+        }
+    }
+
+    fn pending(&self) -> MutexGuard<'_, HashMap<Uuid, SessionActivity>> {
+        // The map holds plain counters, so it is still usable after a panic elsewhere.
+        self.pending.lock().unwrap_or_else(|poisoned| poisoned.into_inner())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_queries_are_buffered_per_session() {
+        let log = SessionLog::new(None);
+        let (first, second) = (Uuid::new_v4(), Uuid::new_v4());
+
+        log.open(first, "Claude");
+        log.record_query(first, Duration::from_millis(2));
+        log.record_query(first, Duration::from_millis(3));
+        log.record_query(second, Duration::from_millis(1));
+        assert_eq!(log.pending_sessions(), 2);
+
+        let first_activity = log.pending()[&first].clone();
+        assert_eq!((first_activity.client_name.as_str(), first_activity.queries, first_activity.query_micros), ("Claude", 2, 5000));
+        assert_eq!(log.pending()[&second].client_name, UNKNOWN_CLIENT);
+
+        // A batch put back after a failed write absorbs what was recorded meanwhile
+        let batch: Vec<SessionActivity> = log.pending().drain().map(|(_, activity)| activity).collect();
+        log.record_query(first, Duration::from_millis(4));
+        log.restore(batch);
+        assert_eq!(log.pending()[&first].queries, 3);
+        assert_eq!(log.pending()[&first].client_name, "Claude");
+
+        assert_eq!(log.flush().unwrap(), 0);
+        assert_eq!(log.pending_sessions(), 0);
+    }
+}
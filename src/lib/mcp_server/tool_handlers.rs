@@ -1,6 +1,51 @@
 use anyhow::{anyhow, Result};
+use chrono::{DateTime, Utc};
+use serde::Serialize;
+use serde_json::value::RawValue;
 use serde_json::{json, Value};
-use tracing::{info, instrument};
+use sha2::{Digest, Sha256};
+use std::cmp::Reverse;
+use std::collections::{BTreeMap, BinaryHeap, HashMap};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard, RwLock};
+use std::time::Instant;
+use tracing::{debug, info, instrument};
+use uuid::Uuid;
+
+use crate::lib::metrics::{self, Stage};
+use crate::lib::cpp_indexer::{hash_content, ChangeSink, CompilationDatabase, EnrichmentJob, ExtractedSymbol, ExtractionResult, IncludeResolver, ReferenceEdge, ReferencedSymbol, SymbolExtractor};
+use crate::lib::storage::models::code_element::{CodeElement, SymbolType};
+use crate::lib::storage::models::code_index::{CodeIndex, IndexState};
+use crate::lib::storage::models::file_metadata::{ExtractionTier, FileMetadata};
+use crate::lib::storage::models::symbol_relationships::{RelationshipType, SymbolEdge, SymbolKey};
+use crate::lib::storage::repository::FILES_PER_TRANSACTION;
+use crate::lib::storage::{ConnectionPool, Cursor, Direction, ElementSearch, FileBatch, FileIngestResult, ReadHandle, Repository, ShardMerge, Snapshot, SnapshotSymbol, StorageError, SymbolGraph, SymbolIndex, SymbolMatch, SymbolRecord, SymbolSearch, SymbolTable};
+use super::result_cache::{CacheKey, ResultCache};
+use super::session_log::SessionLog;
+
+/// Default and maximum `limit` accepted by the paginated tools
+const DEFAULT_PAGE_LIMIT: usize = 100;
+const MAX_PAGE_LIMIT: usize = 1000;
+
+/// Files whose syntax trees `update_file` keeps for incremental re-parsing
+const UPDATE_TREE_CACHE_FILES: usize = 32;
+
+/// Read-only tools whose results are cached per index revision. `get_symbol_details`
+/// joins them once it answers from storage.
+const CACHED_TOOLS: &[&str] = &["search_symbols", "find_references", "get_file_symbols"];
+
+/// Largest `max_depth` accepted by `find_references`
+const MAX_TRAVERSAL_DEPTH: u32 = 16;
+
+/// Symbols one `find_references` traversal may reach before it stops
+const MAX_TRAVERSAL_SYMBOLS: usize = 10_000;
+
+/// Cursor kind for pages of a graph traversal
+const TRAVERSAL_CURSOR: &str = "traversal";
+
+/// Cursor kind for pages of a search over several indices
+const FEDERATED_CURSOR: &str = "federated";
 
 /// Tool Handlers for MCP Protocol
 /// 
@@ -9,63 +54,1484 @@ use tracing::{info, instrument};
 /// and returns structured results according to the response schemas.
 #[derive(Debug, Clone)]
 pub struct ToolHandlers {
-    // TODO: Add actual dependencies when available
+    database: Option<Arc<ConnectionPool>>,
+    /// Indices kept in SQLite files of their own, by name
+    shards: Arc<HashMap<String, Arc<ConnectionPool>>>,
+    /// In-memory name indices per code index, loaded on first search when enabled
+    symbol_indices: Option<Arc<RwLock<HashMap<Uuid, SymbolIndex>>>>,
+    /// Reference graphs per code index, built on the first traversal after a write,
+    /// with the write count of the overlay's base they were built at
+    symbol_graphs: Arc<RwLock<HashMap<Uuid, (u64, Arc<SymbolGraph>)>>>,
+    /// Mapped snapshot answering reads of its index until the index is next written
+    snapshot: Arc<RwLock<Option<Arc<Snapshot>>>>,
+    result_cache: Option<Arc<ResultCache>>,
+    /// Merkle root and in-process write count of each index by name
+    revisions: Arc<RwLock<HashMap<String, IndexRevision>>>,
+    /// Extractor kept across `update_file` calls so edited files re-parse incrementally
+    extractor: Arc<Mutex<ExtractorSlot>>,
+    /// Compile commands the served index was built with, for `update_file`
+    compilation_database: Option<Arc<CompilationDatabase>>,
+}
+
+/// Lazily created extractor; it has no `Debug` of its own
+#[derive(Default)]
+struct ExtractorSlot(Option<SymbolExtractor>);
+
+impl std::fmt::Debug for ExtractorSlot {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str(if self.0.is_some() { "ExtractorSlot(ready)" } else { "ExtractorSlot(empty)" })
+    }
+}
+
+#[derive(Debug, Clone)]
+struct IndexRevision {
+    merkle_root: String,
+    /// Files stored since `merkle_root` was recorded
+    writes: u64,
+}
+
+impl IndexRevision {
+    fn new(merkle_root: Option<&str>) -> Self {
+        Self {
+            merkle_root: merkle_root.unwrap_or_default().to_string(),
+            writes: 0,
+        }
+    }
 }
 
 impl ToolHandlers {
     /// Create new tool handlers instance
     pub fn new() -> Result<Self> {
         Ok(Self {
-            // TODO: Initialize actual dependencies
+            database: None,
+            shards: Arc::new(HashMap::new()),
+            symbol_indices: None,
+            symbol_graphs: Arc::new(RwLock::new(HashMap::new())),
+            snapshot: Arc::new(RwLock::new(None)),
+            result_cache: None,
+            revisions: Arc::new(RwLock::new(HashMap::new())),
+            extractor: Arc::new(Mutex::new(ExtractorSlot::default())),
+            compilation_database: None,
         })
     }
 
-    /// Handle MCP tool call
-    #[instrument(skip(self, arguments))]
-    pub async fn handle_tool_call(&mut self, tool_name: &str, arguments: Value) -> Result<Value> {
-        info!("Handling tool call: {} with arguments: {}", tool_name, arguments);
+    /// Serve tools from `database`; reads use its pooled read connections
+    pub fn with_database(mut self, database: Arc<ConnectionPool>) -> Self {
+        self.database = Some(database);
+        self
+    }
+
+    /// Keep `index_name` in `database` instead of the shared one, so a very large
+    /// index has its own file, writer and read connections
+    pub fn with_shard(mut self, index_name: &str, database: Arc<ConnectionPool>) -> Self {
+        Arc::make_mut(&mut self.shards).insert(index_name.to_string(), database);
+        self
+    }
+
+    /// Serve `search_symbols` from in-memory symbol indices instead of SQLite
+    pub fn with_symbol_index(mut self, enabled: bool) -> Self {
+        self.symbol_indices = enabled.then(|| Arc::new(RwLock::new(HashMap::new())));
+        self
+    }
+
+    /// Serve reads of the snapshot's index from `snapshot` rather than SQLite. The
+    /// first write to that index retires it, after which reads see the database.
+    pub fn with_snapshot(self, snapshot: Snapshot) -> Self {
+        if let Ok(mut slot) = self.snapshot.write() {
+            *slot = Some(Arc::new(snapshot));
+        }
+        self
+    }
+
+    /// Parse files `update_file` re-extracts with their own compile commands and
+    /// resolve their includes against those commands' search paths, as the indexer does
+    pub fn with_compilation_database(mut self, compilation_database: Arc<CompilationDatabase>) -> Self {
+        self.compilation_database = Some(compilation_database);
+        self
+    }
+
+    /// Cache read-only tool results in `cache`
+    pub fn with_result_cache(mut self, cache: Arc<ResultCache>) -> Self {
+        self.result_cache = Some(cache);
+        self
+    }
+
+    pub fn result_cache(&self) -> Option<Arc<ResultCache>> {
+        self.result_cache.clone()
+    }
+
+    /// Write-behind log of session activity, kept in the shared database
+    pub fn session_log(&self) -> SessionLog {
+        SessionLog::new(self.database.clone())
+    }
+
+    /// Current write generation of the stored contents of `index_name`
+    pub fn write_generation(&self, index_name: &str) -> Result<u64> {
+        let (_, write_generation) = self.reader_for(index_name)?
+            .get_index_revision(index_name)?
+            .ok_or_else(|| anyhow!("Index not found: {}", index_name))?;
+        Ok(write_generation)
+    }
+
+    /// Records the Merkle root the stored contents of `index_name` correspond to
+    pub fn set_merkle_root(&self, index_name: &str, merkle_root: Option<&str>) -> Result<()> {
+        let index = self.resolve_index(index_name)?;
+        self.record_merkle_root(&index, merkle_root);
+        Ok(())
+    }
+
+    /// Builds the symbol index for `index_name` ahead of the first query and returns
+    /// the number of symbols loaded
+    pub fn preload_symbol_index(&self, index_name: &str) -> Result<usize> {
+        let index = self.resolve_index(index_name)?;
+        self.with_symbol_index_for(&index, |symbol_index| symbol_index.len())
+            .ok_or_else(|| anyhow!("Symbol index is not enabled"))?
+    }
+
+    /// Whether `tool_name` modifies an index, so calls must not run alongside each other
+    pub fn is_write_tool(tool_name: &str) -> bool {
+        matches!(tool_name, "index_codebase" | "update_file" | "delete_index")
+    }
+
+    /// Runs a tool call and returns its serialized result, answering repeated
+    /// read-only calls from the result cache without touching storage. SQLite and
+    /// libclang work blocks, so the call runs on the blocking pool and the async worker
+    /// stays free for other requests; a caller that stops waiting gets its answer at
+    /// once while the call finishes in the background.
+    pub async fn call_tool(&self, tool_name: &str, arguments: Value) -> Result<Box<RawValue>> {
+        let started = Instant::now();
+        let (handlers, name) = (self.clone(), tool_name.to_string());
+        let result = tokio::task::spawn_blocking(move || handlers.call_tool_cached(&name, arguments))
+            .await
+            .unwrap_or_else(|e| Err(anyhow!("Tool call {} failed: {}", tool_name, e)));
+        metrics::global().record_tool(tool_name, started.elapsed());
+        result
+    }
+
+    fn call_tool_cached(&self, tool_name: &str, arguments: Value) -> Result<Box<RawValue>> {
+        let key = self.cache_key(tool_name, &arguments);
+        if let (Some(cache), Some(key)) = (&self.result_cache, &key) {
+            if let Some(result) = cache.get(key) {
+                return Ok(result);
+            }
+        }
+
+        let result = self.handle_tool_call(tool_name, arguments)?;
+        if let (Some(cache), Some(key)) = (&self.result_cache, key) {
+            cache.insert(key, result.clone());
+        }
+        Ok(result)
+    }
+
+    /// Key for a cacheable call, taken before the call runs so a result computed
+    /// while a write lands is filed under the generation it started from. The write
+    /// generation is read from storage on every call, so writes this process did not
+    /// see, such as an `index` run, stop old entries from matching too.
+    fn cache_key(&self, tool_name: &str, arguments: &Value) -> Option<CacheKey> {
+        self.result_cache.as_ref()?;
+        if !CACHED_TOOLS.contains(&tool_name) || self.database.is_none() {
+            return None;
+        }
+
+        let index_name = arguments.get("index_name")?.as_str()?;
+        let (index_id, write_generation) = self.reader_for(index_name).ok()?.get_index_revision(index_name).ok()??;
+        let merkle_root = self.revisions.read().ok()?.get(index_name).map(|revision| revision.merkle_root.clone()).unwrap_or_default();
+        Some(CacheKey::new(tool_name, arguments, index_id, &merkle_root, write_generation))
+    }
+
+    fn record_merkle_root(&self, index: &CodeIndex, merkle_root: Option<&str>) {
+        if let Ok(mut revisions) = self.revisions.write() {
+            revisions.insert(index.name.clone(), IndexRevision::new(merkle_root));
+        }
+    }
+
+    fn record_write(&self, index: &CodeIndex) {
+        if let Ok(mut revisions) = self.revisions.write() {
+            revisions.entry(index.name.clone()).or_insert_with(|| IndexRevision::new(None)).writes += 1;
+        }
+        if let Ok(mut graphs) = self.symbol_graphs.write() {
+            graphs.remove(&index.id);
+        }
+        if let Ok(mut snapshot) = self.snapshot.write() {
+            if snapshot.as_ref().is_some_and(|snapshot| snapshot.index_id() == index.id) {
+                info!("Snapshot of {} is out of date; reading it from the database", index.name);
+                *snapshot = None;
+            }
+        }
+    }
+
+    /// Files stored into `index` since its Merkle root was last recorded
+    fn write_count(&self, index: &CodeIndex) -> u64 {
+        self.revisions.read().ok().and_then(|revisions| revisions.get(&index.name).map(|revision| revision.writes)).unwrap_or(0)
+    }
+
+    /// Handle MCP tool call, serializing the result as it is produced
+    #[instrument(level = "debug", skip(self, arguments))]
+    pub fn handle_tool_call(&self, tool_name: &str, arguments: Value) -> Result<Box<RawValue>> {
+        debug!("Handling tool call: {} with arguments: {}", tool_name, arguments);
         
         // For now, return placeholder responses for all tools
         // TODO: Implement actual tool functionality when dependencies are available
         match tool_name {
-            "index_codebase" => Ok(json!({
+            "index_codebase" => to_raw(&json!({
                 "success": false,
                 "error": "Not yet implemented",
                 "tool": tool_name
             })),
-            "search_symbols" => Ok(json!({
+            "search_symbols" if self.database.is_some() => self.search_symbols(&arguments),
+            "search_symbols" => to_raw(&json!({
                 "symbols": [],
                 "total_count": 0,
                 "error": "Not yet implemented"
             })),
-            "get_symbol_details" => Ok(json!({
+            "get_symbol_details" => to_raw(&json!({
                 "error": "Not yet implemented"
             })),
-            "find_references" => Ok(json!({
+            "find_references" if self.database.is_some() => self.find_references(&arguments),
+            "find_references" => to_raw(&json!({
                 "references": [],
                 "error": "Not yet implemented"
             })),
-            "list_indices" => Ok(json!({
+            "list_indices" if self.database.is_some() => self.list_indices(&arguments),
+            "list_indices" => to_raw(&json!({
                 "indices": [],
                 "count": 0,
                 "error": "Not yet implemented"
             })),
-            "delete_index" => Ok(json!({
+            "delete_index" => to_raw(&json!({
                 "success": false,
                 "error": "Not yet implemented"
             })),
-            "get_file_symbols" => Ok(json!({
+            "get_file_symbols" if self.database.is_some() => self.get_file_symbols(&arguments),
+            "get_file_symbols" => to_raw(&json!({
                 "symbols": [],
                 "total_symbols": 0,
                 "error": "Not yet implemented"
             })),
-            "update_file" => Ok(json!({
+            "update_file" if self.database.is_some() => to_raw(&self.update_file(&arguments)?),
+            "update_file" => to_raw(&json!({
                 "success": false,
                 "error": "Not yet implemented"
             })),
             _ => Err(anyhow!("Unknown tool: {}", tool_name)),
         }
     }
+
+    /// Ranked symbol search, one page at a time. With the symbol index enabled,
+    /// matching runs in memory and only the returned page is read from SQLite.
+    /// `index_name` may also list several indices separated by commas, or be `*` for
+    /// all of them; those are searched in parallel and their results merged.
+    fn search_symbols(&self, arguments: &Value) -> Result<Box<RawValue>> {
+        let start = Instant::now();
+        let index_name = required_str(arguments, "index_name")?;
+        let query = SymbolQuery::parse(arguments)?;
+        let limit = page_limit(arguments);
+        let cursor = page_cursor(arguments)?;
+
+        if is_federated(index_name) {
+            return self.search_federated(index_name, query, cursor.as_ref(), limit, start);
+        }
+
+        if let Some(snapshot) = self.snapshot_for(index_name).filter(|_| query.unfiltered()) {
+            let search = query.search_names(|pattern, types, max_edits| match max_edits {
+                None => snapshot.lookup_exact(pattern, types, cursor.as_ref(), limit),
+                Some(max_edits) => snapshot.search(pattern, types, max_edits, cursor.as_ref(), limit),
+            })?;
+            let ids: Vec<i64> = search.matches.iter().map(|m| m.id).collect();
+            return to_raw(&SymbolPage {
+                symbols: snapshot.symbols_by_ids(&ids).into_iter().map(SymbolView::from).collect(),
+                total_count: search.total_count,
+                query_time_ms: start.elapsed().as_millis() as u64,
+                next_cursor: search.next_cursor.map(|cursor| cursor.encode()),
+            });
+        }
+
+        let index = self.resolve_index(index_name)?;
+        let hits = self.search_index(&index, &query, cursor.as_ref(), limit)?;
+        to_raw(&SymbolPage {
+            symbols: hits.elements.iter().map(SymbolView::from).collect(),
+            total_count: hits.total_count,
+            query_time_ms: start.elapsed().as_millis() as u64,
+            next_cursor: hits.next_cursor.map(|cursor| cursor.encode()),
+        })
+    }
+
+    /// One page of `query` over a single index, from whichever of the snapshot, the
+    /// symbol index or SQLite serves it. An overlay is searched in SQLite together with
+    /// its base, whose rows count in the files the overlay does not shadow.
+    fn search_index(&self, index: &CodeIndex, query: &SymbolQuery, cursor: Option<&Cursor>, limit: usize) -> Result<IndexHits> {
+        // File and scope filters need the full rows, so those queries stay in SQLite.
+        if let Some(snapshot) = self.snapshot_for(&index.name).filter(|_| query.unfiltered()) {
+            let search = query.search_names(|pattern, types, max_edits| match max_edits {
+                None => snapshot.lookup_exact(pattern, types, cursor, limit),
+                Some(max_edits) => snapshot.search(pattern, types, max_edits, cursor, limit),
+            })?;
+            let ids: Vec<i64> = search.matches.iter().map(|m| m.id).collect();
+            let elements = snapshot.symbols_by_ids(&ids).into_iter().map(|symbol| snapshot_element(index, symbol)).collect();
+            return Ok(IndexHits::from_names(search, elements));
+        }
+
+        let base = self.overlay_base(index)?;
+        let in_memory = if !query.unfiltered() || base.is_some() {
+            None
+        } else {
+            self.with_symbol_index_for(index, |symbol_index| {
+                query.search_names(|pattern, types, max_edits| match max_edits {
+                    None => symbol_index.lookup_exact(pattern, types, cursor, limit),
+                    Some(max_edits) => symbol_index.search(pattern, types, max_edits, cursor, limit),
+                })
+            })
+            .transpose()?
+            .transpose()?
+        };
+
+        let repository = self.reader_for(&index.name)?;
+        Ok(match in_memory {
+            Some(search) => {
+                let ids: Vec<i64> = search.matches.iter().map(|m| m.id).collect();
+                let elements = repository.get_code_elements_by_ids(&ids)?;
+                IndexHits::from_names(search, elements)
+            }
+            None => {
+                let search = ElementSearch::new(&query.query)
+                    .with_types(&query.symbol_types)
+                    .exact(query.exact_match)
+                    .in_file(query.file_path.as_deref())
+                    .in_scope(query.scope.as_deref())
+                    .over_base(base.map(|base| base.id));
+                let page = repository.search_code_elements_keyed(&index.id, &search, cursor, limit)?;
+                let (elements, resume) = page.items.into_iter().unzip();
+                IndexHits {
+                    elements,
+                    resume,
+                    total_count: repository.count_code_elements(&index.id, &search)?,
+                    next_cursor: page.next_cursor,
+                }
+            }
+        })
+    }
+
+    /// `search_symbols` over several indices at once. Each index is searched on a
+    /// blocking worker through the read pool, and the pages are merged with a heap
+    /// keyed on match quality, so the call takes about as long as the slowest index.
+    fn search_federated(&self, index_names: &str, query: SymbolQuery, cursor: Option<&Cursor>, limit: usize, start: Instant) -> Result<Box<RawValue>> {
+        // Per index: the cursor after the last of its rows that earlier pages returned.
+        let (streams, exhausted_count) = match cursor {
+            Some(cursor) => {
+                let key = cursor.key_for(FEDERATED_CURSOR, 2)?;
+                let (Some(states), Some(exhausted_count)) = (key[0].as_array(), key[1].as_u64()) else {
+                    return Err(invalid_cursor());
+                };
+                let streams = states
+                    .iter()
+                    .map(|state| {
+                        let Some(name) = state[0].as_str() else {
+                            return Err(invalid_cursor());
+                        };
+                        let resume = state[1].as_str().map(Cursor::decode).transpose()?;
+                        Ok((self.resolve_index(name)?, resume))
+                    })
+                    .collect::<Result<Vec<_>>>()?;
+                (streams, exhausted_count as usize)
+            }
+            None => (self.target_indices(index_names)?.into_iter().map(|index| (index, None)).collect(), 0),
+        };
+
+        let query = Arc::new(query);
+        let results = {
+            let (handlers, query) = (self.clone(), Arc::clone(&query));
+            fan_out(streams.clone(), self.federated_workers(), move |(index, resume)| {
+                handlers.search_index(index, &query, resume.as_ref(), limit)
+            })?
+        };
+
+        let mut heap = BinaryHeap::new();
+        for (stream, hits) in results.iter().enumerate() {
+            if let Some(element) = hits.elements.first() {
+                heap.push(Reverse((query.merge_key(element), stream, 0)));
+            }
+        }
+        let mut taken = vec![0; results.len()];
+        let mut page = Vec::with_capacity(limit);
+        while page.len() < limit {
+            let Some(Reverse((_, stream, row))) = heap.pop() else {
+                break;
+            };
+            page.push(FederatedView { index_name: &streams[stream].0.name, symbol: SymbolView::from(&results[stream].elements[row]) });
+            taken[stream] += 1;
+            if let Some(element) = results[stream].elements.get(row + 1) {
+                heap.push(Reverse((query.merge_key(element), stream, row + 1)));
+            }
+        }
+
+        // Indices with rows left resume where this page stopped; finished ones drop out.
+        let mut exhausted = exhausted_count;
+        let mut states = Vec::new();
+        for (((index, resume), hits), &taken) in streams.iter().zip(&results).zip(&taken) {
+            if taken < hits.elements.len() {
+                let resume = taken.checked_sub(1).map_or(resume.as_ref(), |last| hits.resume.get(last));
+                states.push(json!([index.name, resume.map(Cursor::encode)]));
+            } else if let Some(next_cursor) = &hits.next_cursor {
+                states.push(json!([index.name, next_cursor.encode()]));
+            } else {
+                exhausted += hits.total_count;
+            }
+        }
+        let total_count = results.iter().map(|hits| hits.total_count).sum::<usize>() + exhausted_count;
+
+        to_raw(&FederatedPage {
+            symbols: page,
+            total_count,
+            indices_searched: streams.len(),
+            query_time_ms: start.elapsed().as_millis() as u64,
+            next_cursor: (!states.is_empty()).then(|| Cursor::new(FEDERATED_CURSOR, vec![json!(states), json!(exhausted)]).encode()),
+        })
+    }
+
+    /// Indices named by a federated `index_name`, ordered by name
+    fn target_indices(&self, index_names: &str) -> Result<Vec<CodeIndex>> {
+        let mut indices = if index_names.trim() == "*" {
+            self.all_indices()?
+        } else {
+            index_names
+                .split(',')
+                .map(str::trim)
+                .filter(|name| !name.is_empty())
+                .map(|name| self.resolve_index(name))
+                .collect::<Result<Vec<_>>>()?
+        };
+        indices.sort_by(|a, b| a.name.cmp(&b.name));
+        indices.dedup_by_key(|index| index.id);
+        Ok(indices)
+    }
+
+    /// Declarations of a symbol and the symbols referring to it, one page at a time.
+    /// Other relationships, or more than one hop, are answered from the symbol graph.
+    /// An overlay is read together with its base, as in `search_index`.
+    fn find_references(&self, arguments: &Value) -> Result<Box<RawValue>> {
+        let start = Instant::now();
+        let index_name = required_str(arguments, "index_name")?;
+        let symbol_name = required_str(arguments, "symbol_name")?;
+        let include_declarations = arguments.get("include_declarations").and_then(Value::as_bool).unwrap_or(true);
+        let relationship = arguments.get("relationship").and_then(Value::as_str).unwrap_or("references");
+        let max_depth = arguments
+            .get("max_depth")
+            .and_then(Value::as_u64)
+            .map_or(1, |depth| (depth as u32).clamp(1, MAX_TRAVERSAL_DEPTH));
+        let limit = page_limit(arguments);
+        let cursor = page_cursor(arguments)?;
+        let symbol_types = symbol_type_filter(arguments)?;
+        let (direction, kinds) = relationship_traversal(relationship)?;
+
+        let index = self.resolve_index(index_name)?;
+        if relationship != "references" || max_depth > 1 {
+            return self.traverse_references(&index, symbol_name, &symbol_types, direction, kinds, max_depth, include_declarations, cursor.as_ref(), limit, start);
+        }
+
+        let base = self.overlay_base(&index)?;
+        let base_id = base.as_ref().map(|base| &base.id);
+        let repository = self.reader_for(&index.name)?;
+        let page = repository.find_references_page(&index.id, base_id, symbol_name, &symbol_types, include_declarations, cursor.as_ref(), limit)?;
+        let total_count = repository.count_references(&index.id, base_id, symbol_name, &symbol_types, include_declarations)?;
+
+        to_raw(&SymbolPage {
+            symbols: page.items.iter().map(SymbolView::from).collect(),
+            total_count,
+            query_time_ms: start.elapsed().as_millis() as u64,
+            next_cursor: page.next_cursor.map(|cursor| cursor.encode()),
+        })
+    }
+
+    /// `find_references` over the symbol graph: the symbols `symbol_name` reaches
+    /// within `max_depth` hops, nearest first, after its own declarations
+    #[allow(clippy::too_many_arguments)]
+    fn traverse_references(
+        &self,
+        index: &CodeIndex,
+        symbol_name: &str,
+        symbol_types: &[SymbolType],
+        direction: Direction,
+        kinds: &[RelationshipType],
+        max_depth: u32,
+        include_declarations: bool,
+        cursor: Option<&Cursor>,
+        limit: usize,
+        start: Instant,
+    ) -> Result<Box<RawValue>> {
+        let offset = match cursor {
+            Some(cursor) => cursor.key_for(TRAVERSAL_CURSOR, 1)?[0]
+                .as_u64()
+                .ok_or_else(invalid_cursor)? as usize,
+            None => 0,
+        };
+
+        let snapshot = self.snapshot_for(&index.name);
+        let (start_ids, traversal) = match &snapshot {
+            Some(snapshot) => {
+                let start_ids = snapshot.element_ids_by_name(symbol_name, symbol_types);
+                let traversal = snapshot.traverse(&start_ids, direction, kinds, max_depth, MAX_TRAVERSAL_SYMBOLS);
+                (start_ids, traversal)
+            }
+            None => {
+                let base = self.overlay_base(index)?;
+                let graph = self.symbol_graph_for(index, base.as_ref())?;
+                let start_ids = self.reader_for(&index.name)?
+                    .code_element_ids_by_name(&index.id, base.as_ref().map(|base| &base.id), symbol_name, symbol_types)?;
+                let traversal = graph.traverse(&start_ids, direction, kinds, max_depth, MAX_TRAVERSAL_SYMBOLS);
+                (start_ids, traversal)
+            }
+        };
+
+        let declarations = if include_declarations { start_ids.as_slice() } else { &[] };
+        let hits: Vec<(i64, u32)> = declarations
+            .iter()
+            .map(|&id| (id, 0))
+            .chain(
+                traversal.hits.iter().filter(|hit| !start_ids.contains(&hit.id)).map(|hit| (hit.id, hit.depth)),
+            )
+            .collect();
+
+        let page = hits.get(offset..).unwrap_or_default();
+        let page = &page[..page.len().min(limit)];
+        let ids: Vec<i64> = page.iter().map(|&(id, _)| id).collect();
+        let elements;
+        let symbols: Vec<SymbolView> = match &snapshot {
+            Some(snapshot) => snapshot.symbols_by_ids(&ids).into_iter().map(SymbolView::from).collect(),
+            None => {
+                elements = self.reader_for(&index.name)?.get_code_elements_by_ids(&ids)?;
+                elements.iter().map(SymbolView::from).collect()
+            }
+        };
+        let depths: HashMap<i64, u32> = page.iter().copied().collect();
+
+        let next_offset = offset + page.len();
+        to_raw(&TraversalPage {
+            symbols: symbols
+                .into_iter()
+                .map(|symbol| TraversalView {
+                    depth: symbol.id.and_then(|id| depths.get(&id).copied()).unwrap_or_default(),
+                    symbol,
+                })
+                .collect(),
+            total_count: hits.len(),
+            truncated: traversal.truncated,
+            query_time_ms: start.elapsed().as_millis() as u64,
+            next_cursor: (next_offset < hits.len()).then(|| Cursor::new(TRAVERSAL_CURSOR, vec![json!(next_offset)]).encode()),
+        })
+    }
+
+    /// The reference graph of `index`, over its base too when it is an overlay, loaded
+    /// on first use after each write to either
+    fn symbol_graph_for(&self, index: &CodeIndex, base: Option<&CodeIndex>) -> Result<Arc<SymbolGraph>> {
+        // Writes to an overlay drop its graph, but writes to its base do not.
+        let base_writes = base.map_or(0, |base| self.write_count(base));
+        let cached = self.symbol_graphs.read().ok().and_then(|graphs| graphs.get(&index.id).cloned());
+        if let Some((_, graph)) = cached.filter(|&(writes, _)| writes == base_writes) {
+            return Ok(graph);
+        }
+
+        let writes = self.write_count(index);
+        let graph = Arc::new(SymbolGraph::load(&*self.reader_for(&index.name)?, &index.id, base.map(|base| &base.id))?);
+        info!("Loaded symbol graph for {} with {} symbols and {} edges", index.name, graph.node_count(), graph.edge_count());
+
+        // A write that landed while loading may be missing from this graph; serve it
+        // once without keeping it.
+        if self.write_count(index) == writes && base.map_or(0, |base| self.write_count(base)) == base_writes {
+            if let Ok(mut graphs) = self.symbol_graphs.write() {
+                graphs.insert(index.id, (base_writes, Arc::clone(&graph)));
+            }
+        }
+        Ok(graph)
+    }
+
+    /// Every index with its file and symbol totals, which are stored counters rather
+    /// than counts taken per call
+    fn list_indices(&self, arguments: &Value) -> Result<Box<RawValue>> {
+        let include_stats = arguments.get("include_stats").and_then(Value::as_bool).unwrap_or(true);
+        let indices = self.all_indices()?;
+
+        let indices: Vec<Value> = indices
+            .iter()
+            .map(|index| {
+                let base = self.overlay_base(index)?;
+                let mut view = json!({
+                    "id": index.id,
+                    "name": index.name,
+                    "base_path": index.base_path,
+                    "created_at": index.created_at.to_rfc3339(),
+                    "updated_at": index.updated_at.to_rfc3339(),
+                    "index_version": index.index_version.to_string(),
+                });
+                if include_stats {
+                    view["total_files"] = json!(index.total_files);
+                    view["total_symbols"] = json!(index.total_symbols);
+                }
+                if let Some(base) = base {
+                    view["overlay_of"] = json!(base.name);
+                }
+                Ok(view)
+            })
+            .collect::<Result<_>>()?;
+
+        to_raw(&json!({
+            "total_count": indices.len(),
+            "indices": indices,
+        }))
+    }
+
+    /// Symbols of one file in source order, one page at a time
+    fn get_file_symbols(&self, arguments: &Value) -> Result<Box<RawValue>> {
+        let index_name = required_str(arguments, "index_name")?;
+        let file_path = required_str(arguments, "file_path")?;
+        let group_by_type = arguments.get("group_by_type").and_then(Value::as_bool).unwrap_or(false);
+        let limit = page_limit(arguments);
+        let cursor = page_cursor(arguments)?;
+
+        let index = self.resolve_index(index_name)?;
+        let (_, relative_path) = resolve_file_path(&index, file_path)?;
+        let owner = self.file_owner(&index, &relative_path)?;
+        let snapshot = self.snapshot_for(index_name);
+        let elements;
+        let (symbols, total_symbols, next_cursor): (Vec<SymbolView>, _, _) = match &snapshot {
+            Some(snapshot) => {
+                let page = snapshot.file_symbols_page(&relative_path, cursor.as_ref(), limit)?;
+                let total_symbols = snapshot.count_file_symbols(&relative_path);
+                (page.items.into_iter().map(SymbolView::from).collect(), total_symbols, page.next_cursor)
+            }
+            None => {
+                let repository = self.reader_for(&index.name)?;
+                elements = repository.list_code_elements_by_file_page(&owner.id, &relative_path, cursor.as_ref(), limit)?;
+                let total_symbols = repository.count_code_elements_by_file(&owner.id, &relative_path)?;
+                (elements.items.iter().map(SymbolView::from).collect(), total_symbols, elements.next_cursor.clone())
+            }
+        };
+
+        let grouped_symbols = group_by_type.then(|| {
+            let mut grouped: BTreeMap<String, Vec<SymbolView>> = BTreeMap::new();
+            for symbol in &symbols {
+                let group = match symbol.symbol_type {
+                    "class" => "classes".to_string(),
+                    symbol_type => format!("{}s", symbol_type),
+                };
+                grouped.entry(group).or_default().push(symbol.clone());
+            }
+            grouped
+        });
+
+        to_raw(&FileSymbols {
+            file_path: &relative_path,
+            symbols,
+            grouped_symbols,
+            total_symbols,
+            next_cursor: next_cursor.map(|cursor| cursor.encode()),
+        })
+    }
+
+    /// Re-extracts one file, replaces its rows and refreshes the symbol index
+    fn update_file(&self, arguments: &Value) -> Result<Value> {
+        let start = Instant::now();
+        let index_name = required_str(arguments, "index_name")?;
+        let file_path = required_str(arguments, "file_path")?;
+
+        let index = self.resolve_index(index_name)?;
+        let (absolute_path, relative_path) = resolve_file_path(&index, file_path)?;
+        let content = metrics::time(Stage::Read, || std::fs::read_to_string(&absolute_path))
+            .map_err(|e| anyhow!("Failed to read {}: {}", absolute_path.display(), e))?;
+
+        let extraction = {
+            let mut slot = self.extractor.lock().map_err(|_| anyhow!("Extractor lock poisoned"))?;
+            let extractor = match &mut slot.0 {
+                Some(extractor) => extractor,
+                empty => {
+                    let mut extractor = SymbolExtractor::new(None)
+                        .map_err(|e| anyhow!("{}", e))?
+                        .with_tree_cache(UPDATE_TREE_CACHE_FILES);
+                    if let Some(compilation_database) = &self.compilation_database {
+                        extractor = extractor.with_compilation_database(Arc::clone(compilation_database));
+                    }
+                    empty.insert(extractor)
+                }
+            };
+            extractor
+                .extract_symbols_from_content(&absolute_path, &content)
+                .map_err(|e| anyhow!("{}", e))?
+        };
+        let extraction = ExtractionResult { content_hash: metrics::time(Stage::Hash, || hash_content(content.as_bytes())), ..extraction };
+        let mut resolver = match &self.compilation_database {
+            Some(compilation_database) => IncludeResolver::new(&[]).with_compilation_database(Arc::clone(compilation_database)),
+            None => IncludeResolver::new(&[]),
+        };
+        let dependencies: Vec<PathBuf> = extraction
+            .includes
+            .iter()
+            .filter_map(|include| resolver.resolve(&absolute_path, include))
+            .collect();
+
+        let symbols_updated =
+            self.store_extraction(&index, &absolute_path, &relative_path, &extraction, &dependencies, None)?.unwrap_or_default();
+
+        Ok(json!({
+            "success": true,
+            "file_path": relative_path,
+            "symbols_updated": symbols_updated,
+            "processing_time_ms": start.elapsed().as_millis() as u64,
+        }))
+    }
+
+    /// Returns a sink that persists the file watcher's changes to `index_name`
+    pub fn change_sink(&self, index_name: &str) -> Result<IndexUpdateSink> {
+        Ok(IndexUpdateSink {
+            handlers: self.clone(),
+            index: self.resolve_index(index_name)?,
+            pending: Vec::new(),
+        })
+    }
+
+    /// The index named `index_name`, created over `base_path` if it does not exist yet
+    pub fn open_index(&self, index_name: &str, base_path: &Path) -> Result<CodeIndex> {
+        if let Some(index) = self.reader_for(index_name)?.get_code_index_by_name(index_name)? {
+            return Ok(index);
+        }
+        let index = CodeIndex::new(index_name.to_string(), base_path.to_string_lossy().to_string());
+        Ok(self.writer_for(index_name)?.create_code_index(index)?)
+    }
+
+    /// The overlay `index_name` over `base_name`, created over `base_path` if it does not
+    /// exist yet; returns the base. Both must be kept in the same database.
+    pub fn open_overlay(&self, index_name: &str, base_name: &str, base_path: &Path) -> Result<CodeIndex> {
+        if !std::ptr::eq(self.database_for(index_name)?, self.database_for(base_name)?) {
+            return Err(anyhow!("Overlay '{}' must be kept in the same database as its base '{}'", index_name, base_name));
+        }
+        let base = self.resolve_index(base_name)?;
+        let index = self.open_index(index_name, base_path)?;
+        self.writer_for(index_name)?.create_overlay(&index.id, &base.id)?;
+        Ok(base)
+    }
+
+    /// Merges `index_name` from the shard database at `shard_path`, built by another
+    /// node with `index create --shard`, into the index of the same name here
+    pub fn merge_shard(&self, index_name: &str, shard_path: &Path) -> Result<ShardMerge> {
+        let index = self.resolve_index(index_name)?;
+        let merged = self.writer_for(&index.name)?.merge_shard(&index.id, shard_path, &index.name)?;
+        self.record_write(&index);
+        Ok(merged)
+    }
+
+    /// Moves `index_name` to `state`, e.g. `Active` once its files are queryable
+    pub fn set_index_state(&self, index_name: &str, state: IndexState) -> Result<()> {
+        let index = self.resolve_index(index_name)?;
+        self.writer_for(&index.name)?.update_code_index_state(&index.id, state)?;
+        Ok(())
+    }
+
+    /// Files of `index_name` stored with tree-sitter symbols only, with the includes to
+    /// store again when they are enriched
+    pub fn pending_enrichment(&self, index_name: &str) -> Result<Vec<EnrichmentJob>> {
+        let index = self.resolve_index(index_name)?;
+        let base_path = Path::new(&index.base_path);
+        let repository = self.reader_for(&index.name)?;
+
+        let mut dependencies: HashMap<String, Vec<PathBuf>> = HashMap::new();
+        for (file, included) in repository.list_file_dependencies(&index.id)? {
+            dependencies.entry(file).or_default().push(base_path.join(included));
+        }
+
+        Ok(repository
+            .list_files_by_tier(&index.id, ExtractionTier::Syntax)?
+            .into_iter()
+            .map(|file| EnrichmentJob {
+                file_path: base_path.join(&file.file_path),
+                dependencies: dependencies.remove(&file.file_path).unwrap_or_default(),
+                file_hash: file.file_hash,
+                size_bytes: file.size_bytes,
+            })
+            .collect())
+    }
+
+    /// Include graph of `index_name` as `(file, included file)` pairs of absolute paths
+    pub fn file_dependencies(&self, index_name: &str) -> Result<Vec<(PathBuf, PathBuf)>> {
+        let index = self.resolve_index(index_name)?;
+        let base_path = Path::new(&index.base_path);
+        let edges = self.reader_for(&index.name)?.list_file_dependencies(&index.id)?;
+        Ok(edges
+            .into_iter()
+            .map(|(file, included)| (base_path.join(file), base_path.join(included)))
+            .collect())
+    }
+
+    /// Replaces a file's stored symbols with `extraction` and its includes with the
+    /// resolved `dependencies`, then refreshes the symbol index; returns the number of
+    /// symbols stored. With `replaces_hash` nothing is stored and `None` returned unless
+    /// the stored version of the file still has that hash.
+    fn store_extraction(
+        &self,
+        index: &CodeIndex,
+        absolute_path: &Path,
+        relative_path: &str,
+        extraction: &ExtractionResult,
+        dependencies: &[PathBuf],
+        replaces_hash: Option<&str>,
+    ) -> Result<Option<usize>> {
+        let batch = file_batch(index, absolute_path, relative_path, extraction, dependencies)?;
+        match replaces_hash {
+            Some(expected_hash) => {
+                let Some(ingest) = self.writer_for(&index.name)?.replace_file_if_hash(&batch, expected_hash)? else {
+                    return Ok(None);
+                };
+                let symbols = ingest.element_ids.len();
+                self.record_stored(index, std::slice::from_ref(&batch), &[ingest]);
+                Ok(Some(symbols))
+            }
+            None => Ok(self.store_batches(index, std::slice::from_ref(&batch))?.first().copied()),
+        }
+    }
+
+    /// Replaces the stored rows of every file in `batches` in one transaction, then
+    /// refreshes the symbol index; returns the number of symbols stored per file
+    fn store_batches(&self, index: &CodeIndex, batches: &[FileBatch]) -> Result<Vec<usize>> {
+        if batches.is_empty() {
+            return Ok(Vec::new());
+        }
+        let ingests = self.writer_for(&index.name)?.replace_files(batches)?;
+        self.record_stored(index, batches, &ingests);
+        Ok(ingests.iter().map(|ingest| ingest.element_ids.len()).collect())
+    }
+
+    fn record_stored(&self, index: &CodeIndex, batches: &[FileBatch], ingests: &[FileIngestResult]) {
+        self.record_write(index);
+        self.with_symbol_indices_mut(|indices| {
+            if let Some(symbol_index) = indices.get_mut(&index.id) {
+                for (batch, ingest) in batches.iter().zip(ingests) {
+                    symbol_index.replace_file(&batch.metadata.file_path, &batch.symbols, &ingest.element_ids);
+                }
+            }
+        });
+    }
+
+    fn forget_file(&self, index: &CodeIndex, relative_path: &str) -> Result<()> {
+        self.writer_for(&index.name)?.remove_file(&index.id, relative_path)?;
+        self.record_write(index);
+        self.with_symbol_indices_mut(|indices| {
+            if let Some(symbol_index) = indices.get_mut(&index.id) {
+                symbol_index.remove_file(relative_path);
+            }
+        });
+        Ok(())
+    }
+
+    /// Records that the base's copy of `relative_path` was deleted on the branch of the
+    /// overlay `index`
+    fn hide_base_file(&self, index: &CodeIndex, relative_path: &str) -> Result<()> {
+        self.writer_for(&index.name)?.mark_base_file_removed(&index.id, relative_path)?;
+        self.record_write(index);
+        Ok(())
+    }
+
+    /// Base index of `index` if it is an overlay
+    fn overlay_base(&self, index: &CodeIndex) -> Result<Option<CodeIndex>> {
+        let repository = self.reader_for(&index.name)?;
+        match repository.get_overlay_base(&index.id)? {
+            Some(base_id) => Ok(repository.get_code_index(&base_id)?),
+            None => Ok(None),
+        }
+    }
+
+    /// Index whose rows describe `relative_path` in `index`: the base of an overlay
+    /// that does not shadow the file, else `index` itself
+    fn file_owner(&self, index: &CodeIndex, relative_path: &str) -> Result<CodeIndex> {
+        match self.overlay_base(index)? {
+            Some(base) if !self.reader_for(&index.name)?.overlay_shadows_file(&index.id, relative_path)? => Ok(base),
+            _ => Ok(index.clone()),
+        }
+    }
+
+    /// Database holding `index_name`: its shard if it has one, else the shared one
+    fn database_for(&self, index_name: &str) -> Result<&ConnectionPool> {
+        match self.shards.get(index_name) {
+            Some(shard) => Ok(shard),
+            None => self.database.as_deref().ok_or_else(|| anyhow!("No index database is open")),
+        }
+    }
+
+    fn reader_for(&self, index_name: &str) -> Result<ReadHandle<'_>> {
+        Ok(self.database_for(index_name)?.read()?)
+    }
+
+    fn writer_for(&self, index_name: &str) -> Result<MutexGuard<'_, Repository>> {
+        Ok(self.database_for(index_name)?.write()?)
+    }
+
+    /// Indices a federated search queries at once: one per read connection of the
+    /// shared database, so a search never queues inside the pool
+    fn federated_workers(&self) -> usize {
+        self.database.as_ref().map_or(1, |database| database.reader_count().max(1))
+    }
+
+    /// Every index of the shared database and the shards, ordered by name. A shard
+    /// only contributes the index it was opened for.
+    fn all_indices(&self) -> Result<Vec<CodeIndex>> {
+        let mut indices: Vec<CodeIndex> = match &self.database {
+            Some(database) => database
+                .read()?
+                .list_code_indices()?
+                .into_iter()
+                .filter(|index| !self.shards.contains_key(&index.name))
+                .collect(),
+            None => Vec::new(),
+        };
+        for (name, shard) in self.shards.iter() {
+            indices.extend(shard.read()?.get_code_index_by_name(name)?);
+        }
+        indices.sort_by(|a, b| a.name.cmp(&b.name));
+        Ok(indices)
+    }
+
+    fn resolve_index(&self, index_name: &str) -> Result<CodeIndex> {
+        if let Some(snapshot) = self.snapshot_for(index_name) {
+            return Ok(snapshot.index());
+        }
+        self.reader_for(index_name)?
+            .get_code_index_by_name(index_name)?
+            .ok_or_else(|| anyhow!("Index not found: {}", index_name))
+    }
+
+    /// The snapshot of `index_name`, while it is still current
+    fn snapshot_for(&self, index_name: &str) -> Option<Arc<Snapshot>> {
+        self.snapshot.read().ok()?.as_ref().filter(|snapshot| snapshot.index_name() == index_name).cloned()
+    }
+
+    /// Runs `f` against the symbol index of `index`, building it on first use.
+    /// Returns `None` when the symbol index is disabled.
+    fn with_symbol_index_for<T>(&self, index: &CodeIndex, f: impl FnOnce(&SymbolIndex) -> T) -> Option<Result<T>> {
+        let index_id = &index.id;
+        let indices = self.symbol_indices.as_ref()?;
+
+        if let Some(symbol_index) = indices.read().ok()?.get(index_id) {
+            return Some(Ok(f(symbol_index)));
+        }
+
+        let loaded = match self.reader_for(&index.name) {
+            Ok(repository) => SymbolIndex::load(&repository, index_id),
+            Err(e) => return Some(Err(e)),
+        };
+        let symbol_index = match loaded {
+            Ok(symbol_index) => symbol_index,
+            Err(e) => return Some(Err(e.into())),
+        };
+        info!("Loaded symbol index for {} with {} symbols", index_id, symbol_index.len());
+
+        let mut indices = indices.write().ok()?;
+        Some(Ok(f(indices.entry(*index_id).or_insert(symbol_index))))
+    }
+
+    fn with_symbol_indices_mut(&self, f: impl FnOnce(&mut HashMap<Uuid, SymbolIndex>)) {
+        if let Some(mut indices) = self.symbol_indices.as_ref().and_then(|indices| indices.write().ok()) {
+            f(&mut indices);
+        }
+    }
+}
+
+/// Persists watcher changes for one index through the tool handlers' repository.
+/// Indexed files are stored `FILES_PER_TRANSACTION` at a time, each group in one
+/// transaction; any other change writes the pending group first.
+pub struct IndexUpdateSink {
+    handlers: ToolHandlers,
+    index: CodeIndex,
+    pending: Vec<FileBatch>,
+}
+
+impl IndexUpdateSink {
+    /// Directory the index covers, i.e. the one to watch
+    pub fn base_path(&self) -> PathBuf {
+        PathBuf::from(&self.index.base_path)
+    }
+
+    fn store_pending(&mut self) -> Result<()> {
+        self.handlers.store_batches(&self.index, &self.pending)?;
+        self.pending.clear();
+        Ok(())
+    }
+}
+
+impl ChangeSink for IndexUpdateSink {
+    fn file_indexed(
+        &mut self,
+        file_path: &Path,
+        extraction: &ExtractionResult,
+        dependencies: &[PathBuf],
+    ) -> Result<(), Box<dyn std::error::Error>> {
+        let (absolute_path, relative_path) = resolve_file_path(&self.index, &file_path.to_string_lossy()).map_err(|e| e.to_string())?;
+        let batch = file_batch(&self.index, &absolute_path, &relative_path, extraction, dependencies).map_err(|e| e.to_string())?;
+        self.pending.push(batch);
+        if self.pending.len() >= FILES_PER_TRANSACTION {
+            self.store_pending().map_err(|e| e.to_string())?;
+        }
+        Ok(())
+    }
+
+    fn file_enriched(
+        &mut self,
+        file_path: &Path,
+        extraction: &ExtractionResult,
+        dependencies: &[PathBuf],
+    ) -> Result<bool, Box<dyn std::error::Error>> {
+        self.store_pending().map_err(|e| e.to_string())?;
+        let (absolute_path, relative_path) = resolve_file_path(&self.index, &file_path.to_string_lossy()).map_err(|e| e.to_string())?;
+        let stored = self
+            .handlers
+            .store_extraction(&self.index, &absolute_path, &relative_path, extraction, dependencies, Some(&extraction.content_hash))
+            .map_err(|e| e.to_string())?;
+        Ok(stored.is_some())
+    }
+
+    fn file_removed(&mut self, file_path: &Path) -> Result<(), Box<dyn std::error::Error>> {
+        self.store_pending().map_err(|e| e.to_string())?;
+        let (_, relative_path) = resolve_file_path(&self.index, &file_path.to_string_lossy()).map_err(|e| e.to_string())?;
+        self.handlers.forget_file(&self.index, &relative_path).map_err(|e| e.to_string())?;
+        Ok(())
+    }
+
+    fn base_file_removed(&mut self, file_path: &Path) -> Result<(), Box<dyn std::error::Error>> {
+        self.store_pending().map_err(|e| e.to_string())?;
+        let (_, relative_path) = resolve_file_path(&self.index, &file_path.to_string_lossy()).map_err(|e| e.to_string())?;
+        self.handlers.hide_base_file(&self.index, &relative_path).map_err(|e| e.to_string())?;
+        Ok(())
+    }
+
+    fn flush(&mut self) -> Result<(), Box<dyn std::error::Error>> {
+        self.store_pending().map_err(|e| e.to_string())?;
+        Ok(())
+    }
+
+    fn batch_applied(&mut self, merkle_root: Option<&str>) {
+        self.handlers.record_merkle_root(&self.index, merkle_root);
+    }
+}
+
+/// The rows storing `extraction` for a file: its symbols, reference edges and the
+/// resolved `dependencies`, under the hash of the content that was parsed
+fn file_batch(
+    index: &CodeIndex,
+    absolute_path: &Path,
+    relative_path: &str,
+    extraction: &ExtractionResult,
+    dependencies: &[PathBuf],
+) -> Result<FileBatch> {
+    let modified: DateTime<Utc> = std::fs::metadata(absolute_path)?.modified()?.into();
+    let mut metadata = FileMetadata::new(index.id, relative_path.to_string(), extraction.content_hash.clone(), modified, extraction.content_size);
+
+    let mut symbols = SymbolTable::new();
+    let mut scope = String::new();
+    for symbol in extraction.symbols.iter().filter(|symbol| symbol.file_path == absolute_path) {
+        symbols.push(symbol_record(symbol, &mut scope));
+    }
+    metadata.update_indexing(symbols.len() as u32);
+
+    let base_path = Path::new(&index.base_path);
+    let mut batch = FileBatch::new(metadata);
+    batch.symbols = symbols;
+    batch.tier = extraction.tier;
+    batch.edges = symbol_edges(&extraction.edges, base_path);
+    // Includes that were not found on disk are kept in memory only; paths outside
+    // the root stay absolute, which `Path::join` leaves as they are when loading.
+    batch.dependencies = dependencies
+        .iter()
+        .filter(|dependency| dependency.is_absolute())
+        .map(|dependency| dependency.strip_prefix(base_path).unwrap_or(dependency).to_string_lossy().to_string())
+        .collect();
+
+    Ok(batch)
+}
+
+/// `limit` argument, clamped to what one page may hold
+fn page_limit(arguments: &Value) -> usize {
+    arguments
+        .get("limit")
+        .and_then(Value::as_u64)
+        .map_or(DEFAULT_PAGE_LIMIT, |limit| (limit as usize).clamp(1, MAX_PAGE_LIMIT))
+}
+
+/// `cursor` argument: the `next_cursor` of the previous page
+fn page_cursor(arguments: &Value) -> Result<Option<Cursor>> {
+    Ok(arguments.get("cursor").and_then(Value::as_str).map(Cursor::decode).transpose()?)
+}
+
+/// A cursor whose key does not have the shape its query wrote, reported like one
+/// storage cannot decode
+fn invalid_cursor() -> anyhow::Error {
+    StorageError::InvalidArgument("Invalid cursor".to_string()).into()
+}
+
+/// Whether a `search_symbols` `index_name` names several indices or all of them
+fn is_federated(index_name: &str) -> bool {
+    index_name.trim() == "*" || index_name.contains(',')
+}
+
+/// Runs `f` over `items` as up to `workers` tasks on the runtime's blocking pool and
+/// returns the results in the order of `items`. The caller is a blocking thread
+/// itself and waits for them; outside a runtime the items run in turn.
+fn fan_out<T, R>(items: Vec<T>, workers: usize, f: impl Fn(&T) -> Result<R> + Send + Sync + 'static) -> Result<Vec<R>>
+where
+    T: Send + Sync + 'static,
+    R: Send + 'static,
+{
+    let runtime = match tokio::runtime::Handle::try_current() {
+        Ok(runtime) if items.len() > 1 => runtime,
+        _ => return items.iter().map(f).collect(),
+    };
+
+    let (items, f, next) = (Arc::new(items), Arc::new(f), Arc::new(AtomicUsize::new(0)));
+    let tasks: Vec<_> = (0..workers.clamp(1, items.len()))
+        .map(|_| {
+            let (items, f, next) = (Arc::clone(&items), Arc::clone(&f), Arc::clone(&next));
+            runtime.spawn_blocking(move || {
+                let mut done = Vec::new();
+                loop {
+                    let i = next.fetch_add(1, Ordering::Relaxed);
+                    let Some(item) = items.get(i) else {
+                        break done;
+                    };
+                    done.push((i, f(item)));
+                }
+            })
+        })
+        .collect();
+
+    let mut slots: Vec<Option<Result<R>>> = (0..items.len()).map(|_| None).collect();
+    for task in tasks {
+        let done = runtime.block_on(task).map_err(|e| anyhow!("Federated query worker failed: {}", e))?;
+        for (i, result) in done {
+            slots[i] = Some(result);
+        }
+    }
+    slots
+        .into_iter()
+        .map(|slot| slot.unwrap_or_else(|| Err(anyhow!("Federated query worker failed"))))
+        .collect()
+}
+
+/// `symbol_type` argument as a filter; empty matches every type
+fn symbol_type_filter(arguments: &Value) -> Result<Vec<SymbolType>> {
+    let Some(name) = arguments.get("symbol_type").and_then(Value::as_str) else {
+        return Ok(Vec::new());
+    };
+    SymbolType::all()
+        .iter()
+        .copied()
+        .find(|symbol_type| symbol_type.as_str() == name)
+        .map(|symbol_type| vec![symbol_type])
+        .ok_or_else(|| anyhow!("Unknown symbol type: {}", name))
+}
+
+fn required_str<'a>(arguments: &'a Value, name: &str) -> Result<&'a str> {
+    arguments
+        .get(name)
+        .and_then(Value::as_str)
+        .ok_or_else(|| anyhow!("Missing required parameter: {}", name))
+}
+
+/// Absolute path on disk and the index-relative path stored in the database
+fn resolve_file_path(index: &CodeIndex, file_path: &str) -> Result<(PathBuf, String)> {
+    let base_path = Path::new(&index.base_path);
+    let absolute_path = if Path::new(file_path).is_absolute() {
+        PathBuf::from(file_path)
+    } else {
+        base_path.join(file_path)
+    };
+
+    let relative_path = absolute_path
+        .strip_prefix(base_path)
+        .map_err(|_| anyhow!("{} is outside index root {}", file_path, index.base_path))?
+        .to_string_lossy()
+        .to_string();
+    Ok((absolute_path, relative_path))
+}
+
+/// Borrowed storage form of `symbol`; its scope is joined into `scope`, which is
+/// reused across symbols
+fn symbol_record<'a>(symbol: &'a ExtractedSymbol, scope: &'a mut String) -> SymbolRecord<'a> {
+    let mut record = SymbolRecord::new(
+        &symbol.name,
+        symbol.symbol_type,
+        symbol.start_line.max(1),
+        symbol.start_column.max(1),
+        Sha256::digest(symbol.content.as_bytes()).into(),
+    )
+    .with_declaration(symbol.is_declaration && !symbol.is_definition);
+
+    if !symbol.namespace_path.is_empty() {
+        scope.clear();
+        for (i, part) in symbol.namespace_path.iter().enumerate() {
+            if i > 0 {
+                scope.push_str("::");
+            }
+            scope.push_str(part);
+        }
+        record = record.with_scope(scope);
+    }
+    if let Some(access_modifier) = symbol.visibility {
+        record = record.with_access_modifier(access_modifier);
+    }
+    if let Some(signature) = &symbol.signature {
+        record = record.with_signature(signature);
+    }
+    if let Some(usr) = &symbol.usr {
+        record = record.with_usr(usr);
+    }
+    record
+}
+
+/// Storage form of `edges`, with paths relative to the index root. Edges into or
+/// from files outside the root, such as third-party headers, are dropped.
+fn symbol_edges(edges: &[ReferenceEdge], base_path: &Path) -> Vec<SymbolEdge> {
+    let relative = |path: &Path| path.strip_prefix(base_path).ok().map(|path| path.to_string_lossy().to_string());
+    let key = |symbol: &ReferencedSymbol| {
+        Some(SymbolKey {
+            usr: symbol.usr.clone(),
+            name: symbol.name.clone(),
+            file_path: relative(&symbol.location.file_path)?,
+            line_number: symbol.location.line.max(1),
+        })
+    };
+
+    edges
+        .iter()
+        .filter_map(|edge| {
+            Some(SymbolEdge {
+                from: key(&edge.from)?,
+                to: key(&edge.to)?,
+                relationship_type: edge.relationship_type,
+                file_path: relative(&edge.location.file_path)?,
+                line_number: edge.location.line.max(1),
+                column_number: edge.location.column.max(1),
+            })
+        })
+        .collect()
+}
+
+/// Direction and edge types `find_references` follows for a `relationship` argument
+fn relationship_traversal(relationship: &str) -> Result<(Direction, &'static [RelationshipType])> {
+    Ok(match relationship {
+        "references" => (Direction::Incoming, &[]),
+        "callers" => (Direction::Incoming, &[RelationshipType::Calls]),
+        "callees" => (Direction::Outgoing, &[RelationshipType::Calls]),
+        "subclasses" => (Direction::Incoming, &[RelationshipType::Inherits]),
+        "base_classes" => (Direction::Outgoing, &[RelationshipType::Inherits]),
+        "overridden_by" => (Direction::Incoming, &[RelationshipType::Overrides]),
+        "overrides" => (Direction::Outgoing, &[RelationshipType::Overrides]),
+        _ => return Err(anyhow!("Unknown relationship: {}", relationship)),
+    })
+}
+
+/// Arguments of `search_symbols` that apply to every index searched
+struct SymbolQuery {
+    query: String,
+    /// Lowercase `query`, for ranking federated results
+    pattern: String,
+    exact_match: bool,
+    file_path: Option<String>,
+    scope: Option<String>,
+    symbol_types: Vec<SymbolType>,
+}
+
+impl SymbolQuery {
+    fn parse(arguments: &Value) -> Result<Self> {
+        let query = required_str(arguments, "query")?;
+        Ok(Self {
+            query: query.to_string(),
+            pattern: query.to_lowercase(),
+            exact_match: arguments.get("exact_match").and_then(Value::as_bool).unwrap_or(false),
+            file_path: arguments.get("file_path").and_then(Value::as_str).map(str::to_string),
+            scope: arguments.get("scope").and_then(Value::as_str).map(str::to_string),
+            symbol_types: symbol_type_filter(arguments)?,
+        })
+    }
+
+    /// Whether name tables can answer the query without full rows
+    fn unfiltered(&self) -> bool {
+        self.file_path.is_none() && self.scope.is_none()
+    }
+
+    /// Runs an exact lookup (no edit budget) or ranked search through `search`
+    fn search_names<E>(&self, search: impl FnOnce(&str, Option<&[SymbolType]>, Option<usize>) -> Result<SymbolSearch, E>) -> Result<SymbolSearch, E> {
+        let max_edits = (!self.exact_match).then(|| SymbolIndex::default_max_edits(&self.query));
+        search(&self.query, Some(&self.symbol_types), max_edits)
+    }
+
+    /// Order of results merged from several indices: exact, prefix, substring, then
+    /// other matches, shorter names first
+    fn merge_key(&self, element: &CodeElement) -> (u8, usize, String) {
+        let name = element.symbol_name.to_lowercase();
+        let class = if name == self.pattern {
+            0
+        } else if name.starts_with(&self.pattern) {
+            1
+        } else if name.contains(&self.pattern) {
+            2
+        } else {
+            3
+        };
+        (class, name.chars().count(), name)
+    }
+}
+
+/// One page of one index's matches
+struct IndexHits {
+    elements: Vec<CodeElement>,
+    /// Cursor resuming the index's search just after each of `elements`
+    resume: Vec<Cursor>,
+    total_count: usize,
+    next_cursor: Option<Cursor>,
+}
+
+impl IndexHits {
+    /// Hits for the hydrated `elements` of a name table `search`
+    fn from_names(search: SymbolSearch, elements: Vec<CodeElement>) -> Self {
+        let matches: HashMap<i64, SymbolMatch> = search.matches.iter().map(|m| (m.id, *m)).collect();
+        let (elements, resume) = elements
+            .into_iter()
+            .filter_map(|element| {
+                let cursor = matches.get(&element.id?)?.cursor_after(&element.symbol_name);
+                Some((element, cursor))
+            })
+            .unzip();
+        Self {
+            elements,
+            resume,
+            total_count: search.total_count,
+            next_cursor: search.next_cursor,
+        }
+    }
+}
+
+/// Owned copy of a snapshot symbol, for results that outlive the snapshot borrow
+fn snapshot_element(index: &CodeIndex, symbol: SnapshotSymbol<'_>) -> CodeElement {
+    let mut element = CodeElement::new(
+        index.id,
+        symbol.name.to_string(),
+        symbol.symbol_type,
+        symbol.file_path.to_string(),
+        symbol.line_number,
+        symbol.column_number,
+        String::new(),
+    );
+    element.id = Some(symbol.id);
+    element.scope = symbol.scope.map(str::to_string);
+    element.signature = symbol.signature.map(str::to_string);
+    element.access_modifier = symbol.access_modifier;
+    element.is_declaration = symbol.is_declaration;
+    element
+}
+
+/// One page of `search_symbols` or `find_references` results
+#[derive(Serialize)]
+struct SymbolPage<'a> {
+    symbols: Vec<SymbolView<'a>>,
+    total_count: usize,
+    query_time_ms: u64,
+    next_cursor: Option<String>,
+}
+
+/// One page of a `search_symbols` call over several indices
+#[derive(Serialize)]
+struct FederatedPage<'a> {
+    symbols: Vec<FederatedView<'a>>,
+    total_count: usize,
+    indices_searched: usize,
+    query_time_ms: u64,
+    next_cursor: Option<String>,
+}
+
+/// A federated match and the index it came from
+#[derive(Serialize)]
+struct FederatedView<'a> {
+    index_name: &'a str,
+    #[serde(flatten)]
+    symbol: SymbolView<'a>,
+}
+
+/// One page of a `find_references` graph traversal
+#[derive(Serialize)]
+struct TraversalPage<'a> {
+    symbols: Vec<TraversalView<'a>>,
+    total_count: usize,
+    /// Whether the traversal stopped before reaching every symbol
+    truncated: bool,
+    query_time_ms: u64,
+    next_cursor: Option<String>,
+}
+
+/// A symbol reached by a traversal; declarations of the queried symbol have depth 0
+#[derive(Serialize)]
+struct TraversalView<'a> {
+    #[serde(flatten)]
+    symbol: SymbolView<'a>,
+    depth: u32,
+}
+
+/// One page of `get_file_symbols` results
+#[derive(Serialize)]
+struct FileSymbols<'a> {
+    file_path: &'a str,
+    symbols: Vec<SymbolView<'a>>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    grouped_symbols: Option<BTreeMap<String, Vec<SymbolView<'a>>>>,
+    total_symbols: usize,
+    next_cursor: Option<String>,
+}
+
+/// A code element as tool results show it, borrowed from the loaded row
+#[derive(Clone, Serialize)]
+struct SymbolView<'a> {
+    id: Option<i64>,
+    name: &'a str,
+    #[serde(rename = "type")]
+    symbol_type: &'static str,
+    file_path: &'a str,
+    line_number: u32,
+    column_number: u32,
+    scope: Option<&'a str>,
+    signature: Option<&'a str>,
+    access_modifier: Option<&'static str>,
+    is_declaration: bool,
+}
+
+impl<'a> From<&'a CodeElement> for SymbolView<'a> {
+    fn from(element: &'a CodeElement) -> Self {
+        Self {
+            id: element.id,
+            name: &element.symbol_name,
+            symbol_type: element.symbol_type.as_str(),
+            file_path: &element.file_path,
+            line_number: element.line_number,
+            column_number: element.column_number,
+            scope: element.scope.as_deref(),
+            signature: element.signature.as_deref(),
+            access_modifier: element.access_modifier.map(|access_modifier| access_modifier.as_str()),
+            is_declaration: element.is_declaration,
+        }
+    }
+}
+
+impl<'a> From<SnapshotSymbol<'a>> for SymbolView<'a> {
+    fn from(symbol: SnapshotSymbol<'a>) -> Self {
+        Self {
+            id: Some(symbol.id),
+            name: symbol.name,
+            symbol_type: symbol.symbol_type.as_str(),
+            file_path: symbol.file_path,
+            line_number: symbol.line_number,
+            column_number: symbol.column_number,
+            scope: symbol.scope,
+            signature: symbol.signature,
+            access_modifier: symbol.access_modifier.map(|access_modifier| access_modifier.as_str()),
+            is_declaration: symbol.is_declaration,
+        }
+    }
+}
+
+fn to_raw<T: Serialize>(result: &T) -> Result<Box<RawValue>> {
+    Ok(serde_json::value::to_raw_value(result)?)
 }
 
 #[cfg(test)]
@@ -78,4 +1544,42 @@ mod tests {
         // Basic smoke test - handlers should be created successfully
         assert!(true);
     }
-}
\ No newline at end of file
+
+    #[tokio::test(flavor = "current_thread")]
+    async fn test_call_tool_leaves_runtime_thread_free() {
+        let handlers = ToolHandlers::new().unwrap();
+        // Both calls are in flight at once on a runtime with a single worker thread
+        let (indices, symbols) = tokio::join!(
+            handlers.call_tool("list_indices", json!({})),
+            handlers.call_tool("get_file_symbols", json!({})),
+        );
+        let indices: Value = serde_json::from_str(indices.unwrap().get()).unwrap();
+        assert_eq!(indices["count"], 0);
+        assert!(symbols.is_ok());
+    }
+
+    #[tokio::test]
+    async fn test_fan_out_keeps_item_order() {
+        let items: Vec<u64> = (0..40).collect();
+        let expected: Vec<u64> = items.iter().map(|item| item * 2).collect();
+        let doubled = tokio::task::spawn_blocking(move || fan_out(items, 4, |&item| Ok(item * 2))).await.unwrap();
+        assert_eq!(doubled.unwrap(), expected);
+
+        let failed = tokio::task::spawn_blocking(|| {
+            fan_out((0..40).collect(), 4, |&item: &u64| if item == 7 { Err(anyhow!("index 7 failed")) } else { Ok(item) })
+        });
+        assert!(failed.await.unwrap().is_err());
+    }
+
+    #[test]
+    fn test_fan_out_without_runtime_runs_in_turn() {
+        assert_eq!(fan_out(vec![1, 2, 3], 4, |&item| Ok(item + 1)).unwrap(), vec![2, 3, 4]);
+    }
+
+    #[test]
+    fn test_federated_index_names() {
+        assert!(is_federated("*"));
+        assert!(is_federated("vendor,services"));
+        assert!(!is_federated("vendor"));
+    }
+}
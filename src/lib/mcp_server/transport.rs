@@ -1,11 +1,28 @@
 use anyhow::{anyhow, Result};
-use serde_json::{json, Value};
-// use std::io; // TODO: Enable when needed
+use serde::{Deserialize, Serialize};
+use serde_json::value::RawValue;
+use serde_json::Value;
+use std::borrow::Cow;
+use std::collections::{HashMap, HashSet};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Arc;
+use std::time::Instant;
 use tokio::sync::mpsc;
-use tokio::io::{AsyncBufReadExt, AsyncWriteExt, BufReader};
-use tracing::{debug, error, info, instrument, warn};
+use tokio::io::{AsyncBufReadExt, AsyncRead, AsyncWrite, AsyncWriteExt, BufReader, BufWriter};
+use tracing::{debug, error, info, instrument, trace};
 
-use super::server::{McpRequest, McpResponse};
+use crate::lib::metrics::{self, Stage};
+use super::dispatch::request_key;
+use super::server::{McpError, McpRequest, McpResponse, INVALID_REQUEST};
+
+/// JSON-RPC error code for a message that is not valid JSON
+const PARSE_ERROR: i32 = -32700;
+
+/// Capacity the read and serialization buffers keep between messages
+const BUFFER_RETAINED: usize = 1024 * 1024;
+
+/// Size of the buffered STDOUT writer and initial size of the message buffers
+const STDIO_BUFFER: usize = 64 * 1024;
 
 /// STDIO Transport for MCP Protocol
 /// 
@@ -22,6 +39,124 @@ pub struct Transport {
     response_sender: Option<mpsc::Sender<McpResponse>>,
     /// Flag to track if transport is running
     is_running: bool,
+    /// Counters shared with the reader and writer tasks
+    counters: Arc<TransportCounters>,
+}
+
+/// Fields of one JSON-RPC message, borrowed from the read buffer. `params` stays
+/// raw until the method is known, so it is parsed once, straight into its type.
+#[derive(Deserialize)]
+struct RawMessage<'a> {
+    #[serde(borrow, default)]
+    jsonrpc: Option<Text<'a>>,
+    #[serde(borrow, default)]
+    method: Option<Text<'a>>,
+    #[serde(borrow, default)]
+    id: Option<&'a RawValue>,
+    #[serde(borrow, default)]
+    params: Option<&'a RawValue>,
+}
+
+/// String borrowed from the buffer unless it contains escapes
+#[derive(Deserialize)]
+struct Text<'a>(#[serde(borrow)] Cow<'a, str>);
+
+/// Requests parsed from one line, which holds a single message or a batch array
+#[derive(Debug, Default)]
+struct Frame {
+    requests: Vec<McpRequest>,
+    /// Responses for messages that could not be dispatched
+    errors: Vec<McpResponse>,
+    batch: bool,
+}
+
+/// A batch whose responses are held back until every request in it has answered
+#[derive(Debug)]
+struct PendingBatch {
+    awaiting: HashSet<String>,
+    responses: Vec<McpResponse>,
+}
+
+/// What the writer sends in one line
+#[derive(Serialize)]
+#[serde(untagged)]
+enum Outgoing {
+    Single(McpResponse),
+    Batch(Vec<McpResponse>),
+}
+
+/// Routes responses that belong to an open batch into it
+#[derive(Default)]
+struct BatchCollector {
+    /// Batch each awaited response belongs to, by request key
+    owners: HashMap<String, u64>,
+    open: HashMap<u64, PendingBatch>,
+    next_batch: u64,
+}
+
+impl BatchCollector {
+    fn open(&mut self, batch: PendingBatch) -> Option<Outgoing> {
+        if batch.awaiting.is_empty() {
+            // Only notifications and invalid messages; a batch of notifications gets no reply.
+            return (!batch.responses.is_empty()).then(|| Outgoing::Batch(batch.responses));
+        }
+
+        let number = self.next_batch;
+        self.next_batch += 1;
+        for key in &batch.awaiting {
+            self.owners.insert(key.clone(), number);
+        }
+        self.open.insert(number, batch);
+        None
+    }
+
+    fn route(&mut self, response: McpResponse) -> Option<Outgoing> {
+        let key = request_key(&response.id);
+        let Some(number) = self.owners.remove(&key) else {
+            return Some(Outgoing::Single(response));
+        };
+
+        let batch = self.open.get_mut(&number)?;
+        batch.awaiting.remove(&key);
+        batch.responses.push(response);
+        if batch.awaiting.is_empty() {
+            self.open.remove(&number).map(|batch| Outgoing::Batch(batch.responses))
+        } else {
+            None
+        }
+    }
+}
+
+/// Message and byte counters updated by the reader and writer tasks
+#[derive(Debug)]
+struct TransportCounters {
+    messages_received: AtomicU64,
+    messages_sent: AtomicU64,
+    batches_received: AtomicU64,
+    bytes_received: AtomicU64,
+    bytes_sent: AtomicU64,
+    parse_errors: AtomicU64,
+    write_errors: AtomicU64,
+    start_time: chrono::DateTime<chrono::Utc>,
+}
+
+impl TransportCounters {
+    fn new() -> Self {
+        Self {
+            messages_received: AtomicU64::new(0),
+            messages_sent: AtomicU64::new(0),
+            batches_received: AtomicU64::new(0),
+            bytes_received: AtomicU64::new(0),
+            bytes_sent: AtomicU64::new(0),
+            parse_errors: AtomicU64::new(0),
+            write_errors: AtomicU64::new(0),
+            start_time: chrono::Utc::now(),
+        }
+    }
+
+    fn add(counter: &AtomicU64, amount: usize) {
+        counter.fetch_add(amount as u64, Ordering::Relaxed);
+    }
 }
 
 impl Transport {
@@ -32,6 +167,7 @@ impl Transport {
             response_receiver: None,
             response_sender: None,
             is_running: false,
+            counters: Arc::new(TransportCounters::new()),
         })
     }
 
@@ -42,6 +178,16 @@ impl Transport {
     /// channels between the transport and the MCP server.
     #[instrument(skip(self, server_sender))]
     pub async fn start(&mut self, server_sender: mpsc::Sender<McpRequest>) -> Result<()> {
+        self.start_with_io(server_sender, tokio::io::stdin(), tokio::io::stdout()).await
+    }
+
+    /// Start the transport over `input` and `output` instead of STDIO, e.g. an
+    /// in-process pipe for benchmarks
+    pub async fn start_with_io<R, W>(&mut self, server_sender: mpsc::Sender<McpRequest>, input: R, output: W) -> Result<()>
+    where
+        R: AsyncRead + Unpin + Send + 'static,
+        W: AsyncWrite + Unpin + Send + 'static,
+    {
         info!("Starting STDIO transport layer");
 
         if self.is_running {
@@ -50,22 +196,25 @@ impl Transport {
 
         // Set up response channel
         let (response_tx, response_rx) = mpsc::channel::<McpResponse>(100);
-        self.response_sender = Some(response_tx);
+        let (batch_tx, batch_rx) = mpsc::unbounded_channel::<PendingBatch>();
+        self.response_sender = Some(response_tx.clone());
         self.response_receiver = Some(response_rx);
         self.request_sender = Some(server_sender);
 
         // Start STDIN reader task
         let request_sender = self.request_sender.as_ref().unwrap().clone();
+        let counters = self.counters.clone();
         tokio::spawn(async move {
-            if let Err(e) = Self::stdin_reader_task(request_sender).await {
+            if let Err(e) = Self::stdin_reader_task(input, request_sender, response_tx, batch_tx, counters).await {
                 error!("STDIN reader task failed: {}", e);
             }
         });
 
         // Start STDOUT writer task
         let response_receiver = self.response_receiver.take().unwrap();
+        let counters = self.counters.clone();
         tokio::spawn(async move {
-            if let Err(e) = Self::stdout_writer_task(response_receiver).await {
+            if let Err(e) = Self::stdout_writer_task(output, response_receiver, batch_rx, counters).await {
                 error!("STDOUT writer task failed: {}", e);
             }
         });
@@ -88,56 +237,86 @@ impl Transport {
         }
     }
 
-    /// STDIN reader task - reads JSON-RPC messages from STDIN
-    #[instrument(skip(request_sender))]
-    async fn stdin_reader_task(request_sender: mpsc::Sender<McpRequest>) -> Result<()> {
+    /// Handle for sending responses from other tasks, e.g. concurrently dispatched requests
+    pub fn response_sender(&self) -> Result<mpsc::Sender<McpResponse>> {
+        self.response_sender.clone().ok_or_else(|| anyhow!("Transport not started"))
+    }
+
+    /// Snapshot of the message and byte counters
+    pub fn stats(&self) -> TransportStats {
+        let counters = &self.counters;
+        let load = |counter: &AtomicU64| counter.load(Ordering::Relaxed);
+        TransportStats {
+            messages_received: load(&counters.messages_received),
+            messages_sent: load(&counters.messages_sent),
+            batches_received: load(&counters.batches_received),
+            bytes_received: load(&counters.bytes_received),
+            bytes_sent: load(&counters.bytes_sent),
+            parse_errors: load(&counters.parse_errors),
+            write_errors: load(&counters.write_errors),
+            start_time: counters.start_time,
+        }
+    }
+
+    /// STDIN reader task - reads JSON-RPC messages from STDIN into one reused
+    /// buffer and parses them in place. Nothing here formats a message unless
+    /// trace logging is enabled.
+    async fn stdin_reader_task<R: AsyncRead + Unpin>(
+        stdin: R,
+        request_sender: mpsc::Sender<McpRequest>,
+        responses: mpsc::Sender<McpResponse>,
+        batches: mpsc::UnboundedSender<PendingBatch>,
+        counters: Arc<TransportCounters>,
+    ) -> Result<()> {
         info!("Starting STDIN reader task");
 
-        let stdin = tokio::io::stdin();
-        let mut reader = BufReader::new(stdin);
-        let mut line_buffer = String::new();
+        let mut reader = BufReader::with_capacity(STDIO_BUFFER, stdin);
+        let mut buffer = Vec::with_capacity(STDIO_BUFFER);
 
         loop {
-            line_buffer.clear();
+            buffer.clear();
+            if buffer.capacity() > BUFFER_RETAINED {
+                buffer.shrink_to(STDIO_BUFFER);
+            }
             
-            match reader.read_line(&mut line_buffer).await {
+            match reader.read_until(b'\n', &mut buffer).await {
                 Ok(0) => {
                     info!("STDIN closed, stopping reader task");
                     break;
                 }
-                Ok(_) => {
-                    let line = line_buffer.trim();
+                Ok(read) => {
+                    TransportCounters::add(&counters.bytes_received, read);
+                    let line = buffer.trim_ascii();
                     if line.is_empty() {
                         continue;
                     }
 
-                    debug!("Received raw message: {}", line);
+                    trace!("Received raw message: {}", String::from_utf8_lossy(line));
 
-                    match Self::parse_request(line) {
-                        Ok(request) => {
-                            debug!("Parsed request: {:?}", request);
-                            if let Err(e) = request_sender.send(request).await {
-                                error!("Failed to forward request to server: {}", e);
+                    let frame = Self::parse_frame(line);
+                    TransportCounters::add(&counters.messages_received, frame.requests.len() + frame.errors.len());
+                    TransportCounters::add(&counters.parse_errors, frame.errors.len());
+
+                    // The writer learns about a batch before any of its requests can answer.
+                    if frame.batch {
+                        TransportCounters::add(&counters.batches_received, 1);
+                        let awaiting = frame.requests.iter().filter_map(McpRequest::id).map(request_key).collect();
+                        if batches.send(PendingBatch { awaiting, responses: frame.errors }).is_err() {
+                            break;
+                        }
+                    } else {
+                        for response in frame.errors {
+                            debug!("Rejected message: {:?}", response.error);
+                            if responses.send(response).await.is_err() {
                                 break;
                             }
                         }
-                        Err(e) => {
-                            warn!("Failed to parse request: {} - Raw: {}", e, line);
-                            // Send error response for malformed requests
-                            let error_response = McpResponse {
-                                jsonrpc: "2.0".to_string(),
-                                id: json!(null),
-                                result: None,
-                                error: Some(super::server::McpError {
-                                    code: -32700, // Parse error
-                                    message: format!("Parse error: {}", e),
-                                    data: None,
-                                }),
-                            };
-                            
-                            if let Err(e) = Self::write_response_to_stdout(&error_response).await {
-                                error!("Failed to send error response: {}", e);
-                            }
+                    }
+
+                    for request in frame.requests {
+                        if let Err(e) = request_sender.send(request).await {
+                            error!("Failed to forward request to server: {}", e);
+                            return Ok(());
                         }
                     }
                 }
@@ -152,63 +331,147 @@ impl Transport {
         Ok(())
     }
 
-    /// STDOUT writer task - writes JSON-RPC responses to STDOUT
-    #[instrument(skip(response_receiver))]
-    async fn stdout_writer_task(mut response_receiver: mpsc::Receiver<McpResponse>) -> Result<()> {
+    /// STDOUT writer task - writes JSON-RPC responses to STDOUT. Responses are
+    /// serialized into one reused buffer and flushed once the queue is drained,
+    /// so a burst of responses shares a write.
+    async fn stdout_writer_task<W: AsyncWrite + Unpin>(
+        stdout: W,
+        mut response_receiver: mpsc::Receiver<McpResponse>,
+        mut batches: mpsc::UnboundedReceiver<PendingBatch>,
+        counters: Arc<TransportCounters>,
+    ) -> Result<()> {
         info!("Starting STDOUT writer task");
+        let mut stdout = BufWriter::with_capacity(STDIO_BUFFER, stdout);
+        let mut buffer = Vec::with_capacity(STDIO_BUFFER);
+        let mut collector = BatchCollector::default();
 
-        while let Some(response) = response_receiver.recv().await {
-            debug!("Sending response: {:?}", response);
-            
-            if let Err(e) = Self::write_response_to_stdout(&response).await {
-                error!("Failed to write response to STDOUT: {}", e);
-                // Continue processing other responses
+        loop {
+            let outgoing = tokio::select! {
+                biased;
+                Some(batch) = batches.recv() => collector.open(batch),
+                response = response_receiver.recv() => match response {
+                    Some(response) => collector.route(response),
+                    None => break,
+                },
+            };
+
+            if let Some(outgoing) = outgoing {
+                let count = match &outgoing {
+                    Outgoing::Single(_) => 1,
+                    Outgoing::Batch(responses) => responses.len(),
+                };
+                let started = Instant::now();
+                let written = Self::write_message(&mut stdout, &outgoing, &mut buffer).await;
+                metrics::record(Stage::StdoutWrite, started.elapsed());
+                match written {
+                    Ok(written) => {
+                        TransportCounters::add(&counters.messages_sent, count);
+                        TransportCounters::add(&counters.bytes_sent, written);
+                    }
+                    Err(e) => {
+                        error!("Failed to write response to STDOUT: {}", e);
+                        TransportCounters::add(&counters.write_errors, 1);
+                        // Continue processing other responses
+                    }
+                }
+            }
+
+            if response_receiver.is_empty() {
+                let started = Instant::now();
+                let flushed = stdout.flush().await;
+                metrics::record(Stage::StdoutWrite, started.elapsed());
+                if let Err(e) = flushed {
+                    error!("Failed to flush STDOUT: {}", e);
+                }
             }
         }
 
+        stdout.flush().await?;
         info!("STDOUT writer task finished");
         Ok(())
     }
 
-    /// Parse incoming JSON-RPC request from string
-    #[instrument(skip(line))]
-    fn parse_request(line: &str) -> Result<McpRequest> {
-        // Parse as generic JSON first
-        let value: Value = serde_json::from_str(line)
-            .map_err(|e| anyhow!("Invalid JSON: {}", e))?;
+    /// Parses one line, a single message or a batch array. Messages that cannot be
+    /// dispatched become error responses rather than failing the whole frame.
+    fn parse_frame(line: &[u8]) -> Frame {
+        let mut frame = Frame::default();
 
-        // Validate JSON-RPC 2.0 structure
-        if value["jsonrpc"] != "2.0" {
-            return Err(anyhow!("Missing or invalid jsonrpc field"));
+        if line.first() != Some(&b'[') {
+            match Self::parse_message(line) {
+                Ok(request) => frame.requests.push(request),
+                Err(response) => frame.errors.push(response),
+            }
+            return frame;
         }
 
-        if value["method"].is_null() {
-            return Err(anyhow!("Missing method field"));
+        match serde_json::from_slice::<Vec<&RawValue>>(line) {
+            Ok(messages) if !messages.is_empty() => {
+                frame.batch = true;
+                for message in messages {
+                    match Self::parse_message(message.get().as_bytes()) {
+                        Ok(request) => frame.requests.push(request),
+                        Err(response) => frame.errors.push(response),
+                    }
+                }
+            }
+            Ok(_) => frame.errors.push(error_response(Value::Null, INVALID_REQUEST, "Empty batch".to_string())),
+            Err(e) => frame.errors.push(error_response(Value::Null, PARSE_ERROR, format!("Parse error: {}", e))),
         }
+        frame
+    }
 
-        // Parse as MCP request
-        let request: McpRequest = serde_json::from_value(value)
-            .map_err(|e| anyhow!("Invalid MCP request structure: {}", e))?;
+    /// Parse one JSON-RPC request, or build the error response for it
+    fn parse_message(message: &[u8]) -> std::result::Result<McpRequest, McpResponse> {
+        let raw: RawMessage = serde_json::from_slice(message).map_err(|e| {
+            let code = if e.is_data() { INVALID_REQUEST } else { PARSE_ERROR };
+            error_response(Value::Null, code, format!("Parse error: {}", e))
+        })?;
+
+        let id = match raw.id {
+            Some(id) => Some(serde_json::from_str::<Value>(id.get())
+                .map_err(|e| error_response(Value::Null, INVALID_REQUEST, format!("Invalid id: {}", e)))?),
+            None => None,
+        };
+        let reply_id = id.clone().unwrap_or(Value::Null);
+
+        if raw.jsonrpc.as_ref().map(|version| version.0.as_ref()) != Some("2.0") {
+            return Err(error_response(reply_id, INVALID_REQUEST, "Missing or invalid jsonrpc field".to_string()));
+        }
+        let Some(method) = raw.method else {
+            return Err(error_response(reply_id, INVALID_REQUEST, "Missing method field".to_string()));
+        };
 
-        Ok(request)
+        McpRequest::from_parts(&method.0, id, raw.params).map_err(|error| McpResponse::failure(reply_id, error))
+    }
+
+    /// Parse a single JSON-RPC request from a string
+    #[cfg(test)]
+    fn parse_request(line: &str) -> Result<McpRequest> {
+        Self::parse_message(line.as_bytes())
+            .map_err(|response| anyhow!("{}", response.error.map_or_else(String::new, |error| error.message)))
     }
 
-    /// Write response to STDOUT as JSON-RPC message
-    #[instrument(skip(response))]
-    async fn write_response_to_stdout(response: &McpResponse) -> Result<()> {
-        let json_str = serde_json::to_string(response)
+    /// Write one line to the buffered STDOUT writer, serializing `outgoing` straight
+    /// into `buffer`, which is reused across messages. Returns the bytes written.
+    async fn write_message<W>(stdout: &mut W, outgoing: &Outgoing, buffer: &mut Vec<u8>) -> Result<usize>
+    where
+        W: AsyncWriteExt + Unpin,
+    {
+        buffer.clear();
+        serde_json::to_writer(&mut *buffer, outgoing)
             .map_err(|e| anyhow!("Failed to serialize response: {}", e))?;
+        buffer.push(b'\n');
 
-        let mut stdout = tokio::io::stdout();
-        stdout.write_all(json_str.as_bytes()).await
+        stdout.write_all(buffer).await
             .map_err(|e| anyhow!("Failed to write to STDOUT: {}", e))?;
-        stdout.write_all(b"\n").await
-            .map_err(|e| anyhow!("Failed to write newline to STDOUT: {}", e))?;
-        stdout.flush().await
-            .map_err(|e| anyhow!("Failed to flush STDOUT: {}", e))?;
+        let written = buffer.len();
 
-        debug!("Response written to STDOUT: {}", json_str);
-        Ok(())
+        // One oversized page should not pin its memory for the rest of the session.
+        if buffer.capacity() > BUFFER_RETAINED {
+            buffer.clear();
+            buffer.shrink_to(STDIO_BUFFER);
+        }
+        Ok(written)
     }
 
     /// Stop the transport layer
@@ -226,12 +489,16 @@ impl Transport {
     }
 }
 
+fn error_response(id: Value, code: i32, message: String) -> McpResponse {
+    McpResponse::failure(id, McpError { code, message, data: None })
+}
+
 /// Helper functions for testing and debugging
 impl Transport {
     /// Create a test message for validation
     #[cfg(test)]
     pub fn create_test_message(method: &str, params: Value) -> String {
-        serde_json::to_string(&json!({
+        serde_json::to_string(&serde_json::json!({
             "jsonrpc": "2.0",
             "id": 1,
             "method": method,
@@ -297,6 +564,10 @@ impl Default for TransportConfig {
 pub struct TransportStats {
     pub messages_received: u64,
     pub messages_sent: u64,
+    /// Batch arrays received; their messages also count in `messages_received`
+    pub batches_received: u64,
+    pub bytes_received: u64,
+    pub bytes_sent: u64,
     pub parse_errors: u64,
     pub write_errors: u64,
     pub start_time: chrono::DateTime<chrono::Utc>,
@@ -307,6 +578,9 @@ impl TransportStats {
         Self {
             messages_received: 0,
             messages_sent: 0,
+            batches_received: 0,
+            bytes_received: 0,
+            bytes_sent: 0,
             parse_errors: 0,
             write_errors: 0,
             start_time: chrono::Utc::now(),
@@ -316,6 +590,21 @@ impl TransportStats {
     pub fn uptime(&self) -> chrono::Duration {
         chrono::Utc::now() - self.start_time
     }
+
+    /// Messages received and sent per second of uptime
+    pub fn messages_per_second(&self) -> f64 {
+        self.per_second(self.messages_received + self.messages_sent)
+    }
+
+    /// Bytes received and sent per second of uptime
+    pub fn bytes_per_second(&self) -> f64 {
+        self.per_second(self.bytes_received + self.bytes_sent)
+    }
+
+    fn per_second(&self, total: u64) -> f64 {
+        let seconds = self.uptime().num_milliseconds() as f64 / 1000.0;
+        if seconds > 0.0 { total as f64 / seconds } else { 0.0 }
+    }
 }
 
 #[cfg(test)]
@@ -355,6 +644,40 @@ mod tests {
         assert!(result.is_err());
     }
 
+    #[test]
+    fn test_parse_unknown_method_keeps_id() {
+        let response = Transport::parse_message(br#"{"jsonrpc":"2.0","id":"x","method":"nope"}"#).unwrap_err();
+
+        assert_eq!(response.id, json!("x"));
+        assert_eq!(response.error.unwrap().code, super::super::server::METHOD_NOT_FOUND);
+    }
+
+    #[test]
+    fn test_parse_batch_frame() {
+        let line = br#"[{"jsonrpc":"2.0","id":1,"method":"ping"},{"jsonrpc":"2.0","method":"$/cancelRequest","params":{"id":1}},{"id":3}]"#;
+        let frame = Transport::parse_frame(line);
+
+        assert!(frame.batch);
+        assert_eq!(frame.requests.len(), 2);
+        assert_eq!(frame.errors.len(), 1);
+        assert!(!Transport::parse_frame(b"[]").batch);
+    }
+
+    #[test]
+    fn test_batch_collector_holds_responses_until_complete() {
+        let mut collector = BatchCollector::default();
+        let awaiting = [json!(1), json!(2)].iter().map(request_key).collect();
+        assert!(collector.open(PendingBatch { awaiting, responses: Vec::new() }).is_none());
+
+        let ok = |id: Value| McpResponse::success(id, &json!({})).unwrap();
+        assert!(matches!(collector.route(ok(json!(9))), Some(Outgoing::Single(_))));
+        assert!(collector.route(ok(json!(2))).is_none());
+        match collector.route(ok(json!(1))) {
+            Some(Outgoing::Batch(responses)) => assert_eq!(responses.len(), 2),
+            _ => panic!("batch not completed"),
+        }
+    }
+
     #[test]
     fn test_validate_message_format() {
         let valid_message = r#"{"jsonrpc":"2.0","id":1,"method":"test"}"#;
@@ -408,5 +731,6 @@ mod tests {
         assert_eq!(stats.parse_errors, 0);
         assert_eq!(stats.write_errors, 0);
         assert!(stats.uptime().num_seconds() >= 0);
+        assert_eq!(stats.messages_per_second(), 0.0);
     }
 }
\ No newline at end of file
@@ -0,0 +1,376 @@
+// Latency Metrics
+//
+// Lock-free histograms for the indexing and serving hot paths, kept in one
+// process-wide registry so any stage can record without threading a handle
+// through every layer.
+
+use serde::Serialize;
+use std::collections::BTreeMap;
+use std::fmt::Write as _;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, OnceLock, RwLock};
+use std::time::{Duration, Instant};
+
+/// Sub-buckets per power of two; quantiles are within 25% of the true value
+const SUB_BUCKET_BITS: u32 = 2;
+const SUB_BUCKETS: usize = 1 << SUB_BUCKET_BITS;
+/// Enough buckets for any `u64` nanosecond count
+const BUCKETS: usize = (64 - SUB_BUCKET_BITS as usize + 1) * SUB_BUCKETS;
+
+/// Distinct tool names tracked separately; further names share `OTHER_TOOL`
+const MAX_TOOLS: usize = 32;
+const OTHER_TOOL: &str = "other";
+
+/// Bucket bounds of the Prometheus export, as powers of two nanoseconds: about 1µs to 69s
+const PROMETHEUS_BOUNDS: std::ops::RangeInclusive<u32> = 10..=36;
+
+static GLOBAL: OnceLock<Metrics> = OnceLock::new();
+
+/// The process-wide registry
+pub fn global() -> &'static Metrics {
+    GLOBAL.get_or_init(Metrics::new)
+}
+
+/// Runs `f` and records its duration under `stage` in the global registry
+pub fn time<T>(stage: Stage, f: impl FnOnce() -> T) -> T {
+    global().time(stage, f)
+}
+
+/// Records `elapsed` under `stage` in the global registry
+pub fn record(stage: Stage, elapsed: Duration) {
+    global().record(stage, elapsed);
+}
+
+/// A timed step of indexing or serving
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Stage {
+    /// Reading a source file from disk
+    Read,
+    /// Hashing file content for change detection
+    Hash,
+    TreeSitter,
+    Clang,
+    /// Combining tree-sitter and libclang symbols
+    Merge,
+    /// One `replace_files` transaction
+    DbWrite,
+    /// Writing or flushing responses to the client
+    StdoutWrite,
+}
+
+impl Stage {
+    pub const ALL: [Stage; 7] = [
+        Stage::Read,
+        Stage::Hash,
+        Stage::TreeSitter,
+        Stage::Clang,
+        Stage::Merge,
+        Stage::DbWrite,
+        Stage::StdoutWrite,
+    ];
+
+    pub fn as_str(&self) -> &'static str {
+        match self {
+            Stage::Read => "read",
+            Stage::Hash => "hash",
+            Stage::TreeSitter => "tree_sitter",
+            Stage::Clang => "clang",
+            Stage::Merge => "merge",
+            Stage::DbWrite => "db_write",
+            Stage::StdoutWrite => "stdout_write",
+        }
+    }
+}
+
+/// Log-linear histogram of nanosecond durations. Recording is a few relaxed atomic
+/// adds, so it is cheap enough to leave on everywhere.
+pub struct Histogram {
+    buckets: Box<[AtomicU64]>,
+    count: AtomicU64,
+    sum_ns: AtomicU64,
+    max_ns: AtomicU64,
+}
+
+impl std::fmt::Debug for Histogram {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("Histogram").field("count", &self.count.load(Ordering::Relaxed)).finish()
+    }
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Histogram {
+    pub fn new() -> Self {
+        Self {
+            buckets: (0..BUCKETS).map(|_| AtomicU64::new(0)).collect(),
+            count: AtomicU64::new(0),
+            sum_ns: AtomicU64::new(0),
+            max_ns: AtomicU64::new(0),
+        }
+    }
+
+    pub fn record(&self, elapsed: Duration) {
+        let nanos = u64::try_from(elapsed.as_nanos()).unwrap_or(u64::MAX);
+        self.buckets[bucket_index(nanos)].fetch_add(1, Ordering::Relaxed);
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.sum_ns.fetch_add(nanos, Ordering::Relaxed);
+        self.max_ns.fetch_max(nanos, Ordering::Relaxed);
+    }
+
+    pub fn count(&self) -> u64 {
+        self.count.load(Ordering::Relaxed)
+    }
+
+    /// Approximate value below which `quantile` of the samples fall, in nanoseconds
+    pub fn quantile_ns(&self, quantile: f64) -> u64 {
+        let count = self.count();
+        if count == 0 {
+            return 0;
+        }
+
+        let rank = ((count as f64 * quantile.clamp(0.0, 1.0)).ceil() as u64).max(1);
+        let max_ns = self.max_ns.load(Ordering::Relaxed);
+        let mut seen = 0;
+        for (index, bucket) in self.buckets.iter().enumerate() {
+            seen += bucket.load(Ordering::Relaxed);
+            if seen >= rank {
+                // Concurrent recording can leave `count` ahead of the buckets; the
+                // bucket's upper bound is the estimate either way.
+                return bucket_upper_bound(index).min(max_ns);
+            }
+        }
+        max_ns
+    }
+
+    /// Samples strictly below `bound_ns`, exact when `bound_ns` is a power of two
+    fn count_below(&self, bound_ns: u64) -> u64 {
+        self.buckets[..bucket_index(bound_ns)].iter().map(|bucket| bucket.load(Ordering::Relaxed)).sum()
+    }
+
+    pub fn snapshot(&self) -> HistogramSnapshot {
+        let count = self.count();
+        let sum_ns = self.sum_ns.load(Ordering::Relaxed);
+        HistogramSnapshot {
+            count,
+            total_ms: sum_ns as f64 / 1e6,
+            mean_us: if count > 0 { sum_ns as f64 / count as f64 / 1e3 } else { 0.0 },
+            p50_us: self.quantile_ns(0.5) as f64 / 1e3,
+            p90_us: self.quantile_ns(0.9) as f64 / 1e3,
+            p99_us: self.quantile_ns(0.99) as f64 / 1e3,
+            max_us: self.max_ns.load(Ordering::Relaxed) as f64 / 1e3,
+        }
+    }
+}
+
+fn bucket_index(nanos: u64) -> usize {
+    if nanos < SUB_BUCKETS as u64 {
+        return nanos as usize;
+    }
+    let exponent = 63 - nanos.leading_zeros();
+    let mantissa = (nanos >> (exponent - SUB_BUCKET_BITS)) as usize & (SUB_BUCKETS - 1);
+    (exponent - SUB_BUCKET_BITS + 1) as usize * SUB_BUCKETS + mantissa
+}
+
+/// Smallest value of the bucket after `index`
+fn bucket_upper_bound(index: usize) -> u64 {
+    let next = index + 1;
+    if next < SUB_BUCKETS {
+        return next as u64;
+    }
+    let mantissa = (SUB_BUCKETS + next % SUB_BUCKETS) as u128;
+    let shift = (next / SUB_BUCKETS - 1) as u32;
+    u64::try_from(mantissa << shift).unwrap_or(u64::MAX)
+}
+
+#[derive(Debug, Clone, Serialize, PartialEq)]
+pub struct HistogramSnapshot {
+    pub count: u64,
+    pub total_ms: f64,
+    pub mean_us: f64,
+    pub p50_us: f64,
+    pub p90_us: f64,
+    pub p99_us: f64,
+    pub max_us: f64,
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct MetricsSnapshot {
+    pub uptime_seconds: u64,
+    /// Keyed by `Stage::as_str`
+    pub stages: BTreeMap<&'static str, HistogramSnapshot>,
+    /// Latency of each tool call, including answers from the result cache
+    pub tools: BTreeMap<String, HistogramSnapshot>,
+}
+
+/// Stage and per-tool latency histograms
+#[derive(Debug)]
+pub struct Metrics {
+    started: Instant,
+    stages: [Histogram; Stage::ALL.len()],
+    /// Created on a tool's first call; recording takes the lock only to read
+    tools: RwLock<BTreeMap<String, Arc<Histogram>>>,
+}
+
+impl Default for Metrics {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Metrics {
+    pub fn new() -> Self {
+        Self {
+            started: Instant::now(),
+            stages: std::array::from_fn(|_| Histogram::new()),
+            tools: RwLock::new(BTreeMap::new()),
+        }
+    }
+
+    pub fn stage(&self, stage: Stage) -> &Histogram {
+        &self.stages[stage as usize]
+    }
+
+    pub fn record(&self, stage: Stage, elapsed: Duration) {
+        self.stage(stage).record(elapsed);
+    }
+
+    pub fn time<T>(&self, stage: Stage, f: impl FnOnce() -> T) -> T {
+        let started = Instant::now();
+        let result = f();
+        self.record(stage, started.elapsed());
+        result
+    }
+
+    pub fn record_tool(&self, tool_name: &str, elapsed: Duration) {
+        self.tool(tool_name).record(elapsed);
+    }
+
+    fn tool(&self, tool_name: &str) -> Arc<Histogram> {
+        if let Some(histogram) = self.tools.read().ok().and_then(|tools| tools.get(tool_name).cloned()) {
+            return histogram;
+        }
+
+        let mut tools = match self.tools.write() {
+            Ok(tools) => tools,
+            Err(poisoned) => poisoned.into_inner(),
+        };
+        // Tool names come from clients, so unknown ones must not grow the map forever.
+        let name = if tools.len() < MAX_TOOLS || tools.contains_key(tool_name) { tool_name } else { OTHER_TOOL };
+        Arc::clone(tools.entry(name.to_string()).or_default())
+    }
+
+    pub fn snapshot(&self) -> MetricsSnapshot {
+        let tools = match self.tools.read() {
+            Ok(tools) => tools.iter().map(|(name, histogram)| (name.clone(), histogram.snapshot())).collect(),
+            Err(_) => BTreeMap::new(),
+        };
+
+        MetricsSnapshot {
+            uptime_seconds: self.started.elapsed().as_secs(),
+            stages: Stage::ALL.iter().map(|&stage| (stage.as_str(), self.stage(stage).snapshot())).collect(),
+            tools,
+        }
+    }
+
+    /// Prometheus text exposition of every histogram, durations in seconds
+    pub fn to_prometheus(&self) -> String {
+        let mut out = String::new();
+
+        out.push_str("# HELP cpp_index_stage_duration_seconds Time spent in each indexing and serving stage\n");
+        out.push_str("# TYPE cpp_index_stage_duration_seconds histogram\n");
+        for stage in Stage::ALL {
+            write_prometheus_histogram(&mut out, "cpp_index_stage_duration_seconds", "stage", stage.as_str(), self.stage(stage));
+        }
+
+        out.push_str("# HELP cpp_index_tool_duration_seconds Latency of MCP tool calls\n");
+        out.push_str("# TYPE cpp_index_tool_duration_seconds histogram\n");
+        if let Ok(tools) = self.tools.read() {
+            for (name, histogram) in tools.iter() {
+                write_prometheus_histogram(&mut out, "cpp_index_tool_duration_seconds", "tool", name, histogram);
+            }
+        }
+
+        out
+    }
+}
+
+fn write_prometheus_histogram(out: &mut String, metric: &str, label: &str, value: &str, histogram: &Histogram) {
+    let value = value.replace('\\', "\\\\").replace('"', "\\\"");
+    for exponent in PROMETHEUS_BOUNDS {
+        let bound_ns = 1u64 << exponent;
+        let _ = writeln!(out, "{}_bucket{{{}=\"{}\",le=\"{:e}\"}} {}", metric, label, value, bound_ns as f64 / 1e9, histogram.count_below(bound_ns));
+    }
+    let count = histogram.count();
+    let _ = writeln!(out, "{}_bucket{{{}=\"{}\",le=\"+Inf\"}} {}", metric, label, value, count);
+    let _ = writeln!(out, "{}_sum{{{}=\"{}\"}} {}", metric, label, value, histogram.sum_ns.load(Ordering::Relaxed) as f64 / 1e9);
+    let _ = writeln!(out, "{}_count{{{}=\"{}\"}} {}", metric, label, value, count);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_bucket_bounds_cover_every_value() {
+        for nanos in (0..4096).chain([1 << 20, (1 << 20) + 1, u64::MAX / 2, u64::MAX]) {
+            let index = bucket_index(nanos);
+            assert!(index < BUCKETS);
+            assert!(nanos < bucket_upper_bound(index) || bucket_upper_bound(index) == u64::MAX, "{} above bucket {}", nanos, index);
+            if index > 0 {
+                assert!(nanos >= bucket_upper_bound(index - 1), "{} below bucket {}", nanos, index);
+            }
+        }
+    }
+
+    #[test]
+    fn test_quantiles_within_bucket_error() {
+        let histogram = Histogram::new();
+        for micros in 1..=1000 {
+            histogram.record(Duration::from_micros(micros));
+        }
+
+        let snapshot = histogram.snapshot();
+        assert_eq!(snapshot.count, 1000);
+        assert_eq!(snapshot.max_us, 1000.0);
+        for (estimate, exact) in [(snapshot.p50_us, 500.0), (snapshot.p90_us, 900.0), (snapshot.p99_us, 990.0)] {
+            assert!(estimate >= exact && estimate <= exact * 1.25, "estimate {} for {}", estimate, exact);
+        }
+    }
+
+    #[test]
+    fn test_prometheus_export_is_cumulative() {
+        let metrics = Metrics::new();
+        metrics.record(Stage::Clang, Duration::from_millis(3));
+        metrics.record(Stage::Clang, Duration::from_secs(2));
+        metrics.record_tool("search_symbols", Duration::from_micros(200));
+
+        let text = metrics.to_prometheus();
+        assert!(text.contains("cpp_index_stage_duration_seconds_count{stage=\"clang\"} 2"));
+        assert!(text.contains("cpp_index_stage_duration_seconds_bucket{stage=\"clang\",le=\"+Inf\"} 2"));
+        assert!(text.contains("cpp_index_tool_duration_seconds_count{tool=\"search_symbols\"} 1"));
+
+        let clang_buckets: Vec<u64> = text
+            .lines()
+            .filter(|line| line.starts_with("cpp_index_stage_duration_seconds_bucket{stage=\"clang\""))
+            .map(|line| line.rsplit(' ').next().unwrap().parse().unwrap())
+            .collect();
+        assert!(clang_buckets.windows(2).all(|pair| pair[0] <= pair[1]));
+        assert!(clang_buckets.contains(&1));
+    }
+
+    #[test]
+    fn test_tool_names_are_bounded() {
+        let metrics = Metrics::new();
+        for i in 0..MAX_TOOLS + 10 {
+            metrics.record_tool(&format!("tool_{}", i), Duration::from_micros(1));
+        }
+
+        let tools = metrics.snapshot().tools;
+        assert_eq!(tools.len(), MAX_TOOLS + 1);
+        assert_eq!(tools[OTHER_TOOL].count, 10);
+    }
+}
@@ -1,8 +1,15 @@
 use rusqlite::{Connection, OpenFlags, Result};
+use std::ops::Deref;
 use std::path::{Path, PathBuf};
 use std::fs;
+use std::sync::{Condvar, Mutex, MutexGuard};
+use std::time::Duration;
+use crate::lib::storage::repository::Repository;
 use crate::lib::storage::schema::{SchemaMigrator, CURRENT_SCHEMA_VERSION};
 
+/// Prepared statements each connection keeps compiled; covers every fixed query in `Repository`
+const STATEMENT_CACHE_CAPACITY: usize = 64;
+
 /// Database configuration options
 #[derive(Debug, Clone)]
 pub struct DatabaseConfig {
@@ -12,7 +19,7 @@ pub struct DatabaseConfig {
     pub create_if_missing: bool,
     /// Whether to enable WAL mode for better concurrency
     pub enable_wal_mode: bool,
-    /// Connection pool size (for future connection pooling)
+    /// Number of read-only connections in a `ConnectionPool`
     pub pool_size: u32,
     /// Query timeout in seconds
     pub query_timeout_seconds: u64,
@@ -20,6 +27,8 @@ pub struct DatabaseConfig {
     pub max_size_mb: u64,
     /// Enable query logging for debugging
     pub enable_query_logging: bool,
+    /// Bytes of the database file each connection may memory-map (0 = disabled)
+    pub mmap_size_mb: u64,
 }
 
 impl DatabaseConfig {
@@ -33,6 +42,7 @@ impl DatabaseConfig {
             query_timeout_seconds: 30,
             max_size_mb: 0, // Unlimited
             enable_query_logging: false,
+            mmap_size_mb: 256,
         }
     }
 
@@ -46,6 +56,7 @@ impl DatabaseConfig {
             query_timeout_seconds: 10,
             max_size_mb: 0,
             enable_query_logging: true,
+            mmap_size_mb: 0,
         }
     }
 
@@ -63,6 +74,7 @@ impl DatabaseConfig {
             query_timeout_seconds: 10,
             max_size_mb: 100, // 100MB limit for temp databases
             enable_query_logging: true,
+            mmap_size_mb: 0,
         })
     }
 
@@ -84,6 +96,18 @@ impl DatabaseConfig {
         self
     }
 
+    /// Sets the number of read-only pooled connections
+    pub fn with_pool_size(mut self, pool_size: u32) -> Self {
+        self.pool_size = pool_size;
+        self
+    }
+
+    /// Sets how much of the database file each connection may memory-map
+    pub fn with_mmap_size_mb(mut self, mmap_size_mb: u64) -> Self {
+        self.mmap_size_mb = mmap_size_mb;
+        self
+    }
+
     /// Enables query logging
     pub fn with_query_logging(mut self, enable: bool) -> Self {
         self.enable_query_logging = enable;
@@ -135,20 +159,56 @@ impl DatabaseManager {
         Ok(Self { config })
     }
 
-    /// Opens a connection to the database and applies all migrations
+    /// Opens a configured connection to the database. The schema is left as found;
+    /// `initialize` brings it up to date.
     pub fn connect(&self) -> Result<Connection> {
         self.ensure_database_directory()?;
         let mut connection = self.open_connection()?;
         self.configure_connection(&mut connection)?;
+        Ok(connection)
+    }
+
+    /// Opens a connection and applies all migrations, once per process at startup
+    /// rather than per connection
+    pub fn initialize(&self) -> Result<Connection> {
+        let mut connection = self.connect()?;
         self.apply_migrations(&mut connection)?;
+        // Planner statistics only need refreshing once the schema is in place.
+        connection.execute("PRAGMA optimize", [])?;
         Ok(connection)
     }
 
-    /// Opens a connection without applying migrations (for migration testing)
-    pub fn connect_raw(&self) -> Result<Connection> {
-        self.ensure_database_directory()?;
-        let mut connection = self.open_connection()?;
-        self.configure_connection(&mut connection)?;
+    /// Opens a pool of one writer and `pool_size` read-only connections, applying
+    /// migrations once through the writer. In-memory databases cannot be shared
+    /// between connections, so their pool serves reads from the writer.
+    pub fn pool(&self) -> Result<ConnectionPool> {
+        let writer = Repository::new(self.initialize()?);
+
+        let reader_count = if self.config.is_in_memory() { 0 } else { self.config.pool_size as usize };
+        let readers = (0..reader_count)
+            .map(|_| self.open_reader().map(Repository::new))
+            .collect::<Result<Vec<_>>>()?;
+
+        Ok(ConnectionPool {
+            writer: Mutex::new(writer),
+            reader_count,
+            readers: Mutex::new(readers),
+            returned: Condvar::new(),
+            acquire_timeout: Duration::from_secs(self.config.query_timeout_seconds),
+        })
+    }
+
+    /// Opens a read-only connection; under WAL each read transaction sees a
+    /// consistent snapshot without blocking the writer
+    fn open_reader(&self) -> Result<Connection> {
+        let flags = OpenFlags::SQLITE_OPEN_READ_ONLY | OpenFlags::SQLITE_OPEN_NO_MUTEX;
+        let connection = Connection::open_with_flags(&self.config.database_path, flags)?;
+
+        connection.execute("PRAGMA cache_size = -64000", [])?;
+        connection.execute("PRAGMA temp_store = MEMORY", [])?;
+        connection.busy_timeout(Duration::from_secs(self.config.query_timeout_seconds))?;
+        self.configure_caches(&connection)?;
+
         Ok(connection)
     }
 
@@ -192,7 +252,8 @@ impl DatabaseManager {
 
         // Configure WAL mode for better concurrency (if enabled and not in-memory)
         if self.config.enable_wal_mode && !self.config.is_in_memory() {
-            connection.execute("PRAGMA journal_mode = WAL", [])?;
+            // journal_mode reports the resulting mode as a row, which `execute` rejects.
+            connection.pragma_update_and_check(None, "journal_mode", "WAL", |row| row.get::<_, String>(0))?;
         }
 
         // Configure synchronous mode for better performance while maintaining safety
@@ -220,8 +281,20 @@ impl DatabaseManager {
             connection.execute(&format!("PRAGMA max_page_count = {}", max_pages), [])?;
         }
 
-        // Enable query optimization
-        connection.execute("PRAGMA optimize", [])?;
+        self.configure_caches(connection)?;
+
+        Ok(())
+    }
+
+    /// Statement cache and memory-mapped I/O, shared by writer and reader connections
+    fn configure_caches(&self, connection: &Connection) -> Result<()> {
+        connection.set_prepared_statement_cache_capacity(STATEMENT_CACHE_CAPACITY);
+
+        if self.config.mmap_size_mb > 0 && !self.config.is_in_memory() {
+            let mmap_bytes = self.config.mmap_size_mb * 1024 * 1024;
+            // mmap_size reports the applied size as a row, which `execute` rejects.
+            connection.pragma_update_and_check(None, "mmap_size", mmap_bytes as i64, |row| row.get::<_, i64>(0))?;
+        }
 
         Ok(())
     }
@@ -357,6 +430,102 @@ impl DatabaseManager {
     }
 }
 
+/// One writer connection and a set of read-only connections to the same database.
+/// The pool is `Sync`, so one `Arc<ConnectionPool>` serves every tokio task; each
+/// handle is held for the duration of a synchronous repository call. Taking a handle
+/// may wait on a lock, so async code takes them on the blocking pool, e.g. through
+/// `spawn_blocking`, never on a runtime worker.
+#[derive(Debug)]
+pub struct ConnectionPool {
+    writer: Mutex<Repository>,
+    reader_count: usize,
+    readers: Mutex<Vec<Repository>>,
+    returned: Condvar,
+    acquire_timeout: Duration,
+}
+
+impl ConnectionPool {
+    /// Pool serving reads and writes from a single repository
+    pub fn single(repository: Repository) -> Self {
+        Self {
+            writer: Mutex::new(repository),
+            reader_count: 0,
+            readers: Mutex::new(Vec::new()),
+            returned: Condvar::new(),
+            acquire_timeout: Duration::from_secs(30),
+        }
+    }
+
+    /// Borrows a read-only repository, waiting for one to be returned if all are in use
+    pub fn read(&self) -> Result<ReadHandle<'_>> {
+        if self.reader_count == 0 {
+            return self.write().map(ReadHandle::Writer);
+        }
+
+        let readers = self.readers.lock().map_err(|_| pool_error("Reader pool lock poisoned"))?;
+        let (mut readers, _) = self
+            .returned
+            .wait_timeout_while(readers, self.acquire_timeout, |readers| readers.is_empty())
+            .map_err(|_| pool_error("Reader pool lock poisoned"))?;
+
+        match readers.pop() {
+            Some(repository) => Ok(ReadHandle::Pooled { pool: self, repository: Some(repository) }),
+            None => Err(pool_error("Timed out waiting for a read connection")),
+        }
+    }
+
+    /// Locks the writer; writes are serialized through this single connection
+    pub fn write(&self) -> Result<MutexGuard<'_, Repository>> {
+        self.writer.lock().map_err(|_| pool_error("Writer lock poisoned"))
+    }
+
+    /// Number of read-only connections, 0 when reads share the writer
+    pub fn reader_count(&self) -> usize {
+        self.reader_count
+    }
+
+    fn release(&self, repository: Repository) {
+        if let Ok(mut readers) = self.readers.lock() {
+            readers.push(repository);
+            self.returned.notify_one();
+        }
+    }
+}
+
+/// Repository borrowed from a `ConnectionPool` for reading
+pub enum ReadHandle<'a> {
+    Pooled { pool: &'a ConnectionPool, repository: Option<Repository> },
+    Writer(MutexGuard<'a, Repository>),
+}
+
+impl Deref for ReadHandle<'_> {
+    type Target = Repository;
+
+    fn deref(&self) -> &Repository {
+        match self {
+            ReadHandle::Pooled { repository, .. } => repository.as_ref().expect("read handle used after release"),
+            ReadHandle::Writer(repository) => repository,
+        }
+    }
+}
+
+impl Drop for ReadHandle<'_> {
+    fn drop(&mut self) {
+        if let ReadHandle::Pooled { pool, repository } = self {
+            if let Some(repository) = repository.take() {
+                pool.release(repository);
+            }
+        }
+    }
+}
+
+fn pool_error(message: &str) -> rusqlite::Error {
+    rusqlite::Error::SqliteFailure(
+        rusqlite::ffi::Error::new(rusqlite::ffi::SQLITE_BUSY),
+        Some(message.to_string()),
+    )
+}
+
 /// Information about the database
 #[derive(Debug, Clone)]
 pub struct DatabaseInfo {
@@ -483,11 +652,25 @@ mod tests {
         assert!(db_path.exists());
     }
 
+    #[test]
+    fn test_connect_leaves_schema_to_initialize() {
+        let temp_dir = tempdir().unwrap();
+        let manager = DatabaseManager::new(DatabaseConfig::new(temp_dir.path().join("schema.db"))).unwrap();
+        let table_count = |connection: &Connection| -> i64 {
+            connection.query_row("SELECT COUNT(*) FROM sqlite_master WHERE type = 'table'", [], |row| row.get(0)).unwrap()
+        };
+        
+        assert_eq!(table_count(&manager.connect().unwrap()), 0);
+        let _connection = manager.initialize().unwrap();
+        assert!(table_count(&manager.connect().unwrap()) > 0);
+    }
+
     #[test]
     fn test_database_info() {
-        let config = DatabaseConfig::in_memory();
-        let manager = DatabaseManager::new(config).unwrap();
-        let _connection = manager.connect().unwrap();
+        // Each in-memory connection is its own database, so the schema needs a file.
+        let temp_dir = tempdir().unwrap();
+        let manager = DatabaseManager::new(DatabaseConfig::new(temp_dir.path().join("info.db"))).unwrap();
+        let _connection = manager.initialize().unwrap();
         
         let info = manager.get_database_info().unwrap();
         
@@ -529,6 +712,35 @@ mod tests {
         assert_eq!(info.file_size_human_readable(), "1.0 KB");
     }
 
+    #[test]
+    fn test_pool_readers_see_committed_writes() {
+        let temp_dir = tempdir().unwrap();
+        let config = DatabaseConfig::new(temp_dir.path().join("pool.db")).with_pool_size(2);
+        let pool = DatabaseManager::new(config).unwrap().pool().unwrap();
+        assert_eq!(pool.reader_count(), 2);
+
+        let first = pool.read().unwrap();
+        let second = pool.read().unwrap();
+        pool.write().unwrap().connection().execute("INSERT INTO schema_migrations (version) VALUES (999)", []).unwrap();
+
+        let count: i64 = first.connection().query_row("SELECT COUNT(*) FROM schema_migrations WHERE version = 999", [], |row| row.get(0)).unwrap();
+        assert_eq!(count, 1);
+        assert!(second.connection().execute("DELETE FROM schema_migrations", []).is_err());
+
+        drop(first);
+        drop(second);
+        assert!(pool.read().is_ok());
+    }
+
+    #[test]
+    fn test_in_memory_pool_reads_from_writer() {
+        let pool = DatabaseManager::new(DatabaseConfig::in_memory()).unwrap().pool().unwrap();
+        assert_eq!(pool.reader_count(), 0);
+
+        let info: i64 = pool.read().unwrap().connection().query_row("SELECT COUNT(*) FROM code_indices", [], |row| row.get(0)).unwrap();
+        assert_eq!(info, 0);
+    }
+
     #[test]
     fn test_database_deletion() {
         let temp_dir = tempdir().unwrap();
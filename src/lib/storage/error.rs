@@ -0,0 +1,17 @@
+use thiserror::Error;
+
+/// Failures of the storage layer: errors SQLite reports, and requests refused before
+/// they reach it
+#[derive(Debug, Error)]
+pub enum StorageError {
+    #[error(transparent)]
+    Sqlite(#[from] rusqlite::Error),
+    /// A caller-supplied argument, such as a pagination cursor, that cannot be used
+    #[error("{0}")]
+    InvalidArgument(String),
+    /// A record that failed validation and was not written
+    #[error("{0}")]
+    Invalid(String),
+}
+
+pub type Result<T, E = StorageError> = std::result::Result<T, E>;
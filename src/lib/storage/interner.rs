@@ -0,0 +1,121 @@
+use std::collections::HashMap;
+use xxhash_rust::xxh3::xxh3_64;
+
+/// Marks the end of a hash chain
+const NO_STRING: u32 = u32::MAX;
+
+/// Handle to a string in a `StringInterner`
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, PartialOrd, Ord)]
+pub struct StrId(u32);
+
+impl StrId {
+    /// The empty string, which every interner holds from the start
+    pub const EMPTY: StrId = StrId(0);
+
+    pub fn is_empty(self) -> bool {
+        self == Self::EMPTY
+    }
+}
+
+/// Stores each distinct string once. All text lives in one buffer and strings are
+/// found by hash, so a table of many short, repetitive strings (paths, scopes,
+/// names) costs a handful of allocations instead of one per string.
+#[derive(Debug, Clone)]
+pub struct StringInterner {
+    text: String,
+    /// End offset of each string in `text`; a string starts where the previous one ends
+    ends: Vec<u32>,
+    /// Most recent string with each hash; older ones with the same hash follow `next`
+    by_hash: HashMap<u64, u32>,
+    next: Vec<u32>,
+}
+
+impl Default for StringInterner {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl StringInterner {
+    pub fn new() -> Self {
+        let mut interner = Self {
+            text: String::new(),
+            ends: Vec::new(),
+            by_hash: HashMap::new(),
+            next: Vec::new(),
+        };
+        interner.intern("");
+        interner
+    }
+
+    pub fn intern(&mut self, value: &str) -> StrId {
+        let hash = xxh3_64(value.as_bytes());
+        if let Some(id) = self.find(hash, value) {
+            return id;
+        }
+
+        let id = self.ends.len() as u32;
+        self.text.push_str(value);
+        self.ends.push(self.text.len() as u32);
+        self.next.push(self.by_hash.insert(hash, id).unwrap_or(NO_STRING));
+        StrId(id)
+    }
+
+    /// Id of `value` if it has been interned
+    pub fn get(&self, value: &str) -> Option<StrId> {
+        self.find(xxh3_64(value.as_bytes()), value)
+    }
+
+    pub fn resolve(&self, id: StrId) -> &str {
+        let index = id.0 as usize;
+        let start = if index == 0 { 0 } else { self.ends[index - 1] as usize };
+        &self.text[start..self.ends[index] as usize]
+    }
+
+    /// Number of distinct strings, including the empty one
+    pub fn len(&self) -> usize {
+        self.ends.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.ends.len() <= 1
+    }
+
+    /// Approximate heap memory held by the table
+    pub fn heap_bytes(&self) -> usize {
+        self.text.capacity()
+            + (self.ends.capacity() + self.next.capacity()) * std::mem::size_of::<u32>()
+            + self.by_hash.capacity() * (std::mem::size_of::<u64>() + std::mem::size_of::<u32>())
+    }
+
+    fn find(&self, hash: u64, value: &str) -> Option<StrId> {
+        let mut candidate = self.by_hash.get(&hash).copied().unwrap_or(NO_STRING);
+        while candidate != NO_STRING {
+            if self.resolve(StrId(candidate)) == value {
+                return Some(StrId(candidate));
+            }
+            candidate = self.next[candidate as usize];
+        }
+        None
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_intern_deduplicates() {
+        let mut interner = StringInterner::new();
+        let scope = interner.intern("geometry::shapes");
+        let name = interner.intern("Circle");
+
+        assert_eq!(interner.intern("geometry::shapes"), scope);
+        assert_ne!(scope, name);
+        assert_eq!(interner.resolve(scope), "geometry::shapes");
+        assert_eq!(interner.resolve(name), "Circle");
+        assert_eq!(interner.intern(""), StrId::EMPTY);
+        assert_eq!(interner.get("Square"), None);
+        assert_eq!(interner.len(), 3);
+    }
+}
@@ -4,7 +4,23 @@
 // including code indices, symbols, relationships, and query sessions.
 
 pub mod models;
-// TODO: Implement these modules in later tasks
-// pub mod schema;
-// pub mod connection; 
-// pub mod repository;
\ No newline at end of file
+pub mod error;
+pub mod schema;
+pub mod connection;
+pub mod repository;
+pub mod symbol_index;
+pub mod symbol_graph;
+pub mod pagination;
+pub mod interner;
+pub mod symbol_table;
+pub mod snapshot;
+
+pub use error::StorageError;
+pub use connection::{DatabaseConfig, DatabaseManager, ConnectionPool, ReadHandle};
+pub use repository::{Repository, ElementSearch, FileBatch, FileIngestResult, PendingRelationship, ShardMerge, SymbolRef};
+pub use pagination::{Cursor, Page};
+pub use interner::{StringInterner, StrId};
+pub use symbol_table::{SymbolTable, CompactSymbol, SymbolRecord};
+pub use symbol_index::{SymbolIndex, SymbolMatch, SymbolSearch, MatchKind};
+pub use symbol_graph::{SymbolGraph, Direction, GraphHit, Traversal};
+pub use snapshot::{Snapshot, SnapshotSymbol, SnapshotSummary};
\ No newline at end of file
@@ -11,7 +11,8 @@ pub struct FileMetadata {
     pub index_id: Uuid,
     /// Relative path from codebase root
     pub file_path: String,
-    /// Blake3 hash of entire file content
+    /// Hash of the entire file content: a git blob id or an xxh3-128 digest, or a
+    /// SHA-256 digest in indices built before either was stored
     pub file_hash: String,
     /// File system modification time
     pub last_modified: DateTime<Utc>,
@@ -36,6 +37,24 @@ pub enum FileProcessingState {
     Error,
 }
 
+/// How much of a file's symbol information is stored
+#[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq, Eq, Hash)]
+pub enum ExtractionTier {
+    /// Tree-sitter symbols only: names, kinds and locations
+    Syntax,
+    /// Merged with libclang: types, access, templates and inheritance
+    Semantic,
+}
+
+impl ExtractionTier {
+    pub fn as_str(&self) -> &'static str {
+        match self {
+            ExtractionTier::Syntax => "syntax",
+            ExtractionTier::Semantic => "semantic",
+        }
+    }
+}
+
 impl FileMetadata {
     /// Creates a new FileMetadata
     pub fn new(
@@ -82,9 +101,9 @@ impl FileMetadata {
             return Err("File path must be relative".to_string());
         }
 
-        // Validate Blake3 hash format (64 character hex string)
-        if self.file_hash.len() != 64 {
-            return Err("File hash must be 64 characters".to_string());
+        // xxh3-128, git blob id (SHA-1) or SHA-256, as a hex string
+        if ![32, 40, 64].contains(&self.file_hash.len()) {
+            return Err("File hash must be 32, 40 or 64 characters".to_string());
         }
 
         if !self.file_hash.chars().all(|c| c.is_ascii_hexdigit()) {
@@ -256,6 +275,12 @@ mod tests {
         // Test invalid hash characters
         metadata.file_hash = "g".repeat(64);
         assert!(metadata.validate().is_err());
+
+        // Git blob ids and xxh3 digests are stored as they are
+        metadata.file_hash = "ce013625030ba8dba906f756967f9e9ca394464a".to_string();
+        assert!(metadata.validate().is_ok());
+        metadata.file_hash = "0".repeat(32);
+        assert!(metadata.validate().is_ok());
     }
 
     #[test]
@@ -17,6 +17,9 @@ pub struct McpQuerySession {
     pub last_activity: DateTime<Utc>,
     /// Number of queries in session
     pub query_count: u32,
+    /// Time spent answering the session's queries
+    #[serde(default)]
+    pub total_query_micros: u64,
     /// Session status
     pub status: SessionStatus,
     /// Optional metadata about the client
@@ -46,6 +49,18 @@ pub struct SessionStats {
     pub most_used_tool: Option<String>,
 }
 
+/// Queries a session ran since its row was last written, buffered in memory and
+/// added to the row by `Repository::record_session_activity`
+#[derive(Debug, Clone, PartialEq)]
+pub struct SessionActivity {
+    pub session_id: Uuid,
+    pub client_name: String,
+    pub created_at: DateTime<Utc>,
+    pub last_activity: DateTime<Utc>,
+    pub queries: u32,
+    pub query_micros: u64,
+}
+
 impl McpQuerySession {
     /// Creates a new MCP query session
     pub fn new(client_name: String) -> Self {
@@ -57,6 +72,7 @@ impl McpQuerySession {
             created_at: now,
             last_activity: now,
             query_count: 0,
+            total_query_micros: 0,
             status: SessionStatus::Active,
             client_metadata: None,
         }
@@ -72,6 +88,7 @@ impl McpQuerySession {
             created_at: now,
             last_activity: now,
             query_count: 0,
+            total_query_micros: 0,
             status: SessionStatus::Active,
             client_metadata: None,
         }
@@ -95,6 +112,12 @@ impl McpQuerySession {
         self.update_activity();
     }
 
+    /// Records a query execution that took `elapsed`
+    pub fn record_timed_query(&mut self, elapsed: std::time::Duration) {
+        self.total_query_micros += elapsed.as_micros() as u64;
+        self.record_query();
+    }
+
     /// Updates the last activity timestamp
     pub fn update_activity(&mut self) {
         self.last_activity = Utc::now();
@@ -180,12 +203,42 @@ impl McpQuerySession {
             total_queries: self.query_count,
             successful_queries: 0, // Would need query log to calculate
             failed_queries: 0,     // Would need query log to calculate
-            avg_response_time_ms: None, // Would need timing data
+            avg_response_time_ms: (self.query_count > 0)
+                .then(|| self.total_query_micros as f64 / self.query_count as f64 / 1000.0),
             most_used_tool: None,  // Would need query log to calculate
         }
     }
 }
 
+impl SessionActivity {
+    /// A session that has not run a query yet
+    pub fn new(session_id: Uuid, client_name: String) -> Self {
+        let now = Utc::now();
+        Self {
+            session_id,
+            client_name,
+            created_at: now,
+            last_activity: now,
+            queries: 0,
+            query_micros: 0,
+        }
+    }
+
+    /// Records a query that took `elapsed`
+    pub fn record_query(&mut self, elapsed: std::time::Duration) {
+        self.queries += 1;
+        self.query_micros += elapsed.as_micros() as u64;
+        self.last_activity = Utc::now();
+    }
+
+    /// Adds the activity of `later`, recorded for the same session after this
+    pub fn merge(&mut self, later: SessionActivity) {
+        self.queries += later.queries;
+        self.query_micros += later.query_micros;
+        self.last_activity = self.last_activity.max(later.last_activity);
+    }
+}
+
 impl SessionStatus {
     /// Returns true if the session can accept new queries
     pub fn can_accept_queries(&self) -> bool {
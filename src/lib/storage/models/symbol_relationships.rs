@@ -17,8 +17,33 @@ pub struct SymbolRelationship {
     pub line_number: u32,
 }
 
+/// A relationship recorded while parsing a file, between symbols identified by their
+/// libclang USR. USRs stay the same across translation units, so an edge from one
+/// file can point at a symbol defined in another, indexed before or after it.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct SymbolEdge {
+    pub from: SymbolKey,
+    pub to: SymbolKey,
+    pub relationship_type: RelationshipType,
+    /// File containing the reference; a header for bases declared there
+    pub file_path: String,
+    /// 1-based position of the reference
+    pub line_number: u32,
+    pub column_number: u32,
+}
+
+/// One end of a `SymbolEdge`. Besides the USR it names the symbol's declaration, which
+/// is how the edge finds elements stored without a USR, like tree-sitter header symbols.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct SymbolKey {
+    pub usr: String,
+    pub name: String,
+    pub file_path: String,
+    pub line_number: u32,
+}
+
 /// Type of relationship between code elements
-#[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq, Eq)]
+#[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq, Eq, Hash)]
 pub enum RelationshipType {
     /// Class inheritance (class A : public B)
     Inherits,
@@ -172,6 +197,11 @@ impl RelationshipType {
         }
     }
 
+    /// Parses the value stored by `as_str`
+    pub fn parse(value: &str) -> Option<Self> {
+        Self::all().iter().copied().find(|relationship_type| relationship_type.as_str() == value)
+    }
+
     /// Returns a description of the relationship
     pub fn description(&self) -> &'static str {
         match self {
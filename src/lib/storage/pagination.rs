@@ -0,0 +1,123 @@
+use crate::lib::storage::error::{Result, StorageError};
+use serde_json::Value;
+
+/// Position just after the last row of a page. It holds that row's sort key, so the
+/// next page starts with a keyset seek instead of skipping rows, and is handed to
+/// clients as an opaque string.
+#[derive(Debug, Clone, PartialEq)]
+pub struct Cursor {
+    /// Query the key belongs to, so a cursor cannot be replayed against another one
+    kind: String,
+    key: Vec<Value>,
+}
+
+/// One page of results and the cursor for the next, if there are more
+#[derive(Debug, Clone)]
+pub struct Page<T> {
+    pub items: Vec<T>,
+    pub next_cursor: Option<Cursor>,
+}
+
+impl<T> Page<T> {
+    /// Builds a page from up to `limit + 1` rows, the extra row only signalling that
+    /// another page exists
+    pub fn from_rows(mut rows: Vec<T>, limit: usize, key_of: impl Fn(&T) -> Cursor) -> Self {
+        let next_cursor = if rows.len() > limit {
+            rows.truncate(limit);
+            rows.last().map(key_of)
+        } else {
+            None
+        };
+        Self { items: rows, next_cursor }
+    }
+
+    pub fn map<U>(self, f: impl FnMut(T) -> U) -> Page<U> {
+        Page {
+            items: self.items.into_iter().map(f).collect(),
+            next_cursor: self.next_cursor,
+        }
+    }
+}
+
+impl Cursor {
+    pub fn new(kind: &str, key: Vec<Value>) -> Self {
+        Self { kind: kind.to_string(), key }
+    }
+
+    /// Hex-encoded JSON, so clients have no reason to look inside
+    pub fn encode(&self) -> String {
+        let json = Value::Array(std::iter::once(Value::from(self.kind.as_str())).chain(self.key.iter().cloned()).collect());
+        json.to_string().bytes().map(|byte| format!("{:02x}", byte)).collect()
+    }
+
+    pub fn decode(text: &str) -> Result<Self> {
+        let invalid = || StorageError::InvalidArgument(format!("Invalid cursor: {}", text));
+
+        if text.len() % 2 != 0 || !text.is_ascii() {
+            return Err(invalid());
+        }
+        let bytes = (0..text.len())
+            .step_by(2)
+            .map(|i| u8::from_str_radix(&text[i..i + 2], 16))
+            .collect::<std::result::Result<Vec<u8>, _>>()
+            .map_err(|_| invalid())?;
+
+        match serde_json::from_slice::<Value>(&bytes).map_err(|_| invalid())? {
+            Value::Array(mut values) if !values.is_empty() => {
+                let kind = values.remove(0).as_str().ok_or_else(invalid)?.to_string();
+                Ok(Self { kind, key: values })
+            }
+            _ => Err(invalid()),
+        }
+    }
+
+    /// The key, checked to come from a `kind` query with `len` columns
+    pub fn key_for(&self, kind: &str, len: usize) -> Result<&[Value]> {
+        if self.kind != kind || self.key.len() != len {
+            return Err(StorageError::InvalidArgument(format!("Cursor does not belong to a {} query", kind)));
+        }
+        Ok(&self.key)
+    }
+
+    /// Key columns as SQL parameters, for `(a, b, ...) > (?, ?, ...)` seeks
+    pub fn sql_params(key: &[Value]) -> Result<Vec<Box<dyn rusqlite::ToSql>>> {
+        key.iter()
+            .map(|value| -> Result<Box<dyn rusqlite::ToSql>> {
+                match value {
+                    Value::String(text) => Ok(Box::new(text.clone())),
+                    Value::Number(number) if number.is_i64() => Ok(Box::new(number.as_i64().unwrap_or_default())),
+                    Value::Number(number) => Ok(Box::new(number.as_f64().unwrap_or_default())),
+                    _ => Err(StorageError::InvalidArgument("Invalid cursor key".to_string())),
+                }
+            })
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+
+    #[test]
+    fn test_cursor_round_trip() {
+        let cursor = Cursor::new("search", vec![json!(0), json!(-1.5), json!("get_value"), json!(42)]);
+        let decoded = Cursor::decode(&cursor.encode()).unwrap();
+
+        assert_eq!(decoded, cursor);
+        assert!(decoded.key_for("search", 4).is_ok());
+        assert!(decoded.key_for("file_symbols", 4).is_err());
+        assert!(Cursor::decode("not a cursor").is_err());
+    }
+
+    #[test]
+    fn test_page_from_rows() {
+        let key_of = |row: &i64| Cursor::new("rows", vec![json!(*row)]);
+
+        let page = Page::from_rows(vec![1, 2, 3], 2, key_of);
+        assert_eq!(page.items, vec![1, 2]);
+        assert_eq!(page.next_cursor, Some(key_of(&2)));
+
+        assert!(Page::from_rows(vec![1, 2], 2, key_of).next_cursor.is_none());
+    }
+}
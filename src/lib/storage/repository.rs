@@ -1,15 +1,65 @@
-use rusqlite::{Connection, Result, params, Row};
+use rusqlite::{Connection, OptionalExtension, params, Row};
 use chrono::{DateTime, Utc};
 use uuid::Uuid;
+use serde_json::json;
 use std::collections::HashMap;
+use std::path::Path;
 
+use crate::lib::storage::error::{Result, StorageError};
 use crate::lib::storage::models::code_index::{CodeIndex, IndexState};
 use crate::lib::storage::models::code_element::{CodeElement, SymbolType, AccessModifier};
-use crate::lib::storage::models::file_metadata::{FileMetadata, FileProcessingState};
-use crate::lib::storage::models::symbol_relationships::{SymbolRelationship, RelationshipType, RelationshipQuery};
-use crate::lib::storage::models::mcp_query_session::{McpQuerySession, SessionStatus, SessionQuery};
+use crate::lib::storage::models::file_metadata::{ExtractionTier, FileMetadata, FileProcessingState};
+use crate::lib::storage::models::symbol_relationships::{SymbolRelationship, SymbolEdge, RelationshipType, RelationshipQuery};
+use crate::lib::storage::models::mcp_query_session::{McpQuerySession, SessionActivity, SessionStatus, SessionQuery};
+use crate::lib::storage::pagination::{Cursor, Page};
+use crate::lib::storage::symbol_table::{hex_digest, SymbolTable};
+use crate::lib::metrics::{self, Stage};
+
+const INSERT_CODE_ELEMENT: &str = r#"
+    INSERT INTO code_elements (
+        index_id, symbol_name, symbol_type, file_path, line_number,
+        column_number, definition_hash, scope, access_modifier, 
+        is_declaration, signature, usr
+    ) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12)
+"#;
+
+const INSERT_SYMBOL_RELATIONSHIP: &str = r#"
+    INSERT INTO symbol_relationships (
+        from_symbol_id, to_symbol_id, relationship_type, 
+        file_path, line_number
+    ) VALUES (?1, ?2, ?3, ?4, ?5)
+"#;
+
+/// Shortest pattern the trigram tokenizer can match; shorter ones use LIKE
+const MIN_TRIGRAM_PATTERN_CHARS: usize = 3;
+
+/// Sort key of ranked symbol search; `k_*` columns come from `element_search_sql`
+const SEARCH_ORDER: &str = "k_exact, k_prefix, k_rank, length(symbol_name), symbol_name, file_path, id";
+const SEARCH_CURSOR: &str = "search";
+pub(crate) const FILE_SYMBOLS_CURSOR: &str = "file_symbols";
+const REFERENCES_CURSOR: &str = "references";
+const RELATIONSHIPS_CURSOR: &str = "relationships";
+
+/// Element search filter for an overlay (?1) over its base (?5): the overlay's rows,
+/// and the base's in files the overlay neither stores nor records as removed
+/// Filter keeping the rows of element `alias` an overlay sees: its own, and its
+/// base's in the files it neither stores nor removed. `overlay` and `base` are the
+/// placeholder numbers of the two index ids.
+fn overlay_index_filter(alias: &str, overlay: usize, base: usize) -> String {
+    format!(
+        r#"({alias}.index_id = ?{overlay} OR ({alias}.index_id = ?{base} AND {alias}.file_path NOT IN (
+    SELECT file_path FROM file_metadata WHERE index_id = ?{overlay}
+    UNION ALL
+    SELECT file_path FROM overlay_removed_files WHERE index_id = ?{overlay}
+)))"#
+    )
+}
+
+/// Number of files `replace_files` callers should group into one transaction
+pub const FILES_PER_TRANSACTION: usize = 64;
 
 /// Repository providing CRUD operations for all storage models
+#[derive(Debug)]
 pub struct Repository {
     connection: Connection,
 }
@@ -34,7 +84,7 @@ impl Repository {
 
     /// Creates a new code index
     pub fn create_code_index(&self, mut index: CodeIndex) -> Result<CodeIndex> {
-        index.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        index.validate().map_err(StorageError::Invalid)?;
         
         self.connection.execute(
             r#"
@@ -61,7 +111,7 @@ impl Repository {
 
     /// Retrieves a code index by ID
     pub fn get_code_index(&self, id: &Uuid) -> Result<Option<CodeIndex>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             "SELECT id, name, base_path, created_at, updated_at, total_files, total_symbols, index_version, state FROM code_indices WHERE id = ?1"
         )?;
         
@@ -77,7 +127,7 @@ impl Repository {
 
     /// Retrieves a code index by name
     pub fn get_code_index_by_name(&self, name: &str) -> Result<Option<CodeIndex>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             "SELECT id, name, base_path, created_at, updated_at, total_files, total_symbols, index_version, state FROM code_indices WHERE name = ?1"
         )?;
         
@@ -93,7 +143,7 @@ impl Repository {
 
     /// Lists all code indices
     pub fn list_code_indices(&self) -> Result<Vec<CodeIndex>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             "SELECT id, name, base_path, created_at, updated_at, total_files, total_symbols, index_version, state FROM code_indices ORDER BY name"
         )?;
         
@@ -105,15 +155,15 @@ impl Repository {
         Ok(indices)
     }
 
-    /// Updates a code index
+    /// Updates a code index. `total_files` and `total_symbols` are maintained by
+    /// storage as files are written, so the values on `index` are ignored.
     pub fn update_code_index(&self, index: &CodeIndex) -> Result<()> {
-        index.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        index.validate().map_err(StorageError::Invalid)?;
         
         let rows_affected = self.connection.execute(
             r#"
             UPDATE code_indices SET 
-                name = ?2, base_path = ?3, updated_at = ?4,
-                total_files = ?5, total_symbols = ?6, index_version = ?7
+                name = ?2, base_path = ?3, updated_at = ?4, index_version = ?5
             WHERE id = ?1
             "#,
             params![
@@ -121,14 +171,12 @@ impl Repository {
                 index.name,
                 index.base_path,
                 index.updated_at.to_rfc3339(),
-                index.total_files,
-                index.total_symbols,
                 index.index_version
             ],
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
@@ -150,7 +198,7 @@ impl Repository {
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
@@ -164,7 +212,7 @@ impl Repository {
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
@@ -174,7 +222,7 @@ impl Repository {
 
     /// Creates a new file metadata entry
     pub fn create_file_metadata(&self, mut metadata: FileMetadata) -> Result<FileMetadata> {
-        metadata.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        metadata.validate().map_err(StorageError::Invalid)?;
         
         self.connection.execute(
             r#"
@@ -201,7 +249,7 @@ impl Repository {
 
     /// Retrieves file metadata by ID
     pub fn get_file_metadata(&self, id: i64) -> Result<Option<FileMetadata>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             r#"
             SELECT id, index_id, file_path, file_hash, last_modified, 
                    size_bytes, symbol_count, indexed_at, processing_state 
@@ -221,7 +269,7 @@ impl Repository {
 
     /// Retrieves file metadata by index and file path
     pub fn get_file_metadata_by_path(&self, index_id: &Uuid, file_path: &str) -> Result<Option<FileMetadata>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             r#"
             SELECT id, index_id, file_path, file_hash, last_modified, 
                    size_bytes, symbol_count, indexed_at, processing_state 
@@ -241,7 +289,7 @@ impl Repository {
 
     /// Lists file metadata for an index
     pub fn list_file_metadata(&self, index_id: &Uuid) -> Result<Vec<FileMetadata>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             r#"
             SELECT id, index_id, file_path, file_hash, last_modified, 
                    size_bytes, symbol_count, indexed_at, processing_state 
@@ -259,9 +307,9 @@ impl Repository {
 
     /// Updates file metadata
     pub fn update_file_metadata(&self, metadata: &FileMetadata) -> Result<()> {
-        metadata.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        metadata.validate().map_err(StorageError::Invalid)?;
         
-        let id = metadata.id.ok_or(rusqlite::Error::InvalidColumnName("File metadata ID is required".to_string()))?;
+        let id = metadata.id.ok_or(StorageError::Invalid("File metadata ID is required".to_string()))?;
         
         let rows_affected = self.connection.execute(
             r#"
@@ -282,7 +330,7 @@ impl Repository {
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
@@ -303,7 +351,7 @@ impl Repository {
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
@@ -317,7 +365,7 @@ impl Repository {
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
@@ -327,16 +375,15 @@ impl Repository {
 
     /// Creates a new code element
     pub fn create_code_element(&self, mut element: CodeElement) -> Result<CodeElement> {
-        element.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        element.validate().map_err(StorageError::Invalid)?;
         
-        self.connection.execute(
-            r#"
-            INSERT INTO code_elements (
-                index_id, symbol_name, symbol_type, file_path, line_number,
-                column_number, definition_hash, scope, access_modifier, 
-                is_declaration, signature
-            ) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11)
-            "#,
+        element.id = Some(self.insert_code_element(&element)?);
+        self.adjust_index_totals(&element.index_id.to_string(), 1, 0)?;
+        Ok(element)
+    }
+
+    fn insert_code_element(&self, element: &CodeElement) -> Result<i64> {
+        self.connection.prepare_cached(INSERT_CODE_ELEMENT)?.execute(
             params![
                 element.index_id.to_string(),
                 element.symbol_name,
@@ -348,17 +395,17 @@ impl Repository {
                 element.scope,
                 element.access_modifier.map(|a| a.as_str()),
                 element.is_declaration,
-                element.signature
+                element.signature,
+                Option::<&str>::None
             ],
         )?;
         
-        element.id = Some(self.connection.last_insert_rowid());
-        Ok(element)
+        Ok(self.connection.last_insert_rowid())
     }
 
     /// Retrieves a code element by ID
     pub fn get_code_element(&self, id: i64) -> Result<Option<CodeElement>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             r#"
             SELECT id, index_id, symbol_name, symbol_type, file_path, line_number,
                    column_number, definition_hash, scope, access_modifier, 
@@ -377,53 +424,237 @@ impl Repository {
         }
     }
 
-    /// Searches for code elements by symbol name pattern
+    /// Searches for code elements whose name contains `name_pattern` (case-insensitive)
     pub fn search_code_elements(&self, index_id: &Uuid, name_pattern: &str, symbol_types: Option<&[SymbolType]>) -> Result<Vec<CodeElement>> {
-        let mut query = String::from(
-            r#"
-            SELECT id, index_id, symbol_name, symbol_type, file_path, line_number,
-                   column_number, definition_hash, scope, access_modifier, 
-                   is_declaration, signature
-            FROM code_elements 
-            WHERE index_id = ?1 AND symbol_name LIKE ?2
-            "#
-        );
+        self.search_code_elements_limited(index_id, name_pattern, symbol_types, None)
+    }
+
+    /// Ranked substring search over symbol names: exact matches first, then prefix
+    /// matches, then the rest by FTS rank and name length. Patterns of three or more
+    /// characters go through the trigram index; shorter ones fall back to LIKE.
+    pub fn search_code_elements_limited(
+        &self,
+        index_id: &Uuid,
+        name_pattern: &str,
+        symbol_types: Option<&[SymbolType]>,
+        limit: Option<usize>,
+    ) -> Result<Vec<CodeElement>> {
+        let search = ElementSearch::new(name_pattern).with_types(symbol_types.unwrap_or_default());
+        let rows = self.search_code_element_rows(index_id, &search, None, limit)?;
+        Ok(rows.into_iter().map(|(element, _)| element).collect())
+    }
+
+    /// One page of `search_code_elements_limited` order, starting after `after`
+    pub fn search_code_elements_page(
+        &self,
+        index_id: &Uuid,
+        search: &ElementSearch,
+        after: Option<&Cursor>,
+        limit: usize,
+    ) -> Result<Page<CodeElement>> {
+        Ok(self.search_code_elements_keyed(index_id, search, after, limit)?.map(|(element, _)| element))
+    }
+
+    /// `search_code_elements_page` with the cursor resuming just after each element,
+    /// for callers that stop part way through a page
+    pub fn search_code_elements_keyed(
+        &self,
+        index_id: &Uuid,
+        search: &ElementSearch,
+        after: Option<&Cursor>,
+        limit: usize,
+    ) -> Result<Page<(CodeElement, Cursor)>> {
+        let rows = self.search_code_element_rows(index_id, search, after, Some(limit + 1))?;
+        let keyed = rows
+            .into_iter()
+            .map(|(element, rank)| {
+                let cursor = Cursor::new(SEARCH_CURSOR, vec![
+                    json!(rank.exact),
+                    json!(rank.prefix),
+                    json!(rank.text),
+                    json!(element.symbol_name.chars().count()),
+                    json!(element.symbol_name),
+                    json!(element.file_path),
+                    json!(element.id.unwrap_or_default()),
+                ]);
+                (element, cursor)
+            })
+            .collect();
+        Ok(Page::from_rows(keyed, limit, |(_, cursor)| cursor.clone()))
+    }
+
+    /// Number of code elements `search` matches
+    pub fn count_code_elements(&self, index_id: &Uuid, search: &ElementSearch) -> Result<usize> {
+        let (matches, params) = self.element_search_sql(index_id, search);
+        let param_refs: Vec<&dyn rusqlite::ToSql> = params.iter().map(|p| p.as_ref()).collect();
+        let count: i64 = self.connection
+            .prepare_cached(&format!("SELECT COUNT(*) FROM ({})", matches))?
+            .query_row(&param_refs[..], |row| row.get(0))?;
+        Ok(count as usize)
+    }
+
+    fn search_code_element_rows(
+        &self,
+        index_id: &Uuid,
+        search: &ElementSearch,
+        after: Option<&Cursor>,
+        limit: Option<usize>,
+    ) -> Result<Vec<(CodeElement, SearchRank)>> {
+        let (matches, mut params) = self.element_search_sql(index_id, search);
+        let mut query = format!("SELECT * FROM ({}) AS matches", matches);
+        
+        if let Some(cursor) = after {
+            let key = cursor.key_for(SEARCH_CURSOR, 7)?;
+            query.push_str(&format!(" WHERE ({}) > ({})", SEARCH_ORDER, placeholders(params.len() + 1, key.len())));
+            params.extend(Cursor::sql_params(key)?);
+        }
+        
+        query.push_str(&format!(" ORDER BY {}", SEARCH_ORDER));
+        if let Some(limit) = limit {
+            query.push_str(&format!(" LIMIT ?{}", params.len() + 1));
+            params.push(Box::new(limit as i64));
+        }
+        
+        let mut stmt = self.connection.prepare_cached(&query)?;
+        let param_refs: Vec<&dyn rusqlite::ToSql> = params.iter().map(|p| p.as_ref()).collect();
+        
+        let rows = stmt.query_map(&param_refs[..], |row| {
+            let rank = SearchRank { exact: row.get(12)?, prefix: row.get(13)?, text: row.get(14)? };
+            Ok((self.row_to_code_element(row)?, rank))
+        })?
+        .collect::<Result<Vec<_>, _>>()?;
+        
+        Ok(rows)
+    }
+
+    /// Matching rows with their rank columns; ?3 is the raw pattern and ?4 the prefix
+    fn element_search_sql(&self, index_id: &Uuid, search: &ElementSearch) -> (String, Vec<Box<dyn rusqlite::ToSql>>) {
+        let name_pattern = search.name_pattern.as_str();
+        let use_fts = name_pattern.chars().count() >= MIN_TRIGRAM_PATTERN_CHARS;
+        let escaped_pattern = escape_like(name_pattern);
+        let index_filter = if search.overlay_base.is_some() { overlay_index_filter("ce", 1, 5) } else { "ce.index_id = ?1".to_string() };
+        
+        let mut query = if use_fts {
+            format!(
+                r#"
+                SELECT ce.id, ce.index_id, ce.symbol_name, ce.symbol_type, ce.file_path, ce.line_number,
+                       ce.column_number, ce.definition_hash, ce.scope, ce.access_modifier, 
+                       ce.is_declaration, ce.signature,
+                       NOT (ce.symbol_name = ?3 COLLATE NOCASE) AS k_exact,
+                       NOT (ce.symbol_name LIKE ?4 ESCAPE '\') AS k_prefix,
+                       code_elements_fts.rank AS k_rank
+                FROM code_elements_fts
+                JOIN code_elements ce ON ce.id = code_elements_fts.rowid
+                WHERE {} AND code_elements_fts MATCH ?2
+                "#,
+                index_filter
+            )
+        } else {
+            format!(
+                r#"
+                SELECT ce.id, ce.index_id, ce.symbol_name, ce.symbol_type, ce.file_path, ce.line_number,
+                       ce.column_number, ce.definition_hash, ce.scope, ce.access_modifier, 
+                       ce.is_declaration, ce.signature,
+                       NOT (ce.symbol_name = ?3 COLLATE NOCASE) AS k_exact,
+                       NOT (ce.symbol_name LIKE ?4 ESCAPE '\') AS k_prefix,
+                       0.0 AS k_rank
+                FROM code_elements ce
+                WHERE {} AND ce.symbol_name LIKE ?2 ESCAPE '\'
+                "#,
+                index_filter
+            )
+        };
         
         let mut params: Vec<Box<dyn rusqlite::ToSql>> = vec![
             Box::new(index_id.to_string()),
-            Box::new(format!("%{}%", name_pattern)),
+            if use_fts {
+                Box::new(format!("symbol_name : \"{}\"", name_pattern.replace('"', "\"\"")))
+            } else {
+                Box::new(format!("%{}%", escaped_pattern))
+            },
+            Box::new(name_pattern.to_string()),
+            Box::new(format!("{}%", escaped_pattern)),
         ];
+        if let Some(base) = &search.overlay_base {
+            params.push(Box::new(base.to_string()));
+        }
         
-        if let Some(types) = symbol_types {
-            if !types.is_empty() {
-                query.push_str(" AND symbol_type IN (");
-                for (i, symbol_type) in types.iter().enumerate() {
-                    if i > 0 {
-                        query.push_str(", ");
-                    }
-                    query.push_str(&format!("?{}", params.len() + 1));
-                    params.push(Box::new(symbol_type.as_str().to_string()));
+        if !search.symbol_types.is_empty() {
+            query.push_str(" AND ce.symbol_type IN (");
+            for (i, symbol_type) in search.symbol_types.iter().enumerate() {
+                if i > 0 {
+                    query.push_str(", ");
                 }
-                query.push(')');
+                query.push_str(&format!("?{}", params.len() + 1));
+                params.push(Box::new(symbol_type.as_str().to_string()));
             }
+            query.push(')');
         }
         
-        query.push_str(" ORDER BY symbol_name, file_path");
+        if search.exact {
+            query.push_str(" AND ce.symbol_name = ?3 COLLATE NOCASE");
+        }
         
-        let mut stmt = self.connection.prepare(&query)?;
-        let param_refs: Vec<&dyn rusqlite::ToSql> = params.iter().map(|p| p.as_ref()).collect();
+        if let Some(file_path) = &search.file_path_contains {
+            query.push_str(&format!(" AND ce.file_path LIKE ?{} ESCAPE '\\'", params.len() + 1));
+            params.push(Box::new(format!("%{}%", escape_like(file_path))));
+        }
         
-        let elements = stmt.query_map(&param_refs[..], |row| {
-            Ok(self.row_to_code_element(row)?)
+        if let Some(scope) = &search.scope {
+            query.push_str(&format!(" AND ce.scope = ?{}", params.len() + 1));
+            params.push(Box::new(scope.clone()));
+        }
+        
+        (query, params)
+    }
+
+    /// Loads code elements by ID, in the order given; unknown IDs are skipped
+    pub fn get_code_elements_by_ids(&self, ids: &[i64]) -> Result<Vec<CodeElement>> {
+        if ids.is_empty() {
+            return Ok(Vec::new());
+        }
+        
+        let placeholders = vec!["?"; ids.len()].join(", ");
+        let mut stmt = self.connection.prepare(&format!(
+            r#"
+            SELECT id, index_id, symbol_name, symbol_type, file_path, line_number,
+                   column_number, definition_hash, scope, access_modifier, 
+                   is_declaration, signature
+            FROM code_elements WHERE id IN ({})
+            "#,
+            placeholders
+        ))?;
+        
+        let mut by_id: HashMap<i64, CodeElement> = stmt.query_map(rusqlite::params_from_iter(ids), |row| {
+            let element = self.row_to_code_element(row)?;
+            Ok((element.id.unwrap_or_default(), element))
+        })?
+        .collect::<Result<HashMap<_, _>, _>>()?;
+        
+        Ok(ids.iter().filter_map(|id| by_id.remove(id)).collect())
+    }
+
+    /// Lists `(id, name, type, file)` for every code element of an index, the minimum
+    /// needed to build an in-memory symbol index
+    pub fn list_symbol_names(&self, index_id: &Uuid) -> Result<Vec<(i64, String, SymbolType, String)>> {
+        let mut stmt = self.connection.prepare_cached(
+            "SELECT id, symbol_name, symbol_type, file_path FROM code_elements WHERE index_id = ?1"
+        )?;
+        
+        let names = stmt.query_map([index_id.to_string()], |row| {
+            let symbol_type_str: String = row.get(2)?;
+            let symbol_type = parse_symbol_type(&symbol_type_str)
+                .ok_or_else(|| rusqlite::Error::InvalidColumnType(2, "Invalid symbol type".to_string(), rusqlite::types::Type::Text))?;
+            Ok((row.get(0)?, row.get(1)?, symbol_type, row.get(3)?))
         })?
         .collect::<Result<Vec<_>, _>>()?;
         
-        Ok(elements)
+        Ok(names)
     }
 
     /// Lists code elements for a file
     pub fn list_code_elements_by_file(&self, index_id: &Uuid, file_path: &str) -> Result<Vec<CodeElement>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             r#"
             SELECT id, index_id, symbol_name, symbol_type, file_path, line_number,
                    column_number, definition_hash, scope, access_modifier, 
@@ -442,11 +673,204 @@ impl Repository {
         Ok(elements)
     }
 
+    /// Every code element of an index, grouped by file and in line order within each
+    pub fn list_code_elements(&self, index_id: &Uuid) -> Result<Vec<CodeElement>> {
+        let mut stmt = self.connection.prepare_cached(
+            r#"
+            SELECT id, index_id, symbol_name, symbol_type, file_path, line_number,
+                   column_number, definition_hash, scope, access_modifier, 
+                   is_declaration, signature
+            FROM code_elements 
+            WHERE index_id = ?1
+            ORDER BY file_path, line_number, column_number, id
+            "#
+        )?;
+        
+        let elements = stmt.query_map([index_id.to_string()], |row| {
+            Ok(self.row_to_code_element(row)?)
+        })?
+        .collect::<Result<Vec<_>, _>>()?;
+        
+        Ok(elements)
+    }
+
+    /// One page of a file's code elements in line order, starting after `after`
+    pub fn list_code_elements_by_file_page(
+        &self,
+        index_id: &Uuid,
+        file_path: &str,
+        after: Option<&Cursor>,
+        limit: usize,
+    ) -> Result<Page<CodeElement>> {
+        let (line, column, id) = match after {
+            Some(cursor) => {
+                let key = cursor.key_for(FILE_SYMBOLS_CURSOR, 3)?;
+                (key[0].as_i64(), key[1].as_i64(), key[2].as_i64())
+            }
+            None => (Some(-1), Some(-1), Some(-1)),
+        };
+        let (Some(line), Some(column), Some(id)) = (line, column, id) else {
+            return Err(StorageError::InvalidArgument("Invalid cursor key".to_string()));
+        };
+        
+        let mut stmt = self.connection.prepare_cached(
+            r#"
+            SELECT id, index_id, symbol_name, symbol_type, file_path, line_number,
+                   column_number, definition_hash, scope, access_modifier, 
+                   is_declaration, signature
+            FROM code_elements 
+            WHERE index_id = ?1 AND file_path = ?2 AND (line_number, column_number, id) > (?3, ?4, ?5)
+            ORDER BY line_number, column_number, id
+            LIMIT ?6
+            "#
+        )?;
+        
+        let elements = stmt.query_map(params![index_id.to_string(), file_path, line, column, id, limit as i64 + 1], |row| {
+            Ok(self.row_to_code_element(row)?)
+        })?
+        .collect::<Result<Vec<_>, _>>()?;
+        
+        Ok(Page::from_rows(elements, limit, |element| {
+            Cursor::new(FILE_SYMBOLS_CURSOR, vec![
+                json!(element.line_number),
+                json!(element.column_number),
+                json!(element.id.unwrap_or_default()),
+            ])
+        }))
+    }
+
+    /// Number of code elements in a file
+    pub fn count_code_elements_by_file(&self, index_id: &Uuid, file_path: &str) -> Result<usize> {
+        let count: i64 = self.connection.prepare_cached(
+            "SELECT COUNT(*) FROM code_elements WHERE index_id = ?1 AND file_path = ?2"
+        )?
+        .query_row(params![index_id.to_string(), file_path], |row| row.get(0))?;
+        Ok(count as usize)
+    }
+
+    /// One page of references to the symbols named `symbol_name`: their declarations
+    /// first when `include_declarations` is set, then the symbol of each relationship
+    /// pointing at them. An overlay passes its base, whose rows count in the files the
+    /// overlay does not shadow.
+    pub fn find_references_page(
+        &self,
+        index_id: &Uuid,
+        overlay_base: Option<&Uuid>,
+        symbol_name: &str,
+        symbol_types: &[SymbolType],
+        include_declarations: bool,
+        after: Option<&Cursor>,
+        limit: usize,
+    ) -> Result<Page<CodeElement>> {
+        let (references, mut params) = self.references_sql(index_id, overlay_base, symbol_name, symbol_types, include_declarations);
+        let mut query = format!("SELECT * FROM ({}) AS refs", references);
+        
+        if let Some(cursor) = after {
+            let key = cursor.key_for(REFERENCES_CURSOR, 2)?;
+            query.push_str(&format!(" WHERE (k_group, k_id) > ({})", placeholders(params.len() + 1, key.len())));
+            params.extend(Cursor::sql_params(key)?);
+        }
+        query.push_str(&format!(" ORDER BY k_group, k_id LIMIT ?{}", params.len() + 1));
+        params.push(Box::new(limit as i64 + 1));
+        
+        let mut stmt = self.connection.prepare_cached(&query)?;
+        let param_refs: Vec<&dyn rusqlite::ToSql> = params.iter().map(|p| p.as_ref()).collect();
+        
+        let rows = stmt.query_map(&param_refs[..], |row| {
+            let key: (i64, i64) = (row.get(12)?, row.get(13)?);
+            Ok((self.row_to_code_element(row)?, key))
+        })?
+        .collect::<Result<Vec<_>, _>>()?;
+        
+        Ok(Page::from_rows(rows, limit, |(_, (group, id))| Cursor::new(REFERENCES_CURSOR, vec![json!(group), json!(id)]))
+            .map(|(element, _)| element))
+    }
+
+    /// Number of rows `find_references_page` pages through
+    pub fn count_references(
+        &self,
+        index_id: &Uuid,
+        overlay_base: Option<&Uuid>,
+        symbol_name: &str,
+        symbol_types: &[SymbolType],
+        include_declarations: bool,
+    ) -> Result<usize> {
+        let (references, params) = self.references_sql(index_id, overlay_base, symbol_name, symbol_types, include_declarations);
+        let param_refs: Vec<&dyn rusqlite::ToSql> = params.iter().map(|p| p.as_ref()).collect();
+        let count: i64 = self.connection
+            .prepare_cached(&format!("SELECT COUNT(*) FROM ({})", references))?
+            .query_row(&param_refs[..], |row| row.get(0))?;
+        Ok(count as usize)
+    }
+
+    /// Reference rows keyed by `(k_group, k_id)`: group 0 holds declarations keyed by
+    /// element id, group 1 referencing symbols keyed by relationship id. Over an
+    /// overlay ?3 is the base, and both ends of a relationship must be visible.
+    fn references_sql(
+        &self,
+        index_id: &Uuid,
+        overlay_base: Option<&Uuid>,
+        symbol_name: &str,
+        symbol_types: &[SymbolType],
+        include_declarations: bool,
+    ) -> (String, Vec<Box<dyn rusqlite::ToSql>>) {
+        let mut params: Vec<Box<dyn rusqlite::ToSql>> = vec![
+            Box::new(index_id.to_string()),
+            Box::new(symbol_name.to_string()),
+        ];
+        let (target_filter, source_filter) = match overlay_base {
+            Some(base) => {
+                params.push(Box::new(base.to_string()));
+                (overlay_index_filter("target", 1, 3), format!(" AND {}", overlay_index_filter("ce", 1, 3)))
+            }
+            None => ("target.index_id = ?1".to_string(), String::new()),
+        };
+        
+        let type_filter = if symbol_types.is_empty() {
+            String::new()
+        } else {
+            let first = params.len() + 1;
+            params.extend(symbol_types.iter().map(|t| Box::new(t.as_str().to_string()) as Box<dyn rusqlite::ToSql>));
+            format!(" AND target.symbol_type IN ({})", placeholders(first, symbol_types.len()))
+        };
+        
+        let mut query = String::new();
+        if include_declarations {
+            query.push_str(&format!(
+                r#"
+                SELECT target.id, target.index_id, target.symbol_name, target.symbol_type, target.file_path, target.line_number,
+                       target.column_number, target.definition_hash, target.scope, target.access_modifier,
+                       target.is_declaration, target.signature,
+                       0 AS k_group, target.id AS k_id
+                FROM code_elements target
+                WHERE {} AND target.symbol_name = ?2 AND target.is_declaration = 1{}
+                UNION ALL
+                "#,
+                target_filter, type_filter
+            ));
+        }
+        query.push_str(&format!(
+            r#"
+            SELECT ce.id, ce.index_id, ce.symbol_name, ce.symbol_type, ce.file_path, ce.line_number,
+                   ce.column_number, ce.definition_hash, ce.scope, ce.access_modifier,
+                   ce.is_declaration, ce.signature,
+                   1 AS k_group, sr.id AS k_id
+            FROM code_elements target
+            JOIN symbol_relationships sr ON sr.to_symbol_id = target.id
+            JOIN code_elements ce ON ce.id = sr.from_symbol_id
+            WHERE {} AND target.symbol_name = ?2{}{}
+            "#,
+            target_filter, type_filter, source_filter
+        ));
+        
+        (query, params)
+    }
+
     /// Updates a code element
     pub fn update_code_element(&self, element: &CodeElement) -> Result<()> {
-        element.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        element.validate().map_err(StorageError::Invalid)?;
         
-        let id = element.id.ok_or(rusqlite::Error::InvalidColumnName("Code element ID is required".to_string()))?;
+        let id = element.id.ok_or(StorageError::Invalid("Code element ID is required".to_string()))?;
         
         let rows_affected = self.connection.execute(
             r#"
@@ -472,7 +896,7 @@ impl Repository {
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
@@ -480,41 +904,38 @@ impl Repository {
 
     /// Deletes code elements for a file (used during re-indexing)
     pub fn delete_code_elements_by_file(&self, index_id: &Uuid, file_path: &str) -> Result<()> {
-        self.connection.execute(
-            "DELETE FROM code_elements WHERE index_id = ?1 AND file_path = ?2",
-            params![index_id.to_string(), file_path],
-        )?;
-        
-        Ok(())
+        self.delete_file_elements(&index_id.to_string(), file_path)
     }
 
     /// Deletes a code element by ID
     pub fn delete_code_element(&self, id: i64) -> Result<()> {
-        let rows_affected = self.connection.execute(
+        let index_id: Option<String> = self.connection
+            .prepare_cached("SELECT index_id FROM code_elements WHERE id = ?1")?
+            .query_row([id], |row| row.get(0))
+            .optional()?;
+        let Some(index_id) = index_id else {
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
+        };
+        
+        let relationships = self.connection.execute(
+            "DELETE FROM symbol_relationships WHERE from_symbol_id = ?1 OR to_symbol_id = ?1",
+            [id],
+        )?;
+        let elements = self.connection.execute(
             "DELETE FROM code_elements WHERE id = ?1",
             [id],
         )?;
         
-        if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
-        }
-        
-        Ok(())
+        self.adjust_index_totals(&index_id, -(elements as i64), -(relationships as i64))
     }
 
     // === Symbol Relationship CRUD Operations ===
 
     /// Creates a new symbol relationship
     pub fn create_symbol_relationship(&self, mut relationship: SymbolRelationship) -> Result<SymbolRelationship> {
-        relationship.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        relationship.validate().map_err(StorageError::Invalid)?;
         
-        self.connection.execute(
-            r#"
-            INSERT INTO symbol_relationships (
-                from_symbol_id, to_symbol_id, relationship_type, 
-                file_path, line_number
-            ) VALUES (?1, ?2, ?3, ?4, ?5)
-            "#,
+        self.connection.prepare_cached(INSERT_SYMBOL_RELATIONSHIP)?.execute(
             params![
                 relationship.from_symbol_id,
                 relationship.to_symbol_id,
@@ -525,11 +946,28 @@ impl Repository {
         )?;
         
         relationship.id = Some(self.connection.last_insert_rowid());
+        self.adjust_relationship_totals("id = ?1", relationship.id, 1)?;
         Ok(relationship)
     }
 
     /// Queries symbol relationships using the relationship query builder
     pub fn query_symbol_relationships(&self, query: &RelationshipQuery) -> Result<Vec<SymbolRelationship>> {
+        self.query_symbol_relationship_rows(query, None, None)
+    }
+
+    /// One page of `query_symbol_relationships`, starting after `after`
+    pub fn query_symbol_relationships_page(&self, query: &RelationshipQuery, after: Option<&Cursor>, limit: usize) -> Result<Page<SymbolRelationship>> {
+        let relationships = self.query_symbol_relationship_rows(query, after, Some(limit + 1))?;
+        Ok(Page::from_rows(relationships, limit, |relationship| {
+            Cursor::new(RELATIONSHIPS_CURSOR, vec![
+                json!(relationship.from_symbol_id),
+                json!(relationship.to_symbol_id),
+                json!(relationship.id.unwrap_or_default()),
+            ])
+        }))
+    }
+
+    fn query_symbol_relationship_rows(&self, query: &RelationshipQuery, after: Option<&Cursor>, limit: Option<usize>) -> Result<Vec<SymbolRelationship>> {
         let mut sql = String::from(
             r#"
             SELECT id, from_symbol_id, to_symbol_id, relationship_type, file_path, line_number
@@ -566,7 +1004,17 @@ impl Repository {
             params.push(Box::new(format!("%{}%", pattern)));
         }
         
-        sql.push_str(" ORDER BY from_symbol_id, to_symbol_id");
+        if let Some(cursor) = after {
+            let key = cursor.key_for(RELATIONSHIPS_CURSOR, 3)?;
+            sql.push_str(&format!(" AND (from_symbol_id, to_symbol_id, id) > ({})", placeholders(params.len() + 1, key.len())));
+            params.extend(Cursor::sql_params(key)?);
+        }
+        
+        sql.push_str(" ORDER BY from_symbol_id, to_symbol_id, id");
+        if let Some(limit) = limit {
+            sql.push_str(&format!(" LIMIT ?{}", params.len() + 1));
+            params.push(Box::new(limit as i64));
+        }
         
         let mut stmt = self.connection.prepare(&sql)?;
         let param_refs: Vec<&dyn rusqlite::ToSql> = params.iter().map(|p| p.as_ref()).collect();
@@ -576,60 +1024,743 @@ impl Repository {
         })?
         .collect::<Result<Vec<_>, _>>()?;
         
-        Ok(relationships)
-    }
-
-    /// Lists all relationships for a symbol (both incoming and outgoing)
-    pub fn get_symbol_relationships(&self, symbol_id: i64) -> Result<(Vec<SymbolRelationship>, Vec<SymbolRelationship>)> {
-        // Outgoing relationships (from this symbol)
-        let outgoing = self.query_symbol_relationships(
-            &RelationshipQuery::new().from_symbol(symbol_id)
+        Ok(relationships)
+    }
+
+    /// Lists all relationships for a symbol (both incoming and outgoing)
+    pub fn get_symbol_relationships(&self, symbol_id: i64) -> Result<(Vec<SymbolRelationship>, Vec<SymbolRelationship>)> {
+        // Outgoing relationships (from this symbol)
+        let outgoing = self.query_symbol_relationships(
+            &RelationshipQuery::new().from_symbol(symbol_id)
+        )?;
+        
+        // Incoming relationships (to this symbol)
+        let incoming = self.query_symbol_relationships(
+            &RelationshipQuery::new().to_symbol(symbol_id)
+        )?;
+        
+        Ok((outgoing, incoming))
+    }
+
+    /// Deletes symbol relationships for a file (used during re-indexing)
+    pub fn delete_symbol_relationships_by_file(&self, file_path: &str) -> Result<()> {
+        self.adjust_relationship_totals("file_path = ?1", file_path, -1)?;
+        self.connection.execute(
+            "DELETE FROM symbol_relationships WHERE file_path = ?1",
+            [file_path],
+        )?;
+        
+        Ok(())
+    }
+
+    /// Deletes a symbol relationship by ID
+    pub fn delete_symbol_relationship(&self, id: i64) -> Result<()> {
+        self.adjust_relationship_totals("id = ?1", id, -1)?;
+        let rows_affected = self.connection.execute(
+            "DELETE FROM symbol_relationships WHERE id = ?1",
+            [id],
+        )?;
+        
+        if rows_affected == 0 {
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
+        }
+        
+        Ok(())
+    }
+
+    // === Bulk Ingest Operations ===
+
+    /// Atomically replaces everything stored for one file
+    pub fn replace_file(&self, batch: &FileBatch) -> Result<FileIngestResult> {
+        let mut results = self.replace_files(std::slice::from_ref(batch))?;
+        Ok(results.remove(0))
+    }
+
+    /// Replaces a file only while its stored version still has `expected_hash`, as a
+    /// background writer must not overwrite a newer version stored since it read the
+    /// file. Returns `None` and writes nothing otherwise.
+    pub fn replace_file_if_hash(&self, batch: &FileBatch, expected_hash: &str) -> Result<Option<FileIngestResult>> {
+        batch.validate().map_err(StorageError::Invalid)?;
+        
+        metrics::time(Stage::DbWrite, || {
+            let transaction = self.connection.unchecked_transaction()?;
+            
+            let stored: Option<String> = self.connection.prepare_cached(
+                "SELECT file_hash FROM file_metadata WHERE index_id = ?1 AND file_path = ?2"
+            )?.query_row(params![batch.metadata.index_id.to_string(), batch.metadata.file_path], |row| row.get(0)).optional()?;
+            if stored.as_deref() != Some(expected_hash) {
+                return Ok(None);
+            }
+            
+            let result = self.write_file_batch(batch)?;
+            transaction.commit()?;
+            Ok(Some(result))
+        })
+    }
+
+    /// Replaces the stored elements and relationships of several files in one transaction.
+    /// Each file's old rows are deleted and the new ones inserted before commit, so readers
+    /// see either the previous or the new version of a file, never a partial one.
+    pub fn replace_files(&self, batches: &[FileBatch]) -> Result<Vec<FileIngestResult>> {
+        for batch in batches {
+            batch.validate().map_err(StorageError::Invalid)?;
+        }
+        
+        metrics::time(Stage::DbWrite, || {
+            // Dropping the transaction without commit rolls back every file in the group.
+            let transaction = self.connection.unchecked_transaction()?;
+            
+            let mut results = Vec::with_capacity(batches.len());
+            for batch in batches {
+                results.push(self.write_file_batch(batch)?);
+            }
+            
+            transaction.commit()?;
+            Ok(results)
+        })
+    }
+
+    /// Removes a deleted file's elements, relationships, includes and metadata in one transaction.
+    /// Returns false if nothing was stored for the file.
+    pub fn remove_file(&self, index_id: &Uuid, file_path: &str) -> Result<bool> {
+        let transaction = self.connection.unchecked_transaction()?;
+        
+        let index_id = index_id.to_string();
+        self.delete_file_contents(&index_id, file_path)?;
+        let removed = self.connection.prepare_cached(
+            "DELETE FROM file_metadata WHERE index_id = ?1 AND file_path = ?2"
+        )?.execute(params![index_id, file_path])?;
+        
+        transaction.commit()?;
+        Ok(removed > 0)
+    }
+
+    fn delete_file_contents(&self, index_id: &str, file_path: &str) -> Result<()> {
+        // Relationships recorded in this file between symbols defined elsewhere; those of
+        // the file's own elements go with them in `delete_file_elements`.
+        let relationships = self.connection.prepare_cached(
+            r#"
+            DELETE FROM symbol_relationships 
+            WHERE file_path = ?2 
+              AND from_symbol_id IN (SELECT id FROM code_elements WHERE index_id = ?1)
+            "#
+        )?.execute(params![index_id, file_path])?;
+        self.adjust_index_totals(index_id, 0, -(relationships as i64))?;
+        
+        self.delete_file_elements(index_id, file_path)?;
+        
+        self.connection.prepare_cached(
+            "DELETE FROM symbol_edges WHERE index_id = ?1 AND recorded_by = ?2"
+        )?.execute(params![index_id, file_path])?;
+        
+        self.connection.prepare_cached(
+            "DELETE FROM file_dependencies WHERE index_id = ?1 AND file_path = ?2"
+        )?.execute(params![index_id, file_path])?;
+        
+        // A file stored in or dropped from an overlay no longer hides a deleted base file.
+        self.connection.prepare_cached(
+            "DELETE FROM overlay_removed_files WHERE index_id = ?1 AND file_path = ?2"
+        )?.execute(params![index_id, file_path])?;
+        
+        Ok(())
+    }
+
+    /// Deletes a file's elements and every relationship from or to them. The
+    /// relationships are deleted first rather than through ON DELETE CASCADE, so
+    /// they can be taken off the index totals.
+    fn delete_file_elements(&self, index_id: &str, file_path: &str) -> Result<()> {
+        let relationships = self.connection.prepare_cached(
+            r#"
+            DELETE FROM symbol_relationships 
+            WHERE from_symbol_id IN (SELECT id FROM code_elements WHERE index_id = ?1 AND file_path = ?2)
+               OR to_symbol_id IN (SELECT id FROM code_elements WHERE index_id = ?1 AND file_path = ?2)
+            "#
+        )?.execute(params![index_id, file_path])?;
+        
+        let elements = self.connection.prepare_cached(
+            "DELETE FROM code_elements WHERE index_id = ?1 AND file_path = ?2"
+        )?.execute(params![index_id, file_path])?;
+        
+        self.adjust_index_totals(index_id, -(elements as i64), -(relationships as i64))
+    }
+
+    /// Adds to an index's element and relationship counters and advances its write
+    /// generation. Every write that inserts or deletes those rows calls this in the same
+    /// transaction, which is what lets `get_index_statistics` read counters instead of
+    /// counting rows, and `get_write_generation` tell that the contents changed.
+    fn adjust_index_totals(&self, index_id: &str, elements: i64, relationships: i64) -> Result<()> {
+        self.connection.prepare_cached(
+            r#"
+            UPDATE code_indices 
+            SET total_elements = total_elements + ?2, total_relationships = total_relationships + ?3,
+                write_generation = write_generation + 1
+            WHERE id = ?1
+            "#
+        )?.execute(params![index_id, elements, relationships])?;
+        Ok(())
+    }
+
+    /// Counter advanced by every write to the contents of `index_id`, including those
+    /// that leave its Merkle root alone; 0 if the index does not exist
+    pub fn get_write_generation(&self, index_id: &Uuid) -> Result<u64> {
+        let generation: Option<i64> = self.connection
+            .prepare_cached("SELECT write_generation FROM code_indices WHERE id = ?1")?
+            .query_row([index_id.to_string()], |row| row.get(0))
+            .optional()?;
+        Ok(generation.unwrap_or(0) as u64)
+    }
+
+    /// Id and write generation of the index named `name`, in one lookup on its name
+    pub fn get_index_revision(&self, name: &str) -> Result<Option<(Uuid, u64)>> {
+        let revision: Option<(String, i64)> = self.connection
+            .prepare_cached("SELECT id, write_generation FROM code_indices WHERE name = ?1")?
+            .query_row([name], |row| Ok((row.get(0)?, row.get(1)?)))
+            .optional()?;
+        revision.map(|(id, generation)| {
+            let id = Uuid::parse_str(&id).map_err(|_| rusqlite::Error::InvalidColumnType(0, "Invalid UUID".to_string(), rusqlite::types::Type::Text))?;
+            Ok((id, generation as u64))
+        })
+        .transpose()
+    }
+
+    /// Adds `sign` times the number of relationships matching `filter` to the
+    /// relationship counter of each index they belong to, i.e. that of their source
+    fn adjust_relationship_totals(&self, filter: &str, param: impl rusqlite::ToSql, sign: i64) -> Result<()> {
+        self.connection.prepare_cached(&format!(
+            r#"
+            UPDATE code_indices SET total_relationships = total_relationships + ?2 * (
+                SELECT COUNT(*) FROM symbol_relationships sr
+                JOIN code_elements ce ON ce.id = sr.from_symbol_id
+                WHERE ce.index_id = code_indices.id AND sr.{}
+            ), write_generation = write_generation + 1
+            WHERE id IN (
+                SELECT ce.index_id FROM symbol_relationships sr
+                JOIN code_elements ce ON ce.id = sr.from_symbol_id
+                WHERE sr.{}
+            )
+            "#,
+            filter, filter
+        ))?.execute(params![param, sign])?;
+        Ok(())
+    }
+
+    /// Turns the edges touching `file_path` into `symbol_relationships` rows: the edges
+    /// the file recorded, and edges recorded elsewhere from or to the symbols it
+    /// declares, whose rows went with its previous elements. Returns the rows added.
+    fn link_symbol_edges(&self, index_id: &str, file_path: &str) -> Result<usize> {
+        Ok(self.connection.prepare_cached(
+            r#"
+            INSERT OR IGNORE INTO symbol_relationships (
+                from_symbol_id, to_symbol_id, relationship_type, 
+                file_path, line_number
+            )
+            SELECT source.id, target.id, edge.relationship_type, edge.file_path, edge.line_number
+            FROM symbol_edges edge
+            JOIN code_elements source ON source.index_id = edge.index_id AND (
+                source.usr = edge.from_usr OR (
+                    source.file_path = edge.from_file AND source.line_number = edge.from_line 
+                    AND source.symbol_name = edge.from_name
+                )
+            )
+            JOIN code_elements target ON target.index_id = edge.index_id AND (
+                target.usr = edge.to_usr OR (
+                    target.file_path = edge.to_file AND target.line_number = edge.to_line 
+                    AND target.symbol_name = edge.to_name
+                )
+            )
+            WHERE source.id != target.id AND edge.id IN (
+                SELECT id FROM symbol_edges WHERE index_id = ?1 AND recorded_by = ?2
+                UNION
+                SELECT id FROM symbol_edges WHERE index_id = ?1 AND (from_file = ?2 OR to_file = ?2)
+                UNION
+                SELECT e.id FROM code_elements ce
+                JOIN symbol_edges e ON e.index_id = ce.index_id AND (e.from_usr = ce.usr OR e.to_usr = ce.usr)
+                WHERE ce.index_id = ?1 AND ce.file_path = ?2 AND ce.usr IS NOT NULL
+            )
+            "#
+        )?.execute(params![index_id, file_path])?)
+    }
+
+    /// Every relationship between an index's elements as `(from, to, type)`, for
+    /// building the in-memory `SymbolGraph`. An overlay passes its base, whose
+    /// relationships count when both of their ends are in files the overlay does not
+    /// shadow.
+    pub fn list_symbol_graph_edges(&self, index_id: &Uuid, overlay_base: Option<&Uuid>) -> Result<Vec<(i64, i64, RelationshipType)>> {
+        let mut params: Vec<Box<dyn rusqlite::ToSql>> = vec![Box::new(index_id.to_string())];
+        let query = match overlay_base {
+            Some(base) => {
+                params.push(Box::new(base.to_string()));
+                format!(
+                    r#"
+                    SELECT sr.from_symbol_id, sr.to_symbol_id, sr.relationship_type
+                    FROM symbol_relationships sr
+                    JOIN code_elements ce ON ce.id = sr.from_symbol_id
+                    JOIN code_elements target ON target.id = sr.to_symbol_id
+                    WHERE {} AND {}
+                    "#,
+                    overlay_index_filter("ce", 1, 2),
+                    overlay_index_filter("target", 1, 2)
+                )
+            }
+            None => r#"
+                SELECT sr.from_symbol_id, sr.to_symbol_id, sr.relationship_type
+                FROM symbol_relationships sr
+                JOIN code_elements ce ON ce.id = sr.from_symbol_id
+                WHERE ce.index_id = ?1
+                "#.to_string(),
+        };
+        
+        let mut stmt = self.connection.prepare_cached(&query)?;
+        let param_refs: Vec<&dyn rusqlite::ToSql> = params.iter().map(|p| p.as_ref()).collect();
+        let edges = stmt.query_map(&param_refs[..], |row| {
+            let relationship_type: String = row.get(2)?;
+            let relationship_type = RelationshipType::parse(&relationship_type)
+                .ok_or_else(|| rusqlite::Error::InvalidColumnType(2, "Invalid relationship type".to_string(), rusqlite::types::Type::Text))?;
+            Ok((row.get(0)?, row.get(1)?, relationship_type))
+        })?;
+        Ok(edges.collect::<rusqlite::Result<_>>()?)
+    }
+
+    /// Ids of the elements named exactly `symbol_name`, optionally of the given types.
+    /// An overlay passes its base, whose elements count in the files it does not shadow.
+    pub fn code_element_ids_by_name(
+        &self,
+        index_id: &Uuid,
+        overlay_base: Option<&Uuid>,
+        symbol_name: &str,
+        symbol_types: &[SymbolType],
+    ) -> Result<Vec<i64>> {
+        let mut params: Vec<Box<dyn rusqlite::ToSql>> = vec![
+            Box::new(index_id.to_string()),
+            Box::new(symbol_name.to_string()),
+        ];
+        
+        let index_filter = match overlay_base {
+            Some(base) => {
+                params.push(Box::new(base.to_string()));
+                overlay_index_filter("ce", 1, 3)
+            }
+            None => "ce.index_id = ?1".to_string(),
+        };
+        let mut query = format!("SELECT ce.id FROM code_elements ce WHERE {} AND ce.symbol_name = ?2", index_filter);
+        if !symbol_types.is_empty() {
+            query.push_str(&format!(" AND ce.symbol_type IN ({})", placeholders(params.len() + 1, symbol_types.len())));
+            params.extend(symbol_types.iter().map(|t| Box::new(t.as_str().to_string()) as Box<dyn rusqlite::ToSql>));
+        }
+        query.push_str(" ORDER BY ce.id");
+        
+        let mut stmt = self.connection.prepare_cached(&query)?;
+        let param_refs: Vec<&dyn rusqlite::ToSql> = params.iter().map(|p| p.as_ref()).collect();
+        let ids = stmt.query_map(&param_refs[..], |row| row.get(0))?;
+        Ok(ids.collect::<rusqlite::Result<_>>()?)
+    }
+
+    /// Every `(file, included file)` edge of an index's include graph
+    pub fn list_file_dependencies(&self, index_id: &Uuid) -> Result<Vec<(String, String)>> {
+        let mut stmt = self.connection.prepare_cached(
+            "SELECT file_path, included_path FROM file_dependencies WHERE index_id = ?1"
+        )?;
+        
+        let edges = stmt.query_map([index_id.to_string()], |row| Ok((row.get(0)?, row.get(1)?)))?;
+        Ok(edges.collect::<rusqlite::Result<_>>()?)
+    }
+
+    /// Metadata of an index's files whose stored symbols came from `tier`
+    pub fn list_files_by_tier(&self, index_id: &Uuid, tier: ExtractionTier) -> Result<Vec<FileMetadata>> {
+        let mut stmt = self.connection.prepare_cached(
+            r#"
+            SELECT id, index_id, file_path, file_hash, last_modified, 
+                   size_bytes, symbol_count, indexed_at, processing_state 
+            FROM file_metadata WHERE index_id = ?1 AND extraction_tier = ?2 ORDER BY file_path
+            "#
+        )?;
+        
+        let files = stmt.query_map(params![index_id.to_string(), tier.as_str()], |row| self.row_to_file_metadata(row))?;
+        Ok(files.collect::<rusqlite::Result<_>>()?)
+    }
+
+    fn write_file_batch(&self, batch: &FileBatch) -> Result<FileIngestResult> {
+        let index_id = batch.metadata.index_id.to_string();
+        let file_path = batch.metadata.file_path.as_str();
+        
+        self.delete_file_contents(&index_id, file_path)?;
+        
+        let mut insert_element = self.connection.prepare_cached(INSERT_CODE_ELEMENT)?;
+        let mut hash_buffer = [0u8; 64];
+        let mut element_ids = Vec::with_capacity(batch.symbols.len());
+        for symbol in batch.symbols.symbols() {
+            insert_element.execute(params![
+                index_id,
+                batch.symbols.name(symbol),
+                symbol.symbol_type.as_str(),
+                file_path,
+                symbol.line_number,
+                symbol.column_number,
+                hex_digest(&symbol.definition_hash, &mut hash_buffer),
+                batch.symbols.optional(symbol.scope),
+                symbol.access_modifier.map(|a| a.as_str()),
+                symbol.is_declaration,
+                batch.symbols.optional(symbol.signature),
+                batch.symbols.optional(symbol.usr)
+            ])?;
+            element_ids.push(self.connection.last_insert_rowid());
+        }
+        
+        let mut insert_relationship = self.connection.prepare_cached(
+            r#"
+            INSERT OR IGNORE INTO symbol_relationships (
+                from_symbol_id, to_symbol_id, relationship_type, 
+                file_path, line_number
+            ) VALUES (?1, ?2, ?3, ?4, ?5)
+            "#
+        )?;
+        
+        let mut relationships_written = 0;
+        for relationship in &batch.relationships {
+            relationships_written += insert_relationship.execute(params![
+                relationship.from.resolve(&element_ids)?,
+                relationship.to.resolve(&element_ids)?,
+                relationship.relationship_type.as_str(),
+                relationship.file_path,
+                relationship.line_number
+            ])?;
+        }
+        
+        let mut insert_edge = self.connection.prepare_cached(
+            r#"
+            INSERT OR IGNORE INTO symbol_edges (
+                index_id, recorded_by, relationship_type, file_path, line_number, column_number,
+                from_usr, from_name, from_file, from_line, to_usr, to_name, to_file, to_line
+            ) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14)
+            "#
+        )?;
+        for edge in &batch.edges {
+            insert_edge.execute(params![
+                index_id,
+                file_path,
+                edge.relationship_type.as_str(),
+                edge.file_path,
+                edge.line_number,
+                edge.column_number,
+                edge.from.usr,
+                edge.from.name,
+                edge.from.file_path,
+                edge.from.line_number,
+                edge.to.usr,
+                edge.to.name,
+                edge.to.file_path,
+                edge.to.line_number
+            ])?;
+        }
+        relationships_written += self.link_symbol_edges(&index_id, file_path)?;
+        
+        let mut insert_dependency = self.connection.prepare_cached(
+            "INSERT OR IGNORE INTO file_dependencies (index_id, file_path, included_path) VALUES (?1, ?2, ?3)"
+        )?;
+        for included_path in &batch.dependencies {
+            insert_dependency.execute(params![index_id, file_path, included_path])?;
+        }
+        
+        let file_id = self.connection.prepare_cached(
+            r#"
+            INSERT INTO file_metadata (
+                index_id, file_path, file_hash, last_modified, 
+                size_bytes, symbol_count, indexed_at, processing_state, extraction_tier
+            ) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, 'indexed', ?8)
+            ON CONFLICT(index_id, file_path) DO UPDATE SET
+                file_hash = excluded.file_hash, last_modified = excluded.last_modified,
+                size_bytes = excluded.size_bytes, symbol_count = excluded.symbol_count,
+                indexed_at = excluded.indexed_at, processing_state = 'indexed',
+                extraction_tier = excluded.extraction_tier
+            RETURNING id
+            "#
+        )?.query_row(
+            params![
+                index_id,
+                file_path,
+                batch.metadata.file_hash,
+                batch.metadata.last_modified.to_rfc3339(),
+                batch.metadata.size_bytes,
+                batch.symbols.len() as u32,
+                batch.metadata.indexed_at.to_rfc3339(),
+                batch.tier.as_str()
+            ],
+            |row| row.get(0),
+        )?;
+        
+        self.adjust_index_totals(&index_id, element_ids.len() as i64, relationships_written as i64)?;
+        
+        Ok(FileIngestResult {
+            file_id,
+            element_ids,
+            relationships_written,
+        })
+    }
+
+    // === Shard Merge ===
+
+    /// Copies the index named `index_name` from the shard database at `shard_path` into
+    /// the index `index_id`, in one transaction. A file stored by several shards, e.g. a
+    /// header in overlapping file lists, is kept once: the copy merged first, unless a
+    /// later one is semantic and the kept one syntax-tier. Every element of a merged
+    /// file is copied, so a redeclaration repeated in several files stays in each of
+    /// them. Edges a shard recorded towards symbols of another are linked as soon as
+    /// both ends are merged.
+    pub fn merge_shard(&self, index_id: &Uuid, shard_path: &Path, index_name: &str) -> Result<ShardMerge> {
+        self.connection.execute("ATTACH DATABASE ?1 AS shard", [shard_path.to_string_lossy()])?;
+        let merged = metrics::time(Stage::DbWrite, || self.merge_attached_shard(&index_id.to_string(), index_name));
+        let detached = self.connection.execute_batch("DETACH DATABASE shard");
+        let merged = merged?;
+        detached?;
+        Ok(merged)
+    }
+
+    fn merge_attached_shard(&self, index_id: &str, index_name: &str) -> Result<ShardMerge> {
+        let shard_id: String = self.connection
+            .query_row("SELECT id FROM shard.code_indices WHERE name = ?1", [index_name], |row| row.get(0))
+            .optional()?
+            .ok_or_else(|| StorageError::InvalidArgument(format!("Shard has no index named '{}'", index_name)))?;
+        
+        // Dropping the transaction without commit also drops the temporary tables.
+        let transaction = self.connection.unchecked_transaction()?;
+        self.connection.execute_batch(
+            r#"
+            CREATE TEMP TABLE merge_files (file_path TEXT PRIMARY KEY, replaces INTEGER NOT NULL);
+            CREATE TEMP TABLE merge_ids (old_id INTEGER PRIMARY KEY, new_id INTEGER NOT NULL);
+            "#
+        )?;
+        
+        let shard_files: usize = self.connection.query_row(
+            "SELECT COUNT(*) FROM shard.file_metadata WHERE index_id = ?1 AND processing_state = 'indexed'",
+            [&shard_id],
+            |row| row.get(0),
+        )?;
+        let files = self.connection.execute(
+            r#"
+            INSERT INTO temp.merge_files (file_path, replaces)
+            SELECT incoming.file_path, stored.id IS NOT NULL
+            FROM shard.file_metadata incoming
+            LEFT JOIN main.file_metadata stored ON stored.index_id = ?1 AND stored.file_path = incoming.file_path
+            WHERE incoming.index_id = ?2 AND incoming.processing_state = 'indexed' AND (
+                stored.id IS NULL OR stored.processing_state != 'indexed'
+                OR (stored.extraction_tier = 'syntax' AND incoming.extraction_tier = 'semantic')
+            )
+            "#,
+            params![index_id, shard_id],
+        )?;
+        
+        let replaced: Vec<String> = self.connection
+            .prepare("SELECT file_path FROM temp.merge_files WHERE replaces")?
+            .query_map([], |row| row.get(0))?
+            .collect::<rusqlite::Result<_>>()?;
+        for file_path in &replaced {
+            self.delete_file_contents(index_id, file_path)?;
+            self.connection.prepare_cached(
+                "DELETE FROM file_metadata WHERE index_id = ?1 AND file_path = ?2"
+            )?.execute(params![index_id, file_path])?;
+        }
+        
+        // Shard elements keep their ids shifted past every id used here, so the new id
+        // of an element and of each relationship end is known without a lookup. Elements
+        // of files kept from another shard map to the stored element at the same place,
+        // or else to one with the same USR and definition hash, so relationships towards
+        // them still link.
+        let offset: i64 = self.connection.query_row(
+            r#"
+            SELECT MAX(
+                COALESCE((SELECT MAX(id) FROM main.code_elements), 0),
+                COALESCE((SELECT seq FROM main.sqlite_sequence WHERE name = 'code_elements'), 0)
+            )
+            "#,
+            [],
+            |row| row.get(0),
+        )?;
+        self.connection.execute(
+            r#"
+            INSERT INTO temp.merge_ids (old_id, new_id)
+            SELECT old_id, new_id FROM (
+                SELECT e.id AS old_id, CASE
+                    WHEN f.file_path IS NOT NULL THEN e.id + ?3
+                    ELSE COALESCE(
+                        (SELECT MIN(stored.id) FROM main.code_elements stored
+                         WHERE stored.index_id = ?1 AND stored.file_path = e.file_path
+                           AND stored.line_number = e.line_number AND stored.column_number = e.column_number
+                           AND stored.symbol_name = e.symbol_name),
+                        (SELECT MIN(stored.id) FROM main.code_elements stored
+                         WHERE stored.index_id = ?1 AND stored.usr = e.usr AND stored.definition_hash = e.definition_hash)
+                    )
+                END AS new_id
+                FROM shard.code_elements e
+                LEFT JOIN temp.merge_files f ON f.file_path = e.file_path
+                WHERE e.index_id = ?2
+            )
+            WHERE new_id IS NOT NULL
+            "#,
+            params![index_id, shard_id, offset],
+        )?;
+        
+        let elements = self.connection.execute(
+            r#"
+            INSERT INTO main.code_elements (
+                id, index_id, symbol_name, symbol_type, file_path, line_number,
+                column_number, definition_hash, scope, access_modifier, 
+                is_declaration, signature, usr
+            )
+            SELECT m.new_id, ?1, e.symbol_name, e.symbol_type, e.file_path, e.line_number,
+                e.column_number, e.definition_hash, e.scope, e.access_modifier,
+                e.is_declaration, e.signature, e.usr
+            FROM shard.code_elements e
+            JOIN temp.merge_ids m ON m.old_id = e.id
+            WHERE m.new_id = e.id + ?2
+            "#,
+            params![index_id, offset],
+        )?;
+        
+        let mut relationships = self.connection.execute(
+            r#"
+            INSERT OR IGNORE INTO main.symbol_relationships (
+                from_symbol_id, to_symbol_id, relationship_type, 
+                file_path, line_number
+            )
+            SELECT source.new_id, target.new_id, r.relationship_type, r.file_path, r.line_number
+            FROM shard.symbol_relationships r
+            JOIN temp.merge_ids source ON source.old_id = r.from_symbol_id
+            JOIN temp.merge_ids target ON target.old_id = r.to_symbol_id
+            WHERE source.new_id != target.new_id AND (source.new_id > ?1 OR target.new_id > ?1)
+            "#,
+            [offset],
+        )?;
+        
+        self.connection.execute(
+            r#"
+            INSERT OR IGNORE INTO main.symbol_edges (
+                index_id, recorded_by, relationship_type, file_path, line_number, column_number,
+                from_usr, from_name, from_file, from_line, to_usr, to_name, to_file, to_line
+            )
+            SELECT ?1, recorded_by, relationship_type, file_path, line_number, column_number,
+                from_usr, from_name, from_file, from_line, to_usr, to_name, to_file, to_line
+            FROM shard.symbol_edges
+            WHERE index_id = ?2 AND recorded_by IN (SELECT file_path FROM temp.merge_files)
+            "#,
+            params![index_id, shard_id],
         )?;
         
-        // Incoming relationships (to this symbol)
-        let incoming = self.query_symbol_relationships(
-            &RelationshipQuery::new().to_symbol(symbol_id)
+        self.connection.execute(
+            r#"
+            INSERT OR IGNORE INTO main.file_dependencies (index_id, file_path, included_path)
+            SELECT ?1, file_path, included_path FROM shard.file_dependencies
+            WHERE index_id = ?2 AND file_path IN (SELECT file_path FROM temp.merge_files)
+            "#,
+            params![index_id, shard_id],
         )?;
         
-        Ok((outgoing, incoming))
-    }
-
-    /// Deletes symbol relationships for a file (used during re-indexing)
-    pub fn delete_symbol_relationships_by_file(&self, file_path: &str) -> Result<()> {
         self.connection.execute(
-            "DELETE FROM symbol_relationships WHERE file_path = ?1",
-            [file_path],
+            r#"
+            INSERT INTO main.file_metadata (
+                index_id, file_path, file_hash, last_modified, 
+                size_bytes, symbol_count, indexed_at, processing_state, extraction_tier
+            )
+            SELECT ?1, fm.file_path, fm.file_hash, fm.last_modified, fm.size_bytes,
+                (SELECT COUNT(*) FROM main.code_elements ce WHERE ce.index_id = ?1 AND ce.file_path = fm.file_path),
+                fm.indexed_at, 'indexed', fm.extraction_tier
+            FROM shard.file_metadata fm
+            JOIN temp.merge_files f ON f.file_path = fm.file_path
+            WHERE fm.index_id = ?2
+            "#,
+            params![index_id, shard_id],
         )?;
         
-        Ok(())
+        let merged_files: Vec<String> = self.connection
+            .prepare("SELECT file_path FROM temp.merge_files ORDER BY file_path")?
+            .query_map([], |row| row.get(0))?
+            .collect::<rusqlite::Result<_>>()?;
+        for file_path in &merged_files {
+            relationships += self.link_symbol_edges(index_id, file_path)?;
+        }
+        
+        self.adjust_index_totals(index_id, elements as i64, relationships as i64)?;
+        self.connection.execute_batch("DROP TABLE temp.merge_files; DROP TABLE temp.merge_ids;")?;
+        transaction.commit()?;
+        
+        Ok(ShardMerge {
+            files,
+            duplicate_files: shard_files - files,
+            elements,
+            relationships,
+        })
     }
 
-    /// Deletes a symbol relationship by ID
-    pub fn delete_symbol_relationship(&self, id: i64) -> Result<()> {
-        let rows_affected = self.connection.execute(
-            "DELETE FROM symbol_relationships WHERE id = ?1",
-            [id],
-        )?;
-        
-        if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+    // === Branch Overlays ===
+
+    /// Makes `index_id` an overlay over `base_index_id`, both in this database. The
+    /// overlay only stores the files that differ from the base.
+    pub fn create_overlay(&self, index_id: &Uuid, base_index_id: &Uuid) -> Result<()> {
+        if index_id == base_index_id {
+            return Err(StorageError::InvalidArgument("An index cannot be an overlay over itself".to_string()));
+        }
+        if self.get_overlay_base(base_index_id)?.is_some() {
+            return Err(StorageError::InvalidArgument("The base of an overlay cannot be an overlay itself".to_string()));
+        }
+        if let Some(existing) = self.get_overlay_base(index_id)? {
+            if existing == *base_index_id {
+                return Ok(());
+            }
+            return Err(StorageError::InvalidArgument(format!("Index is already an overlay over {}", existing)));
         }
         
+        self.connection.execute(
+            "INSERT INTO index_overlays (index_id, base_index_id, created_at) VALUES (?1, ?2, ?3)",
+            params![index_id.to_string(), base_index_id.to_string(), Utc::now().to_rfc3339()],
+        )?;
         Ok(())
     }
 
+    /// Base index of `index_id` if it is an overlay
+    pub fn get_overlay_base(&self, index_id: &Uuid) -> Result<Option<Uuid>> {
+        let base: Option<String> = self.connection
+            .prepare_cached("SELECT base_index_id FROM index_overlays WHERE index_id = ?1")?
+            .query_row([index_id.to_string()], |row| row.get(0))
+            .optional()?;
+        Ok(base.map(|base| {
+            Uuid::parse_str(&base).map_err(|_| rusqlite::Error::InvalidColumnType(0, "Invalid UUID".to_string(), rusqlite::types::Type::Text))
+        })
+        .transpose()?)
+    }
+
+    /// Records that `file_path` of the base was deleted on the overlay's branch, hiding
+    /// the base's copy until the overlay stores the file again
+    pub fn mark_base_file_removed(&self, index_id: &Uuid, file_path: &str) -> Result<()> {
+        self.connection.prepare_cached(
+            "INSERT OR IGNORE INTO overlay_removed_files (index_id, file_path) VALUES (?1, ?2)"
+        )?.execute(params![index_id.to_string(), file_path])?;
+        self.adjust_index_totals(&index_id.to_string(), 0, 0)
+    }
+
+    /// Whether the overlay `index_id` stores `file_path` or records it as removed, so
+    /// its base's copy is hidden
+    pub fn overlay_shadows_file(&self, index_id: &Uuid, file_path: &str) -> Result<bool> {
+        Ok(self.connection
+            .prepare_cached(
+                r#"
+                SELECT EXISTS (SELECT 1 FROM file_metadata WHERE index_id = ?1 AND file_path = ?2)
+                    OR EXISTS (SELECT 1 FROM overlay_removed_files WHERE index_id = ?1 AND file_path = ?2)
+                "#
+            )?
+            .query_row(params![index_id.to_string(), file_path], |row| row.get(0))?)
+    }
+
     // === MCP Query Session CRUD Operations ===
 
     /// Creates a new MCP query session
     pub fn create_mcp_session(&self, mut session: McpQuerySession) -> Result<McpQuerySession> {
-        session.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        session.validate().map_err(StorageError::Invalid)?;
         
         self.connection.execute(
             r#"
             INSERT INTO mcp_query_sessions (
                 session_id, client_name, active_index_id, created_at, 
-                last_activity, query_count, status, client_metadata
-            ) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)
+                last_activity, query_count, status, client_metadata, total_query_micros
+            ) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)
             "#,
             params![
                 session.session_id.to_string(),
@@ -639,7 +1770,8 @@ impl Repository {
                 session.last_activity.to_rfc3339(),
                 session.query_count,
                 session.status.as_str(),
-                session.client_metadata
+                session.client_metadata,
+                session.total_query_micros as i64
             ],
         )?;
         
@@ -648,10 +1780,10 @@ impl Repository {
 
     /// Retrieves an MCP session by ID
     pub fn get_mcp_session(&self, session_id: &Uuid) -> Result<Option<McpQuerySession>> {
-        let mut stmt = self.connection.prepare(
+        let mut stmt = self.connection.prepare_cached(
             r#"
             SELECT session_id, client_name, active_index_id, created_at, 
-                   last_activity, query_count, status, client_metadata
+                   last_activity, query_count, status, client_metadata, total_query_micros
             FROM mcp_query_sessions WHERE session_id = ?1
             "#
         )?;
@@ -671,7 +1803,7 @@ impl Repository {
         let mut sql = String::from(
             r#"
             SELECT session_id, client_name, active_index_id, created_at, 
-                   last_activity, query_count, status, client_metadata
+                   last_activity, query_count, status, client_metadata, total_query_micros
             FROM mcp_query_sessions WHERE 1=1
             "#
         );
@@ -729,13 +1861,13 @@ impl Repository {
 
     /// Updates an MCP session
     pub fn update_mcp_session(&self, session: &McpQuerySession) -> Result<()> {
-        session.validate().map_err(|e| rusqlite::Error::InvalidColumnName(e))?;
+        session.validate().map_err(StorageError::Invalid)?;
         
         let rows_affected = self.connection.execute(
             r#"
             UPDATE mcp_query_sessions SET 
                 client_name = ?2, active_index_id = ?3, last_activity = ?4,
-                query_count = ?5, status = ?6, client_metadata = ?7
+                query_count = ?5, status = ?6, client_metadata = ?7, total_query_micros = ?8
             WHERE session_id = ?1
             "#,
             params![
@@ -745,17 +1877,48 @@ impl Repository {
                 session.last_activity.to_rfc3339(),
                 session.query_count,
                 session.status.as_str(),
-                session.client_metadata
+                session.client_metadata,
+                session.total_query_micros as i64
             ],
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
     }
 
+    /// Adds buffered activity to each session's row in one transaction, creating the
+    /// rows of sessions not stored yet
+    pub fn record_session_activity(&self, activity: &[SessionActivity]) -> Result<()> {
+        let transaction = self.connection.unchecked_transaction()?;
+        {
+            let mut upsert = self.connection.prepare_cached(
+                r#"
+                INSERT INTO mcp_query_sessions (
+                    session_id, client_name, created_at, last_activity, query_count, total_query_micros
+                ) VALUES (?1, ?2, ?3, ?4, ?5, ?6)
+                ON CONFLICT(session_id) DO UPDATE SET
+                    last_activity = MAX(last_activity, excluded.last_activity),
+                    query_count = query_count + excluded.query_count,
+                    total_query_micros = total_query_micros + excluded.total_query_micros
+                "#
+            )?;
+            for session in activity {
+                upsert.execute(params![
+                    session.session_id.to_string(),
+                    session.client_name,
+                    session.created_at.to_rfc3339(),
+                    session.last_activity.to_rfc3339(),
+                    session.queries,
+                    session.query_micros as i64
+                ])?;
+            }
+        }
+        Ok(transaction.commit()?)
+    }
+
     /// Deletes an MCP session
     pub fn delete_mcp_session(&self, session_id: &Uuid) -> Result<()> {
         let rows_affected = self.connection.execute(
@@ -764,7 +1927,7 @@ impl Repository {
         )?;
         
         if rows_affected == 0 {
-            return Err(rusqlite::Error::QueryReturnedNoRows);
+            return Err(rusqlite::Error::QueryReturnedNoRows.into());
         }
         
         Ok(())
@@ -772,22 +1935,39 @@ impl Repository {
 
     // === Utility Methods ===
 
-    /// Gets statistics for all indices
+    /// Gets statistics for all indices from the counters kept on `code_indices`,
+    /// without touching the files, elements or relationships themselves
     pub fn get_index_statistics(&self) -> Result<HashMap<String, IndexStatistics>> {
-        let mut stmt = self.connection.prepare(
+        self.query_index_statistics(
+            r#"
+            SELECT id, name, total_files, total_symbols, 
+                   total_files, total_elements, total_relationships
+            FROM code_indices
+            "#
+        )
+    }
+
+    /// Counts every index's files, elements and relationships from scratch. This
+    /// scans all of them, so it is a consistency check for the counters read by
+    /// `get_index_statistics`, not something to run per request.
+    pub fn recount_index_statistics(&self) -> Result<HashMap<String, IndexStatistics>> {
+        self.query_index_statistics(
             r#"
             SELECT 
                 ci.id, ci.name, ci.total_files, ci.total_symbols,
-                COUNT(DISTINCT fm.id) as file_count,
-                COUNT(DISTINCT ce.id) as element_count,
-                COUNT(DISTINCT sr.id) as relationship_count
+                (SELECT COUNT(*) FROM file_metadata fm 
+                 WHERE fm.index_id = ci.id AND fm.processing_state = 'indexed'),
+                (SELECT COUNT(*) FROM code_elements ce WHERE ce.index_id = ci.id),
+                (SELECT COUNT(*) FROM symbol_relationships sr 
+                 JOIN code_elements ce ON ce.id = sr.from_symbol_id 
+                 WHERE ce.index_id = ci.id)
             FROM code_indices ci
-            LEFT JOIN file_metadata fm ON ci.id = fm.index_id AND fm.processing_state = 'indexed'
-            LEFT JOIN code_elements ce ON ci.id = ce.index_id  
-            LEFT JOIN symbol_relationships sr ON ce.id = sr.from_symbol_id
-            GROUP BY ci.id, ci.name, ci.total_files, ci.total_symbols
             "#
-        )?;
+        )
+    }
+
+    fn query_index_statistics(&self, sql: &str) -> Result<HashMap<String, IndexStatistics>> {
+        let mut stmt = self.connection.prepare_cached(sql)?;
         
         let mut stats_map = HashMap::new();
         
@@ -821,7 +2001,7 @@ impl Repository {
 
     // === Private Helper Methods ===
 
-    fn row_to_code_index(&self, row: &Row) -> Result<CodeIndex> {
+    fn row_to_code_index(&self, row: &Row) -> rusqlite::Result<CodeIndex> {
         let id_str: String = row.get(0)?;
         let created_at_str: String = row.get(3)?;
         let updated_at_str: String = row.get(4)?;
@@ -843,7 +2023,7 @@ impl Repository {
         })
     }
 
-    fn row_to_file_metadata(&self, row: &Row) -> Result<FileMetadata> {
+    fn row_to_file_metadata(&self, row: &Row) -> rusqlite::Result<FileMetadata> {
         let index_id_str: String = row.get(1)?;
         let last_modified_str: String = row.get(4)?;
         let indexed_at_str: String = row.get(7)?;
@@ -864,27 +2044,13 @@ impl Repository {
         })
     }
 
-    fn row_to_code_element(&self, row: &Row) -> Result<CodeElement> {
+    fn row_to_code_element(&self, row: &Row) -> rusqlite::Result<CodeElement> {
         let index_id_str: String = row.get(1)?;
         let symbol_type_str: String = row.get(3)?;
         let access_modifier_str: Option<String> = row.get(9)?;
         
-        let symbol_type = match symbol_type_str.as_str() {
-            "function" => SymbolType::Function,
-            "class" => SymbolType::Class,
-            "struct" => SymbolType::Struct,
-            "variable" => SymbolType::Variable,
-            "macro" => SymbolType::Macro,
-            "namespace" => SymbolType::Namespace,
-            "enum" => SymbolType::Enum,
-            "typedef" => SymbolType::Typedef,
-            "union" => SymbolType::Union,
-            "template" => SymbolType::Template,
-            "constructor" => SymbolType::Constructor,
-            "destructor" => SymbolType::Destructor,
-            "operator" => SymbolType::Operator,
-            _ => return Err(rusqlite::Error::InvalidColumnType(3, "Invalid symbol type".to_string(), rusqlite::types::Type::Text)),
-        };
+        let symbol_type = parse_symbol_type(&symbol_type_str)
+            .ok_or_else(|| rusqlite::Error::InvalidColumnType(3, "Invalid symbol type".to_string(), rusqlite::types::Type::Text))?;
         
         let access_modifier = access_modifier_str.as_ref().map(|s| match s.as_str() {
             "public" => Ok(AccessModifier::Public),
@@ -909,22 +2075,11 @@ impl Repository {
         })
     }
 
-    fn row_to_symbol_relationship(&self, row: &Row) -> Result<SymbolRelationship> {
+    fn row_to_symbol_relationship(&self, row: &Row) -> rusqlite::Result<SymbolRelationship> {
         let relationship_type_str: String = row.get(3)?;
         
-        let relationship_type = match relationship_type_str.as_str() {
-            "inherits" => RelationshipType::Inherits,
-            "uses" => RelationshipType::Uses,
-            "includes" => RelationshipType::Includes,
-            "calls" => RelationshipType::Calls,
-            "defines" => RelationshipType::Defines,
-            "instantiates" => RelationshipType::Instantiates,
-            "contained_in" => RelationshipType::ContainedIn,
-            "friend" => RelationshipType::Friend,
-            "overrides" => RelationshipType::Overrides,
-            "specializes" => RelationshipType::Specializes,
-            _ => return Err(rusqlite::Error::InvalidColumnType(3, "Invalid relationship type".to_string(), rusqlite::types::Type::Text)),
-        };
+        let relationship_type = RelationshipType::parse(&relationship_type_str)
+            .ok_or_else(|| rusqlite::Error::InvalidColumnType(3, "Invalid relationship type".to_string(), rusqlite::types::Type::Text))?;
         
         Ok(SymbolRelationship {
             id: Some(row.get(0)?),
@@ -936,7 +2091,7 @@ impl Repository {
         })
     }
 
-    fn row_to_mcp_session(&self, row: &Row) -> Result<McpQuerySession> {
+    fn row_to_mcp_session(&self, row: &Row) -> rusqlite::Result<McpQuerySession> {
         let session_id_str: String = row.get(0)?;
         let active_index_id_str: Option<String> = row.get(2)?;
         let created_at_str: String = row.get(3)?;
@@ -967,6 +2122,7 @@ impl Repository {
                 .map_err(|_| rusqlite::Error::InvalidColumnType(4, "Invalid datetime".to_string(), rusqlite::types::Type::Text))?
                 .with_timezone(&Utc),
             query_count: row.get(5)?,
+            total_query_micros: row.get::<_, i64>(8)? as u64,
             status,
             client_metadata: row.get(7)?,
         })
@@ -974,7 +2130,7 @@ impl Repository {
 }
 
 /// Statistics for a code index
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq, Eq)]
 pub struct IndexStatistics {
     pub index_id: Uuid,
     pub name: String,
@@ -1002,16 +2158,213 @@ impl IndexStatistics {
     }
 }
 
+/// `?first, ?first+1, ...` for `count` numbered parameters
+fn placeholders(first: usize, count: usize) -> String {
+    (first..first + count).map(|i| format!("?{}", i)).collect::<Vec<_>>().join(", ")
+}
+
+/// Escapes LIKE wildcards so they match literally under `ESCAPE '\'`
+fn escape_like(pattern: &str) -> String {
+    let mut escaped = String::with_capacity(pattern.len());
+    for c in pattern.chars() {
+        if matches!(c, '%' | '_' | '\\') {
+            escaped.push('\\');
+        }
+        escaped.push(c);
+    }
+    escaped
+}
+
+/// Maps a stored `symbol_type` back to its enum value
+fn parse_symbol_type(value: &str) -> Option<SymbolType> {
+    SymbolType::all().iter().copied().find(|symbol_type| symbol_type.as_str() == value)
+}
+
+/// Filters for `Repository::search_code_elements_page`
+#[derive(Debug, Clone, Default)]
+pub struct ElementSearch {
+    pub name_pattern: String,
+    /// Empty matches every type
+    pub symbol_types: Vec<SymbolType>,
+    /// Only names equal to the pattern, ignoring case
+    pub exact: bool,
+    pub file_path_contains: Option<String>,
+    pub scope: Option<String>,
+    /// Base index of the overlay searched, whose rows match in files the overlay
+    /// neither stores nor records as removed
+    pub overlay_base: Option<Uuid>,
+}
+
+impl ElementSearch {
+    pub fn new(name_pattern: &str) -> Self {
+        Self {
+            name_pattern: name_pattern.to_string(),
+            ..Self::default()
+        }
+    }
+
+    pub fn with_types(mut self, symbol_types: &[SymbolType]) -> Self {
+        self.symbol_types = symbol_types.to_vec();
+        self
+    }
+
+    pub fn exact(mut self, exact: bool) -> Self {
+        self.exact = exact;
+        self
+    }
+
+    pub fn in_file(mut self, file_path: Option<&str>) -> Self {
+        self.file_path_contains = file_path.map(str::to_string);
+        self
+    }
+
+    pub fn in_scope(mut self, scope: Option<&str>) -> Self {
+        self.scope = scope.map(str::to_string);
+        self
+    }
+
+    pub fn over_base(mut self, base_index_id: Option<Uuid>) -> Self {
+        self.overlay_base = base_index_id;
+        self
+    }
+}
+
+/// Rank columns of a search row, the leading part of its cursor key
+struct SearchRank {
+    exact: i64,
+    prefix: i64,
+    text: f64,
+}
+
+/// Everything indexed from one file, written as a unit by `Repository::replace_files`
+#[derive(Debug, Clone)]
+pub struct FileBatch {
+    pub metadata: FileMetadata,
+    /// The file's symbols, all stored under `metadata`'s index and path
+    pub symbols: SymbolTable,
+    pub relationships: Vec<PendingRelationship>,
+    /// Paths of the files this file includes
+    pub dependencies: Vec<String>,
+    /// Extraction the symbols came from; syntax-tier files are enriched later
+    pub tier: ExtractionTier,
+    /// Edges found while parsing this file: calls and uses in it, and bases and
+    /// overrides declared in the headers it includes
+    pub edges: Vec<SymbolEdge>,
+}
+
+impl FileBatch {
+    pub fn new(metadata: FileMetadata) -> Self {
+        Self {
+            metadata,
+            symbols: SymbolTable::new(),
+            relationships: Vec::new(),
+            dependencies: Vec::new(),
+            tier: ExtractionTier::Semantic,
+            edges: Vec::new(),
+        }
+    }
+
+    /// Validates the batch; every element must belong to the batch's index and file
+    pub fn validate(&self) -> Result<(), String> {
+        self.metadata.validate()?;
+        
+        for symbol in self.symbols.symbols() {
+            let name = self.symbols.name(symbol);
+            if name.trim().is_empty() {
+                return Err("Symbol name cannot be empty".to_string());
+            }
+            if symbol.line_number == 0 || symbol.column_number == 0 {
+                return Err(format!("Symbol '{}' must have a 1-based line and column", name));
+            }
+        }
+        
+        for relationship in &self.relationships {
+            for endpoint in [relationship.from, relationship.to] {
+                if let SymbolRef::Local(position) = endpoint {
+                    if position >= self.symbols.len() {
+                        return Err(format!("Relationship references missing element {}", position));
+                    }
+                }
+            }
+            
+            if relationship.from == relationship.to {
+                return Err("From and to symbols must be different".to_string());
+            }
+        }
+        
+        for edge in &self.edges {
+            if edge.from.usr.is_empty() || edge.to.usr.is_empty() {
+                return Err("Symbol edges must name both symbols by USR".to_string());
+            }
+        }
+        
+        Ok(())
+    }
+}
+
+/// A relationship whose endpoints may be elements of the same batch, which have no ID yet
+#[derive(Debug, Clone, PartialEq)]
+pub struct PendingRelationship {
+    pub from: SymbolRef,
+    pub to: SymbolRef,
+    pub relationship_type: RelationshipType,
+    pub file_path: String,
+    pub line_number: u32,
+}
+
+/// Endpoint of a `PendingRelationship`
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SymbolRef {
+    /// Position in the batch's `elements`
+    Local(usize),
+    /// An element already stored in the database
+    Existing(i64),
+}
+
+impl SymbolRef {
+    fn resolve(self, element_ids: &[i64]) -> Result<i64> {
+        match self {
+            SymbolRef::Local(position) => element_ids
+                .get(position)
+                .copied()
+                .ok_or_else(|| StorageError::Invalid(format!("Relationship references missing element {}", position))),
+            SymbolRef::Existing(id) => Ok(id),
+        }
+    }
+}
+
+/// Row IDs assigned while writing a `FileBatch`
+#[derive(Debug, Clone)]
+pub struct FileIngestResult {
+    pub file_id: i64,
+    /// IDs of the batch's elements, in batch order
+    pub element_ids: Vec<i64>,
+    pub relationships_written: usize,
+}
+
+/// What `Repository::merge_shard` took from one shard
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct ShardMerge {
+    pub files: usize,
+    /// Files already merged from another shard and kept from there
+    pub duplicate_files: usize,
+    pub elements: usize,
+    /// Relationships copied, and edges linked across shards
+    pub relationships: usize,
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
     use crate::lib::storage::connection::{DatabaseConfig, DatabaseManager};
+    use crate::lib::storage::models::symbol_relationships::SymbolKey;
+    use crate::lib::storage::symbol_table::SymbolRecord;
     use chrono::TimeZone;
 
     fn create_test_repository() -> Repository {
         let config = DatabaseConfig::in_memory();
         let manager = DatabaseManager::new(config).unwrap();
-        let connection = manager.connect().unwrap();
+        let connection = manager.initialize().unwrap();
         Repository::new(connection)
     }
 
@@ -1252,6 +2605,117 @@ mod tests {
         assert!(repo.get_mcp_session(&session_id).unwrap().is_none());
     }
 
+    #[test]
+    fn test_overlay_search_hides_shadowed_base_files() {
+        let repo = create_test_repository();
+        let base = repo.create_code_index(CodeIndex::new("main".to_string(), "/src".to_string())).unwrap();
+        let overlay = repo.create_code_index(CodeIndex::new("feature".to_string(), "/src".to_string())).unwrap();
+        repo.create_overlay(&overlay.id, &base.id).unwrap();
+        assert_eq!(repo.get_overlay_base(&overlay.id).unwrap(), Some(base.id));
+        assert!(repo.create_overlay(&base.id, &overlay.id).is_err());
+        
+        let store = |index_id: Uuid, file_path: &str, name: &str| {
+            let mut batch = FileBatch::new(FileMetadata::new(index_id, file_path.to_string(), "a".repeat(64), Utc::now(), 10));
+            batch.symbols.push(SymbolRecord::new(name, SymbolType::Function, 1, 1, [0xaa; 32]));
+            repo.replace_file(&batch).unwrap();
+        };
+        store(base.id, "src/kept.cpp", "widget_kept");
+        store(base.id, "src/edited.cpp", "widget_old");
+        store(base.id, "src/deleted.cpp", "widget_deleted");
+        store(overlay.id, "src/edited.cpp", "widget_new");
+        let generation = repo.get_write_generation(&overlay.id).unwrap();
+        assert!(generation > 0);
+        repo.mark_base_file_removed(&overlay.id, "src/deleted.cpp").unwrap();
+        assert!(repo.get_write_generation(&overlay.id).unwrap() > generation);
+        
+        let search = ElementSearch::new("widget").over_base(Some(base.id));
+        let page = repo.search_code_elements_page(&overlay.id, &search, None, 10).unwrap();
+        let mut names: Vec<&str> = page.items.iter().map(|element| element.symbol_name.as_str()).collect();
+        names.sort();
+        assert_eq!(names, vec!["widget_kept", "widget_new"]);
+        assert_eq!(repo.count_code_elements(&overlay.id, &search).unwrap(), 2);
+        assert!(repo.overlay_shadows_file(&overlay.id, "src/deleted.cpp").unwrap());
+        assert!(!repo.overlay_shadows_file(&overlay.id, "src/kept.cpp").unwrap());
+        
+        // Storing the file on the branch again replaces the removal record
+        store(overlay.id, "src/deleted.cpp", "widget_restored");
+        repo.remove_file(&overlay.id, "src/deleted.cpp").unwrap();
+        assert!(!repo.overlay_shadows_file(&overlay.id, "src/deleted.cpp").unwrap());
+        assert_eq!(repo.count_code_elements(&overlay.id, &search).unwrap(), 3);
+    }
+
+    #[test]
+    fn test_overlay_references_read_unshadowed_base_files() {
+        let repo = create_test_repository();
+        let base = repo.create_code_index(CodeIndex::new("main".to_string(), "/src".to_string())).unwrap();
+        let overlay = repo.create_code_index(CodeIndex::new("feature".to_string(), "/src".to_string())).unwrap();
+        repo.create_overlay(&overlay.id, &base.id).unwrap();
+        
+        let shape = SymbolKey { usr: "c:@S@Shape".to_string(), name: "Shape".to_string(), file_path: "src/shape.h".to_string(), line_number: 3 };
+        let user = |index_id: Uuid, file_path: &str, name: &str, usr: &str| {
+            let mut batch = FileBatch::new(FileMetadata::new(index_id, file_path.to_string(), "b".repeat(64), Utc::now(), 10));
+            batch.symbols.push(SymbolRecord::new(name, SymbolType::Function, 5, 6, [0xbb; 32]).with_usr(usr));
+            batch.edges.push(SymbolEdge {
+                from: SymbolKey { usr: usr.to_string(), name: name.to_string(), file_path: file_path.to_string(), line_number: 5 },
+                to: shape.clone(),
+                relationship_type: RelationshipType::Uses,
+                file_path: file_path.to_string(),
+                line_number: 6,
+                column_number: 5,
+            });
+            batch
+        };
+        let mut header = FileBatch::new(FileMetadata::new(base.id, "src/shape.h".to_string(), "a".repeat(64), Utc::now(), 10));
+        header.symbols.push(SymbolRecord::new("Shape", SymbolType::Class, 3, 7, [0xaa; 32]).with_usr("c:@S@Shape").with_declaration(true));
+        repo.replace_files(&[
+            header,
+            user(base.id, "src/kept.cpp", "kept_user", "c:@F@kept_user#"),
+            user(base.id, "src/edited.cpp", "old_user", "c:@F@old_user#"),
+        ]).unwrap();
+        repo.replace_file(&user(overlay.id, "src/edited.cpp", "new_user", "c:@F@new_user#")).unwrap();
+        
+        // Without its base the overlay knows no `Shape` at all
+        assert_eq!(repo.count_references(&overlay.id, None, "Shape", &[], true).unwrap(), 0);
+        
+        let page = repo.find_references_page(&overlay.id, Some(&base.id), "Shape", &[], true, None, 10).unwrap();
+        let names: Vec<&str> = page.items.iter().map(|element| element.symbol_name.as_str()).collect();
+        assert_eq!(names, vec!["Shape", "kept_user"]);
+        assert_eq!(repo.count_references(&overlay.id, Some(&base.id), "Shape", &[], false).unwrap(), 1);
+        
+        let shape_ids = repo.code_element_ids_by_name(&overlay.id, Some(&base.id), "Shape", &[]).unwrap();
+        assert_eq!(shape_ids, repo.code_element_ids_by_name(&base.id, None, "Shape", &[]).unwrap());
+        let kept_ids = repo.code_element_ids_by_name(&overlay.id, Some(&base.id), "kept_user", &[]).unwrap();
+        assert!(repo.code_element_ids_by_name(&overlay.id, Some(&base.id), "old_user", &[]).unwrap().is_empty());
+        assert_eq!(
+            repo.list_symbol_graph_edges(&overlay.id, Some(&base.id)).unwrap(),
+            vec![(kept_ids[0], shape_ids[0], RelationshipType::Uses)]
+        );
+        
+        // Removing the header on the branch hides the edge into it
+        repo.mark_base_file_removed(&overlay.id, "src/shape.h").unwrap();
+        assert!(repo.list_symbol_graph_edges(&overlay.id, Some(&base.id)).unwrap().is_empty());
+        assert_eq!(repo.count_references(&overlay.id, Some(&base.id), "Shape", &[], true).unwrap(), 0);
+    }
+
+    #[test]
+    fn test_record_session_activity_accumulates() {
+        let repo = create_test_repository();
+        
+        let mut activity = SessionActivity::new(Uuid::new_v4(), "Claude".to_string());
+        activity.record_query(std::time::Duration::from_millis(3));
+        repo.record_session_activity(&[activity.clone()]).unwrap();
+        
+        let mut later = SessionActivity::new(activity.session_id, "Claude".to_string());
+        later.record_query(std::time::Duration::from_millis(1));
+        later.record_query(std::time::Duration::from_millis(2));
+        repo.record_session_activity(&[later.clone()]).unwrap();
+        
+        let session = repo.get_mcp_session(&activity.session_id).unwrap().unwrap();
+        assert_eq!((session.query_count, session.total_query_micros), (3, 6000));
+        assert_eq!(session.last_activity, later.last_activity);
+        assert_eq!(session.created_at, activity.created_at);
+    }
+
     #[test]
     fn test_index_statistics() {
         let repo = create_test_repository();
@@ -1291,4 +2755,326 @@ mod tests {
         assert_eq!(test_stats.actual_elements, 1);
         assert_eq!(test_stats.relationships, 0);
     }
-}
\ No newline at end of file
+
+    #[test]
+    fn test_index_counters_match_recount() {
+        let repo = create_test_repository();
+
+        let index = CodeIndex::new("Test Index".to_string(), "/test/path".to_string());
+        let index_id = index.id;
+        repo.create_code_index(index).unwrap();
+
+        let file_batch = |file_path: &str, names: &[&str]| {
+            let mut batch = FileBatch::new(FileMetadata::new(index_id, file_path.to_string(), "a".repeat(64), Utc::now(), 10));
+            for (line, name) in names.iter().enumerate() {
+                batch.symbols.push(SymbolRecord::new(name, SymbolType::Class, line as u32 + 1, 1, [0xaa; 32]));
+            }
+            if names.len() > 1 {
+                batch.relationships.push(PendingRelationship {
+                    from: SymbolRef::Local(1),
+                    to: SymbolRef::Local(0),
+                    relationship_type: RelationshipType::Inherits,
+                    file_path: file_path.to_string(),
+                    line_number: 2,
+                });
+            }
+            batch
+        };
+
+        repo.replace_files(&[file_batch("src/a.h", &["Shape", "Circle"]), file_batch("src/b.h", &["Square"])]).unwrap();
+        repo.replace_file(&file_batch("src/a.h", &["Shape", "Ellipse", "Circle"])).unwrap();
+        let element = repo.create_code_element(CodeElement::new(
+            index_id,
+            "helper".to_string(),
+            SymbolType::Function,
+            "src/b.h".to_string(),
+            9,
+            1,
+            "b".repeat(64),
+        )).unwrap();
+        repo.remove_file(&index_id, "src/b.h").unwrap();
+
+        let counted = &repo.get_index_statistics().unwrap()["Test Index"];
+        assert_eq!(counted, &repo.recount_index_statistics().unwrap()["Test Index"]);
+        assert_eq!((counted.actual_files, counted.reported_symbols), (1, 3));
+        assert_eq!((counted.actual_elements, counted.relationships), (3, 1));
+        assert!(repo.delete_code_element(element.id.unwrap()).is_err());
+    }
+
+    #[test]
+    fn test_replace_file_swaps_contents() {
+        let repo = create_test_repository();
+        
+        let index = CodeIndex::new("Test Index".to_string(), "/test/path".to_string());
+        let index_id = index.id;
+        repo.create_code_index(index).unwrap();
+        
+        let file_batch = |names: &[&str]| {
+            let mut batch = FileBatch::new(FileMetadata::new(
+                index_id,
+                "src/shapes.h".to_string(),
+                "c".repeat(64),
+                Utc::now(),
+                512,
+            ));
+            for (line, name) in names.iter().enumerate() {
+                batch.symbols.push(SymbolRecord::new(name, SymbolType::Class, line as u32 + 1, 1, [0xdd; 32]));
+            }
+            batch
+        };
+        
+        let mut first = file_batch(&["Shape", "Circle"]);
+        first.relationships.push(PendingRelationship {
+            from: SymbolRef::Local(1),
+            to: SymbolRef::Local(0),
+            relationship_type: RelationshipType::Inherits,
+            file_path: "src/shapes.h".to_string(),
+            line_number: 2,
+        });
+        
+        let result = repo.replace_file(&first).unwrap();
+        assert_eq!(result.element_ids.len(), 2);
+        assert_eq!(result.relationships_written, 1);
+        
+        let (outgoing, _) = repo.get_symbol_relationships(result.element_ids[1]).unwrap();
+        assert_eq!(outgoing[0].to_symbol_id, result.element_ids[0]);
+        
+        // Re-indexing the file replaces its elements and drops the stale relationship
+        let second = repo.replace_file(&file_batch(&["Square"])).unwrap();
+        let elements = repo.list_code_elements_by_file(&index_id, "src/shapes.h").unwrap();
+        assert_eq!(elements.len(), 1);
+        assert_eq!(elements[0].symbol_name, "Square");
+        assert_eq!(second.file_id, result.file_id);
+        assert!(repo.query_symbol_relationships(&RelationshipQuery::new()).unwrap().is_empty());
+        
+        let metadata = repo.get_file_metadata_by_path(&index_id, "src/shapes.h").unwrap().unwrap();
+        assert_eq!(metadata.symbol_count, 1);
+    }
+
+    #[test]
+    fn test_symbol_edges_link_across_files() {
+        let repo = create_test_repository();
+
+        let index = CodeIndex::new("Test Index".to_string(), "/test/path".to_string());
+        let index_id = index.id;
+        repo.create_code_index(index).unwrap();
+
+        let key = |usr: &str, name: &str, file_path: &str, line_number| SymbolKey {
+            usr: usr.to_string(),
+            name: name.to_string(),
+            file_path: file_path.to_string(),
+            line_number,
+        };
+        let shape = key("c:@S@Shape", "Shape", "src/shape.h", 3);
+        let circle = key("c:@S@Circle", "Circle", "src/shape.h", 8);
+        let area = key("c:@S@Circle@F@area#", "area", "src/circle.cpp", 5);
+
+        // The header's symbols come from tree-sitter and have no USR
+        let header = || {
+            let mut batch = FileBatch::new(FileMetadata::new(index_id, "src/shape.h".to_string(), "a".repeat(64), Utc::now(), 10));
+            batch.symbols.push(SymbolRecord::new("Shape", SymbolType::Class, 3, 7, [0xaa; 32]));
+            batch.symbols.push(SymbolRecord::new("Circle", SymbolType::Class, 8, 7, [0xbb; 32]));
+            batch.tier = ExtractionTier::Syntax;
+            batch
+        };
+
+        let mut source = FileBatch::new(FileMetadata::new(index_id, "src/circle.cpp".to_string(), "b".repeat(64), Utc::now(), 10));
+        source.symbols.push(SymbolRecord::new("area", SymbolType::Function, 5, 14, [0xcc; 32]).with_usr(&area.usr));
+        source.edges.push(SymbolEdge {
+            from: circle.clone(),
+            to: shape.clone(),
+            relationship_type: RelationshipType::Inherits,
+            file_path: "src/shape.h".to_string(),
+            line_number: 8,
+            column_number: 16,
+        });
+        source.edges.push(SymbolEdge {
+            from: area,
+            to: shape,
+            relationship_type: RelationshipType::Uses,
+            file_path: "src/circle.cpp".to_string(),
+            line_number: 6,
+            column_number: 5,
+        });
+
+        // The source is written before the header its edges point into
+        assert_eq!(repo.replace_file(&source).unwrap().relationships_written, 0);
+        let first = repo.replace_file(&header()).unwrap();
+        assert_eq!(first.relationships_written, 2);
+
+        // Re-indexing the header recreates its elements and the edges to them
+        let second = repo.replace_file(&header()).unwrap();
+        assert_eq!(second.relationships_written, 2);
+
+        let mut edges = repo.list_symbol_graph_edges(&index_id, None).unwrap();
+        edges.sort_by_key(|&(from, to, _)| (from, to));
+        let area_id = repo.list_code_elements_by_file(&index_id, "src/circle.cpp").unwrap()[0].id.unwrap();
+        let (shape_id, circle_id) = (second.element_ids[0], second.element_ids[1]);
+        assert!(edges.contains(&(circle_id, shape_id, RelationshipType::Inherits)));
+        assert!(edges.contains(&(area_id, shape_id, RelationshipType::Uses)));
+        assert_eq!(edges.len(), 2);
+    }
+
+    #[test]
+    fn test_merge_shards_dedupes_and_links() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let shard = |file_name: &str, batches: &dyn Fn(Uuid) -> Vec<FileBatch>| {
+            let path = temp_dir.path().join(file_name);
+            let repo = Repository::new(DatabaseManager::new(DatabaseConfig::new(&path)).unwrap().initialize().unwrap());
+            let index = repo.create_code_index(CodeIndex::new("proj".to_string(), "/src/proj".to_string())).unwrap();
+            repo.replace_files(&batches(index.id)).unwrap();
+            path
+        };
+        let header = |index_id, tier| {
+            let mut batch = FileBatch::new(FileMetadata::new(index_id, "src/shape.h".to_string(), "a".repeat(64), Utc::now(), 10));
+            batch.symbols.push(SymbolRecord::new("Shape", SymbolType::Class, 3, 7, [0xaa; 32]).with_usr("c:@S@Shape"));
+            batch.tier = tier;
+            batch
+        };
+        
+        // Shard A stores the header from tree-sitter and an edge from its source into it
+        let first = shard("a.db", &|index_id| {
+            let mut source = FileBatch::new(FileMetadata::new(index_id, "src/circle.cpp".to_string(), "b".repeat(64), Utc::now(), 10));
+            source.symbols.push(SymbolRecord::new("area", SymbolType::Function, 5, 14, [0xbb; 32]).with_usr("c:@F@area#"));
+            source.edges.push(SymbolEdge {
+                from: SymbolKey { usr: "c:@F@area#".to_string(), name: "area".to_string(), file_path: "src/circle.cpp".to_string(), line_number: 5 },
+                to: SymbolKey { usr: "c:@S@Shape".to_string(), name: "Shape".to_string(), file_path: "src/shape.h".to_string(), line_number: 3 },
+                relationship_type: RelationshipType::Uses,
+                file_path: "src/circle.cpp".to_string(),
+                line_number: 6,
+                column_number: 5,
+            });
+            vec![source, header(index_id, ExtractionTier::Syntax)]
+        });
+        let second = shard("b.db", &|index_id| vec![header(index_id, ExtractionTier::Semantic)]);
+        
+        let repo = create_test_repository();
+        let index = repo.create_code_index(CodeIndex::new("proj".to_string(), "/src/proj".to_string())).unwrap();
+        
+        let merged = repo.merge_shard(&index.id, &first, "proj").unwrap();
+        assert_eq!((merged.files, merged.elements, merged.relationships), (2, 2, 1));
+        
+        // The semantic header replaces the syntax-tier copy and the edge into it is relinked
+        let merged = repo.merge_shard(&index.id, &second, "proj").unwrap();
+        assert_eq!((merged.files, merged.duplicate_files, merged.relationships), (1, 0, 1));
+        assert!(repo.list_files_by_tier(&index.id, ExtractionTier::Syntax).unwrap().is_empty());
+        
+        let merged = repo.merge_shard(&index.id, &first, "proj").unwrap();
+        assert_eq!((merged.files, merged.duplicate_files, merged.elements), (0, 2, 0));
+        assert!(repo.merge_shard(&index.id, &first, "other").is_err());
+        
+        let shape_id = repo.code_element_ids_by_name(&index.id, None, "Shape", &[]).unwrap();
+        let area_id = repo.code_element_ids_by_name(&index.id, None, "area", &[]).unwrap();
+        assert_eq!(repo.list_symbol_graph_edges(&index.id, None).unwrap(), vec![(area_id[0], shape_id[0], RelationshipType::Uses)]);
+        
+        let counted = &repo.get_index_statistics().unwrap()["proj"];
+        assert_eq!(counted, &repo.recount_index_statistics().unwrap()["proj"]);
+        assert_eq!((counted.actual_files, counted.actual_elements, counted.relationships), (2, 2, 1));
+    }
+
+    #[test]
+    fn test_merge_shard_keeps_redeclarations() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("shard.db");
+        let shard = Repository::new(DatabaseManager::new(DatabaseConfig::new(&path)).unwrap().initialize().unwrap());
+        let shard_index = shard.create_code_index(CodeIndex::new("proj".to_string(), "/src/proj".to_string())).unwrap();
+        // The same declaration, with the same text and USR, in two source files
+        let batches: Vec<FileBatch> = ["src/a.cpp", "src/b.cpp"].iter().map(|file_path| {
+            let mut batch = FileBatch::new(FileMetadata::new(shard_index.id, file_path.to_string(), "c".repeat(64), Utc::now(), 10));
+            batch.symbols.push(SymbolRecord::new("helper", SymbolType::Function, 1, 6, [0xcc; 32]).with_usr("c:@F@helper#"));
+            batch
+        }).collect();
+        shard.replace_files(&batches).unwrap();
+        
+        let repo = create_test_repository();
+        let index = repo.create_code_index(CodeIndex::new("proj".to_string(), "/src/proj".to_string())).unwrap();
+        let merged = repo.merge_shard(&index.id, &path, "proj").unwrap();
+        assert_eq!((merged.files, merged.elements), (2, 2));
+        assert_eq!(repo.list_code_elements_by_file(&index.id, "src/a.cpp").unwrap().len(), 1);
+        assert_eq!(repo.list_code_elements_by_file(&index.id, "src/b.cpp").unwrap().len(), 1);
+    }
+
+    #[test]
+    fn test_enrichment_upgrades_syntax_tier() {
+        let repo = create_test_repository();
+
+        let index = CodeIndex::new("Test Index".to_string(), "/test/path".to_string());
+        let index_id = index.id;
+        repo.create_code_index(index).unwrap();
+
+        let mut batch = FileBatch::new(FileMetadata::new(index_id, "src/a.cpp".to_string(), "a".repeat(64), Utc::now(), 10));
+        batch.tier = ExtractionTier::Syntax;
+        repo.replace_file(&batch).unwrap();
+        let pending = repo.list_files_by_tier(&index_id, ExtractionTier::Syntax).unwrap();
+        assert_eq!(pending.iter().map(|file| file.file_path.as_str()).collect::<Vec<_>>(), vec!["src/a.cpp"]);
+
+        // An enrichment of a version the watcher has replaced meanwhile is dropped
+        let mut newer = batch.clone();
+        newer.metadata.file_hash = "b".repeat(64);
+        repo.replace_file(&newer).unwrap();
+        batch.tier = ExtractionTier::Semantic;
+        assert!(repo.replace_file_if_hash(&batch, &"a".repeat(64)).unwrap().is_none());
+        assert_eq!(repo.list_files_by_tier(&index_id, ExtractionTier::Syntax).unwrap()[0].file_hash, "b".repeat(64));
+
+        newer.tier = ExtractionTier::Semantic;
+        assert!(repo.replace_file_if_hash(&newer, &"b".repeat(64)).unwrap().is_some());
+        assert!(repo.list_files_by_tier(&index_id, ExtractionTier::Syntax).unwrap().is_empty());
+    }
+
+    #[test]
+    fn test_replace_files_rejects_whole_group() {
+        let repo = create_test_repository();
+        
+        let index = CodeIndex::new("Test Index".to_string(), "/test/path".to_string());
+        let index_id = index.id;
+        repo.create_code_index(index).unwrap();
+        
+        let valid = FileBatch::new(FileMetadata::new(index_id, "src/a.cpp".to_string(), "a".repeat(64), Utc::now(), 10));
+        let mut invalid = FileBatch::new(FileMetadata::new(index_id, "src/b.cpp".to_string(), "b".repeat(64), Utc::now(), 10));
+        // Positions are 1-based, so line 0 is rejected
+        invalid.symbols.push(SymbolRecord::new("misplaced", SymbolType::Function, 0, 1, [0xee; 32]));
+        
+        assert!(repo.replace_files(&[valid, invalid]).is_err());
+        assert!(repo.list_file_metadata(&index_id).unwrap().is_empty());
+    }
+
+    #[test]
+    fn test_search_ranks_exact_and_prefix_matches() {
+        let repo = create_test_repository();
+        
+        let index = CodeIndex::new("Test Index".to_string(), "/test/path".to_string());
+        let index_id = index.id;
+        repo.create_code_index(index).unwrap();
+        
+        for (line, name) in ["parseHttpRequest", "HttpRequestBuilder", "HttpRequest", "log_io"].iter().enumerate() {
+            repo.create_code_element(CodeElement::new(
+                index_id,
+                name.to_string(),
+                SymbolType::Class,
+                "src/http.h".to_string(),
+                line as u32 + 1,
+                1,
+                "a".repeat(64),
+            )).unwrap();
+        }
+        
+        let names = |pattern: &str| -> Vec<String> {
+            repo.search_code_elements(&index_id, pattern, None)
+                .unwrap()
+                .into_iter()
+                .map(|element| element.symbol_name)
+                .collect()
+        };
+        
+        // Trigram path: case-insensitive substring match, exact then prefix first
+        assert_eq!(names("httprequest"), vec!["HttpRequest", "HttpRequestBuilder", "parseHttpRequest"]);
+        assert_eq!(names("uestBuil"), vec!["HttpRequestBuilder"]);
+        
+        // Short patterns use LIKE, with wildcards matched literally
+        assert_eq!(names("_i"), vec!["log_io"]);
+        assert!(names("%").is_empty());
+        
+        let limited = repo.search_code_elements_limited(&index_id, "Request", None, Some(1)).unwrap();
+        assert_eq!(limited.len(), 1);
+    }
+}
@@ -2,7 +2,7 @@ use rusqlite::{Connection, Result};
 use std::collections::HashMap;
 
 /// Database schema version - increment when making schema changes
-pub const CURRENT_SCHEMA_VERSION: i32 = 1;
+pub const CURRENT_SCHEMA_VERSION: i32 = 11;
 
 /// Schema migration manager for SQLite database
 pub struct SchemaMigrator {
@@ -86,6 +86,22 @@ impl SchemaMigrator {
         // Migration 1: Initial schema
         migrations.insert(1, MIGRATION_V1);
         
+        // Migration 2: Trigram full-text index for symbol search
+        migrations.insert(2, MIGRATION_V2);
+        
+        // Migration 3: Resolved include graph
+        migrations.insert(3, MIGRATION_V3);
+        
+        // Migration 4: Per-file extraction tier
+        migrations.insert(4, MIGRATION_V4);
+        migrations.insert(5, MIGRATION_V5);
+        migrations.insert(6, MIGRATION_V6);
+        migrations.insert(7, MIGRATION_V7);
+        migrations.insert(8, MIGRATION_V8);
+        migrations.insert(9, MIGRATION_V9);
+        migrations.insert(10, MIGRATION_V10);
+        migrations.insert(11, MIGRATION_V11);
+        
         migrations
     }
 
@@ -292,16 +308,354 @@ BEGIN
 END;
 "#;
 
+/// Migration V2: FTS5 trigram index over symbol names, scopes and signatures.
+/// It is an external-content table, so the text lives only in code_elements and
+/// the triggers keep the index in step with every write.
+const MIGRATION_V2: &str = r#"
+CREATE VIRTUAL TABLE code_elements_fts USING fts5(
+    symbol_name,
+    scope,
+    signature,
+    content = 'code_elements',
+    content_rowid = 'id',
+    tokenize = 'trigram'
+);
+
+-- Index rows written before this migration
+INSERT INTO code_elements_fts(code_elements_fts) VALUES ('rebuild');
+
+CREATE TRIGGER code_elements_fts_insert
+AFTER INSERT ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(rowid, symbol_name, scope, signature)
+    VALUES (NEW.id, NEW.symbol_name, NEW.scope, NEW.signature);
+END;
+
+CREATE TRIGGER code_elements_fts_delete
+AFTER DELETE ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(code_elements_fts, rowid, symbol_name, scope, signature)
+    VALUES ('delete', OLD.id, OLD.symbol_name, OLD.scope, OLD.signature);
+END;
+
+CREATE TRIGGER code_elements_fts_update
+AFTER UPDATE OF symbol_name, scope, signature ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(code_elements_fts, rowid, symbol_name, scope, signature)
+    VALUES ('delete', OLD.id, OLD.symbol_name, OLD.scope, OLD.signature);
+    INSERT INTO code_elements_fts(rowid, symbol_name, scope, signature)
+    VALUES (NEW.id, NEW.symbol_name, NEW.scope, NEW.signature);
+END;
+"#;
+
+/// Migration V3: the include graph, one row per resolved `#include`, so changes to a
+/// header reach its includers after a restart. Paths are relative to the index root
+/// when they lie under it.
+const MIGRATION_V3: &str = r#"
+CREATE TABLE file_dependencies (
+    index_id TEXT NOT NULL,
+    file_path TEXT NOT NULL,
+    included_path TEXT NOT NULL,
+    PRIMARY KEY (index_id, file_path, included_path),
+    FOREIGN KEY (index_id) REFERENCES code_indices(id) ON DELETE CASCADE
+) WITHOUT ROWID;
+
+-- Reverse edges: who includes a file
+CREATE INDEX idx_file_dependencies_included ON file_dependencies(index_id, included_path);
+"#;
+
+/// Migration V4: which extraction a file's symbols came from, so files stored by the
+/// tree-sitter tier can be found and enriched with libclang later, across restarts.
+/// Rows written before this migration came from the full extraction.
+const MIGRATION_V4: &str = r#"
+ALTER TABLE file_metadata ADD COLUMN extraction_tier TEXT NOT NULL DEFAULT 'semantic'
+    CHECK (extraction_tier IN ('syntax', 'semantic'));
+
+-- Only the files still waiting for enrichment
+CREATE INDEX idx_file_metadata_syntax_tier ON file_metadata(index_id) WHERE extraction_tier = 'syntax';
+"#;
+
+/// Migration V5: libclang USRs on code elements and the USR-keyed edges recorded by
+/// each file. `symbol_relationships` rows are derived from `symbol_edges` whenever
+/// either end is written, so edges to a file survive that file being re-indexed.
+const MIGRATION_V5: &str = r#"
+ALTER TABLE code_elements ADD COLUMN usr TEXT;
+
+CREATE INDEX idx_code_elements_usr ON code_elements(index_id, usr) WHERE usr IS NOT NULL;
+CREATE INDEX idx_code_elements_declaration ON code_elements(index_id, file_path, line_number);
+
+CREATE TABLE symbol_edges (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    index_id TEXT NOT NULL,
+    -- File whose parse recorded the edge; its edges are replaced when it is re-indexed
+    recorded_by TEXT NOT NULL,
+    relationship_type TEXT NOT NULL CHECK (relationship_type IN ('inherits', 'uses', 'includes', 'calls', 'defines', 'instantiates', 'contained_in', 'friend', 'overrides', 'specializes')),
+    -- Where the reference is
+    file_path TEXT NOT NULL,
+    line_number INTEGER NOT NULL,
+    column_number INTEGER NOT NULL,
+    -- Each end by USR, and by name and declaration for elements without one
+    from_usr TEXT NOT NULL,
+    from_name TEXT NOT NULL,
+    from_file TEXT NOT NULL,
+    from_line INTEGER NOT NULL,
+    to_usr TEXT NOT NULL,
+    to_name TEXT NOT NULL,
+    to_file TEXT NOT NULL,
+    to_line INTEGER NOT NULL,
+    FOREIGN KEY (index_id) REFERENCES code_indices(id) ON DELETE CASCADE,
+    UNIQUE(index_id, recorded_by, from_usr, to_usr, relationship_type, file_path, line_number, column_number)
+);
+
+CREATE INDEX idx_symbol_edges_from_usr ON symbol_edges(index_id, from_usr);
+CREATE INDEX idx_symbol_edges_to_usr ON symbol_edges(index_id, to_usr);
+CREATE INDEX idx_symbol_edges_from_file ON symbol_edges(index_id, from_file);
+CREATE INDEX idx_symbol_edges_to_file ON symbol_edges(index_id, to_file);
+"#;
+
+/// Migration V6: per-index totals kept as counters. The file triggers apply each row's
+/// change instead of recounting the whole index on every write; element and
+/// relationship totals are adjusted by the repository in the same transaction.
+const MIGRATION_V6: &str = r#"
+ALTER TABLE code_indices ADD COLUMN total_elements INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE code_indices ADD COLUMN total_relationships INTEGER NOT NULL DEFAULT 0;
+
+DROP TRIGGER update_index_stats_on_file_insert;
+DROP TRIGGER update_index_stats_on_file_update;
+
+CREATE TRIGGER update_index_stats_on_file_insert
+AFTER INSERT ON file_metadata
+WHEN NEW.processing_state = 'indexed'
+BEGIN
+    UPDATE code_indices 
+    SET total_files = total_files + 1,
+        total_symbols = total_symbols + NEW.symbol_count,
+        updated_at = CURRENT_TIMESTAMP
+    WHERE id = NEW.index_id;
+END;
+
+CREATE TRIGGER update_index_stats_on_file_update
+AFTER UPDATE OF index_id, symbol_count, processing_state ON file_metadata
+WHEN OLD.processing_state = 'indexed' OR NEW.processing_state = 'indexed'
+BEGIN
+    UPDATE code_indices 
+    SET total_files = total_files - (OLD.processing_state = 'indexed'),
+        total_symbols = total_symbols - CASE WHEN OLD.processing_state = 'indexed' THEN OLD.symbol_count ELSE 0 END
+    WHERE id = OLD.index_id;
+    UPDATE code_indices 
+    SET total_files = total_files + (NEW.processing_state = 'indexed'),
+        total_symbols = total_symbols + CASE WHEN NEW.processing_state = 'indexed' THEN NEW.symbol_count ELSE 0 END,
+        updated_at = CURRENT_TIMESTAMP
+    WHERE id = NEW.index_id;
+END;
+
+CREATE TRIGGER update_index_stats_on_file_delete
+AFTER DELETE ON file_metadata
+WHEN OLD.processing_state = 'indexed'
+BEGIN
+    UPDATE code_indices 
+    SET total_files = total_files - 1,
+        total_symbols = total_symbols - OLD.symbol_count,
+        updated_at = CURRENT_TIMESTAMP
+    WHERE id = OLD.index_id;
+END;
+
+UPDATE code_indices SET
+    total_files = (
+        SELECT COUNT(*) FROM file_metadata 
+        WHERE index_id = code_indices.id AND processing_state = 'indexed'
+    ),
+    total_symbols = (
+        SELECT COALESCE(SUM(symbol_count), 0) FROM file_metadata 
+        WHERE index_id = code_indices.id AND processing_state = 'indexed'
+    ),
+    total_elements = (SELECT COUNT(*) FROM code_elements WHERE index_id = code_indices.id),
+    total_relationships = (
+        SELECT COUNT(*) FROM symbol_relationships sr 
+        JOIN code_elements ce ON ce.id = sr.from_symbol_id 
+        WHERE ce.index_id = code_indices.id
+    );
+"#;
+
+/// Migration V7: session activity is buffered in memory and written in batches
+/// carrying the time of each session's last query, so the trigger stamping the write
+/// time goes, and the time spent answering queries is kept beside their count.
+const MIGRATION_V7: &str = r#"
+DROP TRIGGER update_session_activity_on_query;
+
+ALTER TABLE mcp_query_sessions ADD COLUMN total_query_micros INTEGER NOT NULL DEFAULT 0;
+"#;
+
+/// Migration V8: branch overlays. An overlay is an index holding only the files that
+/// differ from its base index in the same database; files deleted on the branch are
+/// recorded so the base's copies are hidden too.
+const MIGRATION_V8: &str = r#"
+CREATE TABLE index_overlays (
+    index_id TEXT PRIMARY KEY,
+    base_index_id TEXT NOT NULL,
+    created_at TEXT NOT NULL,
+    FOREIGN KEY (index_id) REFERENCES code_indices(id) ON DELETE CASCADE,
+    FOREIGN KEY (base_index_id) REFERENCES code_indices(id) ON DELETE CASCADE
+);
+
+CREATE INDEX idx_index_overlays_base ON index_overlays(base_index_id);
+
+CREATE TABLE overlay_removed_files (
+    index_id TEXT NOT NULL,
+    file_path TEXT NOT NULL,
+    PRIMARY KEY (index_id, file_path),
+    FOREIGN KEY (index_id) REFERENCES code_indices(id) ON DELETE CASCADE
+) WITHOUT ROWID;
+"#;
+
+/// Migration V9: a per-index write generation, advanced by every write to an index's
+/// contents, so state derived from them can tell it is behind without a Merkle root.
+const MIGRATION_V9: &str = r#"
+ALTER TABLE code_indices ADD COLUMN write_generation INTEGER NOT NULL DEFAULT 0;
+"#;
+
+/// Migration V10: lets `code_elements.symbol_type` hold fields, enum constants and
+/// unknown kinds. SQLite cannot alter a CHECK constraint, so the table is rebuilt
+/// with foreign keys off, keeping element ids, and its indices, FTS triggers and the
+/// view over it are recreated.
+const MIGRATION_V10: &str = r#"
+PRAGMA foreign_keys = OFF;
+BEGIN;
+
+CREATE TABLE code_elements_rebuilt (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    index_id TEXT NOT NULL,
+    symbol_name TEXT NOT NULL,
+    symbol_type TEXT NOT NULL CHECK (symbol_type IN ('function', 'class', 'struct', 'variable', 'macro', 'namespace', 'enum', 'typedef', 'union', 'template', 'constructor', 'destructor', 'operator', 'field', 'enum_constant', 'unknown')),
+    file_path TEXT NOT NULL,
+    line_number INTEGER NOT NULL,
+    column_number INTEGER NOT NULL,
+    definition_hash TEXT NOT NULL,
+    scope TEXT,
+    access_modifier TEXT CHECK (access_modifier IN ('public', 'private', 'protected')),
+    is_declaration BOOLEAN NOT NULL DEFAULT 0,
+    signature TEXT,
+    usr TEXT,
+    FOREIGN KEY (index_id) REFERENCES code_indices(id) ON DELETE CASCADE
+);
+
+INSERT INTO code_elements_rebuilt (
+    id, index_id, symbol_name, symbol_type, file_path, line_number, column_number,
+    definition_hash, scope, access_modifier, is_declaration, signature, usr
+)
+SELECT id, index_id, symbol_name, symbol_type, file_path, line_number, column_number,
+    definition_hash, scope, access_modifier, is_declaration, signature, usr
+FROM code_elements;
+
+-- Ids of deleted elements stay retired.
+UPDATE sqlite_sequence SET seq = MAX(seq, COALESCE((SELECT seq FROM sqlite_sequence WHERE name = 'code_elements'), 0))
+WHERE name = 'code_elements_rebuilt';
+
+-- The rename checks every view, and this one would name a missing table.
+DROP VIEW symbol_details_view;
+DROP TABLE code_elements;
+ALTER TABLE code_elements_rebuilt RENAME TO code_elements;
+
+CREATE INDEX idx_code_elements_index_id ON code_elements(index_id);
+CREATE INDEX idx_code_elements_symbol_name ON code_elements(symbol_name);
+CREATE INDEX idx_code_elements_symbol_type ON code_elements(symbol_type);
+CREATE INDEX idx_code_elements_file_path ON code_elements(file_path);
+CREATE INDEX idx_code_elements_scope ON code_elements(scope);
+CREATE INDEX idx_code_elements_definition_hash ON code_elements(definition_hash);
+CREATE INDEX idx_code_elements_composite ON code_elements(index_id, symbol_name, symbol_type);
+CREATE INDEX idx_code_elements_usr ON code_elements(index_id, usr) WHERE usr IS NOT NULL;
+CREATE INDEX idx_code_elements_declaration ON code_elements(index_id, file_path, line_number);
+
+CREATE TRIGGER code_elements_fts_insert
+AFTER INSERT ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(rowid, symbol_name, scope, signature)
+    VALUES (NEW.id, NEW.symbol_name, NEW.scope, NEW.signature);
+END;
+
+CREATE TRIGGER code_elements_fts_delete
+AFTER DELETE ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(code_elements_fts, rowid, symbol_name, scope, signature)
+    VALUES ('delete', OLD.id, OLD.symbol_name, OLD.scope, OLD.signature);
+END;
+
+CREATE TRIGGER code_elements_fts_update
+AFTER UPDATE OF symbol_name, scope, signature ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(code_elements_fts, rowid, symbol_name, scope, signature)
+    VALUES ('delete', OLD.id, OLD.symbol_name, OLD.scope, OLD.signature);
+    INSERT INTO code_elements_fts(rowid, symbol_name, scope, signature)
+    VALUES (NEW.id, NEW.symbol_name, NEW.scope, NEW.signature);
+END;
+
+CREATE VIEW symbol_details_view AS
+SELECT 
+    ce.id,
+    ce.symbol_name,
+    ce.symbol_type,
+    ce.file_path,
+    ce.line_number,
+    ce.column_number,
+    ce.scope,
+    ce.access_modifier,
+    ce.is_declaration,
+    ce.signature,
+    ci.name as index_name,
+    fm.last_modified as file_last_modified
+FROM code_elements ce
+JOIN code_indices ci ON ce.index_id = ci.id
+LEFT JOIN file_metadata fm ON ce.index_id = fm.index_id AND ce.file_path = fm.file_path
+WHERE ci.state = 'active';
+
+COMMIT;
+PRAGMA foreign_keys = ON;
+"#;
+
+/// Migration V11: the FTS index covers symbol names only. Searches match names, so
+/// the scope and signature columns V2 indexed were never queried.
+const MIGRATION_V11: &str = r#"
+DROP TRIGGER code_elements_fts_insert;
+DROP TRIGGER code_elements_fts_delete;
+DROP TRIGGER code_elements_fts_update;
+DROP TABLE code_elements_fts;
+
+CREATE VIRTUAL TABLE code_elements_fts USING fts5(
+    symbol_name,
+    content = 'code_elements',
+    content_rowid = 'id',
+    tokenize = 'trigram'
+);
+
+INSERT INTO code_elements_fts(code_elements_fts) VALUES ('rebuild');
+
+CREATE TRIGGER code_elements_fts_insert
+AFTER INSERT ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(rowid, symbol_name) VALUES (NEW.id, NEW.symbol_name);
+END;
+
+CREATE TRIGGER code_elements_fts_delete
+AFTER DELETE ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(code_elements_fts, rowid, symbol_name) VALUES ('delete', OLD.id, OLD.symbol_name);
+END;
+
+CREATE TRIGGER code_elements_fts_update
+AFTER UPDATE OF symbol_name ON code_elements
+BEGIN
+    INSERT INTO code_elements_fts(code_elements_fts, rowid, symbol_name) VALUES ('delete', OLD.id, OLD.symbol_name);
+    INSERT INTO code_elements_fts(rowid, symbol_name) VALUES (NEW.id, NEW.symbol_name);
+END;
+"#;
+
 #[cfg(test)]
 mod tests {
     use super::*;
-    use tempfile::tempdir;
-    use std::path::Path;
 
     fn create_test_db() -> Result<Connection> {
-        let dir = tempdir().unwrap();
-        let db_path = dir.path().join("test.db");
-        Connection::open(db_path)
+        // A file inside a dropped tempdir would be unlinked under the open connection.
+        Connection::open_in_memory()
     }
 
     #[test]
@@ -320,7 +674,7 @@ mod tests {
     }
 
     #[test]
-    fn test_tables_created() {
+    fn test_tables_created() -> Result<()> {
         let conn = create_test_db().unwrap();
         let mut migrator = SchemaMigrator::new(conn);
         migrator.migrate().unwrap();
@@ -335,10 +689,13 @@ mod tests {
         
         let expected_tables = vec![
             "code_elements",
+            "code_elements_fts",
             "code_indices", 
+            "file_dependencies",
             "file_metadata",
             "mcp_query_sessions",
             "schema_migrations",
+            "symbol_edges",
             "symbol_relationships",
         ];
         
@@ -350,7 +707,7 @@ mod tests {
     }
 
     #[test]
-    fn test_indices_created() {
+    fn test_indices_created() -> Result<()> {
         let conn = create_test_db().unwrap();
         let mut migrator = SchemaMigrator::new(conn);
         migrator.migrate().unwrap();
@@ -373,7 +730,7 @@ mod tests {
     }
 
     #[test]
-    fn test_views_created() {
+    fn test_views_created() -> Result<()> {
         let conn = create_test_db().unwrap();
         let mut migrator = SchemaMigrator::new(conn);
         migrator.migrate().unwrap();
@@ -393,7 +750,7 @@ mod tests {
     }
 
     #[test]
-    fn test_foreign_keys_enabled() {
+    fn test_foreign_keys_enabled() -> Result<()> {
         let conn = create_test_db().unwrap();
         let mut migrator = SchemaMigrator::new(conn);
         migrator.migrate().unwrap();
@@ -407,6 +764,81 @@ mod tests {
         Ok(())
     }
 
+    #[test]
+    fn test_v10_rebuild_keeps_elements() -> Result<()> {
+        let mut migrator = SchemaMigrator::new(create_test_db().unwrap());
+        migrator.ensure_migration_table()?;
+        let migrations = migrator.get_migrations();
+        for version in 1..=9 {
+            migrator.connection.execute_batch(migrations[&version])?;
+        }
+        migrator.set_schema_version(9)?;
+        
+        let insert_element = |conn: &Connection, name: &str, symbol_type: &str| {
+            conn.execute(
+                r#"
+                INSERT INTO code_elements (index_id, symbol_name, symbol_type, file_path, line_number, column_number, definition_hash)
+                VALUES ('index', ?1, ?2, 'src/shape.h', 1, 1, 'hash')
+                "#,
+                [name, symbol_type],
+            )
+        };
+        let conn = migrator.connection();
+        conn.execute(
+            "INSERT INTO code_indices (id, name, base_path, created_at, updated_at, state) VALUES ('index', 'proj', '/src', 't', 't', 'active')",
+            [],
+        )?;
+        insert_element(conn, "Shape", "class")?;
+        insert_element(conn, "area", "function")?;
+        conn.execute(
+            "INSERT INTO symbol_relationships (from_symbol_id, to_symbol_id, relationship_type, file_path, line_number) VALUES (2, 1, 'uses', 'src/shape.h', 1)",
+            [],
+        )?;
+        assert!(insert_element(conn, "width", "field").is_err());
+        
+        migrator.migrate()?;
+        let conn = migrator.connection();
+        insert_element(conn, "width", "field")?;
+        let elements: i64 = conn.query_row("SELECT COUNT(*) FROM code_elements", [], |row| row.get(0))?;
+        let relationships: i64 = conn.query_row("SELECT COUNT(*) FROM symbol_relationships", [], |row| row.get(0))?;
+        let details: i64 = conn.query_row("SELECT COUNT(*) FROM symbol_details_view", [], |row| row.get(0))?;
+        assert_eq!((elements, relationships, details), (3, 1, 3));
+        let foreign_keys: i32 = conn.query_row("PRAGMA foreign_keys", [], |row| row.get(0))?;
+        assert_eq!(foreign_keys, 1);
+        
+        Ok(())
+    }
+
+    #[test]
+    fn test_fts_indexes_names_only() -> Result<()> {
+        let mut migrator = SchemaMigrator::new(create_test_db().unwrap());
+        migrator.migrate()?;
+        let conn = migrator.connection();
+        conn.execute(
+            "INSERT INTO code_indices (id, name, base_path, created_at, updated_at, state) VALUES ('index', 'proj', '/src', 't', 't', 'active')",
+            [],
+        )?;
+        conn.execute(
+            r#"
+            INSERT INTO code_elements (index_id, symbol_name, symbol_type, file_path, line_number, column_number, definition_hash, scope, signature)
+            VALUES ('index', 'computeArea', 'function', 'src/shape.h', 1, 1, 'hash', 'geometry::Shape', 'double computeArea()')
+            "#,
+            [],
+        )?;
+        
+        let matches = |query: &str| -> Result<i64> {
+            conn.query_row("SELECT COUNT(*) FROM code_elements_fts WHERE code_elements_fts MATCH ?1", [query], |row| row.get(0))
+        };
+        assert_eq!(matches("\"Area\"")?, 1);
+        assert_eq!(matches("\"geometry\"")?, 0);
+        assert_eq!(matches("\"double\"")?, 0);
+        
+        conn.execute("UPDATE code_elements SET symbol_name = 'perimeter'", [])?;
+        assert_eq!((matches("\"Area\"")?, matches("\"meter\"")?), (0, 1));
+        
+        Ok(())
+    }
+
     #[test]
     fn test_migration_idempotent() {
         let conn = create_test_db().unwrap();
@@ -0,0 +1,812 @@
+use chrono::{DateTime, Utc};
+use memmap2::Mmap;
+use serde_json::json;
+use std::collections::{BTreeMap, HashMap};
+use std::error::Error;
+use std::fs::{self, File};
+use std::ops::{Range, RangeInclusive};
+use std::path::{Path, PathBuf};
+use uuid::Uuid;
+
+use crate::lib::storage::error::StorageError;
+use crate::lib::storage::models::code_element::{AccessModifier, CodeElement, SymbolType};
+use crate::lib::storage::models::code_index::CodeIndex;
+use crate::lib::storage::models::symbol_relationships::RelationshipType;
+use crate::lib::storage::pagination::{Cursor, Page};
+use crate::lib::storage::repository::{Repository, FILE_SYMBOLS_CURSOR};
+use crate::lib::storage::symbol_graph::{self, Direction, GraphLayout, SymbolGraph, Traversal};
+use crate::lib::storage::symbol_index::{self, trigrams, NameTable, Postings, SymbolSearch, Trigram};
+
+/// First bytes of every snapshot file
+const MAGIC: &[u8; 8] = b"CIDXSNAP";
+
+/// Layout version; files of any other version are rejected rather than misread
+pub const SNAPSHOT_VERSION: u32 = 3;
+
+/// Sections start on this boundary so fixed-width records are aligned in the mapping
+const SECTION_ALIGNMENT: usize = 8;
+
+const HEADER_LEN: usize = 96;
+const SECTION_COUNT: usize = 14;
+const SECTION_ENTRY_LEN: usize = 16;
+
+const FILE_RECORD: usize = 24;
+const SYMBOL_RECORD: usize = 48;
+const NAME_RECORD: usize = 16;
+const GRAM_RECORD: usize = 20;
+const EDGE_RECORD: usize = 8;
+
+/// String offset marking an absent optional string
+const NO_STRING: u32 = u32::MAX;
+
+/// Sections in file order. Records are little-endian and fixed-width; strings are
+/// `(offset, length)` pairs into `Strings`.
+#[derive(Debug, Clone, Copy)]
+enum Section {
+    Strings,
+    /// Files sorted by path: path, content hash and their range of `Symbols`
+    Files,
+    /// Symbols grouped by file in line order
+    Symbols,
+    /// Rows of `Symbols` sorted by element id
+    SymbolsById,
+    /// Distinct lowercase names, sorted, each with a range of `NameSymbols`
+    Names,
+    NameSymbols,
+    /// Trigrams of the names, sorted, each with a range of `GramPostings`
+    Grams,
+    GramPostings,
+    /// Name ids ordered by length in chars, then id
+    NamesByLength,
+    /// Element ids of the reference graph's nodes, ascending
+    GraphIds,
+    OutgoingOffsets,
+    OutgoingEdges,
+    IncomingOffsets,
+    IncomingEdges,
+}
+
+/// Immutable, read-optimized copy of one index: its symbols, name posting lists and
+/// reference graph laid out for `mmap`. Lookups read the mapped bytes in place, so
+/// opening costs one header check however large the index is, and every server
+/// process mapping the file shares the same page cache.
+#[derive(Debug)]
+pub struct Snapshot {
+    map: Mmap,
+    sections: [Range<usize>; SECTION_COUNT],
+}
+
+/// A symbol as stored in a snapshot, borrowed from the mapping
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SnapshotSymbol<'a> {
+    pub id: i64,
+    pub name: &'a str,
+    pub symbol_type: SymbolType,
+    pub file_path: &'a str,
+    pub line_number: u32,
+    pub column_number: u32,
+    pub scope: Option<&'a str>,
+    pub signature: Option<&'a str>,
+    pub access_modifier: Option<AccessModifier>,
+    pub is_declaration: bool,
+}
+
+/// What `Snapshot::write` exported
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct SnapshotSummary {
+    pub files: usize,
+    pub symbols: usize,
+    pub edges: usize,
+    pub bytes: u64,
+}
+
+impl Snapshot {
+    /// Exports `index_id` as a snapshot at `path`, replacing any previous one
+    /// atomically. `merkle_root` is the root the stored contents correspond to, which
+    /// the server compares before trusting the snapshot, along with the index's write
+    /// generation.
+    pub fn write(repository: &Repository, index_id: &Uuid, merkle_root: Option<&str>, path: &Path) -> Result<SnapshotSummary, Box<dyn Error>> {
+        // Read first: a write landing while the contents are read leaves the snapshot
+        // behind the stored generation, so it is rejected rather than trusted.
+        let write_generation = repository.get_write_generation(index_id)?;
+        let index = repository
+            .get_code_index(index_id)?
+            .ok_or_else(|| format!("Index not found: {}", index_id))?;
+        let files: Vec<(String, String)> = repository
+            .list_file_metadata(index_id)?
+            .into_iter()
+            .map(|metadata| (metadata.file_path, metadata.file_hash))
+            .collect();
+        let elements = repository.list_code_elements(index_id)?;
+        let graph = SymbolGraph::load(repository, index_id, None)?;
+
+        let bytes = encode(&index, merkle_root, write_generation, &files, &elements, &graph)?;
+        if let Some(parent) = path.parent().filter(|parent| !parent.as_os_str().is_empty()) {
+            fs::create_dir_all(parent)?;
+        }
+        let temp_path = path.with_extension("tmp");
+        fs::write(&temp_path, &bytes)?;
+        fs::rename(&temp_path, path)?;
+
+        Ok(SnapshotSummary {
+            files: files.len(),
+            symbols: elements.len(),
+            edges: graph.edge_count(),
+            bytes: bytes.len() as u64,
+        })
+    }
+
+    /// Maps a snapshot written by `write`, checking only its header and section table
+    pub fn open(path: &Path) -> Result<Self, Box<dyn Error>> {
+        let file = File::open(path).map_err(|e| format!("Failed to open {}: {}", path.display(), e))?;
+        // SAFETY: snapshots are written to a temporary file and renamed into place,
+        // never modified in place, so the mapped bytes stay fixed while they are read.
+        let map = unsafe { Mmap::map(&file)? };
+        Self::from_map(map).map_err(|e| format!("Invalid snapshot {}: {}", path.display(), e).into())
+    }
+
+    /// Snapshot file for an index, kept beside the SQLite database
+    pub fn path_for_index(database_path: &Path, index_name: &str) -> PathBuf {
+        let stem = database_path
+            .file_stem()
+            .map(|stem| stem.to_string_lossy().to_string())
+            .unwrap_or_else(|| "index".to_string());
+        let index_name: String = index_name
+            .chars()
+            .map(|c| if c.is_alphanumeric() || c == '-' || c == '_' { c } else { '_' })
+            .collect();
+
+        database_path
+            .parent()
+            .unwrap_or_else(|| Path::new("."))
+            .join(format!("{}-{}.snapshot", stem, index_name))
+    }
+
+    fn from_map(map: Mmap) -> Result<Self, String> {
+        let table_end = HEADER_LEN + SECTION_COUNT * SECTION_ENTRY_LEN;
+        if map.len() < table_end || &map[..MAGIC.len()] != MAGIC {
+            return Err("not a snapshot file".to_string());
+        }
+        let version = read_u32(&map, 8);
+        if version != SNAPSHOT_VERSION {
+            return Err(format!("unsupported version {}", version));
+        }
+        if read_u32(&map, 12) as usize != SECTION_COUNT {
+            return Err("unexpected section count".to_string());
+        }
+
+        let mut sections: [Range<usize>; SECTION_COUNT] = Default::default();
+        for (i, section) in sections.iter_mut().enumerate() {
+            let entry = HEADER_LEN + i * SECTION_ENTRY_LEN;
+            let (offset, len) = (read_u64(&map, entry) as usize, read_u64(&map, entry + 8) as usize);
+            if offset % SECTION_ALIGNMENT != 0 || offset < table_end || offset.checked_add(len).map_or(true, |end| end > map.len()) {
+                return Err(format!("section {} is out of bounds", i));
+            }
+            *section = offset..offset + len;
+        }
+
+        let snapshot = Self { map, sections };
+        let symbols = snapshot.symbol_count();
+        let nodes = snapshot.node_count();
+        let well_formed = [
+            (Section::Files, FILE_RECORD),
+            (Section::Symbols, SYMBOL_RECORD),
+            (Section::Names, NAME_RECORD),
+            (Section::NameSymbols, 4),
+            (Section::Grams, GRAM_RECORD),
+            (Section::GramPostings, 4),
+            (Section::OutgoingEdges, EDGE_RECORD),
+            (Section::IncomingEdges, EDGE_RECORD),
+        ]
+        .iter()
+        .all(|&(section, record)| snapshot.section(section).len() % record == 0)
+            && snapshot.section(Section::SymbolsById).len() == symbols * 4
+            && snapshot.section(Section::NamesByLength).len() == snapshot.name_count() as usize * 4
+            && snapshot.section(Section::GraphIds).len() % 8 == 0
+            && snapshot.section(Section::OutgoingOffsets).len() == (nodes + 1) * 4
+            && snapshot.section(Section::IncomingOffsets).len() == (nodes + 1) * 4;
+        if !well_formed {
+            return Err("section sizes do not match their records".to_string());
+        }
+        Ok(snapshot)
+    }
+
+    /// The exported index as it was when the snapshot was written
+    pub fn index(&self) -> CodeIndex {
+        CodeIndex {
+            id: self.index_id(),
+            name: self.index_name().to_string(),
+            base_path: self.string(&self.map[72..80]).to_string(),
+            created_at: timestamp(read_i64(&self.map, 32)),
+            updated_at: timestamp(read_i64(&self.map, 40)),
+            total_files: self.file_count() as u32,
+            total_symbols: self.symbol_count() as u32,
+            index_version: read_u32(&self.map, 56),
+        }
+    }
+
+    pub fn index_id(&self) -> Uuid {
+        Uuid::from_bytes(self.map[16..32].try_into().expect("16-byte index id"))
+    }
+
+    pub fn index_name(&self) -> &str {
+        self.string(&self.map[64..72])
+    }
+
+    /// Merkle root of the index contents the snapshot was exported from
+    pub fn merkle_root(&self) -> Option<&str> {
+        self.optional_string(&self.map[80..88])
+    }
+
+    /// Write generation of the index when the snapshot was exported; see
+    /// `Repository::get_write_generation`
+    pub fn write_generation(&self) -> u64 {
+        read_u64(&self.map, 88)
+    }
+
+    pub fn exported_at(&self) -> DateTime<Utc> {
+        timestamp(read_i64(&self.map, 48))
+    }
+
+    pub fn file_count(&self) -> usize {
+        self.section(Section::Files).len() / FILE_RECORD
+    }
+
+    pub fn symbol_count(&self) -> usize {
+        self.section(Section::Symbols).len() / SYMBOL_RECORD
+    }
+
+    pub fn edge_count(&self) -> usize {
+        self.section(Section::OutgoingEdges).len() / EDGE_RECORD
+    }
+
+    pub fn symbol_by_id(&self, id: i64) -> Option<SnapshotSymbol<'_>> {
+        let by_id = self.section(Section::SymbolsById);
+        let row_at = |i: usize| read_u32(by_id, i * 4);
+        let position = lower_bound(by_id.len() / 4, |i| self.symbol_id(row_at(i)) < id);
+        (position < by_id.len() / 4 && self.symbol_id(row_at(position)) == id).then(|| self.symbol(row_at(position)))
+    }
+
+    /// Symbols with the given ids, in the order given; unknown ids are skipped
+    pub fn symbols_by_ids(&self, ids: &[i64]) -> Vec<SnapshotSymbol<'_>> {
+        ids.iter().filter_map(|&id| self.symbol_by_id(id)).collect()
+    }
+
+    /// Ids of the symbols named exactly `symbol_name`, optionally of the given types
+    pub fn element_ids_by_name(&self, symbol_name: &str, symbol_types: &[SymbolType]) -> Vec<i64> {
+        let Some(name_id) = self.find_name(&symbol_name.to_lowercase()) else {
+            return Vec::new();
+        };
+        let mut ids: Vec<i64> = self
+            .name_rows(name_id)
+            .map(|row| self.symbol(row))
+            .filter(|symbol| symbol.name == symbol_name && (symbol_types.is_empty() || symbol_types.contains(&symbol.symbol_type)))
+            .map(|symbol| symbol.id)
+            .collect();
+        ids.sort_unstable();
+        ids
+    }
+
+    /// Number of symbols stored for `file_path`
+    pub fn count_file_symbols(&self, file_path: &str) -> usize {
+        self.file_rows(file_path).len()
+    }
+
+    /// One page of a file's symbols in line order, with the same cursors as
+    /// `Repository::list_code_elements_by_file_page`
+    pub fn file_symbols_page(&self, file_path: &str, after: Option<&Cursor>, limit: usize) -> Result<Page<SnapshotSymbol<'_>>, StorageError> {
+        let rows = self.file_rows(file_path);
+        let mut first = rows.start;
+        if let Some(cursor) = after {
+            let key = cursor.key_for(FILE_SYMBOLS_CURSOR, 3)?;
+            let (Some(line), Some(column), Some(id)) = (key[0].as_i64(), key[1].as_i64(), key[2].as_i64()) else {
+                return Err(StorageError::InvalidArgument("Invalid cursor key".to_string()));
+            };
+            let position = |symbol: SnapshotSymbol| (symbol.line_number as i64, symbol.column_number as i64, symbol.id);
+            first += lower_bound(rows.len(), |i| position(self.symbol(rows.start + i as u32)) <= (line, column, id)) as u32;
+        }
+
+        let symbols = (first..rows.end).take(limit + 1).map(|row| self.symbol(row)).collect();
+        Ok(Page::from_rows(symbols, limit, |symbol| {
+            Cursor::new(FILE_SYMBOLS_CURSOR, vec![json!(symbol.line_number), json!(symbol.column_number), json!(symbol.id)])
+        }))
+    }
+
+    /// Symbols named exactly `pattern`, ranked like `SymbolIndex::lookup_exact`
+    pub fn lookup_exact(&self, pattern: &str, symbol_types: Option<&[SymbolType]>, after: Option<&Cursor>, limit: usize) -> Result<SymbolSearch, StorageError> {
+        symbol_index::lookup_exact(self, pattern, symbol_types, after, limit)
+    }
+
+    /// Ranked name search with the same results and cursors as `SymbolIndex::search`
+    pub fn search(
+        &self,
+        pattern: &str,
+        symbol_types: Option<&[SymbolType]>,
+        max_edits: usize,
+        after: Option<&Cursor>,
+        limit: usize,
+    ) -> Result<SymbolSearch, StorageError> {
+        symbol_index::search(self, pattern, symbol_types, max_edits, after, limit)
+    }
+
+    /// Walks the stored reference graph like `SymbolGraph::traverse`
+    pub fn traverse(&self, start: &[i64], direction: Direction, kinds: &[RelationshipType], max_depth: u32, limit: usize) -> Traversal {
+        symbol_graph::traverse(self, start, direction, kinds, max_depth, limit)
+    }
+
+    fn section(&self, section: Section) -> &[u8] {
+        &self.map[self.sections[section as usize].clone()]
+    }
+
+    fn record(&self, section: Section, record: usize, n: u32) -> &[u8] {
+        let start = n as usize * record;
+        &self.section(section)[start..start + record]
+    }
+
+    /// String behind an `(offset, length)` reference; corrupt references read as empty
+    fn string(&self, reference: &[u8]) -> &str {
+        self.optional_string(reference).unwrap_or_default()
+    }
+
+    fn optional_string(&self, reference: &[u8]) -> Option<&str> {
+        let offset = read_u32(reference, 0);
+        if offset == NO_STRING {
+            return None;
+        }
+        let range = offset as usize..offset as usize + read_u32(reference, 4) as usize;
+        Some(self.section(Section::Strings).get(range).and_then(|bytes| std::str::from_utf8(bytes).ok()).unwrap_or_default())
+    }
+
+    fn symbol(&self, row: u32) -> SnapshotSymbol<'_> {
+        let record = self.record(Section::Symbols, SYMBOL_RECORD, row);
+        let file = self.record(Section::Files, FILE_RECORD, read_u32(record, 16));
+        SnapshotSymbol {
+            id: read_i64(record, 0),
+            name: self.string(&record[8..16]),
+            symbol_type: SymbolType::all().get(record[28] as usize).copied().unwrap_or(SymbolType::Unknown),
+            file_path: self.string(&file[0..8]),
+            line_number: read_u32(record, 20),
+            column_number: read_u32(record, 24),
+            scope: self.optional_string(&record[32..40]),
+            signature: self.optional_string(&record[40..48]),
+            access_modifier: decode_access(record[29]),
+            is_declaration: record[30] != 0,
+        }
+    }
+
+    fn symbol_id(&self, row: u32) -> i64 {
+        read_i64(self.record(Section::Symbols, SYMBOL_RECORD, row), 0)
+    }
+
+    /// Rows of `Symbols` stored for `file_path`
+    fn file_rows(&self, file_path: &str) -> Range<u32> {
+        let count = self.file_count();
+        let path_of = |i: usize| self.string(&self.record(Section::Files, FILE_RECORD, i as u32)[0..8]);
+        let position = lower_bound(count, |i| path_of(i) < file_path);
+        if position == count || path_of(position) != file_path {
+            return 0..0;
+        }
+        let record = self.record(Section::Files, FILE_RECORD, position as u32);
+        let first = read_u32(record, 16);
+        first..first + read_u32(record, 20)
+    }
+
+    fn name_rows(&self, name_id: u32) -> impl Iterator<Item = u32> + '_ {
+        let record = self.record(Section::Names, NAME_RECORD, name_id);
+        let (first, count) = (read_u32(record, 8) as usize, read_u32(record, 12) as usize);
+        self.section(Section::NameSymbols)[first * 4..(first + count) * 4]
+            .chunks_exact(4)
+            .map(|word| read_u32(word, 0))
+    }
+
+    /// First name not less than `text`
+    fn name_lower_bound(&self, text: &str) -> u32 {
+        lower_bound(self.name_count() as usize, |i| self.name_text(i as u32) < text) as u32
+    }
+}
+
+impl NameTable for Snapshot {
+    fn name_count(&self) -> u32 {
+        (self.section(Section::Names).len() / NAME_RECORD) as u32
+    }
+
+    fn name_text(&self, name_id: u32) -> &str {
+        self.string(&self.record(Section::Names, NAME_RECORD, name_id)[0..8])
+    }
+
+    fn find_name(&self, text: &str) -> Option<u32> {
+        let name_id = self.name_lower_bound(text);
+        (name_id < self.name_count() && self.name_text(name_id) == text).then_some(name_id)
+    }
+
+    fn names_with_prefix(&self, prefix: &str) -> Vec<u32> {
+        (self.name_lower_bound(prefix)..self.name_count())
+            .take_while(|&name_id| self.name_text(name_id).starts_with(prefix))
+            .collect()
+    }
+
+    fn gram_postings(&self, gram: Trigram) -> Option<Postings<'_>> {
+        let key = (gram.0 as u32, gram.1 as u32, gram.2 as u32);
+        let gram_at = |i: usize| {
+            let record = self.record(Section::Grams, GRAM_RECORD, i as u32);
+            ((read_u32(record, 0), read_u32(record, 4), read_u32(record, 8)), record)
+        };
+        let count = self.section(Section::Grams).len() / GRAM_RECORD;
+        let position = lower_bound(count, |i| gram_at(i).0 < key);
+        if position == count {
+            return None;
+        }
+        let (found, record) = gram_at(position);
+        if found != key {
+            return None;
+        }
+        let (first, len) = (read_u32(record, 12) as usize, read_u32(record, 16) as usize);
+        Some(Postings::Packed(&self.section(Section::GramPostings)[first * 4..(first + len) * 4]))
+    }
+
+    fn names_of_length(&self, lengths: RangeInclusive<usize>) -> Vec<u32> {
+        let by_length = self.section(Section::NamesByLength);
+        let name_at = |i: usize| read_u32(by_length, i * 4);
+        let length_at = |i: usize| self.name_text(name_at(i)).chars().count();
+        let count = by_length.len() / 4;
+        (lower_bound(count, |i| length_at(i) < *lengths.start())..count)
+            .take_while(|&i| length_at(i) <= *lengths.end())
+            .map(name_at)
+            .collect()
+    }
+
+    fn name_symbols(&self, name_id: u32, out: &mut Vec<(i64, SymbolType)>) {
+        out.extend(self.name_rows(name_id).map(|row| {
+            let record = self.record(Section::Symbols, SYMBOL_RECORD, row);
+            (read_i64(record, 0), SymbolType::all().get(record[28] as usize).copied().unwrap_or(SymbolType::Unknown))
+        }));
+    }
+}
+
+impl GraphLayout for Snapshot {
+    fn node_count(&self) -> usize {
+        self.section(Section::GraphIds).len() / 8
+    }
+
+    fn node(&self, id: i64) -> Option<u32> {
+        let ids = self.section(Section::GraphIds);
+        let position = lower_bound(self.node_count(), |i| read_i64(ids, i * 8) < id);
+        (position < self.node_count() && read_i64(ids, position * 8) == id).then_some(position as u32)
+    }
+
+    fn node_id(&self, node: u32) -> i64 {
+        read_i64(self.section(Section::GraphIds), node as usize * 8)
+    }
+
+    fn for_each_neighbor(&self, direction: Direction, node: u32, mut f: impl FnMut(u32, RelationshipType)) {
+        let (offsets, edges) = match direction {
+            Direction::Outgoing => (Section::OutgoingOffsets, Section::OutgoingEdges),
+            Direction::Incoming => (Section::IncomingOffsets, Section::IncomingEdges),
+        };
+        let offsets = self.section(offsets);
+        let range = read_u32(offsets, node as usize * 4) as usize..read_u32(offsets, node as usize * 4 + 4) as usize;
+        for edge in self.section(edges)[range.start * EDGE_RECORD..range.end * EDGE_RECORD].chunks_exact(EDGE_RECORD) {
+            if let Some(&kind) = RelationshipType::all().get(read_u32(edge, 4) as usize) {
+                f(read_u32(edge, 0), kind);
+            }
+        }
+    }
+}
+
+/// Serializes an index into the snapshot layout
+fn encode(
+    index: &CodeIndex,
+    merkle_root: Option<&str>,
+    write_generation: u64,
+    files: &[(String, String)],
+    elements: &[CodeElement],
+    graph: &SymbolGraph,
+) -> Result<Vec<u8>, Box<dyn Error>> {
+    let mut strings = StringPool::default();
+    let mut sections: [Vec<u8>; SECTION_COUNT] = Default::default();
+
+    // Files known to the metadata table, plus any only their symbols mention.
+    let mut hashes: BTreeMap<&str, &str> = files.iter().map(|(path, hash)| (path.as_str(), hash.as_str())).collect();
+    for element in elements {
+        hashes.entry(element.file_path.as_str()).or_default();
+    }
+    let file_ids: HashMap<&str, u32> = hashes.keys().enumerate().map(|(i, &path)| (path, i as u32)).collect();
+
+    // Symbols in (file, line, column, id) order, so each file's rows are contiguous.
+    let mut order: Vec<&CodeElement> = elements.iter().collect();
+    order.sort_by(|a, b| {
+        (&a.file_path, a.line_number, a.column_number, a.id).cmp(&(&b.file_path, b.line_number, b.column_number, b.id))
+    });
+
+    let mut file_ranges = vec![(0u32, 0u32); hashes.len()];
+    let mut names: BTreeMap<String, Vec<u32>> = BTreeMap::new();
+    for (row, element) in order.iter().enumerate() {
+        let row = row as u32;
+        let file = file_ids[element.file_path.as_str()];
+        let range = &mut file_ranges[file as usize];
+        if range.1 == 0 {
+            range.0 = row;
+        }
+        range.1 += 1;
+        names.entry(element.symbol_name.to_lowercase()).or_default().push(row);
+
+        let out = &mut sections[Section::Symbols as usize];
+        out.extend_from_slice(&element.id.unwrap_or_default().to_le_bytes());
+        out.extend_from_slice(&strings.string(&element.symbol_name)?);
+        out.extend_from_slice(&file.to_le_bytes());
+        out.extend_from_slice(&element.line_number.to_le_bytes());
+        out.extend_from_slice(&element.column_number.to_le_bytes());
+        out.push(SymbolType::all().iter().position(|t| *t == element.symbol_type).unwrap_or_default() as u8);
+        out.push(encode_access(element.access_modifier));
+        out.push(element.is_declaration as u8);
+        out.push(0);
+        out.extend_from_slice(&strings.optional(element.scope.as_deref())?);
+        out.extend_from_slice(&strings.optional(element.signature.as_deref())?);
+    }
+
+    for ((path, hash), (first, count)) in hashes.iter().zip(&file_ranges) {
+        let out = &mut sections[Section::Files as usize];
+        out.extend_from_slice(&strings.string(path)?);
+        out.extend_from_slice(&strings.string(hash)?);
+        out.extend_from_slice(&first.to_le_bytes());
+        out.extend_from_slice(&count.to_le_bytes());
+    }
+
+    let mut by_id: Vec<u32> = (0..order.len() as u32).collect();
+    by_id.sort_by_key(|&row| order[row as usize].id);
+    sections[Section::SymbolsById as usize] = words(&by_id);
+
+    let mut grams: BTreeMap<(u32, u32, u32), Vec<u32>> = BTreeMap::new();
+    let mut name_symbols = Vec::new();
+    for (name_id, (text, rows)) in names.iter().enumerate() {
+        let out = &mut sections[Section::Names as usize];
+        out.extend_from_slice(&strings.string(text)?);
+        out.extend_from_slice(&(name_symbols.len() as u32).to_le_bytes());
+        out.extend_from_slice(&(rows.len() as u32).to_le_bytes());
+        name_symbols.extend_from_slice(rows);
+
+        let mut name_grams = trigrams(text);
+        name_grams.sort_unstable();
+        name_grams.dedup();
+        for (a, b, c) in name_grams {
+            grams.entry((a as u32, b as u32, c as u32)).or_default().push(name_id as u32);
+        }
+    }
+    sections[Section::NameSymbols as usize] = words(&name_symbols);
+
+    let mut postings = Vec::new();
+    for ((a, b, c), name_ids) in &grams {
+        let out = &mut sections[Section::Grams as usize];
+        for word in [*a, *b, *c, postings.len() as u32, name_ids.len() as u32] {
+            out.extend_from_slice(&word.to_le_bytes());
+        }
+        postings.extend_from_slice(name_ids);
+    }
+    sections[Section::GramPostings as usize] = words(&postings);
+
+    let lengths: Vec<usize> = names.keys().map(|text| text.chars().count()).collect();
+    let mut by_length: Vec<u32> = (0..names.len() as u32).collect();
+    by_length.sort_by_key(|&name_id| (lengths[name_id as usize], name_id));
+    sections[Section::NamesByLength as usize] = words(&by_length);
+
+    sections[Section::GraphIds as usize] = graph.ids().iter().flat_map(|id| id.to_le_bytes()).collect();
+    for (direction, offsets_section, edges_section) in [
+        (Direction::Outgoing, Section::OutgoingOffsets, Section::OutgoingEdges),
+        (Direction::Incoming, Section::IncomingOffsets, Section::IncomingEdges),
+    ] {
+        let (offsets, targets, kinds) = graph.adjacency(direction);
+        sections[offsets_section as usize] = words(offsets);
+        let edges = &mut sections[edges_section as usize];
+        for (target, kind) in targets.iter().zip(kinds) {
+            edges.extend_from_slice(&target.to_le_bytes());
+            edges.extend_from_slice(&(RelationshipType::all().iter().position(|k| k == kind).unwrap_or_default() as u32).to_le_bytes());
+        }
+    }
+
+    let name = strings.string(&index.name)?;
+    let base_path = strings.string(&index.base_path)?;
+    let merkle_root = strings.optional(merkle_root)?;
+    sections[Section::Strings as usize] = strings.bytes;
+
+    let mut bytes = Vec::with_capacity(HEADER_LEN + sections.iter().map(|section| section.len() + SECTION_ALIGNMENT).sum::<usize>());
+    bytes.extend_from_slice(MAGIC);
+    bytes.extend_from_slice(&SNAPSHOT_VERSION.to_le_bytes());
+    bytes.extend_from_slice(&(SECTION_COUNT as u32).to_le_bytes());
+    bytes.extend_from_slice(index.id.as_bytes());
+    bytes.extend_from_slice(&index.created_at.timestamp_micros().to_le_bytes());
+    bytes.extend_from_slice(&index.updated_at.timestamp_micros().to_le_bytes());
+    bytes.extend_from_slice(&Utc::now().timestamp_micros().to_le_bytes());
+    bytes.extend_from_slice(&index.index_version.to_le_bytes());
+    bytes.extend_from_slice(&0u32.to_le_bytes());
+    bytes.extend_from_slice(&name);
+    bytes.extend_from_slice(&base_path);
+    bytes.extend_from_slice(&merkle_root);
+    bytes.extend_from_slice(&write_generation.to_le_bytes());
+
+    let table = bytes.len();
+    bytes.resize(table + SECTION_COUNT * SECTION_ENTRY_LEN, 0);
+    for (i, section) in sections.iter().enumerate() {
+        bytes.resize(bytes.len().next_multiple_of(SECTION_ALIGNMENT), 0);
+        let (entry, offset) = (table + i * SECTION_ENTRY_LEN, bytes.len() as u64);
+        bytes[entry..entry + 8].copy_from_slice(&offset.to_le_bytes());
+        bytes[entry + 8..entry + 16].copy_from_slice(&(section.len() as u64).to_le_bytes());
+        bytes.extend_from_slice(section);
+    }
+    Ok(bytes)
+}
+
+/// Deduplicated string bytes and the `(offset, length)` references into them
+#[derive(Default)]
+struct StringPool {
+    bytes: Vec<u8>,
+    offsets: HashMap<String, u32>,
+}
+
+impl StringPool {
+    fn string(&mut self, text: &str) -> Result<[u8; 8], Box<dyn Error>> {
+        let offset = match self.offsets.get(text) {
+            Some(&offset) => offset,
+            None => {
+                let offset = u32::try_from(self.bytes.len()).ok().filter(|&offset| offset != NO_STRING).ok_or("Snapshot string pool exceeds 4 GiB")?;
+                self.bytes.extend_from_slice(text.as_bytes());
+                self.offsets.insert(text.to_string(), offset);
+                offset
+            }
+        };
+        Ok(reference(offset, text.len() as u32))
+    }
+
+    fn optional(&mut self, text: Option<&str>) -> Result<[u8; 8], Box<dyn Error>> {
+        match text {
+            Some(text) => self.string(text),
+            None => Ok(reference(NO_STRING, 0)),
+        }
+    }
+}
+
+fn reference(offset: u32, len: u32) -> [u8; 8] {
+    let mut reference = [0u8; 8];
+    reference[..4].copy_from_slice(&offset.to_le_bytes());
+    reference[4..].copy_from_slice(&len.to_le_bytes());
+    reference
+}
+
+fn words(values: &[u32]) -> Vec<u8> {
+    values.iter().flat_map(|value| value.to_le_bytes()).collect()
+}
+
+fn read_u32(bytes: &[u8], at: usize) -> u32 {
+    u32::from_le_bytes(bytes[at..at + 4].try_into().expect("4-byte field"))
+}
+
+fn read_u64(bytes: &[u8], at: usize) -> u64 {
+    u64::from_le_bytes(bytes[at..at + 8].try_into().expect("8-byte field"))
+}
+
+fn read_i64(bytes: &[u8], at: usize) -> i64 {
+    i64::from_le_bytes(bytes[at..at + 8].try_into().expect("8-byte field"))
+}
+
+fn timestamp(micros: i64) -> DateTime<Utc> {
+    DateTime::from_timestamp_micros(micros).unwrap_or_default()
+}
+
+/// Number of leading positions in `0..len` for which `is_before` holds, which must be
+/// a prefix of the range
+fn lower_bound(len: usize, is_before: impl Fn(usize) -> bool) -> usize {
+    let (mut low, mut high) = (0, len);
+    while low < high {
+        let middle = low + (high - low) / 2;
+        if is_before(middle) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    low
+}
+
+fn encode_access(access_modifier: Option<AccessModifier>) -> u8 {
+    match access_modifier {
+        None => 0,
+        Some(AccessModifier::Public) => 1,
+        Some(AccessModifier::Private) => 2,
+        Some(AccessModifier::Protected) => 3,
+    }
+}
+
+fn decode_access(value: u8) -> Option<AccessModifier> {
+    match value {
+        1 => Some(AccessModifier::Public),
+        2 => Some(AccessModifier::Private),
+        3 => Some(AccessModifier::Protected),
+        _ => None,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::lib::storage::symbol_index::SymbolIndex;
+
+    fn element(id: i64, name: &str, symbol_type: SymbolType, file_path: &str, line_number: u32) -> CodeElement {
+        let mut element = CodeElement::new(Uuid::nil(), name.to_string(), symbol_type, file_path.to_string(), line_number, 1, String::new());
+        element.id = Some(id);
+        element
+    }
+
+    fn create_test_elements() -> Vec<CodeElement> {
+        vec![
+            element(1, "Parser", SymbolType::Class, "src/parser.h", 3).with_scope("io".to_string()),
+            element(2, "parse", SymbolType::Function, "src/parser.cpp", 10).with_access_modifier(AccessModifier::Public),
+            element(3, "parse_header", SymbolType::Function, "src/parser.cpp", 20),
+            element(4, "HeaderParser", SymbolType::Class, "src/header.h", 5),
+            element(5, "parse", SymbolType::Function, "src/header.h", 9),
+        ]
+    }
+
+    /// Writes a snapshot of the test elements, where 4 derives from 1 and 3 calls 2
+    fn create_test_snapshot(dir: &Path) -> Snapshot {
+        let index = CodeIndex::new("test".to_string(), "/src/project".to_string());
+        let files = vec![("src/parser.cpp".to_string(), "abc".to_string()), ("src/unused.h".to_string(), "def".to_string())];
+        let graph = SymbolGraph::from_edges(&[(4, 1, RelationshipType::Inherits), (3, 2, RelationshipType::Calls)]);
+
+        let bytes = encode(&index, Some("root"), 7, &files, &create_test_elements(), &graph).unwrap();
+        let path = dir.join("test.snapshot");
+        fs::write(&path, bytes).unwrap();
+        Snapshot::open(&path).unwrap()
+    }
+
+    #[test]
+    fn test_snapshot_round_trip() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let snapshot = create_test_snapshot(temp_dir.path());
+
+        assert_eq!(snapshot.index_name(), "test");
+        assert_eq!(snapshot.index().base_path, "/src/project");
+        assert_eq!(snapshot.merkle_root(), Some("root"));
+        assert_eq!(snapshot.write_generation(), 7);
+        assert_eq!((snapshot.file_count(), snapshot.symbol_count(), snapshot.edge_count()), (4, 5, 2));
+
+        let parser = snapshot.symbol_by_id(1).unwrap();
+        assert_eq!((parser.name, parser.file_path, parser.scope, parser.signature), ("Parser", "src/parser.h", Some("io"), None));
+        assert_eq!(snapshot.symbol_by_id(2).unwrap().access_modifier, Some(AccessModifier::Public));
+        assert!(snapshot.symbol_by_id(42).is_none());
+        assert_eq!(snapshot.element_ids_by_name("parse", &[]), vec![2, 5]);
+
+        let page = snapshot.file_symbols_page("src/header.h", None, 1).unwrap();
+        assert_eq!(page.items[0].id, 4);
+        let rest = snapshot.file_symbols_page("src/header.h", page.next_cursor.as_ref(), 10).unwrap();
+        assert_eq!(rest.items.iter().map(|symbol| symbol.id).collect::<Vec<_>>(), vec![5]);
+        assert_eq!(snapshot.count_file_symbols("src/unused.h"), 0);
+
+        let subclasses = snapshot.traverse(&[1], Direction::Incoming, &[RelationshipType::Inherits], 2, 100);
+        assert_eq!(subclasses.hits.iter().map(|hit| hit.id).collect::<Vec<_>>(), vec![4]);
+    }
+
+    #[test]
+    fn test_snapshot_search_matches_symbol_index() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let snapshot = create_test_snapshot(temp_dir.path());
+        let mut symbol_index = SymbolIndex::new();
+        for element in create_test_elements() {
+            symbol_index.insert(element.id.unwrap(), &element.symbol_name, element.symbol_type, &element.file_path);
+        }
+
+        for pattern in ["parse", "PARSER", "header", "prase", "pars", "prse", "xyz"] {
+            let expected = symbol_index.search(pattern, None, 1, None, 2).unwrap();
+            let actual = snapshot.search(pattern, None, 1, None, 2).unwrap();
+            assert_eq!(actual.matches, expected.matches, "{}", pattern);
+            assert_eq!(actual.total_count, expected.total_count, "{}", pattern);
+            assert_eq!(actual.next_cursor, expected.next_cursor, "{}", pattern);
+        }
+    }
+
+    #[test]
+    fn test_open_rejects_other_files() {
+        let temp_dir = tempfile::tempdir().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("other.snapshot");
+        fs::write(&path, b"not a snapshot").unwrap();
+        assert!(Snapshot::open(&path).is_err());
+    }
+}
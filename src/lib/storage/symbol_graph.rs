@@ -0,0 +1,283 @@
+use uuid::Uuid;
+
+use crate::lib::storage::error::Result;
+use crate::lib::storage::models::symbol_relationships::RelationshipType;
+use crate::lib::storage::repository::Repository;
+
+/// Which end of an edge a traversal starts from
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Direction {
+    /// From a symbol to what it calls, uses or derives from
+    Outgoing,
+    /// From a symbol to its callers, users and subclasses
+    Incoming,
+}
+
+/// Read-only adjacency over one index's `symbol_relationships`, in compressed sparse
+/// row form: one offsets array per direction into flat target and kind arrays, so a
+/// multi-hop traversal touches contiguous memory instead of issuing a query per hop.
+/// Rebuilt rather than patched when the index changes.
+#[derive(Debug, Default)]
+pub struct SymbolGraph {
+    /// Element id of each node, ascending, so node lookup is a binary search
+    ids: Vec<i64>,
+    outgoing: Adjacency,
+    incoming: Adjacency,
+}
+
+#[derive(Debug, Default)]
+struct Adjacency {
+    /// Edges of node `n` are `targets[offsets[n]..offsets[n + 1]]`
+    offsets: Vec<u32>,
+    targets: Vec<u32>,
+    kinds: Vec<RelationshipType>,
+}
+
+/// A symbol reached by a traversal and the number of hops it took
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct GraphHit {
+    pub id: i64,
+    pub depth: u32,
+}
+
+/// Symbols reached by a traversal, nearest first
+#[derive(Debug, Default)]
+pub struct Traversal {
+    pub hits: Vec<GraphHit>,
+    /// Whether the traversal stopped at its node limit
+    pub truncated: bool,
+}
+
+impl SymbolGraph {
+    /// Graph of `index_id`, spanning `overlay_base` too when the index is an overlay
+    pub fn load(repository: &Repository, index_id: &Uuid, overlay_base: Option<&Uuid>) -> Result<Self> {
+        Ok(Self::from_edges(&repository.list_symbol_graph_edges(index_id, overlay_base)?))
+    }
+
+    /// Builds the graph from `(from, to, type)` element id triples
+    pub fn from_edges(edges: &[(i64, i64, RelationshipType)]) -> Self {
+        let mut ids: Vec<i64> = edges.iter().flat_map(|&(from, to, _)| [from, to]).collect();
+        ids.sort_unstable();
+        ids.dedup();
+
+        let node = |id: i64| ids.binary_search(&id).expect("edge endpoints are nodes") as u32;
+        let nodes: Vec<(u32, u32, RelationshipType)> = edges
+            .iter()
+            .map(|&(from, to, kind)| (node(from), node(to), kind))
+            .collect();
+
+        let outgoing = Adjacency::build(ids.len(), nodes.iter().map(|&(from, to, kind)| (from, to, kind)));
+        let incoming = Adjacency::build(ids.len(), nodes.iter().map(|&(from, to, kind)| (to, from, kind)));
+        Self { ids, outgoing, incoming }
+    }
+
+    pub fn node_count(&self) -> usize {
+        self.ids.len()
+    }
+
+    pub fn edge_count(&self) -> usize {
+        self.outgoing.targets.len()
+    }
+
+    /// Breadth-first walk from `start` along edges of the given `kinds` (any kind when
+    /// empty), up to `max_depth` hops. Start symbols are only reported when reached
+    /// again through a cycle; at most `limit` symbols are returned.
+    pub fn traverse(
+        &self,
+        start: &[i64],
+        direction: Direction,
+        kinds: &[RelationshipType],
+        max_depth: u32,
+        limit: usize,
+    ) -> Traversal {
+        traverse(self, start, direction, kinds, max_depth, limit)
+    }
+
+    /// Node ids followed by each direction's offsets, targets and kinds, as an index
+    /// snapshot stores them
+    pub(crate) fn ids(&self) -> &[i64] {
+        &self.ids
+    }
+
+    pub(crate) fn adjacency(&self, direction: Direction) -> (&[u32], &[u32], &[RelationshipType]) {
+        let adjacency = match direction {
+            Direction::Outgoing => &self.outgoing,
+            Direction::Incoming => &self.incoming,
+        };
+        (&adjacency.offsets, &adjacency.targets, &adjacency.kinds)
+    }
+}
+
+/// Compressed sparse row storage a traversal runs over: a `SymbolGraph`, or an index
+/// snapshot read in place
+pub(crate) trait GraphLayout {
+    fn node_count(&self) -> usize;
+
+    /// Node holding element `id`
+    fn node(&self, id: i64) -> Option<u32>;
+
+    fn node_id(&self, node: u32) -> i64;
+
+    fn for_each_neighbor(&self, direction: Direction, node: u32, f: impl FnMut(u32, RelationshipType));
+}
+
+impl GraphLayout for SymbolGraph {
+    fn node_count(&self) -> usize {
+        self.ids.len()
+    }
+
+    fn node(&self, id: i64) -> Option<u32> {
+        self.ids.binary_search(&id).ok().map(|node| node as u32)
+    }
+
+    fn node_id(&self, node: u32) -> i64 {
+        self.ids[node as usize]
+    }
+
+    fn for_each_neighbor(&self, direction: Direction, node: u32, mut f: impl FnMut(u32, RelationshipType)) {
+        let adjacency = match direction {
+            Direction::Outgoing => &self.outgoing,
+            Direction::Incoming => &self.incoming,
+        };
+        for (target, kind) in adjacency.neighbors(node) {
+            f(target, kind);
+        }
+    }
+}
+
+/// Breadth-first walk over `graph`, see `SymbolGraph::traverse`
+pub(crate) fn traverse(
+    graph: &impl GraphLayout,
+    start: &[i64],
+    direction: Direction,
+    kinds: &[RelationshipType],
+    max_depth: u32,
+    limit: usize,
+) -> Traversal {
+    let mut visited = vec![0u64; graph.node_count().div_ceil(64)];
+    let mut visit = |node: u32| {
+        let (word, bit) = (node as usize / 64, 1u64 << (node % 64));
+        let first = visited[word] & bit == 0;
+        visited[word] |= bit;
+        first
+    };
+
+    let mut frontier: Vec<u32> = start.iter().filter_map(|&id| graph.node(id)).collect();
+    let mut traversal = Traversal::default();
+
+    for depth in 1..=max_depth {
+        let mut next = Vec::new();
+        for &node in &frontier {
+            graph.for_each_neighbor(direction, node, |target, kind| {
+                if (kinds.is_empty() || kinds.contains(&kind)) && visit(target) {
+                    next.push(target);
+                }
+            });
+        }
+
+        // Within one depth, hits are ordered by element id so pages are stable.
+        next.sort_unstable_by_key(|&node| graph.node_id(node));
+        for &node in &next {
+            if traversal.hits.len() == limit {
+                traversal.truncated = true;
+                return traversal;
+            }
+            traversal.hits.push(GraphHit { id: graph.node_id(node), depth });
+        }
+
+        if next.is_empty() {
+            break;
+        }
+        frontier = next;
+    }
+
+    traversal
+}
+
+impl Adjacency {
+    /// Counting sort of `(source, target, kind)` edges by source node
+    fn build(nodes: usize, edges: impl Iterator<Item = (u32, u32, RelationshipType)> + Clone) -> Self {
+        let mut offsets = vec![0u32; nodes + 1];
+        for (source, _, _) in edges.clone() {
+            offsets[source as usize + 1] += 1;
+        }
+        for node in 0..nodes {
+            offsets[node + 1] += offsets[node];
+        }
+
+        let edge_count = offsets[nodes] as usize;
+        let mut targets = vec![0u32; edge_count];
+        let mut kinds = vec![RelationshipType::Uses; edge_count];
+        let mut next = offsets.clone();
+        for (source, target, kind) in edges {
+            let slot = next[source as usize] as usize;
+            targets[slot] = target;
+            kinds[slot] = kind;
+            next[source as usize] += 1;
+        }
+
+        Self { offsets, targets, kinds }
+    }
+
+    fn neighbors(&self, node: u32) -> impl Iterator<Item = (u32, RelationshipType)> + '_ {
+        let range = self.offsets[node as usize] as usize..self.offsets[node as usize + 1] as usize;
+        self.targets[range.clone()].iter().copied().zip(self.kinds[range].iter().copied())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    // 1 calls 2 and 3, 2 calls 4, 3 calls 4 and back to 1; 5 derives from 4.
+    fn create_test_graph() -> SymbolGraph {
+        SymbolGraph::from_edges(&[
+            (1, 2, RelationshipType::Calls),
+            (1, 3, RelationshipType::Calls),
+            (2, 4, RelationshipType::Calls),
+            (3, 4, RelationshipType::Calls),
+            (3, 1, RelationshipType::Calls),
+            (5, 4, RelationshipType::Inherits),
+        ])
+    }
+
+    fn hits(traversal: &Traversal) -> Vec<(i64, u32)> {
+        traversal.hits.iter().map(|hit| (hit.id, hit.depth)).collect()
+    }
+
+    #[test]
+    fn test_graph_layout() {
+        let graph = create_test_graph();
+        assert_eq!(graph.node_count(), 5);
+        assert_eq!(graph.edge_count(), 6);
+    }
+
+    #[test]
+    fn test_traverse_follows_direction_and_depth() {
+        let graph = create_test_graph();
+
+        let callees = graph.traverse(&[1], Direction::Outgoing, &[RelationshipType::Calls], 1, 100);
+        assert_eq!(hits(&callees), vec![(2, 1), (3, 1)]);
+
+        // 4 is reachable twice at depth 2 but reported once; 1 comes back through 3.
+        let transitive = graph.traverse(&[1], Direction::Outgoing, &[RelationshipType::Calls], 5, 100);
+        assert_eq!(hits(&transitive), vec![(2, 1), (3, 1), (1, 2), (4, 2)]);
+
+        let callers = graph.traverse(&[4], Direction::Incoming, &[RelationshipType::Calls], 1, 100);
+        assert_eq!(hits(&callers), vec![(2, 1), (3, 1)]);
+    }
+
+    #[test]
+    fn test_traverse_filters_kinds_and_limits() {
+        let graph = create_test_graph();
+
+        let subclasses = graph.traverse(&[4], Direction::Incoming, &[RelationshipType::Inherits], 3, 100);
+        assert_eq!(hits(&subclasses), vec![(5, 1)]);
+
+        let any = graph.traverse(&[4], Direction::Incoming, &[], 1, 2);
+        assert_eq!(hits(&any), vec![(2, 1), (3, 1)]);
+        assert!(any.truncated);
+
+        assert!(graph.traverse(&[42], Direction::Outgoing, &[], 3, 100).hits.is_empty());
+    }
+}
@@ -0,0 +1,559 @@
+use serde_json::json;
+use std::collections::{BTreeMap, HashMap, HashSet};
+use std::ops::RangeInclusive;
+use uuid::Uuid;
+
+use crate::lib::storage::error::{Result, StorageError};
+use crate::lib::storage::models::code_element::SymbolType;
+use crate::lib::storage::pagination::Cursor;
+use crate::lib::storage::repository::Repository;
+use crate::lib::storage::symbol_table::SymbolTable;
+
+/// Length of the n-grams in the substring and fuzzy posting lists
+const GRAM_LENGTH: usize = 3;
+
+/// Cursor kind for search pages
+const SYMBOLS_CURSOR: &str = "symbols";
+
+pub(crate) type Trigram = (char, char, char);
+
+/// In-memory name table over one index's `code_elements`, answering exact, prefix,
+/// substring and fuzzy lookups with row ids so only the returned page is hydrated.
+/// Names are matched case-insensitively.
+#[derive(Debug, Default)]
+pub struct SymbolIndex {
+    names: Vec<NameEntry>,
+    by_name: BTreeMap<String, u32>,
+    trigrams: HashMap<Trigram, Vec<u32>>,
+    /// Names by length in chars, the candidates of fuzzy queries too short for trigrams
+    by_length: BTreeMap<usize, Vec<u32>>,
+    files: HashMap<String, Vec<(i64, u32)>>,
+    symbol_count: usize,
+}
+
+/// A distinct lowercase name and the symbols carrying it. Entries whose symbols were
+/// all removed stay allocated so posting lists never need rewriting.
+#[derive(Debug)]
+struct NameEntry {
+    text: String,
+    symbols: Vec<(i64, SymbolType)>,
+}
+
+/// How a symbol's name matched the query, in ranking order
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+pub enum MatchKind {
+    Exact,
+    Prefix,
+    Substring,
+    Fuzzy(usize),
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct SymbolMatch {
+    pub id: i64,
+    pub kind: MatchKind,
+}
+
+/// One page of matches plus the number of symbols matching overall
+#[derive(Debug, Default)]
+pub struct SymbolSearch {
+    pub matches: Vec<SymbolMatch>,
+    pub total_count: usize,
+    pub next_cursor: Option<Cursor>,
+}
+
+/// Sort key of one match: kind, name length, name, id
+type Position<'a> = (u64, usize, &'a str, i64);
+
+impl SymbolIndex {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Builds the index from every code element of `index_id`
+    pub fn load(repository: &Repository, index_id: &Uuid) -> Result<Self> {
+        let mut index = Self::new();
+        for (id, name, symbol_type, file_path) in repository.list_symbol_names(index_id)? {
+            index.insert(id, &name, symbol_type, &file_path);
+        }
+        Ok(index)
+    }
+
+    /// Number of symbols currently indexed
+    pub fn len(&self) -> usize {
+        self.symbol_count
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.symbol_count == 0
+    }
+
+    pub fn insert(&mut self, id: i64, name: &str, symbol_type: SymbolType, file_path: &str) {
+        let name_id = self.intern(name);
+        self.names[name_id as usize].symbols.push((id, symbol_type));
+        self.files.entry(file_path.to_string()).or_default().push((id, name_id));
+        self.symbol_count += 1;
+    }
+
+    /// Swaps a file's symbols for those in `symbols`, stored under the row ids `ids`
+    pub fn replace_file(&mut self, file_path: &str, symbols: &SymbolTable, ids: &[i64]) {
+        self.remove_file(file_path);
+        for (symbol, &id) in symbols.symbols().iter().zip(ids) {
+            self.insert(id, symbols.name(symbol), symbol.symbol_type, file_path);
+        }
+    }
+
+    pub fn remove_file(&mut self, file_path: &str) {
+        for (id, name_id) in self.files.remove(file_path).unwrap_or_default() {
+            let symbols = &mut self.names[name_id as usize].symbols;
+            if let Some(position) = symbols.iter().position(|(symbol_id, _)| *symbol_id == id) {
+                symbols.swap_remove(position);
+                self.symbol_count -= 1;
+            }
+        }
+    }
+
+    /// Symbols named exactly `pattern`
+    pub fn lookup_exact(&self, pattern: &str, symbol_types: Option<&[SymbolType]>, after: Option<&Cursor>, limit: usize) -> Result<SymbolSearch> {
+        lookup_exact(self, pattern, symbol_types, after, limit)
+    }
+
+    /// Ranked search: exact names first, then prefix, substring and finally names
+    /// within `max_edits` edits, each group ordered by closeness and name length.
+    /// Pages after the first resume from `after`, the previous page's `next_cursor`.
+    pub fn search(
+        &self,
+        pattern: &str,
+        symbol_types: Option<&[SymbolType]>,
+        max_edits: usize,
+        after: Option<&Cursor>,
+        limit: usize,
+    ) -> Result<SymbolSearch> {
+        search(self, pattern, symbol_types, max_edits, after, limit)
+    }
+
+    /// Edit budget for a query: none for short patterns, which match too much already
+    pub fn default_max_edits(pattern: &str) -> usize {
+        match pattern.chars().count() {
+            0..=3 => 0,
+            4..=7 => 1,
+            _ => 2,
+        }
+    }
+
+    fn intern(&mut self, name: &str) -> u32 {
+        let text = name.to_lowercase();
+        if let Some(&name_id) = self.by_name.get(&text) {
+            return name_id;
+        }
+
+        let name_id = self.names.len() as u32;
+        let mut grams: Vec<Trigram> = trigrams(&text);
+        grams.sort_unstable();
+        grams.dedup();
+        for gram in grams {
+            self.trigrams.entry(gram).or_default().push(name_id);
+        }
+        self.by_length.entry(text.chars().count()).or_default().push(name_id);
+
+        self.by_name.insert(text.clone(), name_id);
+        self.names.push(NameEntry { text, symbols: Vec::new() });
+        name_id
+    }
+}
+
+/// Name storage the ranked search runs over: the mutable `SymbolIndex`, or an
+/// index snapshot read in place
+pub(crate) trait NameTable {
+    fn name_count(&self) -> u32;
+
+    /// Lowercase text of a name
+    fn name_text(&self, name_id: u32) -> &str;
+
+    fn find_name(&self, text: &str) -> Option<u32>;
+
+    /// Names starting with `prefix`, in ascending order
+    fn names_with_prefix(&self, prefix: &str) -> Vec<u32>;
+
+    /// Names containing `gram`, or `None` when there are none
+    fn gram_postings(&self, gram: Trigram) -> Option<Postings<'_>>;
+
+    /// Names whose length in chars lies in `lengths`
+    fn names_of_length(&self, lengths: RangeInclusive<usize>) -> Vec<u32>;
+
+    /// Appends `(id, type)` of every symbol carrying the name to `out`
+    fn name_symbols(&self, name_id: u32, out: &mut Vec<(i64, SymbolType)>);
+}
+
+/// A posting list of name ids, held in memory or as little-endian words in a file
+#[derive(Debug, Clone, Copy)]
+pub(crate) enum Postings<'a> {
+    Ids(&'a [u32]),
+    Packed(&'a [u8]),
+}
+
+impl<'a> Postings<'a> {
+    pub(crate) fn len(&self) -> usize {
+        match self {
+            Postings::Ids(ids) => ids.len(),
+            Postings::Packed(bytes) => bytes.len() / 4,
+        }
+    }
+
+    pub(crate) fn iter(&self) -> impl Iterator<Item = u32> + 'a {
+        let (ids, bytes) = match *self {
+            Postings::Ids(ids) => (ids, &[][..]),
+            Postings::Packed(bytes) => (&[][..], bytes),
+        };
+        ids.iter()
+            .copied()
+            .chain(bytes.chunks_exact(4).map(|word| u32::from_le_bytes([word[0], word[1], word[2], word[3]])))
+    }
+}
+
+impl NameTable for SymbolIndex {
+    fn name_count(&self) -> u32 {
+        self.names.len() as u32
+    }
+
+    fn name_text(&self, name_id: u32) -> &str {
+        &self.names[name_id as usize].text
+    }
+
+    fn find_name(&self, text: &str) -> Option<u32> {
+        self.by_name.get(text).copied()
+    }
+
+    fn names_with_prefix(&self, prefix: &str) -> Vec<u32> {
+        self.by_name
+            .range(prefix.to_string()..)
+            .take_while(|(name, _)| name.starts_with(prefix))
+            .map(|(_, &name_id)| name_id)
+            .collect()
+    }
+
+    fn gram_postings(&self, gram: Trigram) -> Option<Postings<'_>> {
+        self.trigrams.get(&gram).map(|postings| Postings::Ids(postings))
+    }
+
+    fn names_of_length(&self, lengths: RangeInclusive<usize>) -> Vec<u32> {
+        self.by_length.range(lengths).flat_map(|(_, name_ids)| name_ids.iter().copied()).collect()
+    }
+
+    fn name_symbols(&self, name_id: u32, out: &mut Vec<(i64, SymbolType)>) {
+        out.extend_from_slice(&self.names[name_id as usize].symbols);
+    }
+}
+
+/// Symbols of `table` named exactly `pattern`
+pub(crate) fn lookup_exact(
+    table: &impl NameTable,
+    pattern: &str,
+    symbol_types: Option<&[SymbolType]>,
+    after: Option<&Cursor>,
+    limit: usize,
+) -> Result<SymbolSearch> {
+    let ranked: Vec<(MatchKind, u32)> = table
+        .find_name(&pattern.to_lowercase())
+        .map(|name_id| (MatchKind::Exact, name_id))
+        .into_iter()
+        .collect();
+    page(table, ranked, symbol_types, after, limit)
+}
+
+/// Ranked search of `table`, see `SymbolIndex::search`
+pub(crate) fn search(
+    table: &impl NameTable,
+    pattern: &str,
+    symbol_types: Option<&[SymbolType]>,
+    max_edits: usize,
+    after: Option<&Cursor>,
+    limit: usize,
+) -> Result<SymbolSearch> {
+    let pattern = pattern.to_lowercase();
+    if pattern.is_empty() {
+        return Ok(SymbolSearch::default());
+    }
+
+    let mut ranked = Vec::new();
+    let mut seen = HashSet::new();
+
+    for name_id in table.names_with_prefix(&pattern) {
+        let kind = if table.name_text(name_id) == pattern { MatchKind::Exact } else { MatchKind::Prefix };
+        ranked.push((kind, name_id));
+        seen.insert(name_id);
+    }
+
+    for name_id in substring_candidates(table, &pattern) {
+        if !seen.contains(&name_id) && table.name_text(name_id).contains(&pattern) {
+            ranked.push((MatchKind::Substring, name_id));
+            seen.insert(name_id);
+        }
+    }
+
+    if max_edits > 0 {
+        for name_id in fuzzy_candidates(table, &pattern, max_edits) {
+            if seen.contains(&name_id) {
+                continue;
+            }
+            if let Some(distance) = bounded_edit_distance(&pattern, table.name_text(name_id), max_edits) {
+                ranked.push((MatchKind::Fuzzy(distance), name_id));
+            }
+        }
+    }
+
+    page(table, ranked, symbol_types, after, limit)
+}
+
+/// Names that can contain `pattern`: the shortest posting list among its trigrams,
+/// or every name when the pattern is shorter than a trigram.
+fn substring_candidates(table: &impl NameTable, pattern: &str) -> Vec<u32> {
+    let grams = trigrams(pattern);
+    if grams.is_empty() {
+        return (0..table.name_count()).collect();
+    }
+
+    let mut shortest: Option<Postings> = None;
+    for gram in grams {
+        match table.gram_postings(gram) {
+            Some(postings) if shortest.map_or(true, |shortest| postings.len() < shortest.len()) => shortest = Some(postings),
+            Some(_) => {}
+            None => return Vec::new(),
+        }
+    }
+    shortest.map(|postings| postings.iter().collect()).unwrap_or_default()
+}
+
+/// Names sharing enough trigrams with `pattern` to be within `max_edits` edits;
+/// each edit destroys at most three of the pattern's distinct trigrams. When that
+/// bound is vacuous every name of a compatible length is a candidate, taken from the
+/// table's length index rather than a scan of all names.
+fn fuzzy_candidates(table: &impl NameTable, pattern: &str, max_edits: usize) -> Vec<u32> {
+    let mut grams = trigrams(pattern);
+    grams.sort_unstable();
+    grams.dedup();
+
+    let required = grams.len().saturating_sub(max_edits * GRAM_LENGTH);
+    if required == 0 {
+        let length = pattern.chars().count();
+        return table.names_of_length(length.saturating_sub(max_edits)..=length + max_edits);
+    }
+
+    let mut shared: HashMap<u32, usize> = HashMap::new();
+    for &gram in &grams {
+        for name_id in table.gram_postings(gram).iter().flat_map(Postings::iter) {
+            *shared.entry(name_id).or_insert(0) += 1;
+        }
+    }
+
+    shared
+        .into_iter()
+        .filter(|&(_, count)| count >= required)
+        .map(|(name_id, _)| name_id)
+        .collect()
+}
+
+/// Orders matched names, expands them to symbols of the requested types and keeps
+/// the first `limit` after `after`, counting all of them.
+fn page(
+    table: &impl NameTable,
+    mut ranked: Vec<(MatchKind, u32)>,
+    symbol_types: Option<&[SymbolType]>,
+    after: Option<&Cursor>,
+    limit: usize,
+) -> Result<SymbolSearch> {
+    ranked.sort_by(|(kind_a, a), (kind_b, b)| {
+        let (name_a, name_b) = (table.name_text(*a), table.name_text(*b));
+        kind_a
+            .cmp(kind_b)
+            .then(name_a.len().cmp(&name_b.len()))
+            .then(name_a.cmp(name_b))
+    });
+
+    let after = after.map(cursor_position).transpose()?;
+    let wanted = |symbol_type: &SymbolType| symbol_types.map_or(true, |types| types.is_empty() || types.contains(symbol_type));
+
+    let mut result = SymbolSearch::default();
+    let mut last = None;
+    let mut symbols = Vec::new();
+    for (kind, name_id) in ranked {
+        let name = table.name_text(name_id);
+        symbols.clear();
+        table.name_symbols(name_id, &mut symbols);
+        let mut ids: Vec<i64> = symbols
+            .iter()
+            .filter(|(_, symbol_type)| wanted(symbol_type))
+            .map(|(id, _)| *id)
+            .collect();
+        ids.sort_unstable();
+
+        result.total_count += ids.len();
+        for id in ids {
+            let position = (kind_rank(kind), name.len(), name, id);
+            if after.as_ref().map_or(false, |(rank, len, text, last_id)| position <= (*rank, *len, text.as_str(), *last_id)) {
+                continue;
+            }
+            if result.matches.len() < limit {
+                result.matches.push(SymbolMatch { id, kind });
+                last = Some(position);
+            } else if result.next_cursor.is_none() {
+                result.next_cursor = last.map(position_cursor);
+            }
+        }
+    }
+    Ok(result)
+}
+
+impl SymbolMatch {
+    /// Cursor resuming a search just after this match of a symbol named `name`, for
+    /// callers that stop part way through a page
+    pub fn cursor_after(&self, name: &str) -> Cursor {
+        let text = name.to_lowercase();
+        position_cursor((kind_rank(self.kind), text.len(), &text, self.id))
+    }
+}
+
+/// Match kinds as one ascending number, fuzzy matches ordered by distance
+fn kind_rank(kind: MatchKind) -> u64 {
+    match kind {
+        MatchKind::Exact => 0,
+        MatchKind::Prefix => 1,
+        MatchKind::Substring => 2,
+        MatchKind::Fuzzy(distance) => 3 + distance as u64,
+    }
+}
+
+fn position_cursor((rank, len, name, id): Position) -> Cursor {
+    Cursor::new(SYMBOLS_CURSOR, vec![json!(rank), json!(len), json!(name), json!(id)])
+}
+
+fn cursor_position(cursor: &Cursor) -> Result<(u64, usize, String, i64)> {
+    let key = cursor.key_for(SYMBOLS_CURSOR, 4)?;
+    match (key[0].as_u64(), key[1].as_u64(), key[2].as_str(), key[3].as_i64()) {
+        (Some(rank), Some(len), Some(name), Some(id)) => Ok((rank, len as usize, name.to_string(), id)),
+        _ => Err(StorageError::InvalidArgument("Invalid cursor key".to_string())),
+    }
+}
+
+pub(crate) fn trigrams(text: &str) -> Vec<Trigram> {
+    let chars: Vec<char> = text.chars().collect();
+    chars.windows(GRAM_LENGTH).map(|w| (w[0], w[1], w[2])).collect()
+}
+
+/// Levenshtein distance between `a` and `b`, or `None` once it must exceed `max`
+fn bounded_edit_distance(a: &str, b: &str, max: usize) -> Option<usize> {
+    let a: Vec<char> = a.chars().collect();
+    let b: Vec<char> = b.chars().collect();
+    if a.len().abs_diff(b.len()) > max {
+        return None;
+    }
+
+    let mut previous: Vec<usize> = (0..=b.len()).collect();
+    let mut current = vec![0; b.len() + 1];
+
+    for (i, ca) in a.iter().enumerate() {
+        current[0] = i + 1;
+        let mut row_min = current[0];
+        for (j, cb) in b.iter().enumerate() {
+            let substitution = previous[j] + usize::from(ca != cb);
+            current[j + 1] = substitution.min(previous[j + 1] + 1).min(current[j] + 1);
+            row_min = row_min.min(current[j + 1]);
+        }
+        if row_min > max {
+            return None;
+        }
+        std::mem::swap(&mut previous, &mut current);
+    }
+
+    Some(previous[b.len()]).filter(|&distance| distance <= max)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::lib::storage::symbol_table::SymbolRecord;
+
+    fn create_test_index() -> SymbolIndex {
+        let mut index = SymbolIndex::new();
+        index.insert(1, "parse", SymbolType::Function, "src/parser.cpp");
+        index.insert(2, "Parser", SymbolType::Class, "src/parser.h");
+        index.insert(3, "parseHeader", SymbolType::Function, "src/parser.cpp");
+        index.insert(4, "reparse", SymbolType::Function, "src/parser.cpp");
+        index.insert(5, "parce", SymbolType::Variable, "src/typo.cpp");
+        index.insert(6, "Lexer", SymbolType::Class, "src/lexer.h");
+        index
+    }
+
+    fn ids(search: &SymbolSearch) -> Vec<i64> {
+        search.matches.iter().map(|m| m.id).collect()
+    }
+
+    #[test]
+    fn test_search_ranks_match_kinds() {
+        let index = create_test_index();
+        let search = index.search("parse", None, 1, None, 10).unwrap();
+
+        assert_eq!(ids(&search), vec![1, 2, 3, 4, 5]);
+        assert_eq!(search.matches[0].kind, MatchKind::Exact);
+        assert_eq!(search.matches[1].kind, MatchKind::Prefix);
+        assert_eq!(search.matches[3].kind, MatchKind::Substring);
+        assert_eq!(search.matches[4].kind, MatchKind::Fuzzy(1));
+        assert_eq!(search.total_count, 5);
+    }
+
+    #[test]
+    fn test_short_fuzzy_pattern_uses_length_index() {
+        let index = create_test_index();
+        assert_eq!(index.names_of_length(5..=5).len(), 3);
+
+        // Too short to share a trigram with "lexer" after an edit
+        let search = index.search("lexr", None, 1, None, 10).unwrap();
+        assert_eq!(ids(&search), vec![6]);
+        assert_eq!(search.matches[0].kind, MatchKind::Fuzzy(1));
+    }
+
+    #[test]
+    fn test_search_filters_types_and_pages() {
+        let index = create_test_index();
+
+        let functions = index.search("parse", Some(&[SymbolType::Function]), 1, None, 10).unwrap();
+        assert_eq!(ids(&functions), vec![1, 3, 4]);
+
+        let page = index.search("parse", None, 1, None, 2).unwrap();
+        assert_eq!(ids(&page), vec![1, 2]);
+        assert_eq!(page.total_count, 5);
+
+        let next = index.search("parse", None, 1, page.next_cursor.as_ref(), 2).unwrap();
+        assert_eq!(ids(&next), vec![3, 4]);
+        let last = index.search("parse", None, 1, next.next_cursor.as_ref(), 2).unwrap();
+        assert_eq!(ids(&last), vec![5]);
+        assert!(last.next_cursor.is_none());
+
+        // Resuming after a match in the middle of a page continues with the next one
+        let after_first = page.matches[0].cursor_after("parse");
+        assert_eq!(ids(&index.search("parse", None, 1, Some(&after_first), 2).unwrap()), vec![2, 3]);
+
+        assert_eq!(ids(&index.lookup_exact("PARSER", None, None, 10).unwrap()), vec![2]);
+        assert_eq!(ids(&index.search("ex", None, 0, None, 10).unwrap()), vec![6]);
+    }
+
+    #[test]
+    fn test_replace_file_updates_matches() {
+        let mut index = create_test_index();
+        let mut symbols = SymbolTable::new();
+        symbols.push(SymbolRecord::new("Tokenizer", SymbolType::Class, 1, 1, [0xaa; 32]));
+
+        index.replace_file("src/lexer.h", &symbols, &[7]);
+
+        assert!(index.search("lexer", None, 0, None, 10).unwrap().matches.is_empty());
+        assert_eq!(ids(&index.search("token", None, 0, None, 10).unwrap()), vec![7]);
+        assert_eq!(index.len(), 6);
+    }
+
+    #[test]
+    fn test_bounded_edit_distance() {
+        assert_eq!(bounded_edit_distance("parse", "prase", 2), Some(2));
+        assert_eq!(bounded_edit_distance("parse", "parser", 1), Some(1));
+        assert_eq!(bounded_edit_distance("parse", "lexer", 2), None);
+    }
+}
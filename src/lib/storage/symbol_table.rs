@@ -0,0 +1,182 @@
+use crate::lib::storage::interner::{StrId, StringInterner};
+use crate::lib::storage::models::code_element::{AccessModifier, SymbolType};
+
+/// Fixed-size record of one symbol; its text lives in the owning `SymbolTable`
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct CompactSymbol {
+    pub name: StrId,
+    /// `StrId::EMPTY` for symbols at global scope
+    pub scope: StrId,
+    /// `StrId::EMPTY` when the type is unknown
+    pub signature: StrId,
+    /// libclang USR; `StrId::EMPTY` for symbols only tree-sitter saw
+    pub usr: StrId,
+    pub symbol_type: SymbolType,
+    pub access_modifier: Option<AccessModifier>,
+    pub is_declaration: bool,
+    /// 1-based position of the symbol
+    pub line_number: u32,
+    pub column_number: u32,
+    /// SHA-256 of the definition text
+    pub definition_hash: [u8; 32],
+}
+
+/// Borrowed form of a symbol, interned when pushed into a `SymbolTable`
+#[derive(Debug, Clone, Copy)]
+pub struct SymbolRecord<'a> {
+    pub name: &'a str,
+    pub symbol_type: SymbolType,
+    pub line_number: u32,
+    pub column_number: u32,
+    pub definition_hash: [u8; 32],
+    pub scope: Option<&'a str>,
+    pub access_modifier: Option<AccessModifier>,
+    pub is_declaration: bool,
+    pub signature: Option<&'a str>,
+    pub usr: Option<&'a str>,
+}
+
+impl<'a> SymbolRecord<'a> {
+    pub fn new(name: &'a str, symbol_type: SymbolType, line_number: u32, column_number: u32, definition_hash: [u8; 32]) -> Self {
+        Self {
+            name,
+            symbol_type,
+            line_number,
+            column_number,
+            definition_hash,
+            scope: None,
+            access_modifier: None,
+            is_declaration: false,
+            signature: None,
+            usr: None,
+        }
+    }
+
+    pub fn with_scope(mut self, scope: &'a str) -> Self {
+        self.scope = Some(scope);
+        self
+    }
+
+    pub fn with_access_modifier(mut self, access_modifier: AccessModifier) -> Self {
+        self.access_modifier = Some(access_modifier);
+        self
+    }
+
+    pub fn with_declaration(mut self, is_declaration: bool) -> Self {
+        self.is_declaration = is_declaration;
+        self
+    }
+
+    pub fn with_signature(mut self, signature: &'a str) -> Self {
+        self.signature = Some(signature);
+        self
+    }
+
+    pub fn with_usr(mut self, usr: &'a str) -> Self {
+        self.usr = Some(usr);
+        self
+    }
+}
+
+/// Symbols on their way into storage: compact records over one string table, so
+/// names, scopes and signatures shared by many symbols are stored once
+#[derive(Debug, Clone, Default)]
+pub struct SymbolTable {
+    strings: StringInterner,
+    symbols: Vec<CompactSymbol>,
+}
+
+impl SymbolTable {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Appends a symbol; returns its position, which relationships refer to
+    pub fn push(&mut self, record: SymbolRecord<'_>) -> usize {
+        let symbol = CompactSymbol {
+            name: self.strings.intern(record.name),
+            scope: record.scope.map_or(StrId::EMPTY, |scope| self.strings.intern(scope)),
+            signature: record.signature.map_or(StrId::EMPTY, |signature| self.strings.intern(signature)),
+            usr: record.usr.map_or(StrId::EMPTY, |usr| self.strings.intern(usr)),
+            symbol_type: record.symbol_type,
+            access_modifier: record.access_modifier,
+            is_declaration: record.is_declaration,
+            line_number: record.line_number,
+            column_number: record.column_number,
+            definition_hash: record.definition_hash,
+        };
+        self.symbols.push(symbol);
+        self.symbols.len() - 1
+    }
+
+    pub fn symbols(&self) -> &[CompactSymbol] {
+        &self.symbols
+    }
+
+    pub fn len(&self) -> usize {
+        self.symbols.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.symbols.is_empty()
+    }
+
+    pub fn resolve(&self, id: StrId) -> &str {
+        self.strings.resolve(id)
+    }
+
+    pub fn name(&self, symbol: &CompactSymbol) -> &str {
+        self.strings.resolve(symbol.name)
+    }
+
+    /// `None` for an empty id, matching the nullable column it is stored in
+    pub fn optional(&self, id: StrId) -> Option<&str> {
+        (!id.is_empty()).then(|| self.strings.resolve(id))
+    }
+
+    /// Approximate heap memory held by the records and their strings
+    pub fn heap_bytes(&self) -> usize {
+        self.symbols.capacity() * std::mem::size_of::<CompactSymbol>() + self.strings.heap_bytes()
+    }
+}
+
+/// Lowercase hex of a hash, written into `buffer` to avoid an allocation per row
+pub fn hex_digest<'a>(hash: &[u8; 32], buffer: &'a mut [u8; 64]) -> &'a str {
+    const DIGITS: &[u8; 16] = b"0123456789abcdef";
+    for (i, byte) in hash.iter().enumerate() {
+        buffer[2 * i] = DIGITS[(byte >> 4) as usize];
+        buffer[2 * i + 1] = DIGITS[(byte & 0x0f) as usize];
+    }
+    std::str::from_utf8(buffer).unwrap_or_default()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_symbols_share_strings() {
+        let mut table = SymbolTable::new();
+        let circle = table.push(SymbolRecord::new("Circle", SymbolType::Class, 3, 7, [1; 32]).with_scope("shapes"));
+        let square = table.push(SymbolRecord::new("Square", SymbolType::Class, 9, 7, [2; 32]).with_scope("shapes"));
+
+        let symbols = table.symbols();
+        assert_eq!(table.name(&symbols[circle]), "Circle");
+        assert_eq!(symbols[circle].scope, symbols[square].scope);
+        assert_eq!(table.optional(symbols[square].scope), Some("shapes"));
+        assert_eq!(table.optional(symbols[square].signature), None);
+    }
+
+    #[test]
+    fn test_hex_digest() {
+        let mut hash = [0u8; 32];
+        hash[0] = 0xab;
+        hash[31] = 0x01;
+        let mut buffer = [0u8; 64];
+
+        let hex = hex_digest(&hash, &mut buffer);
+        assert_eq!(hex.len(), 64);
+        assert!(hex.starts_with("ab00"));
+        assert!(hex.ends_with("01"));
+    }
+}
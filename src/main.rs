@@ -1,16 +1,16 @@
-use anyhow::Result;
+use anyhow::{anyhow, Result};
 use clap::{Parser, Subcommand};
-use tracing::info;
-
-mod config;
-
-// Library modules will be implemented later
-// mod lib {
-//     pub mod cpp_indexer;
-//     pub mod mcp_server;
-//     pub mod storage;
-//     pub mod cli_interface;
-// }
+use cpp_index_mcp::lib::cpp_indexer::{
+    CompilationDatabase, EnrichmentQueue, IncrementalIndexer, IndexAction, IndexWatcher, MemoryBudget, MerkleTree, PchCache, ShardSpec, WatchSettings,
+};
+use cpp_index_mcp::lib::mcp_server::result_cache::DEFAULT_CACHE_BYTES;
+use cpp_index_mcp::lib::mcp_server::{McpServer, ResultCache, ToolHandlers};
+use cpp_index_mcp::lib::storage::models::code_index::IndexState;
+use cpp_index_mcp::lib::storage::{ConnectionPool, DatabaseConfig, DatabaseManager, Snapshot};
+use cpp_index_mcp::Config;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use tracing::{info, warn};
 
 #[derive(Parser)]
 #[command(author, version, about, long_about = None)]
@@ -36,6 +36,13 @@ enum Commands {
         /// Index name to serve
         #[arg(long)]
         index: String,
+        /// Re-index files under the index's base path as they change
+        #[arg(long)]
+        watch: bool,
+        /// compile_commands.json the index was built with, for files updated or
+        /// re-indexed while serving
+        #[arg(long)]
+        compile_commands: Option<String>,
     },
     /// Query symbols
     Query {
@@ -58,9 +65,52 @@ enum IndexActions {
         /// Path to C++ codebase
         #[arg(long)]
         path: String,
+        /// compile_commands.json supplying per-file compile flags
+        #[arg(long)]
+        compile_commands: Option<String>,
+        /// Index only shard K of N, assigned by path hash, e.g. 2/8
+        #[arg(long, conflicts_with = "files")]
+        shard: Option<String>,
+        /// Index only the files listed in this file, one path per line
+        #[arg(long)]
+        files: Option<String>,
+    },
+    /// Merge shard databases built with --shard or --files into one index
+    Merge {
+        /// Index name
+        #[arg(long)]
+        name: String,
+        /// Path to the C++ codebase on this machine; defaults to the first shard's
+        #[arg(long)]
+        path: Option<String>,
+        /// Shard database, once per shard
+        #[arg(long = "shard", required = true)]
+        shards: Vec<String>,
+    },
+    /// Build or refresh a branch overlay: an index holding only the files that differ
+    /// from a base index, which queries fall through to for everything else
+    Overlay {
+        /// Overlay index name, e.g. the branch's
+        #[arg(long)]
+        name: String,
+        /// Index the overlay is based on
+        #[arg(long)]
+        base: String,
+        /// Path to the branch's checkout
+        #[arg(long)]
+        path: String,
+        /// compile_commands.json supplying per-file compile flags
+        #[arg(long)]
+        compile_commands: Option<String>,
     },
     /// List existing indices
     List,
+    /// Export a read-only snapshot that servers map at startup
+    Snapshot {
+        /// Index name
+        #[arg(long)]
+        name: String,
+    },
     /// Delete index
     Delete {
         /// Index name
@@ -83,16 +133,36 @@ fn main() -> Result<()> {
     match cli.command {
         Commands::Index { action } => {
             match action {
-                IndexActions::Create { name, path } => {
+                IndexActions::Create { name, path, compile_commands, shard, files } => {
                     info!("Creating index '{}' for path '{}'", name, path);
-                    // TODO: Implement index creation
-                    println!("Index creation not yet implemented");
+                    let runtime = tokio::runtime::Runtime::new()?;
+                    runtime.block_on(create_index(
+                        &name,
+                        Path::new(&path),
+                        compile_commands.as_deref().map(Path::new),
+                        shard.as_deref(),
+                        files.as_deref().map(Path::new),
+                    ))?;
+                }
+                IndexActions::Merge { name, path, shards } => {
+                    info!("Merging {} shards into index '{}'", shards.len(), name);
+                    let shards: Vec<PathBuf> = shards.iter().map(PathBuf::from).collect();
+                    merge_shards(&name, path.as_deref().map(Path::new), &shards)?;
+                }
+                IndexActions::Overlay { name, base, path, compile_commands } => {
+                    info!("Building overlay '{}' over '{}' for path '{}'", name, base, path);
+                    let runtime = tokio::runtime::Runtime::new()?;
+                    runtime.block_on(build_overlay(&name, &base, Path::new(&path), compile_commands.as_deref().map(Path::new)))?;
                 }
                 IndexActions::List => {
                     info!("Listing indices");
                     // TODO: Implement index listing
                     println!("Index listing not yet implemented");
                 }
+                IndexActions::Snapshot { name } => {
+                    info!("Exporting snapshot of index '{}'", name);
+                    export_snapshot(&name)?;
+                }
                 IndexActions::Delete { name } => {
                     info!("Deleting index '{}'", name);
                     // TODO: Implement index deletion
@@ -105,10 +175,10 @@ fn main() -> Result<()> {
             // TODO: Implement interactive menu
             println!("Interactive menu not yet implemented");
         }
-        Commands::Server { stdio, index } => {
-            info!("Starting MCP server for index '{}' with stdio={}", index, stdio);
-            // TODO: Implement MCP server
-            println!("MCP server not yet implemented");
+        Commands::Server { stdio, index, watch, compile_commands } => {
+            info!("Starting MCP server for index '{}' with stdio={} watch={}", index, stdio, watch);
+            let runtime = tokio::runtime::Runtime::new()?;
+            runtime.block_on(serve(&index, watch, compile_commands.as_deref().map(Path::new)))?;
         }
         Commands::Query { index, symbol } => {
             info!("Querying symbol '{}' in index '{}'", symbol, index);
@@ -118,4 +188,323 @@ fn main() -> Result<()> {
     }
 
     Ok(())
-}
\ No newline at end of file
+}
+
+async fn create_index(
+    name: &str,
+    path: &Path,
+    compile_commands: Option<&Path>,
+    shard: Option<&str>,
+    files: Option<&Path>,
+) -> Result<()> {
+    let config = Config::load()?;
+    let root = std::fs::canonicalize(path)?;
+    let shard = match (shard, files) {
+        (Some(shard), _) => Some(ShardSpec::parse(shard)),
+        (None, Some(files)) => Some(ShardSpec::from_file_list(files, &root)),
+        (None, None) => None,
+    }
+    .transpose()
+    .map_err(|e| anyhow!("{}", e))?;
+    
+    let tool_handlers = open_tool_handlers(&config)?;
+    tool_handlers.open_index(name, &root)?;
+    
+    let compilation_database = load_compilation_database(compile_commands)?;
+    let mut indexer = build_indexer(&config, name, compilation_database.as_ref())?
+        .with_dependencies(tool_handlers.file_dependencies(name)?)
+        .with_deferred_enrichment(config.enable_deferred_enrichment);
+    
+    if let Some(shard) = shard {
+        indexer = indexer.with_shard(shard);
+    }
+    
+    let mut sink = tool_handlers.change_sink(name)?;
+    let results = match indexer.update_directory_into(&root, &mut sink).await {
+        Ok(results) => results,
+        Err(e) => {
+            tool_handlers.set_index_state(name, IndexState::Failed)?;
+            return Err(anyhow!("{}", e));
+        }
+    };
+    tool_handlers.set_index_state(name, IndexState::Active)?;
+    
+    let indexed = results.iter().filter(|result| matches!(result.action, IndexAction::Indexed)).count();
+    let removed = results.iter().filter(|result| matches!(result.action, IndexAction::Removed)).count();
+    let symbols: usize = results.iter().map(|result| result.symbols_extracted).sum();
+    println!(
+        "Index '{}': {} files indexed ({} unchanged, {} removed), {} symbols",
+        name, indexed, results.len() - indexed - removed, removed, symbols
+    );
+    
+    if config.enable_deferred_enrichment {
+        let pending = tool_handlers.pending_enrichment(name)?;
+        if !pending.is_empty() {
+            println!("Index '{}' is queryable; enriching {} files with libclang", name, pending.len());
+            let extractor = indexer.enrichment_extractor().map_err(|e| anyhow!("{}", e))?;
+            let queue = EnrichmentQueue::spawn(pending, extractor, Box::new(tool_handlers.change_sink(name)?))
+                .map_err(|e| anyhow!("{}", e))?;
+            let summary = tokio::task::spawn_blocking(move || queue.wait()).await?;
+            println!(
+                "Index '{}': {} files enriched ({} failed, {} changed since queued)",
+                name, summary.enriched, summary.failed, summary.stale
+            );
+        }
+    }
+    
+    Ok(())
+}
+
+/// Indexes the files of `path` that differ from the base index into the overlay `name`.
+/// Files matching the base are only stat'ed, or not even read with git hashes, so
+/// refreshing an overlay after switching branches costs about as much as the diff.
+async fn build_overlay(name: &str, base: &str, path: &Path, compile_commands: Option<&Path>) -> Result<()> {
+    let config = Config::load()?;
+    let root = std::fs::canonicalize(path)?;
+    
+    let tool_handlers = open_tool_handlers(&config)?;
+    let base_index = tool_handlers.open_overlay(name, base, &root)?;
+    
+    // The base tree's paths are moved under this checkout so files compare by position.
+    let base_state = MerkleTree::load(&MerkleTree::path_for_index(config.database_path_for(base), base)).map_err(|e| anyhow!("{}", e))?;
+    let base_root = PathBuf::from(&base_index.base_path);
+    let base_tree = if base_root == root {
+        base_state
+    } else {
+        let mut rebased = MerkleTree::new();
+        rebased.merge(&base_state, &base_root, &root);
+        rebased
+    };
+    
+    let compilation_database = load_compilation_database(compile_commands)?;
+    let mut indexer = build_indexer(&config, name, compilation_database.as_ref())?
+        .with_dependencies(tool_handlers.file_dependencies(name)?)
+        .with_base_tree(base_tree);
+    
+    let mut sink = tool_handlers.change_sink(name)?;
+    let results = match indexer.update_directory_into(&root, &mut sink).await {
+        Ok(results) => results,
+        Err(e) => {
+            tool_handlers.set_index_state(name, IndexState::Failed)?;
+            return Err(anyhow!("{}", e));
+        }
+    };
+    tool_handlers.set_index_state(name, IndexState::Active)?;
+    
+    let indexed = results.iter().filter(|result| matches!(result.action, IndexAction::Indexed)).count();
+    println!(
+        "Overlay '{}' over '{}': {} files differ from the base, {} indexed in this run",
+        name, base, indexer.get_index_status().total_files, indexed
+    );
+    Ok(())
+}
+
+/// Merges `name` from each shard database into this machine's index of that name, with
+/// the shards' Merkle trees moved under the index's base path
+fn merge_shards(name: &str, path: Option<&Path>, shards: &[PathBuf]) -> Result<()> {
+    let config = Config::load()?;
+    let database_path = config.database_path_for(name);
+    let state_path = MerkleTree::path_for_index(database_path, name);
+    let mut state = MerkleTree::load(&state_path).map_err(|e| anyhow!("{}", e))?;
+    let requested_root = path.map(std::fs::canonicalize).transpose()?;
+    
+    let tool_handlers = open_tool_handlers(&config)?;
+    for shard_path in shards {
+        if std::fs::canonicalize(shard_path)? == std::fs::canonicalize(database_path).unwrap_or_default() {
+            return Err(anyhow!("Shard {} is the database being merged into", shard_path.display()));
+        }
+        
+        // Opening the shard brings its schema up to date before it is attached.
+        let shard_index = open_database(shard_path)?
+            .read()?
+            .get_code_index_by_name(name)?
+            .ok_or_else(|| anyhow!("Shard {} has no index named '{}'", shard_path.display(), name))?;
+        let shard_root = PathBuf::from(&shard_index.base_path);
+        let index = tool_handlers.open_index(name, requested_root.as_deref().unwrap_or(&shard_root))?;
+        
+        let merged = tool_handlers.merge_shard(name, shard_path)?;
+        let shard_state = MerkleTree::load(&MerkleTree::path_for_index(shard_path, name)).map_err(|e| anyhow!("{}", e))?;
+        state.merge(&shard_state, &shard_root, Path::new(&index.base_path));
+        println!(
+            "Shard {}: {} files merged ({} kept from another shard), {} symbols, {} relationships",
+            shard_path.display(), merged.files, merged.duplicate_files, merged.elements, merged.relationships
+        );
+    }
+    
+    state.save(&state_path).map_err(|e| anyhow!("{}", e))?;
+    tool_handlers.set_index_state(name, IndexState::Active)?;
+    println!("Index '{}': {} files after merging {} shards", name, state.len(), shards.len());
+    Ok(())
+}
+
+fn export_snapshot(name: &str) -> Result<()> {
+    let config = Config::load()?;
+    let database_path = config.database_path_for(name);
+    let pool = open_database(database_path)?;
+    let repository = pool.read()?;
+    let index = repository.get_code_index_by_name(name)?.ok_or_else(|| anyhow!("Index not found: {}", name))?;
+    if repository.get_overlay_base(&index.id)?.is_some() {
+        return Err(anyhow!("'{}' is an overlay; its queries need the base index, so it cannot be served from a snapshot", name));
+    }
+    
+    let state = MerkleTree::load(&MerkleTree::path_for_index(database_path, name)).map_err(|e| anyhow!("{}", e))?;
+    let path = Snapshot::path_for_index(database_path, name);
+    let summary = Snapshot::write(&repository, &index.id, state.get_root_hash().map(String::as_str), &path)
+        .map_err(|e| anyhow!("{}", e))?;
+    println!(
+        "Snapshot of '{}' written to {}: {} files, {} symbols, {} edges, {} bytes",
+        name, path.display(), summary.files, summary.symbols, summary.edges, summary.bytes
+    );
+    Ok(())
+}
+
+fn open_database(database_path: &Path) -> Result<Arc<ConnectionPool>> {
+    open_pool(DatabaseConfig::new(database_path))
+}
+
+fn open_pool(database_config: DatabaseConfig) -> Result<Arc<ConnectionPool>> {
+    let database = DatabaseManager::new(database_config).map_err(|e| anyhow!("{}", e))?;
+    Ok(Arc::new(database.pool()?))
+}
+
+/// Tool handlers over the shared database and every index kept in a file of its own.
+/// Each pool has a read connection per request the server runs at once, so an admitted
+/// call never waits for a connection another call holds.
+fn open_tool_handlers(config: &Config) -> Result<ToolHandlers> {
+    let read_connections = config.max_in_flight_requests.max(1) as u32;
+    let pool = open_pool(DatabaseConfig::new(&config.database_path).with_pool_size(read_connections))?;
+    info!("Opened database with {} read connections", pool.reader_count());
+    
+    let mut tool_handlers = ToolHandlers::new()?.with_database(pool);
+    for (index_name, database_path) in &config.index_databases {
+        tool_handlers = tool_handlers.with_shard(index_name, open_pool(DatabaseConfig::new(database_path).with_pool_size(read_connections))?);
+        info!("Index '{}' is kept in {}", index_name, database_path.display());
+    }
+    Ok(tool_handlers)
+}
+
+/// The compile commands at `compile_commands`, if given
+fn load_compilation_database(compile_commands: Option<&Path>) -> Result<Option<Arc<CompilationDatabase>>> {
+    let Some(compile_commands) = compile_commands else {
+        return Ok(None);
+    };
+    let database = CompilationDatabase::load(compile_commands).map_err(|e| anyhow!("{}", e))?;
+    info!("Loaded {} compile commands from {}", database.len(), compile_commands.display());
+    Ok(Some(Arc::new(database)))
+}
+
+/// Indexer configured from `config`, resuming from the index's saved Merkle tree and
+/// parsing with `compilation_database` if given
+fn build_indexer(config: &Config, name: &str, compilation_database: Option<&Arc<CompilationDatabase>>) -> Result<IncrementalIndexer> {
+    let mut indexer = IncrementalIndexer::new(None)
+        .map_err(|e| anyhow!("{}", e))?
+        .with_max_concurrent_tasks(config.max_concurrent_tasks)
+        .with_memory_budget(Arc::new(MemoryBudget::from_megabytes(config.memory_limit_mb)))
+        .with_git_hashes(config.enable_git_hashes)
+        .with_state_path(MerkleTree::path_for_index(config.database_path_for(name), name))
+        .map_err(|e| anyhow!("{}", e))?;
+    
+    if config.enable_pch_cache {
+        let pch_cache = PchCache::for_database(&config.database_path).map_err(|e| anyhow!("{}", e))?;
+        indexer = indexer.with_pch_cache(Arc::new(pch_cache));
+    }
+    if let Some(compilation_database) = compilation_database {
+        indexer = indexer.with_compilation_database(Arc::clone(compilation_database));
+    }
+    
+    Ok(indexer)
+}
+
+/// The exported snapshot of `index_name`, if there is one and it was taken at the
+/// index's current Merkle root and write generation. The root alone misses writes that
+/// do not move it, such as `update_file` and deferred enrichment.
+fn open_snapshot(config: &Config, index_name: &str, merkle_root: Option<&str>, write_generation: u64) -> Option<Snapshot> {
+    let path = Snapshot::path_for_index(config.database_path_for(index_name), index_name);
+    if !path.exists() {
+        return None;
+    }
+    match Snapshot::open(&path) {
+        Ok(snapshot)
+            if snapshot.index_name() == index_name
+                && snapshot.merkle_root() == merkle_root
+                && snapshot.write_generation() == write_generation =>
+        {
+            info!("Serving '{}' from snapshot {} with {} symbols", index_name, path.display(), snapshot.symbol_count());
+            Some(snapshot)
+        }
+        Ok(_) => {
+            warn!("Snapshot {} is out of date; export it again to use it", path.display());
+            None
+        }
+        Err(e) => {
+            warn!("Ignoring snapshot: {}", e);
+            None
+        }
+    }
+}
+
+async fn serve(index_name: &str, watch: bool, compile_commands: Option<&Path>) -> Result<()> {
+    let config = Config::load()?;
+    let compilation_database = load_compilation_database(compile_commands)?;
+    
+    let mut tool_handlers = open_tool_handlers(&config)?.with_symbol_index(config.enable_symbol_index);
+    if let Some(compilation_database) = &compilation_database {
+        tool_handlers = tool_handlers.with_compilation_database(Arc::clone(compilation_database));
+    }
+    
+    let state = MerkleTree::load(&MerkleTree::path_for_index(config.database_path_for(index_name), index_name)).map_err(|e| anyhow!("{}", e))?;
+    let merkle_root = state.get_root_hash().map(String::as_str);
+    
+    let snapshot = if config.enable_snapshot {
+        open_snapshot(&config, index_name, merkle_root, tool_handlers.write_generation(index_name)?)
+    } else {
+        None
+    };
+    let use_snapshot = snapshot.is_some();
+    if let Some(snapshot) = snapshot {
+        tool_handlers = tool_handlers.with_snapshot(snapshot);
+    }
+    
+    if config.result_cache_entries > 0 {
+        let cache = ResultCache::new(config.result_cache_entries, DEFAULT_CACHE_BYTES);
+        tool_handlers = tool_handlers.with_result_cache(Arc::new(cache));
+        tool_handlers.set_merkle_root(index_name, merkle_root)?;
+    }
+    
+    // The snapshot answers searches itself; the symbol index is built if it retires.
+    if config.enable_symbol_index && !use_snapshot {
+        let symbols = tool_handlers.preload_symbol_index(index_name)?;
+        info!("Symbol index for '{}' holds {} symbols", index_name, symbols);
+    }
+    
+    // Held for the server's lifetime; dropping it stops the watcher.
+    let _watcher = if watch {
+        let sink = tool_handlers.change_sink(index_name)?;
+        let settings = WatchSettings::default().with_ignore_patterns(config.ignore_patterns.clone());
+        let indexer = build_indexer(&config, index_name, compilation_database.as_ref())?.with_dependencies(tool_handlers.file_dependencies(index_name)?);
+        let watcher = IndexWatcher::spawn(sink.base_path(), indexer, Box::new(sink), settings)
+            .map_err(|e| anyhow!("{}", e))?;
+        Some(watcher)
+    } else {
+        None
+    };
+    
+    // Files a previous run left with tree-sitter symbols only; held like the watcher.
+    let _enrichment = if config.enable_deferred_enrichment {
+        let pending = tool_handlers.pending_enrichment(index_name)?;
+        if pending.is_empty() {
+            None
+        } else {
+            let extractor = build_indexer(&config, index_name, compilation_database.as_ref())?.enrichment_extractor().map_err(|e| anyhow!("{}", e))?;
+            let sink = tool_handlers.change_sink(index_name)?;
+            Some(EnrichmentQueue::spawn(pending, extractor, Box::new(sink)).map_err(|e| anyhow!("{}", e))?)
+        }
+    } else {
+        None
+    };
+    
+    let mut server = McpServer::new()?
+        .with_tool_handlers(tool_handlers)
+        .with_max_in_flight(config.max_in_flight_requests);
+    server.start().await
+}